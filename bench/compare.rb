@@ -0,0 +1,23 @@
+# -*- coding: utf-8 -*-
+# Side-by-side view of two benchmark reports (rake bench:compare)
+require 'json'
+
+module SleuthkitBench
+  # bumped when the report layout changes
+  REPORT_SCHEMA = 1
+
+  # the benchmarks of two reports side by side; ratio > 1 means new is slower
+  def self.compare(old_path, new_path, out = $stdout)
+    old_report = JSON.parse(File.read(old_path))
+    new_report = JSON.parse(File.read(new_path))
+    index = {}
+    old_report["results"].each { |r| index[[ r["format"], r["name"] ]] = r }
+    out.puts format("%-6s %-12s %12s %12s %8s", "format", "benchmark", old_report["sleuthkit_version"], new_report["sleuthkit_version"], "ratio")
+    new_report["results"].each do |r|
+      before = index[[ r["format"], r["name"] ]]
+      next if before.nil?
+      ratio = before["median_s"] > 0 ? r["median_s"] / before["median_s"] : 0
+      out.puts format("%-6s %-12s %11.6fs %11.6fs %8.2f", r["format"], r["name"], before["median_s"], r["median_s"], ratio)
+    end
+  end
+end
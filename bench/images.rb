@@ -0,0 +1,161 @@
+# -*- coding: utf-8 -*-
+# Deterministic synthetic disk images for the benchmark suite.
+#
+# Every image is an MBR disk with one partition at 1 MiB holding a file
+# system built from a generated source tree. The tree (directory layout,
+# names, sizes, content, timestamps) depends only on the file count, the
+# image size and the seed, so the same parameters give the same files on
+# every machine. Nothing needs root: the file systems are built straight
+# into image files by the formatting tools.
+#
+#   ext4   mke2fs -d (e2fsprogs), fixed UUID, hash seed and clock; debugfs
+#          resets the ctimes -d copied from the tree
+#   fat32  mkfs.fat --invariant, then mcopy -s (mtools)
+#   ntfs   mkntfs -T, then ntfscp per file (ntfs-3g); ntfscp can't make
+#          directories, so the tree is flattened into the root directory.
+#          The volume serial and the timestamps come from the clock, so
+#          NTFS images hold the same files but aren't byte for byte equal
+require 'fileutils'
+require File.expand_path('../../spec/support/fixtures', __FILE__)
+
+module SleuthkitBench
+  module Images
+    FORMATS = [ :fat32, :ext4, :ntfs ]
+    GENERATOR_VERSION = 1
+    PARTITION_OFFSET = 1024 * 1024
+    MEGABYTE = 1024 * 1024
+    # 2020-01-01 00:00:00 UTC
+    EPOCH = 1577836800
+    UUID = "5eed0000-7e57-4b1d-8000-000000000001"
+
+    TOOLS = {
+      :ext4 => %w[ mke2fs debugfs ],
+      :fat32 => %w[ mkfs.fat mcopy ],
+      :ntfs => %w[ mkntfs ntfscp ]
+    }
+    MBR_TYPES = { :ext4 => 0x83, :fat32 => 0x0c, :ntfs => 0x07 }
+
+    module_function
+
+    # path of the image for these parameters, built unless already there
+    def image(format, dir, opts = {})
+      size_mb = opts[:size_mb]; files = opts[:files]; seed = opts[:seed]
+      path = File.join(dir, "#{format}-#{size_mb}m-#{files}f-s#{seed}-v#{GENERATOR_VERSION}.img")
+      return path if File.exist?(path)
+      missing = TOOLS[format].reject { |tool| which(tool) }
+      raise "#{format} needs #{missing.join(', ')}" unless missing.empty?
+      raise "fat32 images need at least 40 MiB" if format == :fat32 && size_mb < 40
+
+      src = source_tree(dir, opts)
+      fs = "#{path}.fs"
+      begin
+        send("build_#{format}", fs, src, size_mb)
+        wrap_in_mbr(fs, path, MBR_TYPES[format])
+      ensure
+        FileUtils.rm_f(fs)
+      end
+      path
+    end
+
+    # the generated files as [relative path, size], sorted
+    def manifest(opts)
+      rng = Random.new(opts[:seed])
+      count = opts[:files]
+      # half the volume is file data, the rest is room for metadata
+      budget = opts[:size_mb] * MEGABYTE / 2
+      mean = [ budget / [ count, 1 ].max, 512 ].max
+      fanout = [ Math.sqrt(count).ceil, 1 ].max
+      (0...count).map do |i|
+        size = rng.rand((mean / 4)..(mean * 7 / 4))
+        dir = format("d%03d/s%02d", i % fanout, (i / fanout) % 8)
+        [ "#{dir}/f#{format('%06d', i)}.bin", size ]
+      end.sort
+    end
+
+    def source_tree(dir, opts)
+      src = File.join(dir, "src-#{opts[:size_mb]}m-#{opts[:files]}f-s#{opts[:seed]}-v#{GENERATOR_VERSION}")
+      files = manifest(opts)
+      unless File.exist?("#{src}.complete")
+        FileUtils.rm_rf(src)
+        rng = Random.new(opts[:seed] ^ 0x5eed)
+        files.each do |name, size|
+          file = File.join(src, name)
+          FileUtils.mkdir_p(File.dirname(file))
+          File.open(file, "wb") { |f| f.write(rng.bytes(size)) }
+        end
+        FileUtils.touch("#{src}.complete")
+      end
+      # reading the tree moves its atimes, and the tools copy them, so
+      # stamp it again before every build
+      files.each_with_index { |(name, size), i| File.utime(EPOCH + i, EPOCH + i, File.join(src, name)) }
+      Dir.glob(File.join(src, "**", "*")).select { |d| File.directory?(d) }.each { |d| File.utime(EPOCH, EPOCH, d) }
+      File.utime(EPOCH, EPOCH, src)
+      src
+    end
+
+    def build_ext4(fs, src, size_mb)
+      run({ "E2FSPROGS_FAKE_TIME" => EPOCH.to_s }, "mke2fs", "-q", "-F", "-t", "ext4", "-b", "4096", "-L", "bench", "-U", UUID,
+          "-E", "hash_seed=#{UUID},root_owner=0:0", "-d", src, fs, "#{size_mb}M")
+      # -d copies the tree's ctimes, which utime can't set; fix them in the image
+      script = "#{fs}.debugfs"
+      File.open(script, "w") do |f|
+        Dir.chdir(src) { Dir.glob("**/*").sort.unshift(".") }.each do |name|
+          f.puts "set_inode_field /#{name == '.' ? '' : name} ctime @#{EPOCH}"
+        end
+      end
+      run({ "E2FSPROGS_FAKE_TIME" => EPOCH.to_s }, "debugfs", "-w", "-f", script, fs)
+    ensure
+      FileUtils.rm_f(script) if script
+    end
+
+    def build_fat32(fs, src, size_mb)
+      # FAT32 needs 65525 clusters; one-sector clusters below 260 MiB
+      cluster = size_mb < 260 ? "1" : "8"
+      run({}, "mkfs.fat", "-F", "32", "-S", "512", "-s", cluster, "-n", "BENCH", "-i", "5EED0001",
+          "--invariant", "-C", fs, (size_mb * 1024).to_s)
+      entries = (Dir.entries(src) - %w[ . .. ]).sort.map { |e| File.join(src, e) }
+      run({ "MTOOLS_SKIP_CHECK" => "1" }, "mcopy", "-s", "-m", "-i", fs, *entries, "::/")
+    end
+
+    def build_ntfs(fs, src, size_mb)
+      File.open(fs, "wb") { |f| f.truncate(size_mb * MEGABYTE) }
+      run({}, "mkntfs", "-q", "-F", "-f", "-T", "-s", "512", "-c", "4096", "-L", "BENCH", fs)
+      Dir.chdir(src) do
+        Dir.glob("**/*.bin").sort.each do |name|
+          run({}, "ntfscp", "-f", "-q", fs, name, "/" + name.tr("/", "_"))
+        end
+      end
+    end
+
+    # one primary partition at PARTITION_OFFSET covering the file system
+    def wrap_in_mbr(fs, path, type)
+      sectors = File.size(fs) / 512
+      entry = [ 0x00, 0xfe, 0xff, 0xff, type, 0xfe, 0xff, 0xff, PARTITION_OFFSET / 512, sectors ].pack("C8VV")
+      mbr = ("\0" * 446).b + entry + ("\0" * 48).b + [ 0x55, 0xaa ].pack("CC")
+      File.open("#{path}.part", "wb") do |out|
+        out.write(mbr)
+        out.seek(PARTITION_OFFSET)
+        File.open(fs, "rb") { |f| IO.copy_stream(f, out) }
+      end
+      File.rename("#{path}.part", path)
+    end
+
+    def run(env, *cmd)
+      env = { "PATH" => SleuthkitFixtures::TOOL_PATH.join(File::PATH_SEPARATOR) }.merge(env)
+      system(env, *cmd, :out => File::NULL) or raise "#{cmd.first} failed (#{$?.exitstatus}): #{cmd.join(' ')}"
+    end
+
+    def which(tool)
+      SleuthkitFixtures.tool(tool)
+    end
+  end
+
+  # image parameters; Suite adds its own
+  DEFAULTS = {
+    :size_mb => 64,
+    :files => 2000,
+    :seed => 1,
+    :formats => Images::FORMATS,
+    :dir => "tmp/bench"
+  }
+end
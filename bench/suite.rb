@@ -0,0 +1,173 @@
+# -*- coding: utf-8 -*-
+# The benchmark suite behind `rake bench`.
+#
+# For each synthetic image (see images.rb) it times image open, volume
+# open, file system open, a directory walk (PathMap), a metadata walk
+# (TimeIndex), sequential block reads, reading every file and hashing
+# every file (Batch.run), then writes one JSON report. Each benchmark
+# runs its warm-up pass, the timed iterations with counters off, and one
+# more pass with Sleuthkit.stats on for the I/O figures.
+require 'json'
+require 'time'
+require 'fileutils'
+require 'sleuthkit'
+require File.expand_path('../images', __FILE__)
+require File.expand_path('../compare', __FILE__)
+
+module SleuthkitBench
+  class Suite
+    DEFAULTS = SleuthkitBench::DEFAULTS.merge(:iterations => 5, :output => nil)
+    BLOCK_RUN = 256
+    CHUNK = 1024 * 1024
+
+    attr_reader :opts
+
+    def initialize(opts = {})
+      @opts = DEFAULTS.merge(opts)
+      @opts[:output] ||= File.join(@opts[:dir], "bench-#{Sleuthkit::VERSION}.json")
+    end
+
+    # runs everything and returns the report
+    def run
+      FileUtils.mkdir_p(opts[:dir])
+      report = {
+        :schema => REPORT_SCHEMA,
+        :sleuthkit_version => Sleuthkit::VERSION,
+        :tsk_version => Sleuthkit::TSK_VERSION,
+        :ruby => RUBY_DESCRIPTION,
+        :platform => RUBY_PLATFORM,
+        :started_at => Time.now.utc.iso8601,
+        :params => opts.reject { |k, v| [ :dir, :output ].include?(k) },
+        :images => [],
+        :results => []
+      }
+      opts[:formats].each do |format|
+        entry = { :format => format }
+        t0 = now
+        begin
+          path = Images.image(format, opts[:dir], opts)
+        rescue => e
+          entry[:skipped] = e.message
+          report[:images] << entry
+          log "#{format}: skipped (#{e.message})"
+          next
+        end
+        entry.update(:path => path, :bytes => File.size(path), :ready_s => now - t0)
+        report[:images] << entry
+        report[:results].concat(bench_image(format, path))
+      end
+      report[:finished_at] = Time.now.utc.iso8601
+      report
+    end
+
+    def write(report = run)
+      FileUtils.mkdir_p(File.dirname(opts[:output]))
+      File.open(opts[:output], "w") { |f| f.puts JSON.pretty_generate(report) }
+      log "wrote #{opts[:output]}"
+      opts[:output]
+    end
+
+    private
+
+    def bench_image(format, path)
+      results = []
+      files = nil
+      Sleuthkit::Batch.run([ path ], :jobs => [ :walk ], :workers => 1).each do |r|
+        raise "#{path}: #{r.error}" unless r.ok?
+        # only regular files are read and hashed; directories have sizes too
+        files = r.files.select { |f| f.regular? }.map { |f| [ f.inum, f.size ] }
+      end
+      bytes_in_files = files.inject(0) { |sum, (inum, size)| sum + size }
+
+      results << measure(format, :image_open) { Sleuthkit::Image.new(path); [ 1, 0 ] }
+      image = Sleuthkit::Image.new(path)
+      results << measure(format, :volume_open) { Sleuthkit::Volume::System.new(image); [ 1, 0 ] }
+      volume = Sleuthkit::Volume::System.new(image)
+      results << measure(format, :fs_open) { Sleuthkit::FileSystem::System.new(volume); [ 1, 0 ] }
+      fs = Sleuthkit::FileSystem::System.new(volume)
+
+      results << measure(format, :dir_walk) { [ fs.path_map(:rebuild => true).size, 0 ] }
+      results << measure(format, :meta_walk) { [ fs.time_index(:rebuild => true).size, 0 ] }
+      results << measure(format, :block_read) do
+        buffer = "".b
+        blocks = 0
+        start = fs.first_block
+        while start <= fs.last_block_act && fs.read_blocks(start, BLOCK_RUN, buffer)
+          blocks += buffer.bytesize / fs.block_size
+          start += BLOCK_RUN
+        end
+        [ blocks, blocks * fs.block_size ]
+      end
+      results << measure(format, :file_read) do
+        fs.clear_file_cache
+        bytes = 0
+        files.each do |inum, size|
+          fs.open_file_by_inum(inum).each_chunk(CHUNK) { |chunk, offset| bytes += chunk.bytesize }
+        end
+        [ files.size, bytes ]
+      end
+      results << measure(format, :hash) do
+        Sleuthkit::Batch.run([ path ], :jobs => [ :hash ], :digest => :md5, :workers => 1).each do |r|
+          raise "#{path}: #{r.error}" unless r.ok?
+          unread = r.file_systems.inject(0) { |sum, s| sum + s[3] }
+          raise "#{path}: #{unread} files could not be read" if unread > 0
+        end
+        [ files.size, bytes_in_files ]
+      end
+      results
+    end
+
+    # block returns [items, bytes] for one pass
+    def measure(kind, name)
+      GC.start
+      yield
+      times = []
+      items = bytes = 0
+      opts[:iterations].times do
+        t0 = now
+        items, bytes = yield
+        times << now - t0
+      end
+
+      Sleuthkit.stats_enabled = true
+      Sleuthkit.reset_stats
+      yield
+      io = Sleuthkit.stats
+      Sleuthkit.stats_enabled = false
+
+      sorted = times.sort
+      median = sorted[sorted.size / 2]
+      result = {
+        :format => kind,
+        :name => name,
+        :iterations => times.size,
+        :times_s => times,
+        :min_s => sorted.first,
+        :median_s => median,
+        :mean_s => times.inject(:+) / times.size,
+        :items => items,
+        :bytes => bytes,
+        :items_per_s => median > 0 ? items / median : nil,
+        :mb_per_s => median > 0 && bytes > 0 ? bytes / median / Images::MEGABYTE : nil,
+        :io => {
+          :media_reads => io[:media][:reads],
+          :media_bytes => io[:media][:bytes],
+          :seek_distance => io[:media][:seek_distance],
+          :delivered_bytes => io[:delivered_bytes],
+          :cache_hits => io[:cache_hits],
+          :read_amplification => io[:read_amplification]
+        }
+      }
+      log format("%-6s %-12s median %10.6fs  %10.1f items/s", kind, name, median, result[:items_per_s] || 0)
+      result
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+
+    def log(line)
+      $stderr.puts line
+    end
+  end
+end
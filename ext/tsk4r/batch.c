@@ -0,0 +1,139 @@
+//
+//  batch.c
+//  RubyTSK
+//
+//  batched, exception-safe yields from inside libtsk walk callbacks
+//
+
+#include <stdio.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "batch.h"
+
+void tsk4r_batch_init(struct tsk4r_batch * b, VALUE size) {
+  b->size = NIL_P(size) ? TSK4R_BATCH_SIZE : NUM2LONG(size);
+  if (b->size < 1) b->size = 1;
+  b->items = rb_ary_new2(b->size);
+  b->state = 0;
+}
+
+// returns non-zero when the walk should stop (the block raised or broke out)
+int tsk4r_batch_push(struct tsk4r_batch * b, VALUE item) {
+  rb_ary_push(b->items, item);
+  if (RARRAY_LEN(b->items) >= b->size) {
+    VALUE full = b->items;
+    b->items = rb_ary_new2(b->size);
+    rb_protect(rb_yield, full, &b->state);
+  }
+  return b->state;
+}
+
+// yields what is left, then re-raises anything the block raised mid-walk
+void tsk4r_batch_finish(struct tsk4r_batch * b) {
+  if (b->state == 0 && RARRAY_LEN(b->items) > 0) {
+    VALUE rest = b->items;
+    b->items = rb_ary_new2(0);
+    rb_protect(rb_yield, rest, &b->state);
+  }
+  if (b->state != 0) rb_jump_tag(b->state);
+}
+
+// options Hash lookup by Symbol, with a default
+VALUE tsk4r_opt(VALUE opts, const char * key, VALUE fallback) {
+  VALUE sym = ID2SYM(rb_intern(key));
+  if (! rb_obj_is_kind_of(opts, rb_cHash)) return fallback;
+  if (! RTEST(rb_funcall(opts, rb_intern("has_key?"), 1, sym))) return fallback;
+  return rb_hash_aref(opts, sym);
+}
+
+struct tsk4r_native_call {
+  void * (*func)(void *);
+  void (*cancel)(void *);
+  void * data;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t finished;
+  int done;
+  int interrupted;
+};
+
+static void * native_call_thread(void * ptr) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)ptr;
+  c->func(c->data);
+  pthread_mutex_lock(&c->lock);
+  c->done = 1;
+  pthread_cond_signal(&c->finished);
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+static void * native_call_wait(void * ptr) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)ptr;
+  pthread_mutex_lock(&c->lock);
+  while (! c->done && ! c->interrupted) pthread_cond_wait(&c->finished, &c->lock);
+  pthread_mutex_unlock(&c->lock);
+  return NULL;
+}
+
+static void native_call_interrupt(void * ptr) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)ptr;
+  pthread_mutex_lock(&c->lock);
+  c->interrupted = 1;
+  pthread_cond_signal(&c->finished);
+  pthread_mutex_unlock(&c->lock);
+}
+
+static void * native_call_join(void * ptr) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)ptr;
+  pthread_join(c->thread, NULL);
+  return NULL;
+}
+
+static void native_call_cancel(void * ptr) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)ptr;
+  c->cancel(c->data);
+}
+
+static VALUE native_call_loop(VALUE arg) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)arg;
+  int done;
+  for (;;) {
+    rb_thread_call_without_gvl(native_call_wait, c, native_call_interrupt, c);
+    pthread_mutex_lock(&c->lock);
+    done = c->done;
+    c->interrupted = 0;
+    pthread_mutex_unlock(&c->lock);
+    if (done) return Qnil;
+    rb_thread_check_ints();
+  }
+}
+
+// reached normally once the work is done, or while an interrupt unwinds
+static VALUE native_call_finish(VALUE arg) {
+  struct tsk4r_native_call * c = (struct tsk4r_native_call *)arg;
+  int done;
+  pthread_mutex_lock(&c->lock);
+  done = c->done;
+  pthread_mutex_unlock(&c->lock);
+  if (! done) c->cancel(c->data);
+  rb_thread_call_without_gvl(native_call_join, c, native_call_cancel, c);
+  pthread_cond_destroy(&c->finished);
+  pthread_mutex_destroy(&c->lock);
+  return Qnil;
+}
+
+void tsk4r_call_interruptible(void * (*func)(void *), void (*cancel)(void *), void * data) {
+  struct tsk4r_native_call c;
+  MEMZERO(&c, struct tsk4r_native_call, 1);
+  c.func = func;
+  c.cancel = cancel;
+  c.data = data;
+  pthread_mutex_init(&c.lock, NULL);
+  pthread_cond_init(&c.finished, NULL);
+  if (pthread_create(&c.thread, NULL, native_call_thread, &c) != 0) {
+    pthread_cond_destroy(&c.finished);
+    pthread_mutex_destroy(&c.lock);
+    rb_raise(rb_eRuntimeError, "unable to start a worker thread.");
+  }
+  rb_ensure(native_call_loop, (VALUE)&c, native_call_finish, (VALUE)&c);
+}
@@ -0,0 +1,36 @@
+//
+//  batch.h
+//  RubyTSK
+//
+//  batched, exception-safe yields from inside libtsk walk callbacks
+//
+
+#ifndef RubyTSK_batch_h
+#define RubyTSK_batch_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_BATCH_SIZE 1024
+
+// a block may raise or break; unwinding through libtsk's walk would leak its
+// state, so yields are protected and the walk stops before re-raising
+struct tsk4r_batch {
+  VALUE items;
+  long size;
+  int state;
+};
+
+void  tsk4r_batch_init(struct tsk4r_batch * b, VALUE size);
+int   tsk4r_batch_push(struct tsk4r_batch * b, VALUE item);
+void  tsk4r_batch_finish(struct tsk4r_batch * b);
+VALUE tsk4r_opt(VALUE opts, const char * key, VALUE fallback);
+
+// runs func(data) to completion on a native thread while the calling Ruby
+// thread waits without the GVL. Interrupts (trap handlers, Thread#raise,
+// Timeout) run on the Ruby thread and the wait resumes; only when one of
+// them raises is cancel(data) called, the work joined and the exception
+// propagated.
+void  tsk4r_call_interruptible(void * (*func)(void *), void (*cancel)(void *), void * data);
+
+#endif
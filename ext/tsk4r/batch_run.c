@@ -0,0 +1,695 @@
+//
+//  batch_run.c
+//  RubyTSK
+//
+//  Sleuthkit::Batch.run: per-image work on native worker threads
+//
+//  Each worker takes the next image, opens it, finds its volume system
+//  and file systems, and runs the requested jobs (walk, hash, extract)
+//  over every file system, all without the GVL. The finished result goes
+//  on a queue that the Ruby thread drains, converting one result at a
+//  time and yielding it, so results and per-image errors stream back in
+//  completion order.
+//
+//  One budget covers the whole batch. An image starts only when its open
+//  cost (TSK4R_BATCH_IMAGE_COST) fits in the memory budget and its file
+//  descriptors (one per segment, one more when extracting) fit in
+//  :max_open_files; a lone image always starts. Result memory is charged
+//  as it grows and released once Ruby has taken the result, so a slow
+//  block holds workers back instead of queuing unbounded results.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "fs_file.h"
+#include "hashset.h"
+#include "batch_run.h"
+#include "batch.h"
+#include "stats.h"
+
+extern VALUE rb_mtsk4r_batch;
+
+#define TSK4R_BQ_WALK    1
+#define TSK4R_BQ_HASH    2
+#define TSK4R_BQ_EXTRACT 4
+
+struct tsk4r_bq_part {
+  TSK_OFF_T offset;
+  TSK_OFF_T length;
+  size_t desc;          // offsets into the result's arena
+};
+
+struct tsk4r_bq_fs {
+  TSK_OFF_T offset;
+  const char * type;
+  unsigned long files;
+  unsigned long read_errors;
+};
+
+struct tsk4r_bq_file {
+  int fs;
+  TSK_INUM_T inum;
+  TSK_OFF_T size;
+  int meta_type;
+  size_t path;
+  size_t export;        // (size_t)-1 when not extracted
+  int hashed;
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+};
+
+struct tsk4r_bq_result {
+  long index;
+  TSK_OFF_T size;
+  const char * failed;
+  char error[256];
+  struct tsk4r_bq_part * parts;
+  size_t part_count;
+  size_t part_alloc;
+  struct tsk4r_bq_fs * fss;
+  size_t fs_count;
+  size_t fs_alloc;
+  struct tsk4r_bq_file * files;
+  size_t file_count;
+  size_t file_alloc;
+  char * arena;
+  size_t used;
+  size_t size_alloc;
+  long long charged;
+  uint64_t elapsed_ns;
+  struct tsk4r_bq_result * next;
+};
+
+struct tsk4r_bq_image {
+  int count;
+  char ** paths;
+};
+
+struct tsk4r_bq_job {
+  struct tsk4r_bq_image * images;
+  long image_count;
+  long next;
+  int workers;
+  int jobs;
+  unsigned int digest_len;
+  char * output;
+
+  long long budget;
+  long long used;
+  long long peak;
+  int max_files;
+  int files_open;
+
+  pthread_mutex_t lock;
+  pthread_cond_t budget_cv;   // workers waiting to start an image
+  pthread_cond_t ready_cv;    // the Ruby thread waiting for a result
+  struct tsk4r_bq_result * head;
+  struct tsk4r_bq_result * tail;
+  int running;
+  int interrupted;
+  pthread_t * threads;
+  int started;
+
+  volatile int cancel;
+  const char * failed;
+};
+
+static uint64_t bq_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void bq_charge(struct tsk4r_bq_job * job, struct tsk4r_bq_result * r, long long bytes) {
+  pthread_mutex_lock(&job->lock);
+  job->used += bytes;
+  if (job->used > job->peak) job->peak = job->used;
+  pthread_mutex_unlock(&job->lock);
+  r->charged += bytes;
+}
+
+static void bq_error(struct tsk4r_bq_result * r, const char * function, const char * message) {
+  if (r->failed != NULL) return;
+  r->failed = function;
+  snprintf(r->error, sizeof(r->error), "%s", message ? message : "unknown error");
+}
+
+// grows one of the result's arrays to hold need items, charging the budget
+static int bq_reserve(struct tsk4r_bq_job * job, struct tsk4r_bq_result * r, void ** items, size_t * alloc,
+                      size_t need, size_t item_size) {
+  size_t grow;
+  void * p;
+  if (need <= *alloc) return 0;
+  grow = *alloc ? *alloc * 2 : 64;
+  while (grow < need) grow *= 2;
+  p = realloc(*items, grow * item_size);
+  if (p == NULL) return -1;
+  bq_charge(job, r, (long long)((grow - *alloc) * item_size));
+  *items = p;
+  *alloc = grow;
+  return 0;
+}
+
+// a + b as one NUL-terminated arena string; (size_t)-1 when out of memory
+static size_t bq_push_str(struct tsk4r_bq_job * job, struct tsk4r_bq_result * r, const char * a, const char * b) {
+  size_t la = a ? strlen(a) : 0, lb = b ? strlen(b) : 0;
+  size_t at = r->used;
+  if (bq_reserve(job, r, (void **)&r->arena, &r->size_alloc, r->used + la + lb + 1, 1) != 0) return (size_t)-1;
+  if (la) memcpy(r->arena + at, a, la);
+  if (lb) memcpy(r->arena + at + la, b, lb);
+  r->arena[at + la + lb] = '\0';
+  r->used += la + lb + 1;
+  return at;
+}
+
+// hash and/or extract
+
+struct tsk4r_bq_walk {
+  struct tsk4r_bq_job * job;
+  struct tsk4r_bq_result * r;
+  int fs;
+  char * buf;
+  int failed;
+};
+
+static int bq_write_all(int fd, const char * buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static int bq_read_file(struct tsk4r_bq_walk * w, TSK_FS_FILE * file, struct tsk4r_bq_file * f) {
+  struct tsk4r_bq_job * job = w->job;
+  TSK_MD5_CTX md5;
+  TSK_SHA_CTX sha;
+  char target[TSK4R_BATCH_PATH_MAX];
+  TSK_OFF_T offset = 0;
+  int fd = -1, ok = 1;
+
+  if (job->jobs & TSK4R_BQ_EXTRACT) {
+    // run_batch keeps :output short enough; a cut name would collide
+    if (snprintf(target, sizeof(target), "%s/%ld-%d-%llu", job->output, w->r->index, w->fs,
+                 (unsigned long long)f->inum) >= (int)sizeof(target)) return -1;
+    fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) return -1;
+  }
+  if (job->digest_len == TSK4R_HS_MD5) TSK_MD5_Init(&md5); else TSK_SHA_Init(&sha);
+
+  while (offset < f->size && ! job->cancel) {
+    size_t want = (size_t)(f->size - offset < TSK4R_FILE_CHUNK ? f->size - offset : TSK4R_FILE_CHUNK);
+    ssize_t got = tsk4r_fs_file_read(file, offset, w->buf, want, TSK_FS_FILE_READ_FLAG_NONE);
+    if (got <= 0) { ok = 0; break; }
+    if (job->jobs & TSK4R_BQ_HASH) {
+      if (job->digest_len == TSK4R_HS_MD5) TSK_MD5_Update(&md5, (unsigned char *)w->buf, (unsigned int)got);
+      else TSK_SHA_Update(&sha, (BYTE *)w->buf, (int)got);
+    }
+    if (fd >= 0 && bq_write_all(fd, w->buf, (size_t)got) != 0) { ok = 0; break; }
+    offset += got;
+  }
+  if (fd >= 0) {
+    if (close(fd) != 0) ok = 0;
+    if (! ok || job->cancel) unlink(target);
+  }
+  if (! ok || job->cancel) return -1;
+  if (job->jobs & TSK4R_BQ_HASH) {
+    if (job->digest_len == TSK4R_HS_MD5) TSK_MD5_Final(f->digest, &md5); else TSK_SHA_Final(f->digest, &sha);
+    f->hashed = 1;
+  }
+  if (fd >= 0) {
+    f->export = bq_push_str(job, w->r, target, NULL);
+    if (f->export == (size_t)-1) w->failed = 1;
+  }
+  return 0;
+}
+
+static TSK_WALK_RET_ENUM bq_walk_callback(TSK_FS_FILE * file, const char * path, void * ptr) {
+  struct tsk4r_bq_walk * w = (struct tsk4r_bq_walk *)ptr;
+  struct tsk4r_bq_result * r = w->r;
+  struct tsk4r_bq_file * f;
+
+  if (w->job->cancel) return TSK_WALK_STOP;
+  if (file->name == NULL || file->name->name == NULL || TSK_FS_ISDOT(file->name->name)) return TSK_WALK_CONT;
+  if (bq_reserve(w->job, r, (void **)&r->files, &r->file_alloc, r->file_count + 1, sizeof(struct tsk4r_bq_file)) != 0) {
+    w->failed = 1;
+    return TSK_WALK_ERROR;
+  }
+  f = &r->files[r->file_count];
+  MEMZERO(f, struct tsk4r_bq_file, 1);
+  f->fs = w->fs;
+  f->inum = file->name->meta_addr;
+  f->meta_type = file->meta ? file->meta->type : 0;
+  f->size = file->meta ? file->meta->size : 0;
+  f->export = (size_t)-1;
+  f->path = bq_push_str(w->job, r, path, file->name->name);
+  if (f->path == (size_t)-1) {
+    w->failed = 1;
+    return TSK_WALK_ERROR;
+  }
+  r->file_count++;
+  r->fss[w->fs].files++;
+
+  if ((w->job->jobs & (TSK4R_BQ_HASH | TSK4R_BQ_EXTRACT)) && f->meta_type == TSK_FS_META_TYPE_REG) {
+    if (bq_read_file(w, file, f) != 0 && ! w->job->cancel) r->fss[w->fs].read_errors++;
+    if (w->failed) return TSK_WALK_ERROR;
+  }
+  return TSK_WALK_CONT;
+}
+
+static int bq_process_fs(struct tsk4r_bq_job * job, struct tsk4r_bq_result * r, TSK_FS_INFO * fs, char * buf) {
+  struct tsk4r_bq_walk w;
+  struct tsk4r_bq_fs * rec;
+
+  if (bq_reserve(job, r, (void **)&r->fss, &r->fs_alloc, r->fs_count + 1, sizeof(struct tsk4r_bq_fs)) != 0) {
+    bq_error(r, "Batch.run", "out of memory");
+    return -1;
+  }
+  rec = &r->fss[r->fs_count];
+  rec->offset = fs->offset;
+  rec->type = tsk_fs_type_toname(fs->ftype);
+  rec->files = 0;
+  rec->read_errors = 0;
+  if (! (job->jobs & TSK4R_BQ_WALK)) {
+    r->fs_count++;
+    return 0;
+  }
+  w.job = job;
+  w.r = r;
+  w.fs = (int)r->fs_count++;
+  w.buf = buf;
+  w.failed = 0;
+  if (tsk4r_fs_dir_walk(fs, fs->root_inum, TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE | TSK_FS_DIR_WALK_FLAG_NOORPHAN,
+                      bq_walk_callback, &w) && ! job->cancel) {
+    if (w.failed) bq_error(r, "Batch.run", "out of memory");
+    else bq_error(r, "tsk_fs_dir_walk", tsk_error_get());
+    return -1;
+  }
+  return 0;
+}
+
+static void bq_process_image(struct tsk4r_bq_job * job, struct tsk4r_bq_image * im, struct tsk4r_bq_result * r) {
+  uint64_t t0 = bq_now_ns();
+  TSK_IMG_INFO * img;
+  TSK_VS_INFO * vs;
+  TSK_FS_INFO * fs;
+  char * buf = malloc(TSK4R_FILE_CHUNK);
+
+  if (buf == NULL) {
+    bq_error(r, "Batch.run", "out of memory");
+    return;
+  }
+  img = tsk4r_img_open(im->count, (const TSK_TCHAR * const *)im->paths, TSK_IMG_TYPE_DETECT, 0);
+  if (img == NULL) {
+    bq_error(r, "tsk_img_open", tsk_error_get());
+    free(buf);
+    return;
+  }
+  r->size = img->size;
+
+  vs = tsk_vs_open(img, 0, TSK_VS_TYPE_DETECT);
+  if (vs != NULL) {
+    TSK_PNUM_T c;
+    for (c = 0; c < vs->part_count && ! job->cancel; c++) {
+      const TSK_VS_PART_INFO * part = tsk_vs_part_get(vs, c);
+      struct tsk4r_bq_part * p;
+      if (part == NULL) continue;
+      if (bq_reserve(job, r, (void **)&r->parts, &r->part_alloc, r->part_count + 1, sizeof(struct tsk4r_bq_part)) != 0) {
+        bq_error(r, "Batch.run", "out of memory");
+        break;
+      }
+      p = &r->parts[r->part_count];
+      p->offset = (TSK_OFF_T)(part->start * vs->block_size);
+      p->length = (TSK_OFF_T)(part->len * vs->block_size);
+      p->desc = bq_push_str(job, r, part->desc, NULL);
+      if (p->desc == (size_t)-1) {
+        bq_error(r, "Batch.run", "out of memory");
+        break;
+      }
+      r->part_count++;
+      if (! (part->flags & TSK_VS_PART_FLAG_ALLOC)) continue;
+      fs = tsk4r_fs_open_vol(part, TSK_FS_TYPE_DETECT);
+      if (fs == NULL) continue;
+      if (bq_process_fs(job, r, fs, buf) != 0) {
+        tsk4r_fs_close(fs);
+        break;
+      }
+      tsk4r_fs_close(fs);
+    }
+    tsk_vs_close(vs);
+  } else if ((fs = tsk4r_fs_open_img(img, 0, TSK_FS_TYPE_DETECT)) != NULL) {
+    bq_process_fs(job, r, fs, buf);
+    tsk4r_fs_close(fs);
+  }
+  tsk4r_img_close(img);
+  free(buf);
+  r->elapsed_ns = bq_now_ns() - t0;
+}
+
+static int bq_files_needed(struct tsk4r_bq_job * job, long i) {
+  return job->images[i].count + ((job->jobs & TSK4R_BQ_EXTRACT) ? 1 : 0);
+}
+
+static void * bq_worker(void * ptr) {
+  struct tsk4r_bq_job * job = (struct tsk4r_bq_job *)ptr;
+
+  for (;;) {
+    struct tsk4r_bq_result * r = calloc(1, sizeof(struct tsk4r_bq_result));
+    long i; int fds;
+
+    pthread_mutex_lock(&job->lock);
+    if (r == NULL) job->failed = "out of memory";
+    if (r == NULL || job->cancel || job->next >= job->image_count) {
+      pthread_mutex_unlock(&job->lock);
+      free(r);
+      break;
+    }
+    i = job->next++;
+    fds = bq_files_needed(job, i);
+    while (! job->cancel && ((job->used > 0 && job->used + TSK4R_BATCH_IMAGE_COST > job->budget)
+                             || (job->files_open > 0 && job->files_open + fds > job->max_files))) {
+      pthread_cond_wait(&job->budget_cv, &job->lock);
+    }
+    if (job->cancel) {
+      pthread_mutex_unlock(&job->lock);
+      free(r);
+      break;
+    }
+    job->used += TSK4R_BATCH_IMAGE_COST;
+    if (job->used > job->peak) job->peak = job->used;
+    job->files_open += fds;
+    pthread_mutex_unlock(&job->lock);
+
+    r->index = i;
+    bq_process_image(job, &job->images[i], r);
+
+    pthread_mutex_lock(&job->lock);
+    job->used -= TSK4R_BATCH_IMAGE_COST;
+    job->files_open -= fds;
+    if (job->tail != NULL) job->tail->next = r; else job->head = r;
+    job->tail = r;
+    pthread_cond_broadcast(&job->budget_cv);
+    pthread_cond_signal(&job->ready_cv);
+    pthread_mutex_unlock(&job->lock);
+  }
+
+  pthread_mutex_lock(&job->lock);
+  job->running--;
+  pthread_cond_signal(&job->ready_cv);
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
+
+// the Ruby side
+
+static void * bq_wait(void * ptr) {
+  struct tsk4r_bq_job * job = (struct tsk4r_bq_job *)ptr;
+  pthread_mutex_lock(&job->lock);
+  while (job->head == NULL && job->running > 0 && ! job->interrupted) {
+    pthread_cond_wait(&job->ready_cv, &job->lock);
+  }
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
+
+static void bq_interrupt(void * ptr) {
+  struct tsk4r_bq_job * job = (struct tsk4r_bq_job *)ptr;
+  pthread_mutex_lock(&job->lock);
+  job->interrupted = 1;
+  pthread_cond_broadcast(&job->ready_cv);
+  pthread_mutex_unlock(&job->lock);
+}
+
+static void bq_free_result(struct tsk4r_bq_job * job, struct tsk4r_bq_result * r) {
+  pthread_mutex_lock(&job->lock);
+  job->used -= r->charged;
+  pthread_cond_broadcast(&job->budget_cv);
+  pthread_mutex_unlock(&job->lock);
+  free(r->parts);
+  free(r->fss);
+  free(r->files);
+  free(r->arena);
+  free(r);
+}
+
+struct tsk4r_bq_args {
+  struct tsk4r_bq_job * job;
+  VALUE images;
+  struct tsk4r_bq_result * current;
+};
+
+static VALUE bq_digest_hex(const unsigned char * digest, unsigned int len) {
+  static const char digits[] = "0123456789abcdef";
+  char hex[2 * TSK4R_HS_MAX_DIGEST];
+  unsigned int i;
+  for (i = 0; i < len; i++) {
+    hex[2 * i] = digits[digest[i] >> 4];
+    hex[2 * i + 1] = digits[digest[i] & 15];
+  }
+  return rb_str_new(hex, 2 * len);
+}
+
+static VALUE bq_result_to_ruby(struct tsk4r_bq_args * a, struct tsk4r_bq_result * r) {
+  struct tsk4r_bq_job * job = a->job;
+  VALUE klass = rb_const_get(rb_mtsk4r_batch, rb_intern("Result"));
+  VALUE file_klass = rb_const_get(rb_mtsk4r_batch, rb_intern("FileEntry"));
+  VALUE volumes = rb_ary_new2((long)r->part_count);
+  VALUE file_systems = rb_ary_new2((long)r->fs_count);
+  VALUE files = rb_ary_new2((long)r->file_count);
+  VALUE error = Qnil;
+  size_t i;
+
+  for (i = 0; i < r->part_count; i++) {
+    const struct tsk4r_bq_part * p = &r->parts[i];
+    rb_ary_push(volumes, rb_ary_new3(3, LL2NUM(p->offset), LL2NUM(p->length), rb_str_new2(r->arena + p->desc)));
+  }
+  for (i = 0; i < r->fs_count; i++) {
+    const struct tsk4r_bq_fs * s = &r->fss[i];
+    rb_ary_push(file_systems, rb_ary_new3(4, LL2NUM(s->offset), rb_str_new2(s->type ? s->type : ""),
+                                          ULONG2NUM(s->files), ULONG2NUM(s->read_errors)));
+  }
+  for (i = 0; i < r->file_count; i++) {
+    const struct tsk4r_bq_file * f = &r->files[i];
+    rb_ary_push(files, rb_struct_new(file_klass, INT2NUM(f->fs), ULL2NUM(f->inum), rb_str_new2(r->arena + f->path),
+                                     LL2NUM(f->size), f->hashed ? bq_digest_hex(f->digest, job->digest_len) : Qnil,
+                                     f->export == (size_t)-1 ? Qnil : rb_str_new2(r->arena + f->export),
+                                     INT2NUM(f->meta_type)));
+  }
+  if (r->failed) error = rb_sprintf("TSK function: %s exited with an error. (%s)", r->failed, r->error);
+  return rb_struct_new(klass, LONG2NUM(r->index), rb_ary_entry(a->images, r->index), LL2NUM(r->size),
+                       volumes, file_systems, files, error, rb_float_new((double)r->elapsed_ns / 1e9));
+}
+
+// copies the image paths out of Ruby before any worker starts
+static void bq_copy_images(struct tsk4r_bq_job * job, VALUE images) {
+  long i, k;
+  job->images = calloc((size_t)RARRAY_LEN(images) + 1, sizeof(struct tsk4r_bq_image));
+  if (job->images == NULL) rb_memerror();
+  for (i = 0; i < RARRAY_LEN(images); i++) {
+    VALUE segments = rb_ary_entry(images, i);
+    struct tsk4r_bq_image * im = &job->images[i];
+    if (! rb_obj_is_kind_of(segments, rb_cArray)) segments = rb_ary_new3(1, segments);
+    if (RARRAY_LEN(segments) == 0) rb_raise(rb_eArgError, "image %ld has no paths", i);
+    im->paths = calloc((size_t)RARRAY_LEN(segments), sizeof(char *));
+    if (im->paths == NULL) rb_memerror();
+    job->image_count = i + 1;   // release_batch frees what was copied so far
+    for (k = 0; k < RARRAY_LEN(segments); k++) {
+      VALUE path = rb_ary_entry(segments, k);
+      im->paths[k] = strdup(StringValueCStr(path));
+      if (im->paths[k] == NULL) rb_memerror();
+      im->count = (int)k + 1;
+    }
+  }
+}
+
+static VALUE batch_results(VALUE arg) {
+  struct tsk4r_bq_args * a = (struct tsk4r_bq_args *)arg;
+  struct tsk4r_bq_job * job = a->job;
+  int block = rb_block_given_p();
+  VALUE results; VALUE stats;
+  unsigned long errors = 0, files = 0;
+  uint64_t t0 = bq_now_ns();
+  int t;
+
+  bq_copy_images(job, a->images);
+  results = block ? Qnil : rb_ary_new2(job->image_count);
+  job->threads = malloc((size_t)job->workers * sizeof(pthread_t));
+  if (job->threads == NULL) rb_memerror();
+  for (t = 0; t < job->workers; t++) {
+    pthread_mutex_lock(&job->lock);
+    job->running++;
+    pthread_mutex_unlock(&job->lock);
+    if (pthread_create(&job->threads[t], NULL, bq_worker, job) != 0) {
+      pthread_mutex_lock(&job->lock);
+      job->running--;
+      pthread_mutex_unlock(&job->lock);
+      break;
+    }
+    job->started++;
+  }
+  if (job->started == 0) rb_raise(rb_eRuntimeError, "unable to start the batch workers.");
+
+  for (;;) {
+    struct tsk4r_bq_result * r;
+    VALUE value;
+    int done;
+
+    rb_thread_call_without_gvl(bq_wait, job, bq_interrupt, job);
+    pthread_mutex_lock(&job->lock);
+    if (job->interrupted) {
+      job->interrupted = 0;
+      pthread_mutex_unlock(&job->lock);
+      rb_thread_check_ints();
+      continue;
+    }
+    r = job->head;
+    if (r != NULL) {
+      job->head = r->next;
+      if (job->head == NULL) job->tail = NULL;
+    }
+    done = (r == NULL && job->running == 0);
+    pthread_mutex_unlock(&job->lock);
+    if (done) break;
+    if (r == NULL) continue;
+
+    a->current = r;
+    value = bq_result_to_ruby(a, r);
+    a->current = NULL;
+    if (r->failed) errors++;
+    files += r->file_count;
+    if (! block) rb_ary_store(results, r->index, value);
+    bq_free_result(job, r);
+    if (block) rb_yield(value);
+  }
+  if (job->failed) rb_raise(rb_eNoMemError, "Batch.run: %s", job->failed);
+  if (! block) return results;
+
+  stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("images")), LONG2NUM(job->image_count));
+  rb_hash_aset(stats, ID2SYM(rb_intern("errors")), ULONG2NUM(errors));
+  rb_hash_aset(stats, ID2SYM(rb_intern("files")), ULONG2NUM(files));
+  rb_hash_aset(stats, ID2SYM(rb_intern("peak_memory")), LL2NUM(job->peak));
+  rb_hash_aset(stats, ID2SYM(rb_intern("elapsed_ns")), ULL2NUM(bq_now_ns() - t0));
+  return stats;
+}
+
+static void * bq_join(void * ptr) {
+  struct tsk4r_bq_job * job = (struct tsk4r_bq_job *)ptr;
+  int t;
+  for (t = 0; t < job->started; t++) pthread_join(job->threads[t], NULL);
+  return NULL;
+}
+
+// stops the workers (the block may have raised or broken out) and frees
+// whatever results Ruby didn't take
+static VALUE release_batch(VALUE arg) {
+  struct tsk4r_bq_args * a = (struct tsk4r_bq_args *)arg;
+  struct tsk4r_bq_job * job = a->job;
+  long i; int k;
+
+  if (job->started) {
+    pthread_mutex_lock(&job->lock);
+    job->cancel = 1;
+    pthread_cond_broadcast(&job->budget_cv);
+    pthread_mutex_unlock(&job->lock);
+    rb_thread_call_without_gvl(bq_join, job, NULL, NULL);
+  }
+  if (a->current != NULL) bq_free_result(job, a->current);
+  while (job->head != NULL) {
+    struct tsk4r_bq_result * r = job->head;
+    job->head = r->next;
+    bq_free_result(job, r);
+  }
+  if (job->images != NULL) {
+    for (i = 0; i < job->image_count; i++) {
+      for (k = 0; k < job->images[i].count; k++) free(job->images[i].paths[k]);
+      free(job->images[i].paths);
+    }
+    free(job->images);
+  }
+  free(job->threads);
+  free(job->output);
+  pthread_cond_destroy(&job->budget_cv);
+  pthread_cond_destroy(&job->ready_cv);
+  pthread_mutex_destroy(&job->lock);
+  return Qnil;
+}
+
+// Sleuthkit::Batch.run(images, opts = {}) { |result| ... }
+// images: paths, or Arrays of segment paths for split images
+// opts: :jobs => [:open, :walk] (also :hash and :extract; both imply
+//       :walk), :workers => 4, :memory_budget => 256 MiB,
+//       :max_open_files => 64, :digest => :md5 or :sha1,
+//       :output => directory for :extract (files are named
+//       <image index>-<file system index>-<inum>)
+// yields a Batch::Result per image as it finishes and returns the run's
+// totals; without a block returns the Results in image order. Errors are
+// reported in Result#error and don't stop the other images.
+VALUE run_batch(int argc, VALUE *args, VALUE self) {
+  VALUE images; VALUE opts; VALUE jobs; VALUE digest; VALUE output; VALUE result;
+  struct tsk4r_bq_job job;
+  struct tsk4r_bq_args a;
+  long i;
+
+  rb_scan_args(argc, args, "11", &images, &opts);
+  Check_Type(images, T_ARRAY);
+  images = rb_ary_dup(images);
+
+  MEMZERO(&job, struct tsk4r_bq_job, 1);
+  jobs = rb_Array(tsk4r_opt(opts, "jobs", Qnil));
+  if (RARRAY_LEN(jobs) == 0) jobs = rb_ary_new3(2, ID2SYM(rb_intern("open")), ID2SYM(rb_intern("walk")));
+  for (i = 0; i < RARRAY_LEN(jobs); i++) {
+    VALUE name = rb_ary_entry(jobs, i);
+    if (name == ID2SYM(rb_intern("open"))) continue;
+    else if (name == ID2SYM(rb_intern("walk"))) job.jobs |= TSK4R_BQ_WALK;
+    else if (name == ID2SYM(rb_intern("hash"))) job.jobs |= TSK4R_BQ_WALK | TSK4R_BQ_HASH;
+    else if (name == ID2SYM(rb_intern("extract"))) job.jobs |= TSK4R_BQ_WALK | TSK4R_BQ_EXTRACT;
+    else rb_raise(rb_eArgError, "unknown job: %s", RSTRING_PTR(rb_inspect(name)));
+  }
+  digest = tsk4r_opt(opts, "digest", ID2SYM(rb_intern("md5")));
+  if (digest == ID2SYM(rb_intern("md5"))) job.digest_len = TSK4R_HS_MD5;
+  else if (digest == ID2SYM(rb_intern("sha1"))) job.digest_len = TSK4R_HS_SHA1;
+  else rb_raise(rb_eArgError, "digest must be :md5 or :sha1");
+  if (job.jobs & TSK4R_BQ_EXTRACT) {
+    output = tsk4r_opt(opts, "output", Qnil);
+    if (NIL_P(output)) rb_raise(rb_eArgError, ":extract needs an :output directory");
+    output = rb_str_dup(rb_String(output));
+    if (strlen(StringValueCStr(output)) + TSK4R_BATCH_NAME_MAX >= TSK4R_BATCH_PATH_MAX) {
+      rb_raise(rb_eArgError, ":output path is too long (%ld bytes)", RSTRING_LEN(output));
+    }
+  } else {
+    output = Qnil;
+  }
+  job.workers = NUM2INT(tsk4r_opt(opts, "workers", INT2FIX(TSK4R_BATCH_WORKERS)));
+  if (job.workers < 1) job.workers = 1;
+  job.budget = NUM2LL(tsk4r_opt(opts, "memory_budget", LL2NUM(TSK4R_BATCH_MEMORY_BUDGET)));
+  if (job.budget < 1) rb_raise(rb_eArgError, "memory_budget must be positive");
+  job.max_files = NUM2INT(tsk4r_opt(opts, "max_open_files", INT2FIX(TSK4R_BATCH_MAX_FILES)));
+  if (job.max_files < 1) rb_raise(rb_eArgError, "max_open_files must be positive");
+  // only once every option is known good, so a bad one leaves nothing behind
+  if (! NIL_P(output)) {
+    if (mkdir(StringValueCStr(output), 0777) != 0 && errno != EEXIST) rb_sys_fail(StringValueCStr(output));
+    job.output = strdup(StringValueCStr(output));
+    if (job.output == NULL) rb_memerror();
+  }
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.budget_cv, NULL);
+  pthread_cond_init(&job.ready_cv, NULL);
+  a.job = &job;
+  a.images = images;
+  a.current = NULL;
+
+  result = rb_ensure(batch_results, (VALUE)&a, release_batch, (VALUE)&a);
+  RB_GC_GUARD(images);
+  return result;
+}
@@ -0,0 +1,27 @@
+//
+//  batch_run.h
+//  RubyTSK
+//
+//  Sleuthkit::Batch.run: many images on native worker threads under one
+//  memory and file descriptor budget
+//
+
+#ifndef RubyTSK_batch_run_h
+#define RubyTSK_batch_run_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_BATCH_WORKERS 4
+#define TSK4R_BATCH_MEMORY_BUDGET (256LL * 1024 * 1024)
+#define TSK4R_BATCH_MAX_FILES 64
+// charged when an image starts: libtsk's image cache plus the read buffer
+#define TSK4R_BATCH_IMAGE_COST (4LL * 1024 * 1024)
+// extracted file paths: :output, then "/<image>-<fs>-<inum>" (at most
+// TSK4R_BATCH_NAME_MAX bytes with the NUL)
+#define TSK4R_BATCH_PATH_MAX 4096
+#define TSK4R_BATCH_NAME_MAX 64
+
+VALUE run_batch(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -0,0 +1,623 @@
+//
+//  blockhash.c
+//  RubyTSK
+//
+//  Sleuthkit::BlockHashDB and hash-based carving (#match_blocks)
+//
+//  A BlockHashDB is a HashSet file whose records carry an 8-byte payload,
+//  the source file and block index of the digest, and whose trailer holds
+//  the block size and the source names. Building it hashes every full,
+//  non-zero block of each reference file.
+//
+//  Matching cuts the scanned byte ranges (the whole image, or the runs of
+//  unallocated blocks found by tsk_fs_block_walk) into chunks that worker
+//  threads read with tsk_img_read and hash every :step bytes. Each chunk is
+//  read with block_size - step bytes of overlap so blocks straddling a
+//  chunk boundary are still seen. Hits along one diagonal (same source,
+//  same image offset minus block index * block size) are merged into runs.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "image.h"
+#include "file_system.h"
+#include "fs_block.h"
+#include "hashset.h"
+#include "blockhash.h"
+#include "batch.h"
+#include "stats.h"
+
+extern VALUE rb_cTSKBlockHashDB;
+
+static uint32_t get32le(const unsigned char * p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put32le(unsigned char * p, uint32_t v) {
+  int i;
+  for (i = 0; i < 4; i++) { p[i] = (unsigned char)v; v >>= 8; }
+}
+
+static int all_zero(const unsigned char * buf, size_t len) {
+  return buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+static void block_digest(unsigned int digest_len, const unsigned char * buf, unsigned int len, unsigned char * out) {
+  if (digest_len == TSK4R_HS_MD5) {
+    TSK_MD5_CTX md5;
+    TSK_MD5_Init(&md5);
+    TSK_MD5_Update(&md5, (unsigned char *)buf, len);
+    TSK_MD5_Final(out, &md5);
+  } else {
+    TSK_SHA_CTX sha;
+    TSK_SHA_Init(&sha);
+    TSK_SHA_Update(&sha, (BYTE *)buf, (int)len);
+    TSK_SHA_Final(out, &sha);
+  }
+}
+
+// BlockHashDB.build
+
+struct tsk4r_bh_build {
+  struct tsk4r_hash_set_builder set;
+  const char ** sources;
+  long source_count;
+  unsigned int block_size;
+  unsigned char * trailer;
+  volatile int cancel;
+};
+
+static int read_block(int fd, unsigned char * buf, size_t len, size_t * got) {
+  *got = 0;
+  while (*got < len) {
+    ssize_t n = read(fd, buf + *got, len - *got);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    if (n == 0) break;
+    *got += (size_t)n;
+  }
+  return 0;
+}
+
+static void * read_block_sources(void * ptr) {
+  struct tsk4r_bh_build * bb = (struct tsk4r_bh_build *)ptr;
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+  unsigned char payload[8];
+  unsigned char * buf = malloc(bb->block_size);
+  long s;
+
+  if (buf == NULL) {
+    bb->set.err = ENOMEM;
+    return NULL;
+  }
+  for (s = 0; s < bb->source_count && ! bb->set.err && ! bb->cancel; s++) {
+    uint64_t block;
+    size_t got;
+    int fd = open(bb->sources[s], O_RDONLY);
+    if (fd < 0) {
+      bb->set.err = errno;
+      bb->set.source = bb->sources[s];
+      break;
+    }
+    // a partial last block is left out: it can't be told apart from slack
+    for (block = 0; ! bb->cancel; block++) {
+      if (read_block(fd, buf, bb->block_size, &got) != 0) {
+        bb->set.err = errno;
+        bb->set.source = bb->sources[s];
+        break;
+      }
+      if (got < bb->block_size) break;
+      if (block > UINT32_MAX) {
+        bb->set.err = EFBIG;
+        bb->set.source = bb->sources[s];
+        break;
+      }
+      if (all_zero(buf, bb->block_size)) continue;
+      block_digest(bb->set.digest_len, buf, bb->block_size, digest);
+      put32le(payload, (uint32_t)s);
+      put32le(payload + 4, (uint32_t)block);
+      if (tsk4r_hash_set_push(&bb->set, digest, payload) != 0) {
+        bb->set.err = ENOMEM;
+        break;
+      }
+    }
+    close(fd);
+  }
+  free(buf);
+  return NULL;
+}
+
+static void cancel_block_sources(void * ptr) {
+  ((struct tsk4r_bh_build *)ptr)->cancel = 1;
+}
+
+static VALUE run_block_hash_build(VALUE arg) {
+  struct tsk4r_bh_build * bb = (struct tsk4r_bh_build *)arg;
+
+  tsk4r_call_interruptible(read_block_sources, cancel_block_sources, bb);
+  if (bb->set.err) {
+    errno = bb->set.err;
+    rb_sys_fail(bb->set.source);
+  }
+  rb_thread_call_without_gvl(tsk4r_hash_set_write, &bb->set, NULL, NULL);
+  if (bb->set.err) {
+    errno = bb->set.err;
+    rb_sys_fail(bb->set.path);
+  }
+  return Qnil;
+}
+
+static VALUE release_block_hash_build(VALUE arg) {
+  struct tsk4r_bh_build * bb = (struct tsk4r_bh_build *)arg;
+  free(bb->set.records);
+  free(bb->sources);
+  free(bb->trailer);
+  return Qnil;
+}
+
+// BlockHashDB.build(sources, path, opts = {})
+// sources: reference file paths (a String or an Array)
+// opts: :block_size => 4096, :digest => :md5 or :sha1, :bloom => true
+// hashes every full, non-zero block of each source, writes the database to
+// path and returns BlockHashDB.open(path)
+VALUE build_block_hash_db(int argc, VALUE *args, VALUE klass) {
+  VALUE sources; VALUE path; VALUE opts; VALUE digest;
+  struct tsk4r_bh_build bb;
+  size_t trailer_len = 8, at;
+  long i;
+
+  rb_scan_args(argc, args, "21", &sources, &path, &opts);
+  sources = rb_ary_dup(rb_Array(sources));
+  MEMZERO(&bb, struct tsk4r_bh_build, 1);
+  digest = tsk4r_opt(opts, "digest", ID2SYM(rb_intern("md5")));
+  if (digest == ID2SYM(rb_intern("md5"))) {
+    bb.set.digest_len = TSK4R_HS_MD5;
+  } else if (digest == ID2SYM(rb_intern("sha1"))) {
+    bb.set.digest_len = TSK4R_HS_SHA1;
+  } else {
+    rb_raise(rb_eArgError, "digest must be :md5 or :sha1");
+  }
+  bb.block_size = NUM2UINT(tsk4r_opt(opts, "block_size", INT2FIX(TSK4R_BH_BLOCK_SIZE)));
+  if (bb.block_size < 64 || bb.block_size > TSK4R_BH_CHUNK) {
+    rb_raise(rb_eArgError, "block_size must be between 64 and %d", TSK4R_BH_CHUNK);
+  }
+  if (RARRAY_LEN(sources) > (long)UINT32_MAX) rb_raise(rb_eArgError, "too many sources");
+  bb.set.payload_len = 8;
+  bb.set.bloom_log2 = RTEST(tsk4r_opt(opts, "bloom", Qtrue)) ? 1 : 0;
+  bb.set.path = StringValueCStr(path);
+  bb.source_count = RARRAY_LEN(sources);
+  for (i = 0; i < bb.source_count; i++) {
+    VALUE source = rb_ary_entry(sources, i);
+    StringValueCStr(source);
+    rb_ary_store(sources, i, source);
+    trailer_len += RSTRING_LEN(source) + 1;
+  }
+
+  // trailer: block size, source count, NUL-terminated source names
+  bb.sources = malloc((size_t)(bb.source_count + 1) * sizeof(char *));
+  bb.trailer = malloc(trailer_len);
+  if (bb.sources == NULL || bb.trailer == NULL) {
+    free(bb.sources);
+    free(bb.trailer);
+    rb_memerror();
+  }
+  put32le(bb.trailer, bb.block_size);
+  put32le(bb.trailer + 4, (uint32_t)bb.source_count);
+  at = 8;
+  for (i = 0; i < bb.source_count; i++) {
+    VALUE source = rb_ary_entry(sources, i);
+    bb.sources[i] = RSTRING_PTR(source);
+    memcpy(bb.trailer + at, RSTRING_PTR(source), RSTRING_LEN(source) + 1);
+    at += RSTRING_LEN(source) + 1;
+  }
+  bb.set.trailer = bb.trailer;
+  bb.set.trailer_len = trailer_len;
+
+  rb_ensure(run_block_hash_build, (VALUE)&bb, release_block_hash_build, (VALUE)&bb);
+  RB_GC_GUARD(sources);
+  return rb_funcall(klass, rb_intern("open"), 1, path);
+}
+
+// BlockHashDB.open(path): HashSet.open plus the block size and source names
+VALUE open_block_hash_db(VALUE klass, VALUE path) {
+  VALUE obj = open_hash_set(klass, path);
+  const struct tsk4r_hash_set * set = tsk4r_hash_set_get(obj);
+  const unsigned char * trailer;
+  VALUE sources;
+  size_t len, at = 8;
+  uint32_t count, i;
+
+  trailer = tsk4r_hash_set_trailer(set, &len);
+  if (tsk4r_hash_set_payload_len(set) != 8 || len < 8 || get32le(trailer) == 0) {
+    rb_raise(rb_eArgError, "%s is not a block hash database.", StringValueCStr(path));
+  }
+  // every name takes at least its NUL, so a count past that is corrupt
+  count = get32le(trailer + 4);
+  if (count > len - 8) rb_raise(rb_eArgError, "%s is a damaged block hash database.", StringValueCStr(path));
+  sources = rb_ary_new2(count);
+  for (i = 0; i < count; i++) {
+    const unsigned char * end = at < len ? memchr(trailer + at, 0, len - at) : NULL;
+    if (end == NULL) rb_raise(rb_eArgError, "%s is a damaged block hash database.", StringValueCStr(path));
+    rb_ary_push(sources, rb_str_new((const char *)trailer + at, end - (trailer + at)));
+    at = (size_t)(end - trailer) + 1;
+  }
+  rb_obj_freeze(sources);
+  rb_iv_set(obj, "@block_size", UINT2NUM(get32le(trailer)));
+  rb_iv_set(obj, "@sources", sources);
+  return obj;
+}
+
+// BlockHashDB#lookup(digest): [source, block index] pairs with that digest
+VALUE block_hash_db_lookup(VALUE self, VALUE digest) {
+  const struct tsk4r_hash_set * set = tsk4r_hash_set_get(self);
+  VALUE sources = rb_iv_get(self, "@sources");
+  VALUE result = rb_ary_new();
+  unsigned char raw[TSK4R_HS_MAX_DIGEST];
+  uint64_t first, n, k;
+
+  if (! tsk4r_hash_set_parse(set, digest, raw)) return result;
+  n = tsk4r_hash_set_find(set, raw, &first);
+  for (k = 0; k < n; k++) {
+    const unsigned char * payload = tsk4r_hash_set_payload(set, first + k);
+    rb_ary_push(result, rb_assoc_new(rb_ary_entry(sources, get32le(payload)), UINT2NUM(get32le(payload + 4))));
+  }
+  return result;
+}
+
+// #match_blocks
+
+struct tsk4r_bh_chunk {
+  TSK_OFF_T offset;
+  TSK_OFF_T length;   // block starts this chunk covers
+  TSK_OFF_T end;      // end of the scanned range: reads may run up to it
+};
+
+struct tsk4r_bh_hit {
+  TSK_OFF_T offset;
+  TSK_OFF_T diagonal; // offset - block * block_size
+  uint32_t source;
+  uint32_t block;
+};
+
+struct tsk4r_bh_run {
+  TSK_OFF_T offset;
+  uint32_t source;
+  uint32_t block;
+  uint64_t count;
+};
+
+struct tsk4r_bh_scan {
+  TSK_IMG_INFO * img;
+  TSK_FS_INFO * fs;   // set: scan this file system's unallocated blocks
+  const struct tsk4r_hash_set * db;
+  unsigned int digest_len;
+  unsigned int block_size;
+  unsigned int step;
+  int threads;
+
+  struct tsk4r_bh_chunk * chunks;
+  size_t chunk_count;
+  size_t chunk_alloc;
+  size_t next;
+  pthread_mutex_t lock;
+
+  struct tsk4r_bh_hit * hits;
+  size_t hit_count;
+  size_t hit_alloc;
+  struct tsk4r_bh_run * runs;
+  size_t run_count;
+
+  volatile int cancel;
+  const char * failed;   // the TSK function that failed
+  char error[256];
+};
+
+static int add_range(void * ptr, TSK_OFF_T offset, TSK_OFF_T length) {
+  struct tsk4r_bh_scan * scan = (struct tsk4r_bh_scan *)ptr;
+  TSK_OFF_T stride = TSK4R_BH_CHUNK - TSK4R_BH_CHUNK % scan->step;
+  TSK_OFF_T end = offset + length, at;
+  if (length < (TSK_OFF_T)scan->block_size) return 0;
+  for (at = offset; at + (TSK_OFF_T)scan->block_size <= end; at += stride) {
+    struct tsk4r_bh_chunk * c;
+    if (scan->chunk_count == scan->chunk_alloc) {
+      size_t grow = scan->chunk_alloc ? scan->chunk_alloc * 2 : 256;
+      struct tsk4r_bh_chunk * chunks = realloc(scan->chunks, grow * sizeof(struct tsk4r_bh_chunk));
+      if (chunks == NULL) return -1;
+      scan->chunks = chunks;
+      scan->chunk_alloc = grow;
+    }
+    c = &scan->chunks[scan->chunk_count++];
+    c->offset = at;
+    c->length = end - at < stride ? end - at : stride;
+    c->end = end;
+  }
+  return 0;
+}
+
+static void scan_fail(struct tsk4r_bh_scan * scan, const char * function, const char * error) {
+  pthread_mutex_lock(&scan->lock);
+  if (scan->failed == NULL) {
+    scan->failed = function;
+    snprintf(scan->error, sizeof(scan->error), "%s", error);
+  }
+  pthread_mutex_unlock(&scan->lock);
+}
+
+static int push_hit(struct tsk4r_bh_hit ** hits, size_t * count, size_t * alloc, const struct tsk4r_bh_hit * hit) {
+  if (*count == *alloc) {
+    size_t grow = *alloc ? *alloc * 2 : 256;
+    struct tsk4r_bh_hit * more = realloc(*hits, grow * sizeof(struct tsk4r_bh_hit));
+    if (more == NULL) return -1;
+    *hits = more;
+    *alloc = grow;
+  }
+  (*hits)[(*count)++] = *hit;
+  return 0;
+}
+
+// hashes every step bytes of one chunk; hits are kept locally, then merged
+static int scan_chunk(struct tsk4r_bh_scan * scan, const struct tsk4r_bh_chunk * c, unsigned char * buf,
+                      struct tsk4r_bh_hit ** hits, size_t * count, size_t * alloc) {
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+  TSK_OFF_T want = c->length + scan->block_size - scan->step, p;
+  ssize_t got;
+
+  if (c->offset + want > c->end) want = c->end - c->offset;
+  got = tsk4r_img_read(scan->img, c->offset, (char *)buf, (size_t)want);
+  if (got < 0) {
+    scan_fail(scan, "tsk_img_read", tsk_error_get());
+    tsk_error_reset();
+    return -1;
+  }
+  for (p = 0; p < c->length && p + (TSK_OFF_T)scan->block_size <= (TSK_OFF_T)got; p += scan->step) {
+    uint64_t first, n, k;
+    if (all_zero(buf + p, scan->block_size)) continue;
+    block_digest(scan->digest_len, buf + p, scan->block_size, digest);
+    n = tsk4r_hash_set_find(scan->db, digest, &first);
+    for (k = 0; k < n; k++) {
+      const unsigned char * payload = tsk4r_hash_set_payload(scan->db, first + k);
+      struct tsk4r_bh_hit hit;
+      hit.offset = c->offset + p;
+      hit.source = get32le(payload);
+      hit.block = get32le(payload + 4);
+      hit.diagonal = hit.offset - (TSK_OFF_T)hit.block * scan->block_size;
+      if (push_hit(hits, count, alloc, &hit) != 0) {
+        scan_fail(scan, "match_blocks", "out of memory");
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void * block_match_worker(void * ptr) {
+  struct tsk4r_bh_scan * scan = (struct tsk4r_bh_scan *)ptr;
+  unsigned char * buf = malloc(TSK4R_BH_CHUNK + scan->block_size);
+  struct tsk4r_bh_hit * hits = NULL;
+  size_t count = 0, alloc = 0, i, h;
+
+  if (buf == NULL) {
+    scan_fail(scan, "match_blocks", "out of memory");
+    return NULL;
+  }
+  for (;;) {
+    pthread_mutex_lock(&scan->lock);
+    i = scan->next++;
+    pthread_mutex_unlock(&scan->lock);
+    if (i >= scan->chunk_count || scan->cancel || scan->failed) break;
+    count = 0;
+    if (scan_chunk(scan, &scan->chunks[i], buf, &hits, &count, &alloc) != 0) break;
+    pthread_mutex_lock(&scan->lock);
+    for (h = 0; h < count; h++) {
+      if (push_hit(&scan->hits, &scan->hit_count, &scan->hit_alloc, &hits[h]) != 0) break;
+    }
+    pthread_mutex_unlock(&scan->lock);
+    if (h < count) {
+      scan_fail(scan, "match_blocks", "out of memory");
+      break;
+    }
+  }
+  free(hits);
+  free(buf);
+  return NULL;
+}
+
+static int compare_hits(const void * a, const void * b) {
+  const struct tsk4r_bh_hit * x = a; const struct tsk4r_bh_hit * y = b;
+  if (x->source != y->source) return x->source < y->source ? -1 : 1;
+  if (x->diagonal != y->diagonal) return x->diagonal < y->diagonal ? -1 : 1;
+  return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static int compare_runs(const void * a, const void * b) {
+  const struct tsk4r_bh_run * x = a; const struct tsk4r_bh_run * y = b;
+  if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+  if (x->source != y->source) return x->source < y->source ? -1 : 1;
+  return (x->block > y->block) - (x->block < y->block);
+}
+
+// merges hits that continue each other (next block of the same source,
+// block_size further on) into runs, ordered by image offset
+static int build_runs(struct tsk4r_bh_scan * scan) {
+  size_t i;
+  if (scan->hit_count == 0) return 0;
+  qsort(scan->hits, scan->hit_count, sizeof(struct tsk4r_bh_hit), compare_hits);
+  scan->runs = malloc(scan->hit_count * sizeof(struct tsk4r_bh_run));
+  if (scan->runs == NULL) return -1;
+  for (i = 0; i < scan->hit_count; i++) {
+    const struct tsk4r_bh_hit * h = &scan->hits[i];
+    struct tsk4r_bh_run * last = scan->run_count ? &scan->runs[scan->run_count - 1] : NULL;
+    if (last != NULL && last->source == h->source && i > 0 && scan->hits[i - 1].diagonal == h->diagonal
+        && h->offset == last->offset + (TSK_OFF_T)(last->count * scan->block_size)) {
+      last->count++;
+      continue;
+    }
+    last = &scan->runs[scan->run_count++];
+    last->offset = h->offset;
+    last->source = h->source;
+    last->block = h->block;
+    last->count = 1;
+  }
+  qsort(scan->runs, scan->run_count, sizeof(struct tsk4r_bh_run), compare_runs);
+  return 0;
+}
+
+static void * run_block_match(void * ptr) {
+  struct tsk4r_bh_scan * scan = (struct tsk4r_bh_scan *)ptr;
+  pthread_t * workers;
+  int started = 0, t;
+
+  if (scan->fs != NULL) {
+    int failed = tsk4r_unalloc_runs(scan->fs, &scan->cancel, add_range, scan);
+    if (scan->cancel) return NULL;
+    if (failed) {
+      scan_fail(scan, "tsk_fs_block_walk", failed > 0 ? tsk_error_get() : "out of memory");
+      return NULL;
+    }
+  }
+
+  workers = malloc((size_t)scan->threads * sizeof(pthread_t));
+  if (workers != NULL) {
+    for (t = 0; t < scan->threads; t++) {
+      if (pthread_create(&workers[t], NULL, block_match_worker, scan) != 0) break;
+      started++;
+    }
+  }
+  if (started == 0) block_match_worker(scan);
+  for (t = 0; t < started; t++) pthread_join(workers[t], NULL);
+  free(workers);
+
+  if (scan->cancel || scan->failed) return NULL;
+  if (build_runs(scan) != 0) scan_fail(scan, "match_blocks", "out of memory");
+  return NULL;
+}
+
+static void cancel_block_match(void * ptr) {
+  ((struct tsk4r_bh_scan *)ptr)->cancel = 1;
+}
+
+struct tsk4r_bh_match_args {
+  struct tsk4r_bh_scan * scan;
+  VALUE db;
+};
+
+static VALUE block_match_result(VALUE arg) {
+  struct tsk4r_bh_match_args * a = (struct tsk4r_bh_match_args *)arg;
+  struct tsk4r_bh_scan * scan = a->scan;
+  VALUE sources = rb_iv_get(a->db, "@sources");
+  VALUE result;
+  size_t i;
+
+  tsk4r_call_interruptible(run_block_match, cancel_block_match, scan);
+  if (scan->failed) rb_raise(rb_eRuntimeError, "TSK function: %s exited with an error. (%s)", scan->failed, scan->error);
+
+  result = rb_ary_new2((long)scan->run_count);
+  for (i = 0; i < scan->run_count; i++) {
+    const struct tsk4r_bh_run * r = &scan->runs[i];
+    rb_ary_push(result, rb_ary_new3(4, LL2NUM(r->offset), rb_ary_entry(sources, r->source),
+                                    UINT2NUM(r->block), ULL2NUM(r->count)));
+  }
+  return result;
+}
+
+static VALUE release_block_match(VALUE arg) {
+  struct tsk4r_bh_scan * scan = ((struct tsk4r_bh_match_args *)arg)->scan;
+  free(scan->chunks);
+  free(scan->hits);
+  free(scan->runs);
+  pthread_mutex_destroy(&scan->lock);
+  return Qnil;
+}
+
+static unsigned int gcd(unsigned int a, unsigned int b) {
+  while (b != 0) { unsigned int t = a % b; a = b; b = t; }
+  return a;
+}
+
+// common option handling; the default step keeps every block of a file
+// system (fs_block_size, 0 for an image) on the grid of hashed offsets
+static void setup_block_match(struct tsk4r_bh_scan * scan, VALUE db, VALUE opts, unsigned int fs_block_size) {
+  unsigned int default_step;
+  if (! rb_obj_is_kind_of(db, rb_cTSKBlockHashDB)) rb_raise(rb_eTypeError, "expected a Sleuthkit::BlockHashDB");
+  scan->db = tsk4r_hash_set_get(db);
+  scan->digest_len = tsk4r_hash_set_digest_len(scan->db);
+  scan->block_size = NUM2UINT(rb_iv_get(db, "@block_size"));
+  default_step = fs_block_size ? gcd(scan->block_size, fs_block_size) : scan->block_size;
+  scan->step = NUM2UINT(tsk4r_opt(opts, "step", UINT2NUM(default_step)));
+  if (scan->step < 1 || scan->step > scan->block_size) rb_raise(rb_eArgError, "step must be between 1 and the block size");
+  scan->threads = NUM2INT(tsk4r_opt(opts, "threads", INT2FIX(TSK4R_BH_THREADS)));
+  if (scan->threads < 1) scan->threads = 1;
+}
+
+// Image#match_blocks(db, opts = {})
+// opts: :step => db.block_size (512 for sector-level matching of images
+//       whose files aren't aligned to the database blocks), :threads => 4
+// returns [image offset, source, first block index, block count] runs of
+// database blocks found in the image, ordered by offset
+VALUE match_image_blocks(int argc, VALUE *args, VALUE self) {
+  VALUE db; VALUE opts; VALUE result;
+  struct tsk4r_img_wrapper * img_ptr;
+  struct tsk4r_bh_scan scan;
+  struct tsk4r_bh_match_args a;
+
+  rb_scan_args(argc, args, "11", &db, &opts);
+  TypedData_Get_Struct(self, struct tsk4r_img_wrapper, &tsk4r_image_type, img_ptr);
+  if (img_ptr->image == NULL) rb_raise(rb_eRuntimeError, "image pointer is NULL");
+
+  MEMZERO(&scan, struct tsk4r_bh_scan, 1);
+  setup_block_match(&scan, db, opts, 0);
+  scan.img = img_ptr->image;
+  if (add_range(&scan, 0, scan.img->size) != 0) {
+    free(scan.chunks);
+    rb_memerror();
+  }
+  pthread_mutex_init(&scan.lock, NULL);
+  a.scan = &scan;
+  a.db = db;
+
+  result = rb_ensure(block_match_result, (VALUE)&a, release_block_match, (VALUE)&a);
+  RB_GC_GUARD(db);   // keeps the database mapped until the workers are done
+  return result;
+}
+
+// FileSystem::System#match_blocks(db, opts = {})
+// opts: :unallocated => true (false scans every block of the file system),
+//       :step => the gcd of the database and file system block sizes,
+//       :threads => 4
+// returns [image offset, source, first block index, block count] runs like
+// Image#match_blocks
+VALUE match_fs_blocks(int argc, VALUE *args, VALUE self) {
+  VALUE db; VALUE opts; VALUE result;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_bh_scan scan;
+  struct tsk4r_bh_match_args a;
+  TSK_FS_INFO * fs;
+
+  rb_scan_args(argc, args, "11", &db, &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+  fs = fs_ptr->filesystem;
+
+  MEMZERO(&scan, struct tsk4r_bh_scan, 1);
+  setup_block_match(&scan, db, opts, fs->block_size);
+  scan.img = fs->img_info;
+  if (RTEST(tsk4r_opt(opts, "unallocated", Qtrue))) {
+    scan.fs = fs;
+  } else if (add_range(&scan, fs->offset, (TSK_OFF_T)((fs->last_block_act + 1) * fs->block_size)) != 0) {
+    free(scan.chunks);
+    rb_memerror();
+  }
+  pthread_mutex_init(&scan.lock, NULL);
+  a.scan = &scan;
+  a.db = db;
+
+  result = rb_ensure(block_match_result, (VALUE)&a, release_block_match, (VALUE)&a);
+  RB_GC_GUARD(db);
+  return result;
+}
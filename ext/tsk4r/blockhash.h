@@ -0,0 +1,26 @@
+//
+//  blockhash.h
+//  RubyTSK
+//
+//  Sleuthkit::BlockHashDB: block hashes of reference files, and the
+//  sector-level matcher for images and unallocated space
+//
+
+#ifndef RubyTSK_blockhash_h
+#define RubyTSK_blockhash_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_BH_BLOCK_SIZE 4096
+#define TSK4R_BH_THREADS 4
+// bytes of image each worker reads and hashes per turn
+#define TSK4R_BH_CHUNK (1024 * 1024)
+
+VALUE build_block_hash_db(int argc, VALUE *args, VALUE klass);
+VALUE open_block_hash_db(VALUE klass, VALUE path);
+VALUE block_hash_db_lookup(VALUE self, VALUE digest);
+VALUE match_image_blocks(int argc, VALUE *args, VALUE self);
+VALUE match_fs_blocks(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -28,6 +28,31 @@ have_library("tsk3")
    abort "tsk3/libtsk.h is missing.  please install tsk3/libtsk.h"
  end
 
+# release the GVL around libtsk reads where the interpreter allows it (see tsk4r_i.h)
+have_header('ruby/thread.h')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+have_header('ruby/encoding.h')
+
+# kernel-side copies for FileData#export_to (fs_export.c); pread/pwrite otherwise
+have_func('copy_file_range')
+have_header('sys/sendfile.h')
+
+# prefetch_walk and the long native jobs run on their own threads (fs_prefetch.c, batch.c)
+unless have_header('pthread.h') && have_library('pthread', 'pthread_create')
+  abort "pthreads are required."
+end
+
+# Sleuthkit::HashSet maps set files read-only (hashset.c); read into memory otherwise
+have_header('sys/mman.h')
+
+# TypedData wrappers: GC compaction support (2.7+) and native footprint for dsize (memsize.c)
+have_func('rb_gc_mark_movable', 'ruby.h')
+have_header('malloc.h')
+have_func('malloc_usable_size', 'malloc.h')
+
+# USDT probe points for perf and bpftrace (trace.h); systemtap-sdt-dev / systemtap-sdt-devel
+have_header('sys/sdt.h')
+
 # 1.9 compatibility
 $CFLAGS += " -DRUBY_19" if RUBY_VERSION =~ /^1\.9/
 
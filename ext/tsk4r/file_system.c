@@ -24,6 +24,11 @@
 #include <stdio.h>
 #include <ruby.h>
 #include "file_system.h"
+#include "image.h"
+#include "volume.h"
+#include "memsize.h"
+#include "batch.h"
+#include "stats.h"
 
 extern VALUE rb_cTSKImage;
 extern VALUE rb_cTSKVolumeSystem;
@@ -42,16 +47,74 @@ void populate_instance_variables(VALUE self);
 
 // functions
 
+static void mark_filesystem(void * ptr);
+static void compact_filesystem(void * ptr);
+static size_t filesystem_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_fs_type = {
+  "Sleuthkit::FileSystem::System",
+  TSK4R_DATA_FUNCTIONS(mark_filesystem, deallocate_filesystem, filesystem_memsize, compact_filesystem),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE allocate_filesystem(VALUE klass){
   struct tsk4r_fs_wrapper * ptr;
-  //    ptr = ALLOC(struct tsk4r_fs_wrapper);
-  return Data_Make_Struct(klass, struct tsk4r_fs_wrapper, 0, deallocate_filesystem, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_wrapper, &tsk4r_fs_type, ptr);
+  ptr->parent = Qnil;
+  tsk4r_file_cache_init(&ptr->cache);
+  return obj;
+}
+
+static void close_filesystem_handle(void * handle){
+  tsk4r_fs_close((TSK_FS_INFO *)handle);
+}
+
+void deallocate_filesystem(void * ptr){
+  struct tsk4r_fs_wrapper * wrapper = ptr;
+  tsk4r_file_cache_free(&wrapper->cache);
+  tsk4r_owner_release(wrapper->owner);
+  xfree(wrapper);
 }
 
-void deallocate_filesystem(struct tsk4r_fs_wrapper * ptr){
-  TSK_FS_INFO *filesystem = ptr->filesystem;
-  tsk_fs_close(filesystem);
-  xfree(ptr);
+TSK_FS_INFO * tsk4r_fs_reopen(TSK_FS_INFO * fs){
+  // fs->offset is absolute, also for a file system opened on a partition
+  return tsk4r_fs_open_img(fs->img_info, fs->offset, fs->ftype);
+}
+
+// the Image or Volume::System the TSK_FS_INFO was opened through
+static struct tsk4r_owner * filesystem_parent_owner(VALUE parent_obj){
+  if (rb_obj_is_kind_of(parent_obj, rb_cTSKVolumePart)) {
+    struct tsk4r_vpart_wrapper * partition;
+    TypedData_Get_Struct(parent_obj, struct tsk4r_vpart_wrapper, &tsk4r_vpart_type, partition);
+    parent_obj = partition->parent;
+  }
+  if (rb_obj_is_kind_of(parent_obj, rb_cTSKVolumeSystem)) {
+    struct tsk4r_vs_wrapper * volume;
+    TypedData_Get_Struct(parent_obj, struct tsk4r_vs_wrapper, &tsk4r_vs_type, volume);
+    return volume->owner;
+  } else {
+    struct tsk4r_img_wrapper * image;
+    TypedData_Get_Struct(parent_obj, struct tsk4r_img_wrapper, &tsk4r_image_type, image);
+    return image->owner;
+  }
+}
+
+// the image (or volume) must outlive the TSK_FS_INFO opened on it
+static void mark_filesystem(void * ptr){
+  struct tsk4r_fs_wrapper * wrapper = ptr;
+  tsk4r_gc_mark(wrapper->parent);
+  tsk4r_file_cache_mark(&wrapper->cache);
+}
+
+static void compact_filesystem(void * ptr){
+  struct tsk4r_fs_wrapper * wrapper = ptr;
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
+  tsk4r_file_cache_compact(&wrapper->cache);
+}
+
+static size_t filesystem_memsize(const void * ptr){
+  const struct tsk4r_fs_wrapper * wrapper = ptr;
+  return sizeof(*wrapper) + tsk4r_fs_memsize(wrapper->filesystem) + tsk4r_file_cache_memsize(&wrapper->cache);
 }
 
 VALUE initialize_filesystem(int argc, VALUE *args, VALUE self){
@@ -71,7 +134,7 @@ VALUE initialize_filesystem(int argc, VALUE *args, VALUE self){
 
 VALUE open_filesystem(VALUE self, VALUE parent_obj, VALUE opts) {
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   
   if (rb_obj_is_kind_of((VALUE)parent_obj, rb_cTSKImage)) {
     open_fs_from_image(self, parent_obj, opts);
@@ -92,6 +155,8 @@ VALUE open_filesystem(VALUE self, VALUE parent_obj, VALUE opts) {
     VALUE my_description = get_filesystem_type(self);
     rb_iv_set(self, "@description", my_description);
     rb_iv_set(self, "@parent", parent_obj);
+    fs_ptr->parent = parent_obj;
+    fs_ptr->owner = tsk4r_owner_new(fs_ptr->filesystem, close_filesystem_handle, filesystem_parent_owner(parent_obj));
     
   } else {
     rb_funcall(self, rb_intern("taint"), 0, NULL);
@@ -101,27 +166,27 @@ VALUE open_filesystem(VALUE self, VALUE parent_obj, VALUE opts) {
 }
 
 VALUE open_fs_from_image(VALUE self, VALUE image_obj, VALUE opts) {
-  struct tsk4r_img * rb_image; struct tsk4r_fs_wrapper * my_pointer;
+  struct tsk4r_img_wrapper * rb_image; struct tsk4r_fs_wrapper * my_pointer;
   TSK_OFF_T offset = 0;
   VALUE fs_type_flag = rb_hash_aref(opts, rb_symname_p("type_flag"));
   TSK_FS_TYPE_ENUM * type_flag_num = get_fs_flag(fs_type_flag);
 
-  Data_Get_Struct(image_obj, struct tsk4r_img, rb_image);
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, my_pointer);
+  TypedData_Get_Struct(image_obj, struct tsk4r_img_wrapper, &tsk4r_image_type, rb_image);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, my_pointer);
   TSK_IMG_INFO * disk = rb_image->image;
-  my_pointer->filesystem = tsk_fs_open_img(disk, offset, (TSK_FS_TYPE_ENUM)type_flag_num);
+  my_pointer->filesystem = tsk4r_fs_open_img(disk, offset, (TSK_FS_TYPE_ENUM)type_flag_num);
   return self;
 }
 
 VALUE open_fs_from_partition(VALUE self, VALUE vpart_obj, VALUE opts) {
-  struct tsk4r_vs_part * rb_partition; struct tsk4r_fs_wrapper * my_pointer;
-  Data_Get_Struct(vpart_obj, struct tsk4r_vs_part, rb_partition);
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, my_pointer);
+  struct tsk4r_vpart_wrapper * rb_partition; struct tsk4r_fs_wrapper * my_pointer;
+  TypedData_Get_Struct(vpart_obj, struct tsk4r_vpart_wrapper, &tsk4r_vpart_type, rb_partition);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, my_pointer);
 
   VALUE fs_type_flag = rb_hash_aref(opts, rb_symname_p("type_flag"));
   TSK_FS_TYPE_ENUM * type_flag_num = get_fs_flag(fs_type_flag);
   
-  my_pointer->filesystem = tsk_fs_open_vol(rb_partition->volume_part, (TSK_FS_TYPE_ENUM)type_flag_num);
+  my_pointer->filesystem = tsk4r_fs_open_vol(rb_partition->volume_part, (TSK_FS_TYPE_ENUM)type_flag_num);
   
   return self;
 }
@@ -130,9 +195,9 @@ VALUE open_fs_from_partition(VALUE self, VALUE vpart_obj, VALUE opts) {
 // with a readable filesystem.  Right now, this simply returns
 // the last one found.
 VALUE open_fs_from_volume(VALUE self, VALUE vs_obj, VALUE opts) {
-  struct tsk4r_vs * rb_volumesystem; struct tsk4r_fs_wrapper * my_pointer;
-  Data_Get_Struct(vs_obj, struct tsk4r_vs, rb_volumesystem);
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, my_pointer);
+  struct tsk4r_vs_wrapper * rb_volumesystem; struct tsk4r_fs_wrapper * my_pointer;
+  TypedData_Get_Struct(vs_obj, struct tsk4r_vs_wrapper, &tsk4r_vs_type, rb_volumesystem);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, my_pointer);
 
   VALUE fs_type_flag = rb_hash_aref(opts, rb_symname_p("type_flag"));
   TSK_FS_TYPE_ENUM * type_flag_num = get_fs_flag(fs_type_flag);
@@ -140,7 +205,7 @@ VALUE open_fs_from_volume(VALUE self, VALUE vs_obj, VALUE opts) {
   TSK_PNUM_T c = 0;
   while (c < rb_volumesystem->volume->part_count) {
     const TSK_VS_PART_INFO * partition = tsk_vs_part_get(rb_volumesystem->volume, c);
-    my_pointer->filesystem = tsk_fs_open_vol(partition, (TSK_FS_TYPE_ENUM)type_flag_num);
+    my_pointer->filesystem = tsk4r_fs_open_vol(partition, (TSK_FS_TYPE_ENUM)type_flag_num);
     if (my_pointer->filesystem != NULL) { break; }
     c++;
   }
@@ -150,11 +215,11 @@ VALUE open_fs_from_volume(VALUE self, VALUE vs_obj, VALUE opts) {
 // directory read functions
 VALUE open_directory_by_name(int argc, VALUE *args, VALUE self) {
   VALUE name; VALUE opts; TSK_FS_DIR * tsk_dir; struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
 
   rb_scan_args(argc, args, "11", &name, &opts);
   VALUE new_obj;
-  tsk_dir = tsk_fs_dir_open(fs_ptr->filesystem, StringValuePtr(name));
+  tsk_dir = tsk4r_fs_dir_open(fs_ptr->filesystem, StringValuePtr(name));
   if (tsk_dir != NULL ) {
     printf("We are getting somewhere (open_directory_by_name)!!\n");
     new_obj = rb_funcall(rb_cTSKFileSystemDir, rb_intern("new"), 2, self, name);
@@ -167,7 +232,7 @@ VALUE open_directory_by_inum(int argc, VALUE *args, VALUE self) {
   VALUE inum; VALUE opts; struct tsk4r_fs_wrapper * fs_ptr;
   VALUE new_obj;
   
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   rb_scan_args(argc, args, "11", &inum, &opts);
   if ( ! rb_obj_is_kind_of(inum, rb_cInteger) ) { inum = INT2FIX(0); }
 
@@ -183,18 +248,23 @@ VALUE open_directory_by_inum(int argc, VALUE *args, VALUE self) {
   return new_obj;
 }
 
+// repeat opens return the same FileData (see fs_cache.c); opts[:seq]
+// only matches an entry with that sequence number, opts[:type] and
+// opts[:id] open the file on that attribute instead of the default one
 VALUE open_file_by_inum(int argc, VALUE *args, VALUE self) {
-  VALUE inum; VALUE opts; VALUE new_obj;
+  VALUE inum; VALUE opts; VALUE type;
+  TSK_FS_ATTR_TYPE_ENUM attr_type = TSK_FS_ATTR_TYPE_DEFAULT; int attr_id = -1;
   
   rb_scan_args(argc, args, "11", &inum, &opts);
   if ( ! rb_obj_is_kind_of(inum, rb_cInteger) ) { inum = INT2FIX(0); }
-  
-  new_obj = rb_funcall(rb_cTSKFileSystemFileData, rb_intern("new"), 2, self, inum);
-  if ( OBJ_TAINTED(new_obj)) {
-    new_obj = Qnil;
+  type = tsk4r_opt(opts, "type", Qnil);
+  if (! NIL_P(type)) {
+    attr_type = (TSK_FS_ATTR_TYPE_ENUM)NUM2INT(type);
+    attr_id = NUM2INT(tsk4r_opt(opts, "id", INT2FIX(-1)));
+    if (attr_id < -1 || attr_id > 0xffff) rb_raise(rb_eArgError, "attribute id %d out of range.", attr_id);
   }
   
-  return new_obj;
+  return tsk4r_cached_file(self, (TSK_INUM_T)NUM2ULL(inum), attr_type, attr_id, tsk4r_opt(opts, "seq", Qnil));
 }
 
 VALUE open_file_by_name(int argc, VALUE *args, VALUE self) {
@@ -216,7 +286,7 @@ VALUE open_file_by_name(int argc, VALUE *args, VALUE self) {
 VALUE get_filesystem_type(VALUE self) {
   const char * mytype;
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   mytype = tsk_fs_type_toname(fs_ptr->filesystem->ftype);
   rb_iv_set(self, "@name", rb_str_new2(mytype));
   return rb_str_new2(mytype);
@@ -232,7 +302,7 @@ VALUE call_tsk_fsstat(VALUE self, VALUE io){
   FILE * hFile = fdopen((int)fd, "w");
 
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   
   // this accesses the function pointer in TSK_FS_INFO
   // the function dumps a status report (text)
@@ -267,7 +337,7 @@ VALUE call_tsk_istat(int argc, VALUE *args, VALUE self) {
   FILE * hFile = fdopen((int)fd, "w");
   
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   
   if (fs_ptr->filesystem != NULL) {
     uint8_t(*myfunc) (TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
@@ -284,7 +354,7 @@ VALUE call_tsk_istat(int argc, VALUE *args, VALUE self) {
 // assigns numerous TSK_FS_INFO values to ruby instance variables
 void populate_instance_variables(VALUE self) {
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
 
   rb_iv_set(self, "@block_count", ULONG2NUM((unsigned long long)fs_ptr->filesystem->block_count));
   //    rb_iv_set(self, "@block_getflags", INT2NUM((int)fs_ptr->filesystem->block_getflags)); // do not impl
@@ -315,8 +385,8 @@ void populate_instance_variables(VALUE self) {
   rb_iv_set(self, "@isOrphanHunting", UINT2NUM((uint)fs_ptr->filesystem->isOrphanHunting));
 #endif
   //    rb_iv_set(self, "@istat", fs_ptr->filesystem->istat); // do not impl
-  //    rb_iv_set(self, "@jblk_walk", fs_ptr->filesystem->jblk_walk);//no
-  //    rb_iv_set(self, "@jentry_walk", fs_ptr->filesystem->jentry_walk);//no
+  //    rb_iv_set(self, "@jblk_walk", fs_ptr->filesystem->jblk_walk);// see #journal_blocks (fs_journal.c)
+  //    rb_iv_set(self, "@jentry_walk", fs_ptr->filesystem->jentry_walk);// see #each_journal_entry
   //    rb_iv_set(self, "@jopen", fs_ptr->filesystem->jopen);//no
   rb_iv_set(self, "@journ_inum", ULONG2NUM((unsigned long int)fs_ptr->filesystem->journ_inum));
   rb_iv_set(self, "@last_block", ULONG2NUM((unsigned long int)fs_ptr->filesystem->last_block));
@@ -26,27 +26,22 @@
 
 #include <tsk3/libtsk.h>
 #include "tsk4r_i.h"
+#include "fs_cache.h"
+#include "owner.h"
 
 // Sleuthkit::FileSystem struct
 struct tsk4r_fs_wrapper {
   TSK_FS_INFO * filesystem;
+  VALUE parent;   // Image, Volume::System or Volume::Partition
+  struct tsk4r_owner * owner;
+  struct tsk4r_file_cache cache;
 };
-// Sleuthkit::Volume struct
-struct tsk4r_vs {
-  TSK_VS_INFO * volume;
-  //  tsk4r_img_wrapper * disk;
-};
-struct tsk4r_vs_part {
-  TSK_VS_PART_INFO * volume_part;
-};
-struct tsk4r_img {
-  TSK_IMG_INFO * image;
-};
+extern const rb_data_type_t tsk4r_fs_type;
 
 // Sleuthkit::FileSystem
 VALUE initialize_filesystem(int argc, VALUE *args, VALUE self);
 VALUE allocate_filesystem(VALUE self);
-void  deallocate_filesystem(struct tsk4r_fs_wrapper * ptr);
+void  deallocate_filesystem(void * ptr);
 VALUE open_filesystem(VALUE self, VALUE source, VALUE opts);
 VALUE open_fs_from_image(VALUE self, VALUE image_obj, VALUE opts);
 VALUE open_fs_from_volume(VALUE self, VALUE vol_obj, VALUE opts);
@@ -60,5 +55,9 @@ VALUE open_file_by_name(int argc, VALUE *args, VALUE self);
 VALUE open_file_by_inum(int argc, VALUE *args, VALUE self);
 VALUE return_tsk_fs_type_list(int argc, VALUE *args, VALUE self);
 
+// a second TSK_FS_INFO on the same volume, for a native thread that walks
+// or reads while Ruby code keeps using the first; close with tsk4r_fs_close
+TSK_FS_INFO * tsk4r_fs_reopen(TSK_FS_INFO * fs);
+
 
 #endif
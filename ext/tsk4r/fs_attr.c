@@ -10,18 +10,46 @@
 #include <ruby.h>
 #include "fs_attr.h"
 #include "fs_file.h"
+#include "file_system.h"
+#include "batch.h"
+#include "stats.h"
 
 extern VALUE rb_cTSKFileSystemFileData;
 
+static void mark_fs_attr(void * ptr);
+static void compact_fs_attr(void * ptr);
+static size_t fs_attr_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_fs_attr_type = {
+  "Sleuthkit::FileSystem::Attribute",
+  TSK4R_DATA_FUNCTIONS(mark_fs_attr, deallocate_fs_attr, fs_attr_memsize, compact_fs_attr),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE allocate_fs_attr(VALUE klass) {
-  TSK_FS_ATTR * ptr;
-  return Data_Make_Struct(klass, TSK_FS_ATTR, 0, deallocate_fs_attr, ptr);
+  struct tsk4r_fs_attr_wrapper * ptr;
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_attr_wrapper, &tsk4r_fs_attr_type, ptr);
+  ptr->file = Qnil;
+  return obj;
 }
 
-void deallocate_fs_attr(TSK_FS_ATTR * ptr) {
+void deallocate_fs_attr(void * ptr) {
   xfree(ptr);
 }
 
+static void mark_fs_attr(void * ptr) {
+  tsk4r_gc_mark(((struct tsk4r_fs_attr_wrapper *)ptr)->file);
+}
+
+static void compact_fs_attr(void * ptr) {
+  struct tsk4r_fs_attr_wrapper * wrapper = ptr;
+  wrapper->file = tsk4r_gc_location(wrapper->file);
+}
+
+static size_t fs_attr_memsize(const void * ptr) {
+  return sizeof(struct tsk4r_fs_attr_wrapper);
+}
+
 VALUE initialize_fs_attr(int argc, VALUE *args, VALUE self) {
   VALUE fs_file; VALUE attr_idx; char * method;
   rb_scan_args(argc, args, "11", &fs_file, &attr_idx);
@@ -54,9 +82,9 @@ VALUE fetch_attr(int argc, VALUE *args, VALUE self) {
     }
   }
   a_idx = (int)NUM2LONG(idx);
-  const TSK_FS_ATTR * ptr; struct tsk4r_fs_file_wrapper * fs;
-  Data_Get_Struct(self, TSK_FS_ATTR, ptr);
-  Data_Get_Struct(fs_file, struct tsk4r_fs_file_wrapper, fs);
+  const TSK_FS_ATTR * ptr; struct tsk4r_fs_attr_wrapper * my_attr; struct tsk4r_fs_file_wrapper * fs;
+  TypedData_Get_Struct(self, struct tsk4r_fs_attr_wrapper, &tsk4r_fs_attr_type, my_attr);
+  TypedData_Get_Struct(fs_file, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs);
 
   TSK_FS_FILE * f;
   f = fs->file;
@@ -64,6 +92,9 @@ VALUE fetch_attr(int argc, VALUE *args, VALUE self) {
   ptr = tsk_fs_file_attr_get_idx(f, a_idx);
   
   if (ptr != NULL) {
+    // keep the libtsk struct; its run list stays owned by the file held in @file
+    my_attr->attr = *ptr;
+    my_attr->file = fs_file;
     rb_iv_set(self, "@file", fs_file);
     rb_iv_set(self, "@flags", ULONG2NUM(ptr->flags));
     rb_iv_set(self, "@id", ULONG2NUM(ptr->id));
@@ -77,4 +108,124 @@ VALUE fetch_attr(int argc, VALUE *args, VALUE self) {
     rb_warn("unable to get attribute");
   }
   return self;
-}
\ No newline at end of file
+}
+
+// little-endian regardless of host, so packed runs unpack with 'Q<*'
+static void put_le64(unsigned char * dest, uint64_t value) {
+  int i;
+  for (i = 0; i < 8; i++) { dest[i] = (unsigned char)(value >> (8 * i)); }
+}
+
+// packs the non-resident run list of attr; resident attributes have no runs
+VALUE pack_attr_runs(const TSK_FS_ATTR * attr) {
+  const TSK_FS_ATTR_RUN * run; TSK_FS_INFO * fs; long count = 0; unsigned char * out;
+  VALUE packed;
+  uint64_t extra = 0;
+
+  if (attr == NULL || ! (attr->flags & TSK_FS_ATTR_NONRES) || attr->fs_file == NULL) {
+    return TSK4R_BINARY_STR(rb_str_new(NULL, 0));
+  }
+  fs = attr->fs_file->fs_info;
+  if (attr->flags & TSK_FS_ATTR_COMP) extra |= TSK4R_RUN_COMPRESSED;
+  if (attr->flags & TSK_FS_ATTR_ENC)  extra |= TSK4R_RUN_ENCRYPTED;
+
+  for (run = attr->nrd.run; run != NULL; run = run->next) count++;
+  packed = rb_str_new(NULL, count * TSK4R_RUN_FIELDS * 8);
+  out = (unsigned char *)RSTRING_PTR(packed);
+
+  for (run = attr->nrd.run; run != NULL; run = run->next) {
+    uint64_t image_offset = 0;
+    uint64_t file_offset = (uint64_t)run->offset * fs->block_size;
+    uint64_t length = (uint64_t)run->len * fs->block_size;
+    // the last run covers whole blocks; stop it at the attribute's size
+    if (attr->size <= 0 || file_offset >= (uint64_t)attr->size) {
+      length = 0;
+    } else if (length > (uint64_t)attr->size - file_offset) {
+      length = (uint64_t)attr->size - file_offset;
+    }
+    if (! (run->flags & (TSK_FS_ATTR_RUN_FLAG_FILLER | TSK_FS_ATTR_RUN_FLAG_SPARSE))) {
+      image_offset = (uint64_t)fs->offset + (uint64_t)run->addr * fs->block_size;
+    }
+    put_le64(out,      file_offset);
+    put_le64(out + 8,  image_offset);
+    put_le64(out + 16, length);
+    put_le64(out + 24, (uint64_t)run->flags | extra);
+    out += TSK4R_RUN_FIELDS * 8;
+  }
+  return TSK4R_BINARY_STR(packed);
+}
+
+// Attribute#runs
+VALUE get_attr_runs(VALUE self) {
+  struct tsk4r_fs_attr_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_attr_wrapper, &tsk4r_fs_attr_type, ptr);
+  return pack_attr_runs(&ptr->attr);
+}
+
+// FileSystem::System#each_attribute
+
+struct tsk4r_attr_walk {
+  struct tsk4r_batch batch;
+  int all_types;
+  TSK_FS_ATTR_TYPE_ENUM type;
+  int named_only;
+};
+
+static TSK_WALK_RET_ENUM attr_walk_callback(TSK_FS_FILE * file, void * ptr) {
+  struct tsk4r_attr_walk * walk = (struct tsk4r_attr_walk *)ptr;
+  int i; int count;
+  if (file->meta == NULL) return TSK_WALK_CONT;
+
+  count = tsk_fs_file_attr_getsize(file);
+  for (i = 0; i < count; i++) {
+    const TSK_FS_ATTR * attr = tsk_fs_file_attr_get_idx(file, i);
+    int named;
+    if (attr == NULL) continue;
+    if (! walk->all_types && attr->type != walk->type) continue;
+    named = (attr->name != NULL && attr->name[0] != '\0');
+    if (walk->named_only && ! named) continue;
+
+    VALUE entry = rb_ary_new3(6, ULL2NUM(file->meta->addr), INT2NUM(attr->type), UINT2NUM(attr->id),
+                              named ? rb_str_new2(attr->name) : Qnil, LL2NUM(attr->size),
+                              (attr->flags & TSK_FS_ATTR_RES) ? Qtrue : Qfalse);
+    if (tsk4r_batch_push(&walk->batch, entry)) return TSK_WALK_STOP;
+  }
+  return TSK_WALK_CONT;
+}
+
+// FileSystem::System#each_attribute(opts = {}) { |entries| ... }
+// opts: :type => :data (default), :all, nil or an Integer TSK_FS_ATTR_TYPE_ENUM,
+//       :named_only => true, :unallocated => false, :batch_size => 1024
+// yields Arrays of [inum, attr_type, id, name, size, resident?] without building
+// FileData or Attribute objects
+VALUE each_fs_attribute(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE type; struct tsk4r_attr_walk walk;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  TSK_FS_META_FLAG_ENUM flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+  uint8_t failed;
+
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  MEMZERO(&walk, struct tsk4r_attr_walk, 1);
+  type = tsk4r_opt(opts, "type", ID2SYM(rb_intern("data")));
+  if (NIL_P(type) || type == ID2SYM(rb_intern("all"))) {
+    walk.all_types = 1;
+  } else if (type == ID2SYM(rb_intern("data"))) {
+    // non-NTFS file systems keep content in the default attribute type
+    walk.type = TSK_FS_TYPE_ISNTFS(fs_ptr->filesystem->ftype) ? TSK_FS_ATTR_TYPE_NTFS_DATA : TSK_FS_ATTR_TYPE_DEFAULT;
+  } else {
+    walk.type = (TSK_FS_ATTR_TYPE_ENUM)NUM2INT(type);
+  }
+  walk.named_only = RTEST(tsk4r_opt(opts, "named_only", Qtrue));
+  if (RTEST(tsk4r_opt(opts, "unallocated", Qfalse))) flags |= TSK_FS_META_FLAG_UNALLOC;
+  tsk4r_batch_init(&walk.batch, tsk4r_opt(opts, "batch_size", Qnil));
+
+  failed = tsk4r_fs_meta_walk(fs_ptr->filesystem, fs_ptr->filesystem->first_inum, fs_ptr->filesystem->last_inum,
+                            flags, attr_walk_callback, &walk);
+  tsk4r_batch_finish(&walk.batch);
+  if (failed) rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_meta_walk exited with an error. (%s)", tsk_error_get());
+  return self;
+}
@@ -12,11 +12,27 @@
 #include <tsk3/libtsk.h>
 #include "tsk4r_i.h"
 
-extern struct TSK_FS_ATTR fs_attr;
+// a copy of the libtsk attribute; its run list and name stay owned by the
+// TSK_FS_FILE of file, which the mark function keeps alive
+struct tsk4r_fs_attr_wrapper {
+  TSK_FS_ATTR attr;
+  VALUE file;
+};
+extern const rb_data_type_t tsk4r_fs_attr_type;
+
+// flags of a packed run, beyond TSK_FS_ATTR_RUN_FLAG_ENUM (filler 0x1, sparse 0x2)
+#define TSK4R_RUN_COMPRESSED 0x100
+#define TSK4R_RUN_ENCRYPTED  0x200
+// one run = 4 little-endian uint64: file offset, image offset, length (bytes,
+// clipped to the attribute's size), flags
+#define TSK4R_RUN_FIELDS 4
 
 VALUE allocate_fs_attr(VALUE self);
-void  deallocate_fs_attr(TSK_FS_ATTR * ptr);
+void  deallocate_fs_attr(void * ptr);
 VALUE initialize_fs_attr(int argc, VALUE *args, VALUE self);
 VALUE fetch_attr(int argc, VALUE *args, VALUE self);
+VALUE get_attr_runs(VALUE self);
+VALUE pack_attr_runs(const TSK_FS_ATTR * attr);
+VALUE each_fs_attribute(int argc, VALUE *args, VALUE self);
 
 #endif
@@ -7,20 +7,47 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 #include <ruby.h>
 #include "fs_block.h"
 #include "file_system.h"
+#include "stats.h"
 
 
+static void mark_fs_block(void * ptr);
+static void compact_fs_block(void * ptr);
+static size_t fs_block_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_fs_block_type = {
+  "Sleuthkit::FileSystem::Block",
+  TSK4R_DATA_FUNCTIONS(mark_fs_block, deallocate_fs_block, fs_block_memsize, compact_fs_block),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 VALUE allocate_fs_block(VALUE klass){
-  TSK_FS_BLOCK * ptr;
-  return Data_Make_Struct(klass, TSK_FS_BLOCK, 0, deallocate_fs_block, ptr);
+  struct tsk4r_fs_block_wrapper * ptr;
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_block_wrapper, &tsk4r_fs_block_type, ptr);
+  ptr->filesystem = Qnil;
+  return obj;
 }
 
-void deallocate_fs_block(TSK_FS_BLOCK * ptr) {
+void deallocate_fs_block(void * ptr) {
   xfree(ptr);
 }
 
+static void mark_fs_block(void * ptr) {
+  tsk4r_gc_mark(((struct tsk4r_fs_block_wrapper *)ptr)->filesystem);
+}
+
+static void compact_fs_block(void * ptr) {
+  struct tsk4r_fs_block_wrapper * wrapper = ptr;
+  wrapper->filesystem = tsk4r_gc_location(wrapper->filesystem);
+}
+
+static size_t fs_block_memsize(const void * ptr) {
+  return sizeof(struct tsk4r_fs_block_wrapper);
+}
+
 VALUE initialize_fs_block(int argc, VALUE *args, VALUE self) {
   VALUE filesystem; VALUE address;
 
@@ -31,24 +58,158 @@ VALUE initialize_fs_block(int argc, VALUE *args, VALUE self) {
 }
 
 VALUE fetch_block(VALUE self, VALUE filesystem, VALUE address) {
-  TSK_FS_BLOCK * ptr; struct tsk4r_fs_wrapper * fs; TSK_DADDR_T addr;
-  Data_Get_Struct(self, TSK_FS_BLOCK, ptr);
-  Data_Get_Struct(filesystem, struct tsk4r_fs_wrapper, fs);
+  struct tsk4r_fs_block_wrapper * wrapper; TSK_FS_BLOCK * ptr;
+  struct tsk4r_fs_wrapper * fs; TSK_DADDR_T addr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_block_wrapper, &tsk4r_fs_block_type, wrapper);
+  ptr = &wrapper->block;
+  TypedData_Get_Struct(filesystem, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs);
   addr = (TSK_DADDR_T)NUM2ULL(address);
   TSK_FS_INFO * fsystem;
   fsystem = fs->filesystem;
 
-  ptr = tsk_fs_block_get(fsystem, NULL, addr);
+  TSK_FS_BLOCK * tsk_block = tsk4r_fs_block_get(fsystem, NULL, addr);
   
-  if (ptr != NULL) {
+  if (tsk_block != NULL) {
+    // keep everything but the libtsk-owned buffer, which is copied (NULs and all)
+    *ptr = *tsk_block;
+    ptr->buf = NULL;
+    wrapper->filesystem = filesystem;
     rb_iv_set(self, "@address", ULONG2NUM(ptr->addr));
-    rb_iv_set(self, "@buffer", rb_str_new2(ptr->buf));
+    rb_iv_set(self, "@buffer", TSK4R_BINARY_STR(rb_str_new(tsk_block->buf, fsystem->block_size)));
     rb_iv_set(self, "@flags", UINT2NUM(ptr->flags));
     rb_iv_set(self, "@filesystem", filesystem);
     rb_iv_set(self, "@tag", INT2NUM(ptr->tag));
+    tsk_fs_block_free(tsk_block);
   } else {
     rb_warn("unable to get block");
   }
   return self;
 }
 
+// FileSystem::System#read_blocks
+
+struct tsk4r_block_read {
+  TSK_FS_INFO * fs;
+  TSK_DADDR_T start;
+  char * dest;
+  size_t len;
+  ssize_t got;
+};
+
+static void * read_blocks_without_gvl(void * ptr) {
+  struct tsk4r_block_read * rd = (struct tsk4r_block_read *)ptr;
+  rd->got = tsk4r_fs_read_block(rd->fs, rd->start, rd->dest, rd->len);
+  return NULL;
+}
+
+// FileSystem::System#read_blocks(start, count, buffer = nil, opts = {})
+// reads count contiguous blocks into one binary String (buffer, when given).
+// :flags_out => String receives one little-endian uint32 TSK_FS_BLOCK_FLAG_ENUM per block
+VALUE read_fs_blocks(int argc, VALUE *args, VALUE self) {
+  VALUE start; VALUE count; VALUE buffer; VALUE opts; VALUE flags_out;
+  struct tsk4r_fs_wrapper * fs_ptr; struct tsk4r_block_read rd;
+  TSK_DADDR_T first; TSK_DADDR_T n; TSK_DADDR_T i;
+
+  rb_scan_args(argc, args, "22", &start, &count, &buffer, &opts);
+  if (rb_obj_is_kind_of(buffer, rb_cHash) && NIL_P(opts)) { opts = buffer; buffer = Qnil; }
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  if (NUM2LL(start) < 0 || NUM2LL(count) < 0) rb_raise(rb_eArgError, "start and count must not be negative.");
+  first = (TSK_DADDR_T)NUM2ULL(start);
+  n = (TSK_DADDR_T)NUM2ULL(count);
+  // blocks past last_block_act are not in the image (truncated images)
+  if (first > fs_ptr->filesystem->last_block_act) return Qnil;
+  if (n > fs_ptr->filesystem->last_block_act - first + 1) n = fs_ptr->filesystem->last_block_act - first + 1;
+
+  if (NIL_P(buffer)) {
+    buffer = rb_str_buf_new(0);
+  } else {
+    StringValue(buffer);
+  }
+  TSK4R_BINARY_STR(buffer);
+  rb_str_modify(buffer);
+  rb_str_resize(buffer, (long)(n * fs_ptr->filesystem->block_size));
+
+  rd.fs = fs_ptr->filesystem; rd.start = first; rd.len = (size_t)RSTRING_LEN(buffer);
+  rb_str_locktmp(buffer);
+  rd.dest = RSTRING_PTR(buffer);
+  rb_thread_call_without_gvl(read_blocks_without_gvl, &rd, NULL, NULL);
+  rb_str_unlocktmp(buffer);
+  if (rd.got < 0) {
+    rb_str_set_len(buffer, 0);
+    rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_read_block exited with an error. (%s)", tsk_error_get());
+  }
+  rb_str_set_len(buffer, rd.got);
+
+  flags_out = rb_obj_is_kind_of(opts, rb_cHash) ? rb_hash_aref(opts, ID2SYM(rb_intern("flags_out"))) : Qnil;
+  if (! NIL_P(flags_out)) {
+    unsigned char * out;
+    StringValue(flags_out);
+    rb_str_modify(flags_out);
+    rb_str_resize(flags_out, (long)(n * 4));
+    out = (unsigned char *)RSTRING_PTR(flags_out);
+    for (i = 0; i < n; i++) {
+      uint32_t flags = 0;
+      if (fs_ptr->filesystem->block_getflags != NULL) {
+        flags = (uint32_t)fs_ptr->filesystem->block_getflags(fs_ptr->filesystem, first + i);
+      }
+      out[4 * i]     = (unsigned char)flags;
+      out[4 * i + 1] = (unsigned char)(flags >> 8);
+      out[4 * i + 2] = (unsigned char)(flags >> 16);
+      out[4 * i + 3] = (unsigned char)(flags >> 24);
+    }
+  }
+  return buffer;
+}
+
+
+struct tsk4r_unalloc_walk {
+  TSK_FS_INFO * fs;
+  volatile int * cancel;
+  tsk4r_range_fn add;
+  void * ctx;
+  TSK_DADDR_T addr;
+  TSK_DADDR_T len;
+  int failed;
+};
+
+static int flush_unalloc_run(struct tsk4r_unalloc_walk * w) {
+  int err = 0;
+  if (w->len > 0) {
+    err = w->add(w->ctx, w->fs->offset + (TSK_OFF_T)(w->addr * w->fs->block_size), (TSK_OFF_T)(w->len * w->fs->block_size));
+  }
+  w->len = 0;
+  return err;
+}
+
+static TSK_WALK_RET_ENUM unalloc_run_callback(const TSK_FS_BLOCK * block, void * ptr) {
+  struct tsk4r_unalloc_walk * w = (struct tsk4r_unalloc_walk *)ptr;
+  if (*w->cancel) return TSK_WALK_STOP;
+  if (w->len > 0 && block->addr == w->addr + w->len) {
+    w->len++;
+    return TSK_WALK_CONT;
+  }
+  if (flush_unalloc_run(w) != 0) {
+    w->failed = 1;
+    return TSK_WALK_ERROR;
+  }
+  w->addr = block->addr;
+  w->len = 1;
+  return TSK_WALK_CONT;
+}
+
+// hands each run of unallocated blocks to add() as an image byte range;
+// runs without the GVL. Returns 0, 1 when tsk_fs_block_walk failed
+// (tsk_error_get() has why) or -1 when add() did.
+int tsk4r_unalloc_runs(TSK_FS_INFO * fs, volatile int * cancel, tsk4r_range_fn add, void * ctx) {
+  struct tsk4r_unalloc_walk w;
+  uint8_t failed;
+  memset(&w, 0, sizeof(w));
+  w.fs = fs; w.cancel = cancel; w.add = add; w.ctx = ctx;
+  failed = tsk4r_fs_block_walk(fs, fs->first_block, fs->last_block_act,
+                             TSK_FS_BLOCK_WALK_FLAG_UNALLOC | TSK_FS_BLOCK_WALK_FLAG_AONLY, unalloc_run_callback, &w);
+  if (w.failed) return -1;
+  if (failed) return *cancel ? 0 : 1;
+  return flush_unalloc_run(&w) != 0 ? -1 : 0;
+}
@@ -12,11 +12,21 @@
 #include <tsk3/libtsk.h>
 #include "tsk4r_i.h"
 
-extern struct TSK_FS_BLOCK fs_block;
+// block header copied from libtsk; the data lives in @buffer
+struct tsk4r_fs_block_wrapper {
+  TSK_FS_BLOCK block;
+  VALUE filesystem;
+};
+extern const rb_data_type_t tsk4r_fs_block_type;
 
 VALUE allocate_fs_block(VALUE self);
-void  deallocate_fs_block(TSK_FS_BLOCK * ptr);
+void  deallocate_fs_block(void * ptr);
 VALUE initialize_fs_block(int argc, VALUE *args, VALUE self);
 VALUE fetch_block(VALUE self, VALUE filesystem, VALUE address);
+VALUE read_fs_blocks(int argc, VALUE *args, VALUE self);
+
+// runs of unallocated blocks for the native scanners (match_blocks, carve, search)
+typedef int (*tsk4r_range_fn)(void * ctx, TSK_OFF_T offset, TSK_OFF_T length);
+int tsk4r_unalloc_runs(TSK_FS_INFO * fs, volatile int * cancel, tsk4r_range_fn add, void * ctx);
 
 #endif
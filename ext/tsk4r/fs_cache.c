@@ -0,0 +1,272 @@
+//
+//  fs_cache.c
+//  RubyTSK
+//
+//  per-filesystem identity cache of FileData objects
+//
+//  Opening an inum parses its metadata into a new TSK_FS_FILE, so repeat
+//  opens through FileSystem::System#open_file_by_inum, FileMeta.new(fs, inum)
+//  and Directory#file are served from here instead. Lookups go through an
+//  ObjectSpace::WeakMap, so any FileData still referenced elsewhere is found
+//  again; the `capacity` most recently used files are also held strongly,
+//  so a correlation pass that drops and reopens files doesn't re-parse
+//  them. Those sit in a hash table on a doubly linked LRU list, so a hit,
+//  a store and an eviction each take constant time. Entries are keyed by
+//  inum and the attribute the FileData reads (type and id), and only match
+//  when the sequence number matches too (NTFS reuses MFT entries), if the
+//  caller gave one. Every thread gets the same FileData for a key, so
+//  FileData serializes its own reads (fs_file.h).
+//
+
+#include <stdio.h>
+#include <ruby.h>
+#include <ruby/version.h>
+#include "file_system.h"
+#include "fs_file.h"
+#include "fs_cache.h"
+
+extern VALUE rb_cTSKFileSystemFileData;
+
+void tsk4r_file_cache_init(struct tsk4r_file_cache * cache) {
+  cache->weak = Qnil;
+  cache->nodes = NULL;
+  cache->buckets = NULL;
+  cache->bucket_count = 0;
+  cache->head = cache->tail = -1;
+  cache->capacity = TSK4R_FILE_CACHE_CAPACITY;
+  cache->held = 0;
+  cache->hits = cache->misses = cache->evictions = 0;
+}
+
+void tsk4r_file_cache_mark(struct tsk4r_file_cache * cache) {
+  long i;
+  tsk4r_gc_mark(cache->weak);
+  for (i = 0; i < cache->held; i++) tsk4r_gc_mark(cache->nodes[i].file);
+}
+
+void tsk4r_file_cache_compact(struct tsk4r_file_cache * cache) {
+  long i;
+  cache->weak = tsk4r_gc_location(cache->weak);
+  for (i = 0; i < cache->held; i++) cache->nodes[i].file = tsk4r_gc_location(cache->nodes[i].file);
+}
+
+void tsk4r_file_cache_free(struct tsk4r_file_cache * cache) {
+  if (cache->nodes != NULL) xfree(cache->nodes);
+  if (cache->buckets != NULL) xfree(cache->buckets);
+  cache->nodes = NULL;
+  cache->buckets = NULL;
+  cache->bucket_count = 0;
+  cache->head = cache->tail = -1;
+  cache->held = 0;
+}
+
+size_t tsk4r_file_cache_memsize(const struct tsk4r_file_cache * cache) {
+  if (cache->nodes == NULL) return 0;
+  return cache->capacity * sizeof(struct tsk4r_file_cache_node) + cache->bucket_count * sizeof(long);
+}
+
+static struct tsk4r_file_cache * file_cache(VALUE fs) {
+  struct tsk4r_fs_wrapper * fs_ptr;
+  TypedData_Get_Struct(fs, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  return &fs_ptr->cache;
+}
+
+// WeakMap takes Integer keys from ruby 2.7; older rubies only find held files
+#if RUBY_API_VERSION_MAJOR > 2 || (RUBY_API_VERSION_MAJOR == 2 && RUBY_API_VERSION_MINOR >= 7)
+#define TSK4R_WEAK_INUM_KEYS 1
+#endif
+
+static VALUE weak_map(struct tsk4r_file_cache * cache) {
+  if (NIL_P(cache->weak)) {
+#ifdef TSK4R_WEAK_INUM_KEYS
+    VALUE object_space = rb_const_get(rb_cObject, rb_intern("ObjectSpace"));
+    cache->weak = rb_class_new_instance(0, NULL, rb_const_get(object_space, rb_intern("WeakMap")));
+#else
+    cache->weak = Qfalse;
+#endif
+  }
+  return cache->weak;
+}
+
+// WeakMap keys are compared by identity, so the key has to be a Fixnum:
+// inum, then 16 bits of type and 17 of id + 1. Larger inums (and older
+// rubies) only find files still held strongly.
+static VALUE cache_key(TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id) {
+  if (inum >= ((TSK_INUM_T)1 << 29)) return Qnil;
+  return LL2NUM((long long)(((uint64_t)inum << 33) | ((uint64_t)(type & 0xffff) << 17) | (uint64_t)(id + 1)));
+}
+
+static int file_matches(VALUE file, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE seq) {
+  struct tsk4r_fs_file_wrapper * file_ptr;
+  if (! rb_obj_is_kind_of(file, rb_cTSKFileSystemFileData)) return 0;
+  TypedData_Get_Struct(file, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, file_ptr);
+  if (file_ptr->file == NULL || file_ptr->file->meta == NULL) return 0;
+  if (file_ptr->file->meta->addr != inum) return 0;
+  if (file_ptr->attr_type != type || file_ptr->attr_id != id) return 0;
+  return NIL_P(seq) || file_ptr->file->meta->seq == NUM2UINT(seq);
+}
+
+static long cache_bucket(const struct tsk4r_file_cache * cache, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id) {
+  uint64_t h = ((uint64_t)inum ^ ((uint64_t)(type & 0xffff) << 40) ^ ((uint64_t)(id + 1) << 56)) * 0x9e3779b97f4a7c15ULL;
+  return (long)((h >> 32) & (uint64_t)(cache->bucket_count - 1));
+}
+
+// the held node for (inum, type, id), or -1
+static long cache_find(const struct tsk4r_file_cache * cache, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id) {
+  long n;
+  if (cache->nodes == NULL) return -1;
+  for (n = cache->buckets[cache_bucket(cache, inum, type, id)]; n >= 0; n = cache->nodes[n].chain) {
+    const struct tsk4r_file_cache_node * node = &cache->nodes[n];
+    if (node->inum == inum && node->type == type && node->id == id) return n;
+  }
+  return -1;
+}
+
+static void lru_unlink(struct tsk4r_file_cache * cache, long n) {
+  struct tsk4r_file_cache_node * node = &cache->nodes[n];
+  if (node->prev >= 0) cache->nodes[node->prev].next = node->next; else cache->head = node->next;
+  if (node->next >= 0) cache->nodes[node->next].prev = node->prev; else cache->tail = node->prev;
+}
+
+static void lru_push_front(struct tsk4r_file_cache * cache, long n) {
+  struct tsk4r_file_cache_node * node = &cache->nodes[n];
+  node->prev = -1;
+  node->next = cache->head;
+  if (cache->head >= 0) cache->nodes[cache->head].prev = n; else cache->tail = n;
+  cache->head = n;
+}
+
+static void bucket_unlink(struct tsk4r_file_cache * cache, long n) {
+  const struct tsk4r_file_cache_node * node = &cache->nodes[n];
+  long * link = &cache->buckets[cache_bucket(cache, node->inum, node->type, node->id)];
+  while (*link != n) link = &cache->nodes[*link].chain;
+  *link = node->chain;
+}
+
+// holds file as the most recently used entry for (inum, type, id),
+// evicting the least recently used one when the cache is full
+static void cache_touch(struct tsk4r_file_cache * cache, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE file) {
+  struct tsk4r_file_cache_node * node;
+  long n, b;
+  if (cache->capacity <= 0) return;
+  if (cache->nodes == NULL) {
+    cache->bucket_count = 1;
+    while (cache->bucket_count < 2 * cache->capacity) cache->bucket_count <<= 1;
+    cache->buckets = ALLOC_N(long, cache->bucket_count);
+    for (b = 0; b < cache->bucket_count; b++) cache->buckets[b] = -1;
+    cache->nodes = ALLOC_N(struct tsk4r_file_cache_node, cache->capacity);
+  }
+  n = cache_find(cache, inum, type, id);
+  if (n >= 0) {
+    cache->nodes[n].file = file;
+    if (n != cache->head) {
+      lru_unlink(cache, n);
+      lru_push_front(cache, n);
+    }
+    return;
+  }
+  if (cache->held == cache->capacity) {
+    cache->evictions++;
+    n = cache->tail;
+    lru_unlink(cache, n);
+    bucket_unlink(cache, n);
+  } else {
+    n = cache->held++;
+  }
+  node = &cache->nodes[n];
+  node->file = file;
+  node->inum = inum;
+  node->type = type;
+  node->id = id;
+  b = cache_bucket(cache, inum, type, id);
+  node->chain = cache->buckets[b];
+  cache->buckets[b] = n;
+  lru_push_front(cache, n);
+}
+
+// returns the live FileData for (inum, type, id) (and seq, unless nil), or nil
+VALUE tsk4r_file_cache_fetch(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE seq) {
+  struct tsk4r_file_cache * cache = file_cache(fs);
+  VALUE weak = weak_map(cache);
+  VALUE key = cache_key(inum, type, id);
+  VALUE file = Qnil;
+  long n = cache_find(cache, inum, type, id);
+
+  if (n >= 0) {
+    file = cache->nodes[n].file;
+  } else if (RTEST(weak) && ! NIL_P(key)) {
+    file = rb_funcall(weak, rb_intern("[]"), 1, key);
+  }
+  if (! NIL_P(file) && file_matches(file, inum, type, id, seq)) {
+    cache->hits++;
+    cache_touch(cache, inum, type, id, file);
+    return file;
+  }
+  cache->misses++;
+  return Qnil;
+}
+
+void tsk4r_file_cache_store(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE file) {
+  struct tsk4r_file_cache * cache = file_cache(fs);
+  VALUE weak = weak_map(cache);
+  VALUE key = cache_key(inum, type, id);
+
+  cache_touch(cache, inum, type, id, file);
+  if (RTEST(weak) && ! NIL_P(key)) rb_funcall(weak, rb_intern("[]="), 2, key, file);
+}
+
+// fetch, or open and remember; nil when libtsk can't open the inum or
+// the file has no such attribute
+VALUE tsk4r_cached_file(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE seq) {
+  struct tsk4r_fs_file_wrapper * file_ptr;
+  VALUE opts = Qnil;
+  VALUE file = tsk4r_file_cache_fetch(fs, inum, type, id, seq);
+  if (! NIL_P(file)) return file;
+
+  if (type != TSK_FS_ATTR_TYPE_DEFAULT) {
+    opts = rb_hash_new();
+    rb_hash_aset(opts, ID2SYM(rb_intern("type")), INT2NUM((int)type));
+    if (id >= 0) rb_hash_aset(opts, ID2SYM(rb_intern("id")), INT2NUM(id));
+  }
+  file = rb_funcall(rb_cTSKFileSystemFileData, rb_intern("new"), 3, fs, ULL2NUM(inum), opts);
+  TypedData_Get_Struct(file, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, file_ptr);
+  if (file_ptr->file == NULL || file_ptr->file->meta == NULL) return Qnil;
+  if (type != TSK_FS_ATTR_TYPE_DEFAULT && tsk4r_fs_file_attr(file_ptr) == NULL) return Qnil;
+  if (! NIL_P(seq) && file_ptr->file->meta->seq != NUM2UINT(seq)) return Qnil;
+  tsk4r_file_cache_store(fs, inum, type, id, file);
+  return file;
+}
+
+// FileSystem::System#file_cache_stats
+VALUE get_file_cache_stats(VALUE self) {
+  struct tsk4r_file_cache * cache = file_cache(self);
+  VALUE stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("hits")), ULONG2NUM(cache->hits));
+  rb_hash_aset(stats, ID2SYM(rb_intern("misses")), ULONG2NUM(cache->misses));
+  rb_hash_aset(stats, ID2SYM(rb_intern("evictions")), ULONG2NUM(cache->evictions));
+  rb_hash_aset(stats, ID2SYM(rb_intern("held")), LONG2NUM(cache->held));
+  rb_hash_aset(stats, ID2SYM(rb_intern("capacity")), LONG2NUM(cache->capacity));
+  return stats;
+}
+
+VALUE get_file_cache_capacity(VALUE self) {
+  return LONG2NUM(file_cache(self)->capacity);
+}
+
+// resizing drops the strong references; live objects stay in the WeakMap
+VALUE set_file_cache_capacity(VALUE self, VALUE capacity) {
+  struct tsk4r_file_cache * cache = file_cache(self);
+  long n = NUM2LONG(capacity);
+  if (n < 0) rb_raise(rb_eArgError, "capacity must not be negative.");
+  tsk4r_file_cache_free(cache);
+  cache->capacity = n;
+  return capacity;
+}
+
+VALUE clear_file_cache(VALUE self) {
+  struct tsk4r_file_cache * cache = file_cache(self);
+  tsk4r_file_cache_free(cache);
+  cache->weak = Qnil;
+  cache->hits = cache->misses = cache->evictions = 0;
+  return self;
+}
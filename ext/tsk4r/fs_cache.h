@@ -0,0 +1,59 @@
+//
+//  fs_cache.h
+//  RubyTSK
+//
+//  per-filesystem identity cache of FileData objects
+//
+
+#ifndef RubyTSK_fs_cache_h
+#define RubyTSK_fs_cache_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_FILE_CACHE_CAPACITY 256
+
+// a strongly held FileData; nodes sit in one array and link to each
+// other by index, -1 ending a list
+struct tsk4r_file_cache_node {
+  VALUE file;
+  TSK_INUM_T inum;
+  TSK_FS_ATTR_TYPE_ENUM type;
+  int id;
+  long prev;          // more recently used
+  long next;          // less recently used
+  long chain;         // next node in the same bucket
+};
+
+// embedded in struct tsk4r_fs_wrapper
+struct tsk4r_file_cache {
+  VALUE weak;         // ObjectSpace::WeakMap, (inum, type, id) key => FileData
+  struct tsk4r_file_cache_node * nodes;   // capacity of them, once used
+  long * buckets;     // (inum, type, id) hash => first node, or -1
+  long bucket_count;  // a power of two, at least twice capacity
+  long head;          // most recently used node, or -1
+  long tail;          // least recently used node, or -1
+  long capacity;
+  long held;          // nodes[0, held) are in use
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+};
+
+void   tsk4r_file_cache_init(struct tsk4r_file_cache * cache);
+void   tsk4r_file_cache_mark(struct tsk4r_file_cache * cache);
+void   tsk4r_file_cache_compact(struct tsk4r_file_cache * cache);
+void   tsk4r_file_cache_free(struct tsk4r_file_cache * cache);
+size_t tsk4r_file_cache_memsize(const struct tsk4r_file_cache * cache);
+
+// type TSK_FS_ATTR_TYPE_DEFAULT is the default attribute; id -1 is any id
+VALUE tsk4r_file_cache_fetch(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE seq);
+void  tsk4r_file_cache_store(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE file);
+VALUE tsk4r_cached_file(VALUE fs, TSK_INUM_T inum, TSK_FS_ATTR_TYPE_ENUM type, int id, VALUE seq);
+
+VALUE get_file_cache_stats(VALUE self);
+VALUE get_file_cache_capacity(VALUE self);
+VALUE set_file_cache_capacity(VALUE self, VALUE capacity);
+VALUE clear_file_cache(VALUE self);
+
+#endif
@@ -0,0 +1,623 @@
+//
+//  fs_carve.c
+//  RubyTSK
+//
+//  FileSystem::System#carve: signature carving of unallocated space
+//
+//  tsk_fs_block_walk finds the runs of unallocated blocks; only those are
+//  read. The runs are cut into stripes that worker threads take in turn.
+//  A worker looks for headers in its own stripe only, but follows a file
+//  it found past the stripe end (to the end of the run), so files across
+//  a stripe boundary are carved once, by the stripe holding the header.
+//  The scan resumes after a carved file, and files found inside another
+//  (a thumbnail in a JPEG, a PNG stored in a ZIP) are dropped once all
+//  stripes are done, since they are part of the outer file.
+//
+//  Each type's end is taken from its structure where it has one (JPEG
+//  segments, PNG chunks, the ZIP end of central directory, the SQLite and
+//  EVTX headers); PDF ends at its first %%EOF. Candidates that don't parse
+//  are dropped rather than carved to a maximum size.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_block.h"
+#include "fs_carve.h"
+#include "batch.h"
+#include "stats.h"
+
+enum tsk4r_carve_kind {
+  TSK4R_CARVE_JPEG,
+  TSK4R_CARVE_PNG,
+  TSK4R_CARVE_PDF,
+  TSK4R_CARVE_ZIP,
+  TSK4R_CARVE_SQLITE,
+  TSK4R_CARVE_EVTX,
+  TSK4R_CARVE_KINDS
+};
+
+struct tsk4r_carve_reader;
+typedef TSK_OFF_T (*tsk4r_carve_end_fn)(struct tsk4r_carve_reader * rd, char * ext);
+
+struct tsk4r_carve_type {
+  const char * name;
+  const char * magic;
+  size_t magic_len;
+  TSK_OFF_T max_size;
+  tsk4r_carve_end_fn end;
+};
+
+// the longest magic, and so the overlap each stripe reads past its end
+#define TSK4R_CARVE_MAGIC_MAX 16
+
+struct tsk4r_carve_stripe {
+  TSK_OFF_T offset;
+  TSK_OFF_T length;   // header positions this stripe owns
+  TSK_OFF_T end;      // end of the unallocated run
+};
+
+struct tsk4r_carved {
+  TSK_OFF_T offset;
+  TSK_OFF_T length;
+  int kind;
+  char ext[8];
+};
+
+struct tsk4r_carve_job {
+  TSK_FS_INFO * fs;
+  TSK_IMG_INFO * img;
+  const char * output;
+  int kinds[TSK4R_CARVE_KINDS];
+  TSK_OFF_T max_size;   // 0: the per-type limits
+  int aligned;
+  int threads;
+  unsigned char first_bytes[256];
+
+  struct tsk4r_carve_stripe * stripes;
+  size_t stripe_count;
+  size_t stripe_alloc;
+  size_t next;
+  pthread_mutex_t lock;
+
+  struct tsk4r_carved * carved;
+  size_t carved_count;
+  size_t carved_alloc;
+
+  volatile int cancel;
+  const char * failed;
+  char error[256];
+};
+
+struct tsk4r_carve_reader {
+  struct tsk4r_carve_job * job;
+  TSK_OFF_T start;      // image offset of the candidate
+  TSK_OFF_T limit;      // bytes it may span
+  unsigned char * buf;
+  TSK_OFF_T buf_pos;    // window, relative to start
+  size_t buf_len;
+};
+
+static uint32_t be16(const unsigned char * p) { return ((uint32_t)p[0] << 8) | p[1]; }
+static uint32_t be32(const unsigned char * p) { return (be16(p) << 16) | be16(p + 2); }
+static uint32_t le16(const unsigned char * p) { return ((uint32_t)p[1] << 8) | p[0]; }
+static uint32_t le32(const unsigned char * p) { return (le16(p + 2) << 16) | le16(p); }
+
+// bytes [pos, pos + len) of the candidate, or NULL past its limit
+static const unsigned char * carve_peek(struct tsk4r_carve_reader * rd, TSK_OFF_T pos, size_t len) {
+  TSK_OFF_T want;
+  ssize_t got;
+  if (pos < 0 || len > TSK4R_CARVE_WINDOW || pos + (TSK_OFF_T)len > rd->limit) return NULL;
+  if (pos >= rd->buf_pos && pos + (TSK_OFF_T)len <= rd->buf_pos + (TSK_OFF_T)rd->buf_len) {
+    return rd->buf + (pos - rd->buf_pos);
+  }
+  want = rd->limit - pos < TSK4R_CARVE_WINDOW ? rd->limit - pos : TSK4R_CARVE_WINDOW;
+  got = tsk4r_img_read(rd->job->img, rd->start + pos, (char *)rd->buf, (size_t)want);
+  if (got < (ssize_t)len) {
+    tsk_error_reset();
+    rd->buf_len = 0;
+    return NULL;
+  }
+  rd->buf_pos = pos;
+  rd->buf_len = (size_t)got;
+  return rd->buf;
+}
+
+// memchr on the needle's first byte, then a compare
+static const unsigned char * find_bytes(const unsigned char * hay, size_t n, const char * needle, size_t m) {
+  const unsigned char * end = hay + n;
+  while ((size_t)(end - hay) >= m) {
+    const unsigned char * p = memchr(hay, (unsigned char)needle[0], (size_t)(end - hay) - m + 1);
+    if (p == NULL) return NULL;
+    if (memcmp(p, needle, m) == 0) return p;
+    hay = p + 1;
+  }
+  return NULL;
+}
+
+// first position >= from where needle starts, or -1
+static TSK_OFF_T carve_find(struct tsk4r_carve_reader * rd, TSK_OFF_T from, const char * needle, size_t m) {
+  while (from + (TSK_OFF_T)m <= rd->limit && ! rd->job->cancel) {
+    TSK_OFF_T chunk = rd->limit - from < TSK4R_CARVE_WINDOW ? rd->limit - from : TSK4R_CARVE_WINDOW;
+    const unsigned char * p = carve_peek(rd, from, (size_t)chunk);
+    const unsigned char * hit;
+    if (p == NULL) return -1;
+    hit = find_bytes(p, (size_t)chunk, needle, m);
+    if (hit != NULL) return from + (hit - p);
+    from += chunk - (TSK_OFF_T)m + 1;
+  }
+  return -1;
+}
+
+// JPEG: marker segments up to each SOS, entropy-coded data up to the next
+// marker that isn't a stuffed 0x00 or a restart, until EOI
+static TSK_OFF_T jpeg_end(struct tsk4r_carve_reader * rd, char * ext) {
+  TSK_OFF_T pos = 2;
+  int scans = 0;
+  for (;;) {
+    const unsigned char * p = carve_peek(rd, pos, 4);
+    unsigned int marker;
+    if (p == NULL || p[0] != 0xFF) return 0;
+    marker = p[1];
+    if (marker == 0xFF) { pos++; continue; }
+    if (marker == 0xD9) return scans ? pos + 2 : 0;
+    if (marker == 0x00 || marker == 0xD8) return 0;
+    if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) { pos += 2; continue; }
+    if (be16(p + 2) < 2) return 0;
+    pos += 2 + be16(p + 2);
+    if (marker != 0xDA) continue;
+    scans++;
+    for (;;) {
+      TSK_OFF_T at = carve_find(rd, pos, "\xFF", 1);
+      const unsigned char * q = at < 0 ? NULL : carve_peek(rd, at, 2);
+      if (q == NULL) return 0;
+      if (q[1] == 0x00 || q[1] == 0xFF || (q[1] >= 0xD0 && q[1] <= 0xD7)) {
+        pos = at + 1;
+        continue;
+      }
+      pos = at;
+      break;
+    }
+  }
+}
+
+// PNG: IHDR first, then chunks until IEND
+static TSK_OFF_T png_end(struct tsk4r_carve_reader * rd, char * ext) {
+  TSK_OFF_T pos = 8;
+  const unsigned char * p = carve_peek(rd, pos, 8);
+  if (p == NULL || be32(p) != 13 || memcmp(p + 4, "IHDR", 4) != 0) return 0;
+  for (;;) {
+    uint32_t len;
+    int i;
+    p = carve_peek(rd, pos, 8);
+    if (p == NULL) return 0;
+    len = be32(p);
+    if (len > 0x7fffffff) return 0;
+    for (i = 4; i < 8; i++) {
+      if (! ((p[i] >= 'A' && p[i] <= 'Z') || (p[i] >= 'a' && p[i] <= 'z'))) return 0;
+    }
+    if (memcmp(p + 4, "IEND", 4) == 0) return pos + 12 + len;
+    pos += 12 + (TSK_OFF_T)len;
+  }
+}
+
+// PDF: the first %%EOF and its end of line; incremental updates past it
+// are lost
+static TSK_OFF_T pdf_end(struct tsk4r_carve_reader * rd, char * ext) {
+  const unsigned char * p = carve_peek(rd, 5, 3);
+  TSK_OFF_T at, end;
+  int i;
+  if (p == NULL || p[0] < '1' || p[0] > '2' || p[1] != '.') return 0;
+  at = carve_find(rd, 8, "%%EOF", 5);
+  if (at < 0) return 0;
+  end = at + 5;
+  for (i = 0; i < 2; i++) {
+    p = carve_peek(rd, end, 1);
+    if (p == NULL || (p[0] != '\r' && p[0] != '\n')) break;
+    end++;
+  }
+  return end;
+}
+
+// ZIP: the end of central directory record whose directory ends right
+// before it; OOXML packages are told apart by their part names
+static TSK_OFF_T zip_end(struct tsk4r_carve_reader * rd, char * ext) {
+  TSK_OFF_T at = 30;
+  for (;;) {
+    const unsigned char * p;
+    uint32_t cd_size, cd_off;
+    TSK_OFF_T end;
+    at = carve_find(rd, at, "PK\005\006", 4);
+    if (at < 0) return 0;
+    p = carve_peek(rd, at, 22);
+    if (p == NULL) return 0;
+    cd_size = le32(p + 12);
+    cd_off = le32(p + 16);
+    end = at + 22 + le16(p + 20);
+    if ((TSK_OFF_T)cd_off + cd_size != at || end > rd->limit) {
+      at++;
+      continue;
+    }
+    p = carve_peek(rd, cd_off, cd_size < TSK4R_CARVE_WINDOW ? cd_size : TSK4R_CARVE_WINDOW);
+    if (p != NULL) {
+      size_t n = cd_size < TSK4R_CARVE_WINDOW ? cd_size : TSK4R_CARVE_WINDOW;
+      if (find_bytes(p, n, "word/", 5)) strcpy(ext, "docx");
+      else if (find_bytes(p, n, "xl/", 3)) strcpy(ext, "xlsx");
+      else if (find_bytes(p, n, "ppt/", 4)) strcpy(ext, "pptx");
+    }
+    return end;
+  }
+}
+
+// SQLite: page size * page count from the header, when the count is valid
+static TSK_OFF_T sqlite_end(struct tsk4r_carve_reader * rd, char * ext) {
+  const unsigned char * p = carve_peek(rd, 0, 100);
+  uint32_t page_size, pages;
+  if (p == NULL) return 0;
+  page_size = be16(p + 16);
+  if (page_size == 1) page_size = 65536;
+  if (page_size < 512 || (page_size & (page_size - 1)) != 0) return 0;
+  pages = be32(p + 28);
+  if (pages == 0 || be32(p + 24) != be32(p + 92)) return 0;
+  return (TSK_OFF_T)page_size * pages;
+}
+
+// EVTX: a 4 KiB file header followed by 64 KiB chunks
+static TSK_OFF_T evtx_end(struct tsk4r_carve_reader * rd, char * ext) {
+  const unsigned char * p = carve_peek(rd, 0, 128);
+  uint32_t chunks;
+  if (p == NULL || le32(p + 32) != 128 || le16(p + 40) != 4096) return 0;
+  chunks = le16(p + 42);
+  if (chunks == 0) return 0;
+  p = carve_peek(rd, 4096, 8);
+  if (p == NULL || memcmp(p, "ElfChnk\0", 8) != 0) return 0;
+  return 4096 + (TSK_OFF_T)chunks * 65536;
+}
+
+static const struct tsk4r_carve_type TSK4R_CARVE_TYPES[TSK4R_CARVE_KINDS] = {
+  { "jpeg",   "\xFF\xD8\xFF",           3, 32LL * 1024 * 1024,  jpeg_end },
+  { "png",    "\x89PNG\r\n\x1A\n",      8, 64LL * 1024 * 1024,  png_end },
+  { "pdf",    "%PDF-",                  5, TSK4R_CARVE_MAX_SIZE, pdf_end },
+  { "zip",    "PK\003\004",             4, TSK4R_CARVE_MAX_SIZE, zip_end },
+  { "sqlite", "SQLite format 3\0",     16, TSK4R_CARVE_MAX_SIZE, sqlite_end },
+  { "evtx",   "ElfFile\0",              8, 128LL * 1024 * 1024, evtx_end }
+};
+
+static const char * TSK4R_CARVE_EXTS[TSK4R_CARVE_KINDS] = { "jpg", "png", "pdf", "zip", "sqlite", "evtx" };
+
+static void carve_fail(struct tsk4r_carve_job * job, const char * function, const char * error) {
+  pthread_mutex_lock(&job->lock);
+  if (job->failed == NULL) {
+    job->failed = function;
+    snprintf(job->error, sizeof(job->error), "%s", error);
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+static void carved_path(const struct tsk4r_carve_job * job, const struct tsk4r_carved * c, char * path, size_t len) {
+  snprintf(path, len, "%s/%012llx.%s", job->output, (unsigned long long)c->offset, c->ext);
+}
+
+// copies the carved bytes out of the image through the reader's window
+static int write_carved(struct tsk4r_carve_reader * rd, const struct tsk4r_carved * c) {
+  char path[4096];
+  TSK_OFF_T pos = 0;
+  FILE * out;
+  carved_path(rd->job, c, path, sizeof(path));
+  out = fopen(path, "wb");
+  if (out == NULL) {
+    carve_fail(rd->job, "fopen", strerror(errno));
+    return -1;
+  }
+  while (pos < c->length) {
+    size_t chunk = (size_t)(c->length - pos < TSK4R_CARVE_WINDOW ? c->length - pos : TSK4R_CARVE_WINDOW);
+    const unsigned char * p = carve_peek(rd, pos, chunk);
+    if (p == NULL) {
+      carve_fail(rd->job, "tsk_img_read", "read failed while copying a carved file");
+      break;
+    }
+    if (fwrite(p, 1, chunk, out) != chunk) {
+      carve_fail(rd->job, "fwrite", strerror(errno));
+      break;
+    }
+    pos += (TSK_OFF_T)chunk;
+  }
+  if (fclose(out) != 0 && pos >= c->length) {
+    carve_fail(rd->job, "fclose", strerror(errno));
+    return -1;
+  }
+  return pos < c->length ? -1 : 0;
+}
+
+static int push_carved(struct tsk4r_carve_job * job, const struct tsk4r_carved * c) {
+  int err = 0;
+  pthread_mutex_lock(&job->lock);
+  if (job->carved_count == job->carved_alloc) {
+    size_t grow = job->carved_alloc ? job->carved_alloc * 2 : 64;
+    struct tsk4r_carved * more = realloc(job->carved, grow * sizeof(struct tsk4r_carved));
+    if (more == NULL) {
+      err = -1;
+    } else {
+      job->carved = more;
+      job->carved_alloc = grow;
+    }
+  }
+  if (! err) job->carved[job->carved_count++] = *c;
+  pthread_mutex_unlock(&job->lock);
+  if (err) carve_fail(job, "carve", "out of memory");
+  return err;
+}
+
+// tries every requested type whose magic is at image offset `at`; returns
+// the length carved there, 0 for nothing, -1 on failure
+static TSK_OFF_T carve_at(struct tsk4r_carve_job * job, struct tsk4r_carve_reader * rd, const unsigned char * p,
+                          size_t avail, TSK_OFF_T at, TSK_OFF_T end) {
+  int k;
+  for (k = 0; k < TSK4R_CARVE_KINDS; k++) {
+    const struct tsk4r_carve_type * t = &TSK4R_CARVE_TYPES[k];
+    struct tsk4r_carved c;
+    TSK_OFF_T max = job->max_size ? job->max_size : t->max_size;
+    if (! job->kinds[k] || avail < t->magic_len || memcmp(p, t->magic, t->magic_len) != 0) continue;
+    rd->start = at;
+    rd->limit = end - at < max ? end - at : max;
+    rd->buf_pos = 0;
+    rd->buf_len = 0;
+    memset(&c, 0, sizeof(c));
+    strcpy(c.ext, TSK4R_CARVE_EXTS[k]);
+    c.length = t->end(rd, c.ext);
+    if (c.length <= 0 || c.length > rd->limit) continue;
+    c.offset = at;
+    c.kind = k;
+    if (write_carved(rd, &c) != 0 || push_carved(job, &c) != 0) return -1;
+    return c.length;
+  }
+  return 0;
+}
+
+static int carve_stripe(struct tsk4r_carve_job * job, const struct tsk4r_carve_stripe * s,
+                        unsigned char * buf, struct tsk4r_carve_reader * rd) {
+  TSK_OFF_T want = s->length + TSK4R_CARVE_MAGIC_MAX - 1, pos;
+  unsigned int step = job->aligned ? job->fs->block_size : 1;
+  ssize_t got;
+
+  if (s->offset + want > s->end) want = s->end - s->offset;
+  got = tsk4r_img_read(job->img, s->offset, (char *)buf, (size_t)want);
+  if (got < 0) {
+    carve_fail(job, "tsk_img_read", tsk_error_get());
+    tsk_error_reset();
+    return -1;
+  }
+  pos = 0;
+  while (pos < s->length && pos < got && ! job->cancel) {
+    TSK_OFF_T carved;
+    if (! job->aligned) {
+      // prefilter: skip to the next byte any requested magic starts with
+      while (pos < s->length && pos < got && ! job->first_bytes[buf[pos]]) pos++;
+      if (pos >= s->length || pos >= got) break;
+    } else if (! job->first_bytes[buf[pos]]) {
+      pos += step;
+      continue;
+    }
+    carved = carve_at(job, rd, buf + pos, (size_t)(got - pos), s->offset + pos, s->end);
+    if (carved < 0) return -1;
+    // don't look for headers inside what was just carved
+    pos += carved > 0 ? (carved + step - 1) / step * step : step;
+  }
+  return 0;
+}
+
+static void * carve_worker(void * ptr) {
+  struct tsk4r_carve_job * job = (struct tsk4r_carve_job *)ptr;
+  unsigned char * buf = malloc(TSK4R_CARVE_STRIPE + TSK4R_CARVE_MAGIC_MAX);
+  struct tsk4r_carve_reader rd;
+
+  memset(&rd, 0, sizeof(rd));
+  rd.job = job;
+  rd.buf = malloc(TSK4R_CARVE_WINDOW);
+  if (buf == NULL || rd.buf == NULL) {
+    carve_fail(job, "carve", "out of memory");
+  } else {
+    for (;;) {
+      size_t i;
+      pthread_mutex_lock(&job->lock);
+      i = job->next++;
+      pthread_mutex_unlock(&job->lock);
+      if (i >= job->stripe_count || job->cancel || job->failed) break;
+      if (carve_stripe(job, &job->stripes[i], buf, &rd) != 0) break;
+    }
+  }
+  free(rd.buf);
+  free(buf);
+  return NULL;
+}
+
+static int add_stripes(void * ptr, TSK_OFF_T offset, TSK_OFF_T length) {
+  struct tsk4r_carve_job * job = (struct tsk4r_carve_job *)ptr;
+  TSK_OFF_T end = offset + length, at;
+  for (at = offset; at < end; at += TSK4R_CARVE_STRIPE) {
+    struct tsk4r_carve_stripe * s;
+    if (job->stripe_count == job->stripe_alloc) {
+      size_t grow = job->stripe_alloc ? job->stripe_alloc * 2 : 256;
+      struct tsk4r_carve_stripe * more = realloc(job->stripes, grow * sizeof(struct tsk4r_carve_stripe));
+      if (more == NULL) return -1;
+      job->stripes = more;
+      job->stripe_alloc = grow;
+    }
+    s = &job->stripes[job->stripe_count++];
+    s->offset = at;
+    s->length = end - at < TSK4R_CARVE_STRIPE ? end - at : TSK4R_CARVE_STRIPE;
+    s->end = end;
+  }
+  return 0;
+}
+
+static int compare_carved(const void * a, const void * b) {
+  const struct tsk4r_carved * x = a; const struct tsk4r_carved * y = b;
+  if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+  return x->kind - y->kind;
+}
+
+// after sorting: drops (and deletes) files that lie inside an earlier one,
+// found by a stripe that started past the outer file's header
+static void drop_nested(struct tsk4r_carve_job * job) {
+  char path[4096];
+  TSK_OFF_T covered = 0;
+  size_t i, kept = 0;
+  for (i = 0; i < job->carved_count; i++) {
+    const struct tsk4r_carved * c = &job->carved[i];
+    if (kept > 0 && c->offset < covered) {
+      carved_path(job, c, path, sizeof(path));
+      unlink(path);
+      continue;
+    }
+    covered = c->offset + c->length;
+    job->carved[kept++] = *c;
+  }
+  job->carved_count = kept;
+}
+
+static void write_manifest(struct tsk4r_carve_job * job) {
+  char path[4096];
+  FILE * out;
+  size_t i;
+  snprintf(path, sizeof(path), "%s/manifest.csv", job->output);
+  out = fopen(path, "w");
+  if (out == NULL) {
+    carve_fail(job, "fopen", strerror(errno));
+    return;
+  }
+  fprintf(out, "offset,length,type,file\n");
+  for (i = 0; i < job->carved_count; i++) {
+    const struct tsk4r_carved * c = &job->carved[i];
+    fprintf(out, "%lld,%lld,%s,%012llx.%s\n", (long long)c->offset, (long long)c->length,
+            TSK4R_CARVE_TYPES[c->kind].name, (unsigned long long)c->offset, c->ext);
+  }
+  if (fclose(out) != 0) carve_fail(job, "fclose", strerror(errno));
+}
+
+static void * run_carve(void * ptr) {
+  struct tsk4r_carve_job * job = (struct tsk4r_carve_job *)ptr;
+  pthread_t * workers;
+  int started = 0, t;
+  int failed = tsk4r_unalloc_runs(job->fs, &job->cancel, add_stripes, job);
+
+  if (job->cancel) return NULL;
+  if (failed) {
+    carve_fail(job, "tsk_fs_block_walk", failed > 0 ? tsk_error_get() : "out of memory");
+    return NULL;
+  }
+
+  workers = malloc((size_t)job->threads * sizeof(pthread_t));
+  if (workers != NULL) {
+    for (t = 0; t < job->threads; t++) {
+      if (pthread_create(&workers[t], NULL, carve_worker, job) != 0) break;
+      started++;
+    }
+  }
+  if (started == 0) carve_worker(job);
+  for (t = 0; t < started; t++) pthread_join(workers[t], NULL);
+  free(workers);
+
+  if (job->cancel || job->failed) return NULL;
+  qsort(job->carved, job->carved_count, sizeof(struct tsk4r_carved), compare_carved);
+  drop_nested(job);
+  write_manifest(job);
+  return NULL;
+}
+
+static void cancel_carve(void * ptr) {
+  ((struct tsk4r_carve_job *)ptr)->cancel = 1;
+}
+
+static VALUE carve_result(VALUE arg) {
+  struct tsk4r_carve_job * job = (struct tsk4r_carve_job *)arg;
+  VALUE result;
+  char path[4096];
+  size_t i;
+
+  tsk4r_call_interruptible(run_carve, cancel_carve, job);
+  if (job->failed) rb_raise(rb_eRuntimeError, "TSK function: %s exited with an error. (%s)", job->failed, job->error);
+
+  result = rb_ary_new2((long)job->carved_count);
+  for (i = 0; i < job->carved_count; i++) {
+    const struct tsk4r_carved * c = &job->carved[i];
+    carved_path(job, c, path, sizeof(path));
+    rb_ary_push(result, rb_ary_new3(4, LL2NUM(c->offset), LL2NUM(c->length),
+                                    ID2SYM(rb_intern(TSK4R_CARVE_TYPES[c->kind].name)), rb_str_new2(path)));
+  }
+  return result;
+}
+
+static VALUE release_carve(VALUE arg) {
+  struct tsk4r_carve_job * job = (struct tsk4r_carve_job *)arg;
+  free(job->stripes);
+  free(job->carved);
+  pthread_mutex_destroy(&job->lock);
+  return Qnil;
+}
+
+// FileSystem::System#carve(opts)
+// opts: :output => directory for the carved files (required; created if
+//       missing), :types => [:jpeg, :png, :pdf, :zip, :sqlite, :evtx],
+//       :threads => 4, :aligned => true (headers only at block starts;
+//       false scans every byte), :max_size => per-type limit in bytes
+// writes <image offset in hex>.<ext> files and manifest.csv to :output and
+// returns [image offset, length, type, path] for each, ordered by offset
+VALUE carve_filesystem(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE output; VALUE types; VALUE max_size; VALUE result;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_carve_job job;
+  long i; int k;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  output = tsk4r_opt(opts, "output", Qnil);
+  if (NIL_P(output)) rb_raise(rb_eArgError, "carve needs an :output directory");
+  output = rb_str_dup(rb_String(output));
+
+  MEMZERO(&job, struct tsk4r_carve_job, 1);
+  types = tsk4r_opt(opts, "types", Qnil);
+  if (NIL_P(types)) {
+    for (k = 0; k < TSK4R_CARVE_KINDS; k++) job.kinds[k] = 1;
+  } else {
+    types = rb_Array(types);
+    for (i = 0; i < RARRAY_LEN(types); i++) {
+      VALUE type = rb_ary_entry(types, i);
+      int kind = -1;
+      if (SYMBOL_P(type)) {
+        for (k = 0; k < TSK4R_CARVE_KINDS; k++) {
+          if (strcmp(rb_id2name(SYM2ID(type)), TSK4R_CARVE_TYPES[k].name) == 0) kind = k;
+        }
+      }
+      if (kind < 0) rb_raise(rb_eArgError, "unknown carve type: %s", RSTRING_PTR(rb_inspect(type)));
+      job.kinds[kind] = 1;
+    }
+  }
+  for (k = 0; k < TSK4R_CARVE_KINDS; k++) {
+    if (job.kinds[k]) job.first_bytes[(unsigned char)TSK4R_CARVE_TYPES[k].magic[0]] = 1;
+  }
+
+  job.fs = fs_ptr->filesystem;
+  job.img = job.fs->img_info;
+  job.output = StringValueCStr(output);
+  job.aligned = RTEST(tsk4r_opt(opts, "aligned", Qtrue));
+  max_size = tsk4r_opt(opts, "max_size", Qnil);
+  job.max_size = NIL_P(max_size) ? 0 : (TSK_OFF_T)NUM2LL(max_size);
+  job.threads = NUM2INT(tsk4r_opt(opts, "threads", INT2FIX(TSK4R_CARVE_THREADS)));
+  if (job.threads < 1) job.threads = 1;
+  // only once every option is known to be good
+  if (mkdir(job.output, 0777) != 0 && errno != EEXIST) rb_sys_fail(job.output);
+  pthread_mutex_init(&job.lock, NULL);
+
+  result = rb_ensure(carve_result, (VALUE)&job, release_carve, (VALUE)&job);
+  RB_GC_GUARD(output);
+  return result;
+}
@@ -0,0 +1,23 @@
+//
+//  fs_carve.h
+//  RubyTSK
+//
+//  FileSystem::System#carve: signature carving of unallocated space
+//
+
+#ifndef RubyTSK_fs_carve_h
+#define RubyTSK_fs_carve_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_CARVE_THREADS 4
+// bytes of unallocated space each worker scans for headers per turn
+#define TSK4R_CARVE_STRIPE (4 * 1024 * 1024)
+// read window while following a file's structure or copying it out
+#define TSK4R_CARVE_WINDOW (1024 * 1024)
+#define TSK4R_CARVE_MAX_SIZE (256LL * 1024 * 1024)
+
+VALUE carve_filesystem(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -22,9 +22,16 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
 #include <ruby.h>
+#include <ruby/re.h>
 #include "file_system.h"
 #include "fs_dir.h"
+#include "batch.h"
+#include "memsize.h"
+#include "stats.h"
 
 
 extern VALUE rb_cTSKImage;
@@ -37,16 +44,47 @@ extern VALUE rb_cTSKFileSystemFileData;
 extern void klassify();
 
 
+static void mark_fs_dir(void * ptr);
+static void compact_fs_dir(void * ptr);
+static size_t fs_dir_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_fs_dir_type = {
+  "Sleuthkit::FileSystem::Directory",
+  TSK4R_DATA_FUNCTIONS(mark_fs_dir, deallocate_fs_dir, fs_dir_memsize, compact_fs_dir),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 // creation functions
 VALUE allocate_fs_dir(VALUE klass){
   struct tsk4r_fs_dir_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_fs_dir_wrapper, 0, deallocate_fs_dir, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, ptr);
+  ptr->parent = Qnil;
+  return obj;
+}
+
+static void close_dir_handle(void * handle){
+  tsk_fs_dir_close((TSK_FS_DIR *)handle);
+}
+
+void deallocate_fs_dir(void * ptr){
+  struct tsk4r_fs_dir_wrapper * wrapper = ptr;
+  tsk4r_owner_release(wrapper->owner);
+  xfree(wrapper);
+}
+
+static void mark_fs_dir(void * ptr){
+  tsk4r_gc_mark(((struct tsk4r_fs_dir_wrapper *)ptr)->parent);
+}
+
+static void compact_fs_dir(void * ptr){
+  struct tsk4r_fs_dir_wrapper * wrapper = ptr;
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
 }
 
-void deallocate_fs_dir(struct tsk4r_fs_dir_wrapper * ptr){
-  TSK_FS_DIR *directory = ptr->directory;
-  tsk_fs_dir_close(directory);
-  xfree(ptr);
+// name array, name strings and the directory's own TSK_FS_FILE
+static size_t fs_dir_memsize(const void * ptr){
+  const struct tsk4r_fs_dir_wrapper * wrapper = ptr;
+  return sizeof(*wrapper) + tsk4r_fs_dir_memsize(wrapper->directory);
 }
 
 VALUE initialize_fs_dir(int argc, VALUE *args, VALUE self){
@@ -78,45 +116,331 @@ VALUE initialize_fs_dir(int argc, VALUE *args, VALUE self){
 VALUE open_fs_directory(VALUE self, VALUE source_obj, VALUE reference, VALUE opts) {
   struct tsk4r_fs_dir_wrapper * dir_ptr;
   struct tsk4r_fs_wrapper * fs_ptr;
-  Data_Get_Struct(self, struct tsk4r_fs_dir_wrapper, dir_ptr);
-  Data_Get_Struct(source_obj, struct tsk4r_fs_wrapper, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, dir_ptr);
+  TypedData_Get_Struct(source_obj, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
   klassify(self, "self");
   klassify(source_obj, "source_obj");
   klassify(reference, "reference");
 
   
   if (rb_obj_is_kind_of(reference, rb_cString)) {
-    dir_ptr->directory = tsk_fs_dir_open(fs_ptr->filesystem, StringValuePtr(reference));
+    dir_ptr->directory = tsk4r_fs_dir_open(fs_ptr->filesystem, StringValuePtr(reference));
     if (dir_ptr->directory == NULL) {
       printf("opened dir, got NULL, returning to init.\n");
     }
   }
   else if (rb_obj_is_kind_of(reference, rb_cFixnum)) {
     TSK_INUM_T addr = (TSK_INUM_T)FIX2ULONG(reference);
-    dir_ptr->directory = tsk_fs_dir_open_meta(fs_ptr->filesystem, addr);
+    dir_ptr->directory = tsk4r_fs_dir_open_meta(fs_ptr->filesystem, addr);
     if (dir_ptr->directory == NULL) printf("opened dir, got NULL, returning to init.\n");
   } else {
       rb_warn("arg2 is not a String or Fixnum!");
   }
   // populate object attributes
   if (dir_ptr->directory != NULL) {
+    dir_ptr->parent = source_obj;
+    dir_ptr->owner = tsk4r_owner_new(dir_ptr->directory, close_dir_handle, fs_ptr->owner);
     rb_iv_set(self, "@inum", LONG2FIX(dir_ptr->directory->addr));
     rb_iv_set(self, "@names_used", LONG2FIX(dir_ptr->directory->names_used));
     rb_iv_set(self, "@names_alloc", LONG2FIX(dir_ptr->directory->names_alloc));
-    
-    VALUE names = rb_ary_new2(dir_ptr->directory->names_used);
-    TSK_FS_NAME * names_list = dir_ptr->directory->names;
-    int c;
-    for (c=0; c < dir_ptr->directory->names_used; c++) {
-      char * n_str = names_list[c].name;
-      rb_ary_push(names, rb_str_new2(n_str));
-    }
-    rb_iv_set(self, "@names", names);
+    // @names is built on first call to #names; see also #each_entry
     
     // build a new file object for the directory
     // FileData#new(fs, dir)
     VALUE directory_file = rb_funcall(rb_cTSKFileSystemFileData, rb_intern("new"), 2, source_obj, self);
     rb_iv_set(self, "@file", directory_file);
+    tsk4r_file_cache_store(source_obj, dir_ptr->directory->addr, TSK_FS_ATTR_TYPE_DEFAULT, -1, directory_file);
+  }
+  return self;
+}
+
+// Directory#names: every name in the TSK_FS_DIR (dots and deleted entries
+// included), built once on first call
+VALUE get_fs_dir_names(VALUE self) {
+  struct tsk4r_fs_dir_wrapper * dir_ptr;
+  VALUE names = rb_iv_get(self, "@names");
+  size_t c;
+  if (! NIL_P(names)) return names;
+
+  TypedData_Get_Struct(self, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, dir_ptr);
+  if (dir_ptr->directory == NULL) return Qnil;
+  names = rb_ary_new2(dir_ptr->directory->names_used);
+  for (c = 0; c < dir_ptr->directory->names_used; c++) {
+    rb_ary_push(names, rb_str_new2(dir_ptr->directory->names[c].name));
+  }
+  rb_iv_set(self, "@names", names);
+  return names;
+}
+
+// Directory#each_entry
+
+static const char * TSK4R_NAME_TYPES[] = {
+  "undef", "fifo", "chr", "dir", "blk", "reg", "lnk", "sock", "shad", "wht", "virt"
+};
+#define TSK4R_NAME_TYPE_COUNT (sizeof(TSK4R_NAME_TYPES) / sizeof(TSK4R_NAME_TYPES[0]))
+
+struct tsk4r_dir_filter {
+  int allocated;          // 1 allocated only, 0 unallocated only, -1 both
+  unsigned long types;    // bit per TSK_FS_NAME_TYPE_ENUM; 0 = any
+  int dots;
+  const char * glob;
+  VALUE regexp;           // matched on the name's bytes in place, with no String or MatchData
+};
+
+struct tsk4r_dir_sort_key {
+  size_t idx;
+  const TSK_FS_NAME * name;
+};
+
+static unsigned long name_type_bit(VALUE type) {
+  size_t i; int n;
+  if (SYMBOL_P(type)) {
+    const char * wanted = rb_id2name(SYM2ID(type));
+    for (i = 0; i < TSK4R_NAME_TYPE_COUNT; i++) {
+      if (strcmp(wanted, TSK4R_NAME_TYPES[i]) == 0) return 1UL << i;
+    }
+    rb_raise(rb_eArgError, "unknown name type :%s", wanted);
+  }
+  n = NUM2INT(type);
+  if (n < 0 || (size_t)n >= TSK4R_NAME_TYPE_COUNT) {
+    rb_raise(rb_eArgError, "name type %d out of range (0...%d)", n, (int)TSK4R_NAME_TYPE_COUNT);
+  }
+  return 1UL << n;
+}
+
+static void parse_dir_filter(VALUE filter, struct tsk4r_dir_filter * f) {
+  VALUE allocated, type, name;
+  f->allocated = -1; f->types = 0; f->dots = 0; f->glob = NULL; f->regexp = Qnil;
+  if (NIL_P(filter)) return;
+  Check_Type(filter, T_HASH);
+
+  allocated = tsk4r_opt(filter, "allocated", Qnil);
+  if (! NIL_P(allocated)) f->allocated = RTEST(allocated) ? 1 : 0;
+  type = tsk4r_opt(filter, "type", Qnil);
+  if (RB_TYPE_P(type, T_ARRAY)) {
+    long i;
+    for (i = 0; i < RARRAY_LEN(type); i++) f->types |= name_type_bit(rb_ary_entry(type, i));
+  } else if (! NIL_P(type)) {
+    f->types = name_type_bit(type);
+  }
+  f->dots = RTEST(tsk4r_opt(filter, "dots", Qfalse));
+  name = tsk4r_opt(filter, "name", Qnil);
+  if (RB_TYPE_P(name, T_STRING)) {
+    f->glob = StringValueCStr(name);
+  } else if (RB_TYPE_P(name, T_REGEXP)) {
+    f->regexp = name;
+  }
+}
+
+static int dir_entry_matches(const TSK_FS_NAME * n, const struct tsk4r_dir_filter * f) {
+  if (n->name == NULL) return 0;
+  if (! f->dots && TSK_FS_ISDOT(n->name)) return 0;
+  if (f->allocated == 1 && ! (n->flags & TSK_FS_NAME_FLAG_ALLOC)) return 0;
+  if (f->allocated == 0 && ! (n->flags & TSK_FS_NAME_FLAG_UNALLOC)) return 0;
+  if (f->types && ((unsigned)n->type >= sizeof(unsigned long) * 8 || ! (f->types & (1UL << n->type)))) return 0;
+  if (f->glob != NULL && fnmatch(f->glob, n->name, 0) != 0) return 0;
+  if (! NIL_P(f->regexp)) {
+    // read the compiled pattern each time: Ruby may recompile it for
+    // another encoding between entries
+    const OnigUChar * start = (const OnigUChar *)n->name;
+    const OnigUChar * end = start + strlen(n->name);
+    if (onig_search(RREGEXP(f->regexp)->ptr, start, end, start, end, NULL, ONIG_OPTION_NONE) < 0) return 0;
+  }
+  return 1;
+}
+
+// ties fall back to the on-disk position, so pages stay stable
+static int compare_by_name(const void * a, const void * b) {
+  const struct tsk4r_dir_sort_key * x = a; const struct tsk4r_dir_sort_key * y = b;
+  int c = strcmp(x->name->name, y->name->name);
+  if (c != 0) return c;
+  return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static int compare_by_inum(const void * a, const void * b) {
+  const struct tsk4r_dir_sort_key * x = a; const struct tsk4r_dir_sort_key * y = b;
+  if (x->name->meta_addr != y->name->meta_addr) return x->name->meta_addr < y->name->meta_addr ? -1 : 1;
+  return (x->idx > y->idx) - (x->idx < y->idx);
+}
+
+static VALUE dir_entry_class(void) {
+  return rb_const_get(rb_cTSKFileSystemDir, rb_intern("Entry"));
+}
+
+static VALUE build_dir_entry(VALUE klass, size_t idx, const TSK_FS_NAME * n) {
+  return rb_struct_new(klass, ULONG2NUM(idx), ULL2NUM(n->meta_addr), UINT2NUM(n->meta_seq),
+                       rb_str_new2(n->name), INT2NUM(n->type), INT2NUM(n->flags), ULL2NUM(n->par_addr));
+}
+
+struct tsk4r_dir_sorted {
+  struct tsk4r_dir_sort_key * keys;
+  size_t count;
+  long offset;
+  long limit;
+};
+
+static VALUE yield_sorted_entries(VALUE arg) {
+  struct tsk4r_dir_sorted * s = (struct tsk4r_dir_sorted *)arg;
+  VALUE klass = dir_entry_class();
+  size_t i = (size_t)s->offset;
+  long yielded = 0;
+  for (; i < s->count && (s->limit < 0 || yielded < s->limit); i++, yielded++) {
+    rb_yield(build_dir_entry(klass, s->keys[i].idx, s->keys[i].name));
+  }
+  return Qnil;
+}
+
+static VALUE free_sorted_entries(VALUE arg) {
+  struct tsk4r_dir_sorted * s = (struct tsk4r_dir_sorted *)arg;
+  xfree(s->keys);
+  return Qnil;
+}
+
+// Directory#each_entry(opts = {}) { |entry| ... }
+// opts: :filter => { :allocated => true/false/nil, :type => :reg / [:reg, :dir] / Integer,
+//                    :name => "*.eml" (fnmatch glob) or Regexp, :dots => false },
+//       :offset => 0, :limit => nil, :sort => nil (on-disk order), :name or :inum
+// yields Directory::Entry structs; offset and limit count matching entries, so
+// the same opts always return the same page. Without :sort nothing is buffered.
+VALUE each_fs_dir_entry(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE sort; VALUE limit;
+  struct tsk4r_fs_dir_wrapper * dir_ptr;
+  struct tsk4r_dir_filter filter;
+  const TSK_FS_DIR * dir;
+  long offset, max; size_t i;
+
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, dir_ptr);
+  if (dir_ptr->directory == NULL) rb_raise(rb_eRuntimeError, "directory pointer is NULL");
+  dir = dir_ptr->directory;
+
+  parse_dir_filter(tsk4r_opt(opts, "filter", Qnil), &filter);
+  offset = NUM2LONG(tsk4r_opt(opts, "offset", INT2FIX(0)));
+  limit = tsk4r_opt(opts, "limit", Qnil);
+  max = NIL_P(limit) ? -1 : NUM2LONG(limit);
+  sort = tsk4r_opt(opts, "sort", Qnil);
+  if (offset < 0) rb_raise(rb_eArgError, "offset must not be negative.");
+  if (max == 0) return self;
+
+  if (NIL_P(sort)) {
+    VALUE klass = dir_entry_class();
+    long skipped = 0, yielded = 0;
+    for (i = 0; i < dir->names_used; i++) {
+      if (! dir_entry_matches(&dir->names[i], &filter)) continue;
+      if (skipped < offset) { skipped++; continue; }
+      rb_yield(build_dir_entry(klass, i, &dir->names[i]));
+      if (max > 0 && ++yielded >= max) break;
+    }
+  } else {
+    struct tsk4r_dir_sorted sorted;
+    int (*compare)(const void *, const void *);
+    if (sort == ID2SYM(rb_intern("name"))) {
+      compare = compare_by_name;
+    } else if (sort == ID2SYM(rb_intern("inum"))) {
+      compare = compare_by_inum;
+    } else {
+      rb_raise(rb_eArgError, "sort must be nil, :name or :inum");
+    }
+    sorted.keys = ALLOC_N(struct tsk4r_dir_sort_key, dir->names_used ? dir->names_used : 1);
+    sorted.count = 0;
+    for (i = 0; i < dir->names_used; i++) {
+      if (! dir_entry_matches(&dir->names[i], &filter)) continue;
+      sorted.keys[sorted.count].idx = i;
+      sorted.keys[sorted.count].name = &dir->names[i];
+      sorted.count++;
+    }
+    qsort(sorted.keys, sorted.count, sizeof(struct tsk4r_dir_sort_key), compare);
+    sorted.offset = offset;
+    sorted.limit = max;
+    rb_ensure(yield_sorted_entries, (VALUE)&sorted, free_sorted_entries, (VALUE)&sorted);
   }
   return self;
-}
\ No newline at end of file
+}
+
+// Directory#entries_with_meta
+
+#define TSK4R_DIR_COLUMNS 17
+static const char * TSK4R_DIR_COLUMN_NAMES[TSK4R_DIR_COLUMNS] = {
+  "index", "name", "inum", "seq", "name_type", "name_flags",
+  "meta_type", "mode", "size", "uid", "gid", "nlink", "meta_flags",
+  "atime", "mtime", "ctime", "crtime"
+};
+
+static void push_dir_meta_row(VALUE * cols, size_t idx, const TSK_FS_NAME * n, const TSK_FS_META * m) {
+  int c = 0;
+  rb_ary_push(cols[c++], ULONG2NUM(idx));
+  rb_ary_push(cols[c++], rb_str_new2(n->name));
+  rb_ary_push(cols[c++], ULL2NUM(n->meta_addr));
+  rb_ary_push(cols[c++], UINT2NUM(n->meta_seq));
+  rb_ary_push(cols[c++], INT2NUM(n->type));
+  rb_ary_push(cols[c++], INT2NUM(n->flags));
+  if (m == NULL) {
+    for (; c < TSK4R_DIR_COLUMNS; c++) rb_ary_push(cols[c], Qnil);
+    return;
+  }
+  rb_ary_push(cols[c++], INT2NUM(m->type));
+  rb_ary_push(cols[c++], INT2NUM(m->mode));
+  rb_ary_push(cols[c++], LL2NUM(m->size));
+  rb_ary_push(cols[c++], UINT2NUM(m->uid));
+  rb_ary_push(cols[c++], UINT2NUM(m->gid));
+  rb_ary_push(cols[c++], INT2NUM(m->nlink));
+  rb_ary_push(cols[c++], INT2NUM(m->flags));
+  rb_ary_push(cols[c++], LL2NUM((long long)m->atime));
+  rb_ary_push(cols[c++], LL2NUM((long long)m->mtime));
+  rb_ary_push(cols[c++], LL2NUM((long long)m->ctime));
+  rb_ary_push(cols[c++], LL2NUM((long long)m->crtime));
+}
+
+// Directory#entries_with_meta(opts = {})
+// one pass over the open TSK_FS_DIR: each entry's metadata is loaded with
+// tsk_fs_dir_get, so nothing is resolved from the root again. Returns a Hash
+// of equal-length column Arrays keyed :index, :name, :inum, :seq, :name_type,
+// :name_flags, :meta_type, :mode, :size, :uid, :gid, :nlink, :meta_flags,
+// :atime, :mtime, :ctime, :crtime (times as raw epoch Integers; meta
+// columns are nil where an entry has no readable metadata).
+// opts: :filter as for #each_entry; without one every name is included,
+// matching #names.
+VALUE get_fs_dir_entries_with_meta(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE filter_opt; VALUE result;
+  VALUE cols[TSK4R_DIR_COLUMNS];
+  struct tsk4r_fs_dir_wrapper * dir_ptr;
+  struct tsk4r_dir_filter filter;
+  const TSK_FS_DIR * dir;
+  size_t i; int c;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, dir_ptr);
+  if (dir_ptr->directory == NULL) rb_raise(rb_eRuntimeError, "directory pointer is NULL");
+  dir = dir_ptr->directory;
+  filter_opt = tsk4r_opt(opts, "filter", Qnil);
+  parse_dir_filter(filter_opt, &filter);
+
+  result = rb_hash_new();
+  for (c = 0; c < TSK4R_DIR_COLUMNS; c++) {
+    cols[c] = rb_ary_new2(dir->names_used);
+    rb_hash_aset(result, ID2SYM(rb_intern(TSK4R_DIR_COLUMN_NAMES[c])), cols[c]);
+  }
+
+  for (i = 0; i < dir->names_used; i++) {
+    const TSK_FS_NAME * n = &dir->names[i];
+    TSK_FS_FILE * file;
+    TSK_FS_META meta; int has_meta;
+    if (n->name == NULL) continue;
+    if (! NIL_P(filter_opt) && ! dir_entry_matches(n, &filter)) continue;
+
+    file = tsk_fs_dir_get(dir, i);
+    if (file == NULL) {
+      tsk_error_reset();
+      push_dir_meta_row(cols, i, n, NULL);
+      continue;
+    }
+    // only scalar fields are read, so a copy lets the file close before
+    // anything that could raise
+    if (file->meta != NULL) meta = *file->meta;
+    has_meta = file->meta != NULL;
+    tsk_fs_file_close(file);
+    push_dir_meta_row(cols, i, n, has_meta ? &meta : NULL);
+  }
+  return result;
+}
@@ -25,17 +25,25 @@
 #define RubyTSK_fs_dir_h
 
 #include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+#include "owner.h"
 
 // Sleuthkit::FileSystemDirectory struct
 struct tsk4r_fs_dir_wrapper {
   TSK_FS_DIR * directory;
+  VALUE parent;   // FileSystem::System
+  struct tsk4r_owner * owner;
 };
+extern const rb_data_type_t tsk4r_fs_dir_type;
 
 // Sleuthkit::FileSystemDirectory
 
 VALUE allocate_fs_dir(VALUE self);
-void  deallocate_fs_dir(struct tsk4r_fs_dir_wrapper * ptr);
+void  deallocate_fs_dir(void * ptr);
 VALUE initialize_fs_dir(int argc, VALUE *args, VALUE self);
 VALUE open_fs_directory(VALUE self, VALUE parent_obj, VALUE name_or_inum, VALUE opts);
+VALUE get_fs_dir_names(VALUE self);
+VALUE each_fs_dir_entry(int argc, VALUE *args, VALUE self);
+VALUE get_fs_dir_entries_with_meta(int argc, VALUE *args, VALUE self);
 
 #endif
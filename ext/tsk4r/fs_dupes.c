@@ -0,0 +1,376 @@
+//
+//  fs_dupes.c
+//  RubyTSK
+//
+//  FileSystem::System#duplicates: files with identical content
+//
+//  Work is cut down in three rounds, all without the GVL:
+//    1. a metadata walk groups regular files by size; unique sizes drop out
+//    2. worker threads hash a head and a tail sample of every remaining
+//       file (small files are hashed whole here), noting where each file
+//       starts on disk
+//    3. files still sharing size and sample hash are hashed in full, in
+//       order of their first block, so the workers sweep the image forward
+//  Hashes are libtsk's SHA-1. A TSK_FS_INFO isn't safe to share between
+//  threads, so each worker opens its own on the volume and its files
+//  through that; only the image handle, which libtsk locks, is shared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_file.h"
+#include "fs_dupes.h"
+#include "hashset.h"
+#include "batch.h"
+#include "stats.h"
+
+#define TSK4R_DUP_PENDING  0
+#define TSK4R_DUP_SAMPLED  1
+#define TSK4R_DUP_HASHED   2
+#define TSK4R_DUP_FAILED  -1
+#define TSK4R_DUP_KNOWN   -2
+
+struct tsk4r_dup_file {
+  TSK_INUM_T inum;
+  TSK_OFF_T size;
+  TSK_DADDR_T first_block;
+  int state;
+  unsigned char sample[SHS_DIGESTSIZE];
+  unsigned char full[SHS_DIGESTSIZE];
+};
+
+struct tsk4r_dup_job {
+  TSK_FS_INFO * fs;
+  TSK_OFF_T min_size;
+  int threads;
+
+  struct tsk4r_dup_file * files;
+  size_t count;
+  size_t alloc;
+
+  // the current round's queue: indexes into files
+  size_t * work;
+  size_t work_count;
+  size_t next;
+  int full_round;
+  pthread_mutex_t lock;
+
+  const struct tsk4r_hash_set * known;
+
+  volatile int cancel;
+  const char * failed;
+  char error[256];
+};
+
+static void dup_fail(struct tsk4r_dup_job * job, const char * function, const char * error) {
+  pthread_mutex_lock(&job->lock);
+  if (job->failed == NULL) {
+    job->failed = function;
+    snprintf(job->error, sizeof(job->error), "%s", error);
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+static TSK_WALK_RET_ENUM dup_walk_callback(TSK_FS_FILE * file, void * ptr) {
+  struct tsk4r_dup_job * job = (struct tsk4r_dup_job *)ptr;
+  struct tsk4r_dup_file * f;
+
+  if (job->cancel) return TSK_WALK_STOP;
+  if (file->meta == NULL || file->meta->type != TSK_FS_META_TYPE_REG) return TSK_WALK_CONT;
+  if (file->meta->size < job->min_size || file->meta->size <= 0) return TSK_WALK_CONT;
+
+  if (job->count == job->alloc) {
+    size_t grow = job->alloc ? job->alloc * 2 : 1024;
+    struct tsk4r_dup_file * files = realloc(job->files, grow * sizeof(struct tsk4r_dup_file));
+    if (files == NULL) {
+      dup_fail(job, "tsk_fs_meta_walk", "out of memory");
+      return TSK_WALK_ERROR;
+    }
+    job->files = files;
+    job->alloc = grow;
+  }
+  f = &job->files[job->count++];
+  memset(f, 0, sizeof(struct tsk4r_dup_file));
+  f->inum = file->meta->addr;
+  f->size = file->meta->size;
+  return TSK_WALK_CONT;
+}
+
+static TSK_DADDR_T first_block(TSK_FS_FILE * file) {
+  const TSK_FS_ATTR * attr = tsk_fs_file_attr_get(file);
+  const TSK_FS_ATTR_RUN * run;
+  if (attr == NULL || ! (attr->flags & TSK_FS_ATTR_NONRES)) return 0;
+  for (run = attr->nrd.run; run != NULL; run = run->next) {
+    if (! (run->flags & (TSK_FS_ATTR_RUN_FLAG_FILLER | TSK_FS_ATTR_RUN_FLAG_SPARSE))) return run->addr;
+  }
+  return 0;
+}
+
+static int hash_range(TSK_FS_FILE * file, TSK_SHA_CTX * ctx, char * buf, TSK_OFF_T offset, TSK_OFF_T len) {
+  while (len > 0) {
+    size_t want = (size_t)(len < TSK4R_FILE_CHUNK ? len : TSK4R_FILE_CHUNK);
+    ssize_t got = tsk4r_fs_file_read(file, offset, buf, want, TSK_FS_FILE_READ_FLAG_NONE);
+    if (got <= 0) return -1;
+    TSK_SHA_Update(ctx, (BYTE *)buf, (int)got);
+    offset += got;
+    len -= got;
+  }
+  return 0;
+}
+
+// skip_known: a fully hashed file found in the set leaves every group
+static void dup_check_known(struct tsk4r_dup_job * job, struct tsk4r_dup_file * f, TSK_FS_FILE * file, char * buf) {
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+  if (job->known == NULL || f->state != TSK4R_DUP_HASHED) return;
+  if (tsk4r_hash_set_digest_len(job->known) == SHS_DIGESTSIZE) {
+    memcpy(digest, f->full, SHS_DIGESTSIZE);
+  } else if (tsk4r_hash_set_digest_file(job->known, file, buf, TSK4R_FILE_CHUNK, digest) != 0) {
+    return;
+  }
+  if (tsk4r_hash_set_contains(job->known, digest)) f->state = TSK4R_DUP_KNOWN;
+}
+
+static void dup_hash_file(struct tsk4r_dup_job * job, TSK_FS_INFO * fs, struct tsk4r_dup_file * f, char * buf) {
+  TSK_FS_FILE * file = tsk4r_fs_file_open_meta(fs, NULL, f->inum);
+  TSK_SHA_CTX ctx;
+  int err;
+
+  if (file == NULL) {
+    tsk_error_reset();
+    f->state = TSK4R_DUP_FAILED;
+    return;
+  }
+  TSK_SHA_Init(&ctx);
+  if (job->full_round) {
+    err = hash_range(file, &ctx, buf, 0, f->size);
+    if (! err) { TSK_SHA_Final(f->full, &ctx); f->state = TSK4R_DUP_HASHED; }
+  } else {
+    f->first_block = first_block(file);
+    if (f->size <= 2 * TSK4R_DUP_SAMPLE) {
+      err = hash_range(file, &ctx, buf, 0, f->size);
+      if (! err) {
+        TSK_SHA_Final(f->sample, &ctx);
+        memcpy(f->full, f->sample, SHS_DIGESTSIZE);
+        f->state = TSK4R_DUP_HASHED;
+      }
+    } else {
+      err = hash_range(file, &ctx, buf, 0, TSK4R_DUP_SAMPLE)
+        || hash_range(file, &ctx, buf, f->size - TSK4R_DUP_SAMPLE, TSK4R_DUP_SAMPLE);
+      if (! err) { TSK_SHA_Final(f->sample, &ctx); f->state = TSK4R_DUP_SAMPLED; }
+    }
+  }
+  if (err) {
+    tsk_error_reset();
+    f->state = TSK4R_DUP_FAILED;
+  }
+  dup_check_known(job, f, file, buf);
+  tsk_fs_file_close(file);
+}
+
+static void * dup_worker(void * ptr) {
+  struct tsk4r_dup_job * job = (struct tsk4r_dup_job *)ptr;
+  TSK_FS_INFO * fs;
+  char * buf = malloc(TSK4R_FILE_CHUNK);
+  if (buf == NULL) {
+    dup_fail(job, "malloc", "out of memory");
+    return NULL;
+  }
+  if ((fs = tsk4r_fs_reopen(job->fs)) == NULL) {
+    dup_fail(job, "tsk_fs_open_img", tsk_error_get());
+    free(buf);
+    return NULL;
+  }
+  for (;;) {
+    size_t i;
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->work_count || job->cancel || job->failed) break;
+    dup_hash_file(job, fs, &job->files[job->work[i]], buf);
+  }
+  tsk4r_fs_close(fs);
+  free(buf);
+  return NULL;
+}
+
+// runs the queued round on job->threads workers (inline if none start)
+static void dup_run_round(struct tsk4r_dup_job * job) {
+  pthread_t * workers = malloc((size_t)job->threads * sizeof(pthread_t));
+  int started = 0, t;
+  job->next = 0;
+  if (workers != NULL) {
+    for (t = 0; t < job->threads; t++) {
+      if (pthread_create(&workers[t], NULL, dup_worker, job) != 0) break;
+      started++;
+    }
+  }
+  if (started == 0) dup_worker(job);
+  for (t = 0; t < started; t++) pthread_join(workers[t], NULL);
+  free(workers);
+}
+
+static int compare_size(const void * a, const void * b) {
+  const struct tsk4r_dup_file * x = a; const struct tsk4r_dup_file * y = b;
+  if (x->size != y->size) return x->size > y->size ? -1 : 1;
+  return (x->inum > y->inum) - (x->inum < y->inum);
+}
+
+static int compare_sample(const void * a, const void * b) {
+  const struct tsk4r_dup_file * x = a; const struct tsk4r_dup_file * y = b;
+  int c;
+  if (x->size != y->size) return x->size > y->size ? -1 : 1;
+  if ((x->state < 0) != (y->state < 0)) return x->state < 0 ? 1 : -1;
+  c = memcmp(x->sample, y->sample, SHS_DIGESTSIZE);
+  if (c != 0) return c;
+  return (x->inum > y->inum) - (x->inum < y->inum);
+}
+
+static int compare_full(const void * a, const void * b) {
+  const struct tsk4r_dup_file * x = a; const struct tsk4r_dup_file * y = b;
+  int c;
+  if (x->size != y->size) return x->size > y->size ? -1 : 1;
+  if ((x->state == TSK4R_DUP_HASHED) != (y->state == TSK4R_DUP_HASHED)) return x->state == TSK4R_DUP_HASHED ? -1 : 1;
+  c = memcmp(x->full, y->full, SHS_DIGESTSIZE);
+  if (c != 0) return c;
+  return (x->inum > y->inum) - (x->inum < y->inum);
+}
+
+static int compare_first_block(const void * a, const void * b) {
+  const struct tsk4r_dup_file * x = a; const struct tsk4r_dup_file * y = b;
+  if ((x->state == TSK4R_DUP_SAMPLED) != (y->state == TSK4R_DUP_SAMPLED)) return x->state == TSK4R_DUP_SAMPLED ? -1 : 1;
+  if (x->first_block != y->first_block) return x->first_block < y->first_block ? -1 : 1;
+  return (x->inum > y->inum) - (x->inum < y->inum);
+}
+
+// keeps runs of at least two files that same() says are alike
+static void dup_keep_groups(struct tsk4r_dup_job * job, int (*same)(const struct tsk4r_dup_file *, const struct tsk4r_dup_file *)) {
+  size_t i = 0, j, kept = 0;
+  while (i < job->count) {
+    for (j = i + 1; j < job->count && same(&job->files[i], &job->files[j]); j++);
+    if (j - i > 1) {
+      memmove(&job->files[kept], &job->files[i], (j - i) * sizeof(struct tsk4r_dup_file));
+      kept += j - i;
+    }
+    i = j;
+  }
+  job->count = kept;
+}
+
+static int same_size(const struct tsk4r_dup_file * x, const struct tsk4r_dup_file * y) {
+  return x->size == y->size;
+}
+
+static int same_sample(const struct tsk4r_dup_file * x, const struct tsk4r_dup_file * y) {
+  return x->size == y->size && x->state >= 0 && y->state >= 0
+    && memcmp(x->sample, y->sample, SHS_DIGESTSIZE) == 0;
+}
+
+static int same_content(const struct tsk4r_dup_file * x, const struct tsk4r_dup_file * y) {
+  return x->size == y->size && x->state == TSK4R_DUP_HASHED && y->state == TSK4R_DUP_HASHED
+    && memcmp(x->full, y->full, SHS_DIGESTSIZE) == 0;
+}
+
+static void * find_duplicates(void * ptr) {
+  struct tsk4r_dup_job * job = (struct tsk4r_dup_job *)ptr;
+  uint8_t failed;
+  size_t i;
+
+  failed = tsk4r_fs_meta_walk(job->fs, job->fs->first_inum, job->fs->last_inum,
+                            TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED, dup_walk_callback, job);
+  if (failed && ! job->cancel) dup_fail(job, "tsk_fs_meta_walk", tsk_error_get());
+  if (job->failed || job->cancel) return NULL;
+
+  // round 1: sizes
+  qsort(job->files, job->count, sizeof(struct tsk4r_dup_file), compare_size);
+  dup_keep_groups(job, same_size);
+  if (job->count == 0) return NULL;
+
+  job->work = malloc(job->count * sizeof(size_t));
+  if (job->work == NULL) {
+    dup_fail(job, "malloc", "out of memory");
+    return NULL;
+  }
+
+  // round 2: head and tail samples
+  for (i = 0; i < job->count; i++) job->work[i] = i;
+  job->work_count = job->count;
+  job->full_round = 0;
+  dup_run_round(job);
+  if (job->cancel || job->failed) return NULL;
+  qsort(job->files, job->count, sizeof(struct tsk4r_dup_file), compare_sample);
+  dup_keep_groups(job, same_sample);
+
+  // round 3: full content, in disk order
+  qsort(job->files, job->count, sizeof(struct tsk4r_dup_file), compare_first_block);
+  job->work_count = 0;
+  for (i = 0; i < job->count && job->files[i].state == TSK4R_DUP_SAMPLED; i++) job->work[job->work_count++] = i;
+  job->full_round = 1;
+  dup_run_round(job);
+  if (job->cancel || job->failed) return NULL;
+
+  qsort(job->files, job->count, sizeof(struct tsk4r_dup_file), compare_full);
+  dup_keep_groups(job, same_content);
+  return NULL;
+}
+
+static void cancel_duplicates(void * ptr) {
+  ((struct tsk4r_dup_job *)ptr)->cancel = 1;
+}
+
+static VALUE duplicate_groups(VALUE arg) {
+  struct tsk4r_dup_job * job = (struct tsk4r_dup_job *)arg;
+  VALUE groups; VALUE group = Qnil;
+  size_t i;
+
+  tsk4r_call_interruptible(find_duplicates, cancel_duplicates, job);
+  if (job->failed) rb_raise(rb_eRuntimeError, "TSK function: %s exited with an error. (%s)", job->failed, job->error);
+
+  groups = rb_ary_new();
+  for (i = 0; i < job->count; i++) {
+    if (i == 0 || ! same_content(&job->files[i - 1], &job->files[i])) {
+      group = rb_ary_new();
+      rb_ary_push(groups, group);
+    }
+    rb_ary_push(group, ULL2NUM(job->files[i].inum));
+  }
+  return groups;
+}
+
+static VALUE release_duplicates(VALUE arg) {
+  struct tsk4r_dup_job * job = (struct tsk4r_dup_job *)arg;
+  free(job->files);
+  free(job->work);
+  pthread_mutex_destroy(&job->lock);
+  return Qnil;
+}
+
+// FileSystem::System#duplicates(opts = {})
+// opts: :min_size => 1 (bytes), :threads => 4,
+//       :skip_known => a Sleuthkit::HashSet of content to leave out
+// returns Arrays of inums of allocated regular files with identical content,
+// largest files first
+VALUE find_fs_duplicates(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE groups;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_dup_job job;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  MEMZERO(&job, struct tsk4r_dup_job, 1);
+  job.fs = fs_ptr->filesystem;
+  job.min_size = (TSK_OFF_T)NUM2LL(tsk4r_opt(opts, "min_size", INT2FIX(1)));
+  job.threads = NUM2INT(tsk4r_opt(opts, "threads", INT2FIX(TSK4R_DUP_THREADS)));
+  if (job.threads < 1) job.threads = 1;
+  job.known = tsk4r_hash_set_get(tsk4r_opt(opts, "skip_known", Qnil));
+  pthread_mutex_init(&job.lock, NULL);
+
+  groups = rb_ensure(duplicate_groups, (VALUE)&job, release_duplicates, (VALUE)&job);
+  RB_GC_GUARD(opts);   // keeps a skip_known set mapped until the workers are done
+  return groups;
+}
@@ -0,0 +1,20 @@
+//
+//  fs_dupes.h
+//  RubyTSK
+//
+//  FileSystem::System#duplicates: files with identical content
+//
+
+#ifndef RubyTSK_fs_dupes_h
+#define RubyTSK_fs_dupes_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+// bytes hashed from each end of a file before committing to a full read
+#define TSK4R_DUP_SAMPLE 4096
+#define TSK4R_DUP_THREADS 4
+
+VALUE find_fs_duplicates(int argc, VALUE *args, VALUE self);
+
+#endif
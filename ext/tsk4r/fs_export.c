@@ -0,0 +1,281 @@
+//
+//  fs_export.c
+//  RubyTSK
+//
+//  kernel-side extraction of file content from raw images
+//
+//  For an uncompressed, unencrypted, non-resident file on a raw (single or
+//  split) image, every run maps to a byte range of one or more segment
+//  files, so the content can be moved with copy_file_range (or sendfile,
+//  or pread/pwrite) without passing through libtsk or Ruby. Sparse and
+//  filler runs, and bytes past the initialized size, are left as holes
+//  when the destination ends where the export starts; otherwise they are
+//  written as zeros, so no stale bytes survive and nothing after the
+//  export is cut off. Anything else (including pipes and sockets) returns
+//  nil and FileData#export_to streams instead.
+//
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#include <ruby.h>
+#include "fs_file.h"
+#include "fs_export.h"
+
+#define TSK4R_COPY_BUF 1048576
+
+struct tsk4r_segment {
+  int fd;
+  TSK_OFF_T start;   // offset of the segment within the image
+  TSK_OFF_T size;
+};
+
+struct tsk4r_copy {
+  int src;           // -1: write len zeros
+  TSK_OFF_T src_off;
+  TSK_OFF_T dst_off;
+  TSK_OFF_T len;
+};
+
+struct tsk4r_export {
+  struct tsk4r_segment * segments;
+  long segment_count;
+  struct tsk4r_copy * copies;
+  long copy_count;
+  long copy_alloc;
+  int dest;
+  TSK_OFF_T dest_start;
+  TSK_OFF_T size;
+  int fresh;         // nothing in the destination at or after dest_start
+  const TSK_FS_ATTR * attr;
+  int error;
+};
+
+static int copy_with_pread(struct tsk4r_copy * c, int dest) {
+  char * buf = malloc(TSK4R_COPY_BUF);
+  TSK_OFF_T done = 0;
+  if (buf == NULL) return ENOMEM;
+  while (done < c->len) {
+    size_t want = (size_t)((c->len - done) < TSK4R_COPY_BUF ? (c->len - done) : TSK4R_COPY_BUF);
+    ssize_t got = pread(c->src, buf, want, (off_t)(c->src_off + done));
+    ssize_t put = 0;
+    if (got <= 0) { free(buf); return got == 0 ? EIO : errno; }
+    while (put < got) {
+      ssize_t w = pwrite(dest, buf + put, (size_t)(got - put), (off_t)(c->dst_off + done + put));
+      if (w < 0) { free(buf); return errno; }
+      put += w;
+    }
+    done += got;
+  }
+  free(buf);
+  return 0;
+}
+
+static int write_zeros(struct tsk4r_copy * c, int dest) {
+  char * buf = calloc(1, TSK4R_COPY_BUF);
+  TSK_OFF_T done = 0;
+  if (buf == NULL) return ENOMEM;
+  while (done < c->len) {
+    size_t want = (size_t)((c->len - done) < TSK4R_COPY_BUF ? (c->len - done) : TSK4R_COPY_BUF);
+    ssize_t w = pwrite(dest, buf, want, (off_t)(c->dst_off + done));
+    if (w < 0) { free(buf); return errno; }
+    done += w;
+  }
+  free(buf);
+  return 0;
+}
+
+#ifdef HAVE_SYS_SENDFILE_H
+// sendfile writes at the destination's file position
+static int copy_with_sendfile(struct tsk4r_copy * c, int dest, TSK_OFF_T * done) {
+  off_t src_off = (off_t)(c->src_off + *done);
+  if (lseek(dest, (off_t)(c->dst_off + *done), SEEK_SET) < 0) return errno;
+  while (*done < c->len) {
+    ssize_t n = sendfile(dest, c->src, &src_off, (size_t)(c->len - *done));
+    if (n < 0) return errno;
+    if (n == 0) return EIO;
+    *done += n;
+  }
+  return 0;
+}
+#endif
+
+static int copy_run(struct tsk4r_copy * c, int dest) {
+  TSK_OFF_T done = 0;
+  int err = 0;
+  if (c->src < 0) return write_zeros(c, dest);
+#ifdef HAVE_COPY_FILE_RANGE
+  while (done < c->len) {
+    loff_t src_off = (loff_t)(c->src_off + done);
+    loff_t dst_off = (loff_t)(c->dst_off + done);
+    ssize_t n = copy_file_range(c->src, &src_off, dest, &dst_off, (size_t)(c->len - done), 0);
+    if (n <= 0) { err = (n == 0) ? EIO : errno; break; }
+    done += n;
+  }
+  if (done == c->len) return 0;
+  if (err != ENOSYS && err != EXDEV && err != EINVAL && err != EOPNOTSUPP && err != EIO) return err;
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+  err = copy_with_sendfile(c, dest, &done);
+  if (err == 0) return 0;
+  if (err != EINVAL && err != ENOSYS) return err;
+#endif
+  if (done > 0) {
+    struct tsk4r_copy rest = *c;
+    rest.src_off += done; rest.dst_off += done; rest.len -= done;
+    return copy_with_pread(&rest, dest);
+  }
+  return copy_with_pread(c, dest);
+}
+
+static void * export_without_gvl(void * ptr) {
+  struct tsk4r_export * ex = (struct tsk4r_export *)ptr;
+  long i;
+  for (i = 0; i < ex->copy_count && ex->error == 0; i++) {
+    ex->error = copy_run(&ex->copies[i], ex->dest);
+  }
+  // trailing holes of a fresh destination; this only ever extends it
+  if (ex->error == 0 && ex->fresh && ftruncate(ex->dest, (off_t)(ex->dest_start + ex->size)) != 0) ex->error = errno;
+  if (ex->error == 0 && lseek(ex->dest, (off_t)(ex->dest_start + ex->size), SEEK_SET) < 0) ex->error = errno;
+  return NULL;
+}
+
+static VALUE release_export(VALUE arg) {
+  struct tsk4r_export * ex = (struct tsk4r_export *)arg;
+  long i;
+  for (i = 0; i < ex->segment_count; i++) {
+    if (ex->segments[i].fd >= 0) close(ex->segments[i].fd);
+  }
+  if (ex->segments != NULL) xfree(ex->segments);
+  if (ex->copies != NULL) xfree(ex->copies);
+  return Qnil;
+}
+
+static struct tsk4r_copy * next_copy(struct tsk4r_export * ex) {
+  if (ex->copy_count == ex->copy_alloc) {
+    ex->copy_alloc = ex->copy_alloc ? ex->copy_alloc * 2 : 16;
+    REALLOC_N(ex->copies, struct tsk4r_copy, ex->copy_alloc);
+  }
+  return &ex->copies[ex->copy_count++];
+}
+
+// zeros for a hole, unless the destination already reads back as zeros there
+static void add_zeros(struct tsk4r_export * ex, TSK_OFF_T dst_off, TSK_OFF_T len) {
+  struct tsk4r_copy * c;
+  if (ex->fresh || len <= 0) return;
+  c = next_copy(ex);
+  c->src = -1; c->src_off = 0; c->dst_off = dst_off; c->len = len;
+}
+
+static void add_copy(struct tsk4r_export * ex, TSK_OFF_T image_off, TSK_OFF_T dst_off, TSK_OFF_T len) {
+  struct tsk4r_copy * c;
+  long i;
+  while (len > 0) {
+    struct tsk4r_segment * seg = NULL;
+    for (i = 0; i < ex->segment_count; i++) {
+      if (image_off >= ex->segments[i].start && image_off < ex->segments[i].start + ex->segments[i].size) {
+        seg = &ex->segments[i]; break;
+      }
+    }
+    if (seg == NULL) rb_raise(rb_eRuntimeError, "run lies outside the image segments.");
+
+    TSK_OFF_T n = seg->start + seg->size - image_off;
+    if (n > len) n = len;
+    c = next_copy(ex);
+    c->src = seg->fd;
+    c->src_off = image_off - seg->start;
+    c->dst_off = dst_off;
+    c->len = n;
+    image_off += n; dst_off += n; len -= n;
+  }
+}
+
+static VALUE plan_and_copy(VALUE arg) {
+  struct tsk4r_export * ex = (struct tsk4r_export *)arg;
+  const TSK_FS_ATTR * attr = ex->attr;
+  const TSK_FS_ATTR_RUN * run;
+  TSK_FS_INFO * fs = attr->fs_file->fs_info;
+  TSK_OFF_T valid; TSK_OFF_T pos = 0;
+
+  // bytes past the initialized size read back as zeros
+  valid = attr->nrd.initsize < attr->size ? attr->nrd.initsize : attr->size;
+  if (valid < 0) valid = 0;
+  for (run = attr->nrd.run; run != NULL; run = run->next) {
+    TSK_OFF_T file_off = (TSK_OFF_T)run->offset * fs->block_size;
+    TSK_OFF_T len = (TSK_OFF_T)run->len * fs->block_size;
+    if (run->flags & (TSK_FS_ATTR_RUN_FLAG_FILLER | TSK_FS_ATTR_RUN_FLAG_SPARSE)) continue;
+    if (file_off >= valid) continue;
+    if (file_off + len > valid) len = valid - file_off;
+    if (file_off > pos) add_zeros(ex, ex->dest_start + pos, file_off - pos);
+    add_copy(ex, fs->offset + (TSK_OFF_T)run->addr * fs->block_size, ex->dest_start + file_off, len);
+    if (file_off + len > pos) pos = file_off + len;
+  }
+  add_zeros(ex, ex->dest_start + pos, ex->size - pos);
+
+  rb_thread_call_without_gvl(export_without_gvl, ex, NULL, NULL);
+  if (ex->error != 0) {
+    errno = ex->error;
+    rb_sys_fail("FileData#export_to");
+  }
+  return LL2NUM(ex->size);
+}
+
+// FileData#export_raw(fd, segment_paths) (private; see FileData#export_to)
+// returns bytes written, or nil when the file can't take the raw path
+VALUE export_fs_file_raw(VALUE self, VALUE fd, VALUE segment_paths) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  struct tsk4r_export ex; struct stat st;
+  const TSK_FS_ATTR * attr;
+  TSK_FS_INFO * fs; TSK_OFF_T total = 0;
+  long i;
+
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  Check_Type(segment_paths, T_ARRAY);
+  if (fs_file->file == NULL || fs_file->file->meta == NULL) return Qnil;
+
+  fs = fs_file->file->fs_info;
+  if (fs->img_info->itype != TSK_IMG_TYPE_RAW_SING && fs->img_info->itype != TSK_IMG_TYPE_RAW_SPLIT) return Qnil;
+  attr = tsk4r_fs_file_attr(fs_file);
+  if (attr == NULL || ! (attr->flags & TSK_FS_ATTR_NONRES)) return Qnil;
+  if (attr->flags & (TSK_FS_ATTR_COMP | TSK_FS_ATTR_ENC)) return Qnil;
+  if (attr->nrd.skiplen != 0) return Qnil;
+
+  MEMZERO(&ex, struct tsk4r_export, 1);
+  ex.dest = NUM2INT(fd);
+  if (fstat(ex.dest, &st) != 0 || ! S_ISREG(st.st_mode)) return Qnil;
+  ex.dest_start = (TSK_OFF_T)lseek(ex.dest, 0, SEEK_CUR);
+  if (ex.dest_start < 0) return Qnil;
+  ex.fresh = ((TSK_OFF_T)st.st_size <= ex.dest_start);
+  ex.size = attr->size;
+
+  ex.segment_count = RARRAY_LEN(segment_paths);
+  ex.segments = ALLOC_N(struct tsk4r_segment, ex.segment_count);
+  for (i = 0; i < ex.segment_count; i++) ex.segments[i].fd = -1;
+  for (i = 0; i < ex.segment_count; i++) {
+    VALUE path = rb_ary_entry(segment_paths, i);
+    ex.segments[i].fd = open(StringValueCStr(path), O_RDONLY);
+    if (ex.segments[i].fd < 0 || fstat(ex.segments[i].fd, &st) != 0) {
+      release_export((VALUE)&ex);
+      return Qnil;
+    }
+    ex.segments[i].start = total;
+    ex.segments[i].size = (TSK_OFF_T)st.st_size;
+    total += (TSK_OFF_T)st.st_size;
+  }
+  if (total != fs->img_info->size) {
+    release_export((VALUE)&ex);
+    return Qnil;
+  }
+
+  ex.attr = attr;
+  return rb_ensure(plan_and_copy, (VALUE)&ex, release_export, (VALUE)&ex);
+}
@@ -0,0 +1,16 @@
+//
+//  fs_export.h
+//  RubyTSK
+//
+//  kernel-side extraction of file content from raw images
+//
+
+#ifndef RubyTSK_fs_export_h
+#define RubyTSK_fs_export_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+VALUE export_fs_file_raw(VALUE self, VALUE fd, VALUE segment_paths);
+
+#endif
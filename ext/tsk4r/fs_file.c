@@ -26,6 +26,10 @@
 #include "file_system.h"
 #include "fs_file.h"
 #include "fs_dir.h"
+#include "fs_attr.h"
+#include "memsize.h"
+#include "batch.h"
+#include "stats.h"
 
 extern VALUE rb_cTSKFileSystem;
 extern VALUE rb_cTSKFileSystemDir;
@@ -37,43 +41,146 @@ extern void klassify();
 // internal function prototypes
 void open_fs_meta(VALUE self, VALUE source_obj, VALUE reference);
 void open_fs_name(VALUE self, VALUE source_obj, VALUE reference);
-void build_attributes(VALUE self, TSK_FS_META * ptr);
 
 
+static void mark_fs_file(void * ptr);
+static void mark_fs_meta(void * ptr);
+static void mark_fs_name(void * ptr);
+static void compact_fs_file(void * ptr);
+static void compact_fs_meta(void * ptr);
+static void compact_fs_name(void * ptr);
+static size_t fs_file_memsize(const void * ptr);
+static size_t fs_meta_memsize(const void * ptr);
+static size_t fs_name_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_fs_file_type = {
+  "Sleuthkit::FileSystem::FileData",
+  TSK4R_DATA_FUNCTIONS(mark_fs_file, deallocate_fs_file, fs_file_memsize, compact_fs_file),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+const rb_data_type_t tsk4r_fs_meta_type = {
+  "Sleuthkit::FileSystem::FileMeta",
+  TSK4R_DATA_FUNCTIONS(mark_fs_meta, deallocate_fs_meta, fs_meta_memsize, compact_fs_meta),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+const rb_data_type_t tsk4r_fs_name_type = {
+  "Sleuthkit::FileSystem::FileName",
+  TSK4R_DATA_FUNCTIONS(mark_fs_name, deallocate_fs_name, fs_name_memsize, compact_fs_name),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 // alloc & dealloc functions
 VALUE allocate_fs_file(VALUE klass){
   struct tsk4r_fs_file_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_fs_file_wrapper, 0, deallocate_fs_file, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, ptr);
+  ptr->parent = Qnil;
+  ptr->dir = Qnil;
+  ptr->attr_type = TSK_FS_ATTR_TYPE_DEFAULT;
+  ptr->attr_id = -1;
+  pthread_mutex_init(&ptr->read_lock, NULL);
+  return obj;
 }
 
 VALUE allocate_fs_meta(VALUE klass){
   struct tsk4r_fs_meta_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_fs_meta_wrapper, 0, deallocate_fs_meta, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, ptr);
+  ptr->owner = Qnil;
+  ptr->parent = Qnil;
+  return obj;
 }
 
 VALUE allocate_fs_name(VALUE klass){
   struct tsk4r_fs_name_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_fs_name_wrapper, 0, deallocate_fs_name, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, ptr);
+  ptr->owner = Qnil;
+  return obj;
 }
 
-void deallocate_fs_file(struct tsk4r_fs_file_wrapper * ptr){
-  TSK_FS_FILE *file = ptr->file;
-  tsk_fs_file_close(file);
-  xfree(ptr);
+static void mark_fs_file(void * ptr){
+  struct tsk4r_fs_file_wrapper * wrapper = ptr;
+  tsk4r_gc_mark(wrapper->parent);
+  tsk4r_gc_mark(wrapper->dir);
+}
+
+// owners hold the TSK_FS_FILE the wrappers point into
+static void mark_fs_meta(void * ptr){
+  struct tsk4r_fs_meta_wrapper * wrapper = ptr;
+  int i;
+  tsk4r_gc_mark(wrapper->owner);
+  tsk4r_gc_mark(wrapper->parent);
+  for (i = 0; i < TSK4R_META_TIMES; i++) tsk4r_gc_mark(wrapper->times[i]);
+}
+
+static void mark_fs_name(void * ptr){
+  struct tsk4r_fs_name_wrapper * wrapper = ptr;
+  tsk4r_gc_mark(wrapper->owner);
+  tsk4r_gc_mark(wrapper->name_str);
+  tsk4r_gc_mark(wrapper->shrt_name_str);
+}
+
+static void compact_fs_file(void * ptr){
+  struct tsk4r_fs_file_wrapper * wrapper = ptr;
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
+  wrapper->dir = tsk4r_gc_location(wrapper->dir);
+}
+
+static void compact_fs_meta(void * ptr){
+  struct tsk4r_fs_meta_wrapper * wrapper = ptr;
+  int i;
+  wrapper->owner = tsk4r_gc_location(wrapper->owner);
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
+  for (i = 0; i < TSK4R_META_TIMES; i++) wrapper->times[i] = tsk4r_gc_location(wrapper->times[i]);
+}
+
+static void compact_fs_name(void * ptr){
+  struct tsk4r_fs_name_wrapper * wrapper = ptr;
+  wrapper->owner = tsk4r_gc_location(wrapper->owner);
+  wrapper->name_str = tsk4r_gc_location(wrapper->name_str);
+  wrapper->shrt_name_str = tsk4r_gc_location(wrapper->shrt_name_str);
+}
+
+static void close_file_handle(void * handle){
+  tsk_fs_file_close((TSK_FS_FILE *)handle);
 }
 
-void deallocate_fs_meta(struct tsk4r_fs_meta_wrapper * ptr){
+// a file borrowed from a Directory is closed with the TSK_FS_DIR; its
+// owner only keeps the directory open (owner.h)
+void deallocate_fs_file(void * ptr){
+  struct tsk4r_fs_file_wrapper * wrapper = ptr;
+  tsk4r_owner_release(wrapper->owner);
+  pthread_mutex_destroy(&wrapper->read_lock);
+  xfree(wrapper);
+}
+
+void deallocate_fs_meta(void * ptr){
   xfree(ptr);
 }
 
-void deallocate_fs_name(struct tsk4r_fs_name_wrapper * ptr){
+void deallocate_fs_name(void * ptr){
   xfree(ptr);
 }
 
+static size_t fs_file_memsize(const void * ptr){
+  const struct tsk4r_fs_file_wrapper * wrapper = ptr;
+  if (! NIL_P(wrapper->dir)) return sizeof(*wrapper);
+  return sizeof(*wrapper) + tsk4r_fs_file_memsize(wrapper->file);
+}
+
+static size_t fs_meta_memsize(const void * ptr){
+  return sizeof(struct tsk4r_fs_meta_wrapper);
+}
+
+static size_t fs_name_memsize(const void * ptr){
+  return sizeof(struct tsk4r_fs_name_wrapper);
+}
+
 // init can be called in several ways
 // 1. creation of FileSystem::Directory calls it to build
 // file object to represent the directory  #new(filesystem, dir, opts)
 // 2. an inum or name can be used to seek a file on its own #new(filesystem, name_or_inum, opts)
+//    opts: :type and :id select the attribute the file reads (the default one otherwise)
 
 VALUE initialize_fs_file(int argc, VALUE *args, VALUE self) {
   VALUE fs; VALUE reference; VALUE opts; TSK_INUM_T addr;
@@ -87,26 +194,38 @@ VALUE initialize_fs_file(int argc, VALUE *args, VALUE self) {
   struct tsk4r_fs_wrapper * fs_ptr;
   TSK_FS_INFO * filesystem;
 
-  Data_Get_Struct(fs, struct tsk4r_fs_wrapper, fs_ptr);
-  Data_Get_Struct(self, struct tsk4r_fs_file_wrapper, fs_file);
+  TypedData_Get_Struct(fs, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
   filesystem = fs_ptr->filesystem;
+  fs_file->parent = fs;
+  if (! NIL_P(tsk4r_opt(opts, "type", Qnil))) {
+    int id = NUM2INT(tsk4r_opt(opts, "id", INT2FIX(-1)));
+    if (id < -1 || id > 0xffff) rb_raise(rb_eArgError, "attribute id %d out of range.", id);
+    fs_file->attr_type = (TSK_FS_ATTR_TYPE_ENUM)NUM2INT(tsk4r_opt(opts, "type", Qnil));
+    fs_file->attr_id = id;
+  }
   
   // determine if reference is a directory obj, file name, or metadata entry (e.g. inum)
   if (rb_obj_is_kind_of(reference, rb_cTSKFileSystemDir)) {
     struct tsk4r_fs_dir_wrapper * fs_dir;
-    Data_Get_Struct(reference, struct tsk4r_fs_dir_wrapper, fs_dir);
+    TypedData_Get_Struct(reference, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, fs_dir);
     addr = fs_dir->directory->addr;
 
     printf("accessing file entry for (%llu) (from a directory object)\n", addr);
     // if directory already built, we should have TSK_FS_FILE pointer
     fs_file->file = fs_dir->directory->fs_file;
+    fs_file->dir = reference;
+    fs_file->owner = tsk4r_owner_new(NULL, NULL, fs_dir->owner);
     
   } else if (rb_obj_is_kind_of(reference, rb_cFixnum)) {
 
     addr = (TSK_INUM_T)FIX2ULONG(reference);  TSK_FS_FILE * fs_temp_file;
 
-    fs_temp_file = tsk_fs_file_open_meta(filesystem, NULL, addr);
-    if (fs_temp_file != NULL ) { fs_file->file = fs_temp_file; }
+    fs_temp_file = tsk4r_fs_file_open_meta(filesystem, NULL, addr);
+    if (fs_temp_file != NULL ) {
+      fs_file->file = fs_temp_file;
+      fs_file->owner = tsk4r_owner_new(fs_temp_file, close_file_handle, fs_ptr->owner);
+    }
 
   } else if (rb_obj_is_kind_of(reference, rb_cString)) {
 
@@ -114,19 +233,17 @@ VALUE initialize_fs_file(int argc, VALUE *args, VALUE self) {
     name = StringValuePtr(reference);
     printf("calling tsk_fs_file_open('%s')\n", name);
     fs_temp_file = tsk_fs_file_open(filesystem, NULL, name);
-    if (fs_temp_file != NULL ) { fs_file->file = fs_temp_file; }
+    if (fs_temp_file != NULL ) {
+      fs_file->file = fs_temp_file;
+      fs_file->owner = tsk4r_owner_new(fs_temp_file, close_file_handle, fs_ptr->owner);
+    }
 
   } else {
     rb_warn("arg2 should be a FileSystem::Directory object, Fixnum, or String!");
   }
 
-  if (fs_file->file != NULL) {
-    rb_iv_set(self, "@meta", rb_funcall(rb_cTSKFileSystemFileMeta, rb_intern("new"), 1, self));
-    // build FileName if possible
-    if (fs_file->file->name != NULL) {
-      rb_iv_set(self, "@name", rb_funcall(rb_cTSKFileSystemFileName, rb_intern("new"), 1, self));
-    }
-  } else {
+  // FileMeta and FileName are built on first access (#meta, #name)
+  if (fs_file->file == NULL) {
     rb_warn("fs_file->file is NULL!");
   }
   
@@ -165,20 +282,17 @@ VALUE initialize_fs_meta(int argc, VALUE *args, VALUE self){
 }
 
 // private functions for accessing TSK_FS_META struct
-// this first one makes a temporary TSK_FS_FILE struct to get at TSK_FS_META
+// FileMeta keeps a pointer into the TSK_FS_FILE of its owner and reads
+// fields on demand (see init_fs_meta_accessors), so nothing is copied here.
+// this first one goes through the filesystem's FileData cache (fs_cache.c)
 VALUE get_meta_from_inum(VALUE self, VALUE filesystem, VALUE addr) {
-  struct tsk4r_fs_wrapper * fs_ptr;
   struct tsk4r_fs_meta_wrapper * meta_ptr;
-  TSK_FS_FILE * fs_file;
-  
-  Data_Get_Struct(filesystem, struct tsk4r_fs_wrapper, fs_ptr);
-  Data_Get_Struct(self, struct tsk4r_fs_meta_wrapper, meta_ptr);
-  fs_file = tsk_fs_file_open_meta(fs_ptr->filesystem, NULL, (TSK_INUM_T)FIX2LONG(addr));
+  VALUE fs_file = tsk4r_cached_file(filesystem, (TSK_INUM_T)NUM2ULL(addr), TSK_FS_ATTR_TYPE_DEFAULT, -1, Qnil);
   
-  if ( fs_file->meta ) {
-    meta_ptr->metadata = fs_file->meta;
-    build_attributes(self, meta_ptr->metadata);
-
+  if ( ! NIL_P(fs_file) ) {
+    get_meta_from_file(self, fs_file);
+    TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, meta_ptr);
+    meta_ptr->parent = filesystem;
   } else {
     rb_warn("access to TSK_FS_FILE struct's meta field failed.");
   }
@@ -188,12 +302,13 @@ VALUE get_meta_from_inum(VALUE self, VALUE filesystem, VALUE addr) {
 VALUE get_meta_from_file(VALUE self, VALUE fs_file) {
   struct tsk4r_fs_file_wrapper * file_ptr;
   struct tsk4r_fs_meta_wrapper * meta_ptr;
-  Data_Get_Struct(fs_file, struct tsk4r_fs_file_wrapper, file_ptr);
-  Data_Get_Struct(self, struct tsk4r_fs_meta_wrapper, meta_ptr);
+  TypedData_Get_Struct(fs_file, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, file_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, meta_ptr);
 
-  if ( file_ptr->file->meta ) {
+  if ( file_ptr->file != NULL && file_ptr->file->meta ) {
     meta_ptr->metadata = file_ptr->file->meta;
-    build_attributes(self, meta_ptr->metadata);
+    meta_ptr->owner = fs_file;
+    meta_ptr->parent = fs_file;
 
   } else {
     rb_warn("access to TSK_FS_FILE struct's meta field failed.");
@@ -205,13 +320,14 @@ VALUE get_meta_from_dir(VALUE self, VALUE fs_dir)  {
   struct tsk4r_fs_dir_wrapper * dir_ptr;
   struct tsk4r_fs_meta_wrapper * meta_ptr;
   TSK_FS_FILE * fs_file;
-  Data_Get_Struct(fs_dir, struct tsk4r_fs_dir_wrapper, dir_ptr);
-  Data_Get_Struct(self, struct tsk4r_fs_meta_wrapper, meta_ptr);
+  TypedData_Get_Struct(fs_dir, struct tsk4r_fs_dir_wrapper, &tsk4r_fs_dir_type, dir_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, meta_ptr);
   fs_file = dir_ptr->directory->fs_file;
   
-  if ( fs_file->meta ) {
+  if ( fs_file != NULL && fs_file->meta ) {
     meta_ptr->metadata = fs_file->meta;
-    build_attributes(self, meta_ptr->metadata);
+    meta_ptr->owner = fs_dir;
+    meta_ptr->parent = fs_dir;
 
   } else {
     rb_warn("access to TSK_FS_FILE struct's meta field failed.");
@@ -221,65 +337,123 @@ VALUE get_meta_from_dir(VALUE self, VALUE fs_dir)  {
 
 VALUE get_number_of_attributes(VALUE self) {
   VALUE number; int n; TSK_FS_FILE * fs_file; struct tsk4r_fs_file_wrapper * fwrapper;
-  Data_Get_Struct(self, struct tsk4r_fs_file_wrapper, fwrapper);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fwrapper);
   fs_file = fwrapper->file;
   n = tsk_fs_file_attr_getsize(fs_file);
   number = INT2NUM(n);
   return number;
 }
 
-void build_attributes(VALUE self, TSK_FS_META * metadata) {
+// FileMeta getters
+static TSK_FS_META * fs_meta_ptr(VALUE self) {
+  struct tsk4r_fs_meta_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, ptr);
+  return ptr->metadata;
+}
+
+#define TSK4R_META_GETTER(field, conv) \
+  static VALUE get_fs_meta_##field(VALUE self) { \
+    TSK_FS_META * meta = fs_meta_ptr(self); \
+    return meta == NULL ? Qnil : conv(meta->field); \
+  }
 
-  rb_iv_set(self, "@addr", LONG2FIX(metadata->addr));
-  rb_iv_set(self, "@atime", LONG2FIX(metadata->atime));
-  rb_iv_set(self, "@atime_nano", LONG2FIX(metadata->atime_nano));
-//  rb_iv_set(self, "@attr", LONG2FIX(metadata->attr));
-//  rb_iv_set(self, "@attr_state", LONG2FIX(metadata->attr_state));
-  rb_iv_set(self, "@content_len", LONG2FIX(metadata->content_len));
-  rb_iv_set(self, "@content_ptr", LONG2FIX(metadata->content_ptr));
-  rb_iv_set(self, "@crtime", LONG2FIX(metadata->crtime));
-  rb_iv_set(self, "@crtime_nano", LONG2FIX(metadata->crtime_nano));
-  rb_iv_set(self, "@ctime", LONG2FIX(metadata->ctime));
-  rb_iv_set(self, "@ctime_nano", LONG2FIX(metadata->ctime_nano));
-//  rb_iv_set(self, "@flags", LONG2FIX(metadata->flags));
-  rb_iv_set(self, "@gid", INT2FIX(metadata->gid));
-  rb_iv_set(self, "@link", LONG2FIX(metadata->link));
-  rb_iv_set(self, "@mode", LONG2FIX(metadata->mode));
-  rb_iv_set(self, "@mtime", LONG2FIX(metadata->mtime));
-  rb_iv_set(self, "@mtime_nano", LONG2FIX(metadata->mtime_nano));
-//  rb_iv_set(self, "@name2", LONG2FIX(metadata->name2));
-  rb_iv_set(self, "@nlink", LONG2FIX(metadata->nlink));
-  rb_iv_set(self, "@seq", LONG2FIX(metadata->seq));
-  rb_iv_set(self, "@size", LONG2FIX(metadata->size));
-  rb_iv_set(self, "@tag", INT2FIX(metadata->tag));
+TSK4R_META_GETTER(addr, ULL2NUM)
+TSK4R_META_GETTER(atime_nano, UINT2NUM)
+TSK4R_META_GETTER(content_len, SIZET2NUM)
+TSK4R_META_GETTER(crtime_nano, UINT2NUM)
+TSK4R_META_GETTER(ctime_nano, UINT2NUM)
+TSK4R_META_GETTER(flags, INT2NUM)
+TSK4R_META_GETTER(gid, UINT2NUM)
+TSK4R_META_GETTER(mode, INT2NUM)
+TSK4R_META_GETTER(mtime_nano, UINT2NUM)
+TSK4R_META_GETTER(nlink, INT2NUM)
+TSK4R_META_GETTER(seq, UINT2NUM)
+TSK4R_META_GETTER(size, LL2NUM)
+TSK4R_META_GETTER(tag, INT2NUM)
+TSK4R_META_GETTER(type, INT2NUM)
+TSK4R_META_GETTER(uid, UINT2NUM)
+
+static VALUE get_fs_meta_content_ptr(VALUE self) {
+  TSK_FS_META * meta = fs_meta_ptr(self);
+  return meta == NULL ? Qnil : ULL2NUM((unsigned long long)(uintptr_t)meta->content_ptr);
+}
 
+static VALUE get_fs_meta_link(VALUE self) {
+  TSK_FS_META * meta = fs_meta_ptr(self);
+  if (meta == NULL || meta->link == NULL) return Qnil;
+  return rb_str_new2(meta->link);
+}
+
+static VALUE get_fs_meta_parent(VALUE self) {
+  struct tsk4r_fs_meta_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, ptr);
+  return ptr->parent;
+}
+
+// #atime(format = :cooked) etc.; :raw returns the epoch seconds, anything
+// else a Time built once per FileMeta
+static VALUE fs_meta_time(int argc, VALUE *args, VALUE self, int which) {
+  struct tsk4r_fs_meta_wrapper * ptr; VALUE format; time_t secs; uint32_t nsec;
+  rb_scan_args(argc, args, "01", &format);
+  TypedData_Get_Struct(self, struct tsk4r_fs_meta_wrapper, &tsk4r_fs_meta_type, ptr);
+  if (ptr->metadata == NULL) return Qnil;
+
+  switch (which) {
+    case TSK4R_META_ATIME:  secs = ptr->metadata->atime;  nsec = ptr->metadata->atime_nano;  break;
+    case TSK4R_META_CRTIME: secs = ptr->metadata->crtime; nsec = ptr->metadata->crtime_nano; break;
+    case TSK4R_META_CTIME:  secs = ptr->metadata->ctime;  nsec = ptr->metadata->ctime_nano;  break;
+    default:                secs = ptr->metadata->mtime;  nsec = ptr->metadata->mtime_nano;  break;
+  }
+  if (! NIL_P(format) && rb_funcall(format, rb_intern("to_sym"), 0) == ID2SYM(rb_intern("raw"))) {
+    return LONG2NUM((long)secs);
+  }
+  if (! ptr->times[which]) ptr->times[which] = rb_time_nano_new(secs, (long)nsec);
+  return ptr->times[which];
+}
+
+static VALUE get_fs_meta_atime(int argc, VALUE *args, VALUE self)  { return fs_meta_time(argc, args, self, TSK4R_META_ATIME); }
+static VALUE get_fs_meta_crtime(int argc, VALUE *args, VALUE self) { return fs_meta_time(argc, args, self, TSK4R_META_CRTIME); }
+static VALUE get_fs_meta_ctime(int argc, VALUE *args, VALUE self)  { return fs_meta_time(argc, args, self, TSK4R_META_CTIME); }
+static VALUE get_fs_meta_mtime(int argc, VALUE *args, VALUE self)  { return fs_meta_time(argc, args, self, TSK4R_META_MTIME); }
+
+void init_fs_meta_accessors(VALUE klass) {
+  rb_define_method(klass, "addr", get_fs_meta_addr, 0);
+  rb_define_method(klass, "atime", get_fs_meta_atime, -1);
+  rb_define_method(klass, "atime_nano", get_fs_meta_atime_nano, 0);
+  rb_define_method(klass, "content_len", get_fs_meta_content_len, 0);
+  rb_define_method(klass, "content_ptr", get_fs_meta_content_ptr, 0);
+  rb_define_method(klass, "crtime", get_fs_meta_crtime, -1);
+  rb_define_method(klass, "crtime_nano", get_fs_meta_crtime_nano, 0);
+  rb_define_method(klass, "ctime", get_fs_meta_ctime, -1);
+  rb_define_method(klass, "ctime_nano", get_fs_meta_ctime_nano, 0);
+  rb_define_method(klass, "flags", get_fs_meta_flags, 0);
+  rb_define_method(klass, "gid", get_fs_meta_gid, 0);
+  rb_define_method(klass, "link", get_fs_meta_link, 0);
+  rb_define_method(klass, "mode", get_fs_meta_mode, 0);
+  rb_define_method(klass, "mtime", get_fs_meta_mtime, -1);
+  rb_define_method(klass, "mtime_nano", get_fs_meta_mtime_nano, 0);
+  rb_define_method(klass, "nlink", get_fs_meta_nlink, 0);
+  rb_define_method(klass, "parent", get_fs_meta_parent, 0);
+  rb_define_method(klass, "seq", get_fs_meta_seq, 0);
+  rb_define_method(klass, "size", get_fs_meta_size, 0);
+  rb_define_method(klass, "tag", get_fs_meta_tag, 0);
+  rb_define_method(klass, "type", get_fs_meta_type, 0);
+  rb_define_method(klass, "uid", get_fs_meta_uid, 0);
 }
 
 
 VALUE initialize_fs_name(int argc, VALUE *args, VALUE self){
   VALUE file_obj; VALUE opts;
   rb_scan_args(argc, args, "11", &file_obj, &opts);
-  rb_iv_set(self, "@file", file_obj);
   
   struct tsk4r_fs_file_wrapper * file_ptr;
   struct tsk4r_fs_name_wrapper * my_ptr;
-  Data_Get_Struct(file_obj, struct tsk4r_fs_file_wrapper, file_ptr);
-  Data_Get_Struct(self, struct tsk4r_fs_name_wrapper, my_ptr);
+  TypedData_Get_Struct(file_obj, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, file_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, my_ptr);
 
-  if (file_ptr->file->name != NULL) {
+  if (file_ptr->file != NULL && file_ptr->file->name != NULL) {
     my_ptr->name = file_ptr->file->name;
-    if (my_ptr->name) {
-      TSK_FS_NAME * name = my_ptr->name;
-      rb_iv_set(self, "@meta_addr", LONG2FIX(name->meta_addr));
-      rb_iv_set(self, "@meta_seq", LONG2FIX(name->meta_seq));
-      rb_iv_set(self, "@name", rb_str_new2(name->name));
-      rb_iv_set(self, "@name_size", LONG2FIX(name->name_size));
-      rb_iv_set(self, "@parent_addr", LONG2FIX(name->par_addr));
-      rb_iv_set(self, "@shrt_name", rb_str_new2(name->shrt_name));
-      rb_iv_set(self, "@shrt_name_size", LONG2FIX(name->shrt_name_size));
-      rb_iv_set(self, "@tag", INT2FIX(name->tag));
-
-    } else { rb_warn("file_ptr->file had NULL for its name struct."); }
+    my_ptr->owner = file_obj;
   } else {
     rb_warn("unable to access file name data!");
   }
@@ -287,6 +461,89 @@ VALUE initialize_fs_name(int argc, VALUE *args, VALUE self){
   return self;
 }
 
+// FileName getters
+static TSK_FS_NAME * fs_name_ptr(VALUE self) {
+  struct tsk4r_fs_name_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, ptr);
+  return ptr->name;
+}
+
+#define TSK4R_NAME_GETTER(method, field, conv) \
+  static VALUE get_fs_name_##method(VALUE self) { \
+    TSK_FS_NAME * name = fs_name_ptr(self); \
+    return name == NULL ? Qnil : conv(name->field); \
+  }
+
+TSK4R_NAME_GETTER(meta_addr, meta_addr, ULL2NUM)
+TSK4R_NAME_GETTER(meta_seq, meta_seq, UINT2NUM)
+TSK4R_NAME_GETTER(name_size, name_size, SIZET2NUM)
+TSK4R_NAME_GETTER(parent_addr, par_addr, ULL2NUM)
+TSK4R_NAME_GETTER(shrt_name_size, shrt_name_size, SIZET2NUM)
+TSK4R_NAME_GETTER(tag, tag, INT2NUM)
+TSK4R_NAME_GETTER(type, type, INT2NUM)
+TSK4R_NAME_GETTER(flags, flags, INT2NUM)
+
+// names are converted once and kept on the wrapper
+static VALUE get_fs_name_name(VALUE self) {
+  struct tsk4r_fs_name_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, ptr);
+  if (ptr->name == NULL || ptr->name->name == NULL) return Qnil;
+  if (! ptr->name_str) ptr->name_str = rb_str_new2(ptr->name->name);
+  return ptr->name_str;
+}
+
+static VALUE get_fs_name_shrt_name(VALUE self) {
+  struct tsk4r_fs_name_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, ptr);
+  if (ptr->name == NULL || ptr->name->shrt_name == NULL) return Qnil;
+  if (! ptr->shrt_name_str) ptr->shrt_name_str = rb_str_new2(ptr->name->shrt_name);
+  return ptr->shrt_name_str;
+}
+
+static VALUE get_fs_name_file(VALUE self) {
+  struct tsk4r_fs_name_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_name_wrapper, &tsk4r_fs_name_type, ptr);
+  return ptr->owner ? ptr->owner : Qnil;
+}
+
+void init_fs_name_accessors(VALUE klass) {
+  rb_define_method(klass, "file", get_fs_name_file, 0);
+  rb_define_method(klass, "flags", get_fs_name_flags, 0);
+  rb_define_method(klass, "meta_addr", get_fs_name_meta_addr, 0);
+  rb_define_method(klass, "meta_seq", get_fs_name_meta_seq, 0);
+  rb_define_method(klass, "name", get_fs_name_name, 0);
+  rb_define_method(klass, "name_size", get_fs_name_name_size, 0);
+  rb_define_method(klass, "parent", get_fs_name_file, 0);
+  rb_define_method(klass, "parent_addr", get_fs_name_parent_addr, 0);
+  rb_define_method(klass, "shrt_name", get_fs_name_shrt_name, 0);
+  rb_define_method(klass, "shrt_name_size", get_fs_name_shrt_name_size, 0);
+  rb_define_method(klass, "tag", get_fs_name_tag, 0);
+  rb_define_method(klass, "type", get_fs_name_type, 0);
+}
+
+// FileData#meta and #name are built on first use
+VALUE get_fs_file_meta(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  VALUE meta = rb_iv_get(self, "@meta");
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  if (NIL_P(meta) && fs_file->file != NULL && fs_file->file->meta != NULL) {
+    meta = rb_funcall(rb_cTSKFileSystemFileMeta, rb_intern("new"), 1, self);
+    rb_iv_set(self, "@meta", meta);
+  }
+  return meta;
+}
+
+VALUE get_fs_file_name(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  VALUE name = rb_iv_get(self, "@name");
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  if (NIL_P(name) && fs_file->file != NULL && fs_file->file->name != NULL) {
+    name = rb_funcall(rb_cTSKFileSystemFileName, rb_intern("new"), 1, self);
+    rb_iv_set(self, "@name", name);
+  }
+  return name;
+}
+
 
 // private functions
 VALUE open_fs_file(int argc, VALUE *args, VALUE self){
@@ -298,8 +555,8 @@ VALUE open_fs_file(int argc, VALUE *args, VALUE self){
   const TSK_TCHAR *addr_string;
   VALUE parent;
   parent = rb_iv_get(self, "@parent");
-  Data_Get_Struct(self, struct tsk4r_fs_file_wrapper, fsfile);
-  Data_Get_Struct(parent, struct tsk4r_fs_wrapper, ptr);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fsfile);
+  TypedData_Get_Struct(parent, struct tsk4r_fs_wrapper, &tsk4r_fs_type, ptr);
   TSK_FS_ATTR_TYPE_ENUM type = TSK_FS_ATTR_TYPE_DEFAULT;
   uint8_t type_used = 0; // image type? (autodetect)
   uint16_t id = 0;
@@ -314,7 +571,7 @@ VALUE open_fs_file(int argc, VALUE *args, VALUE self){
   TSK_FS_INFO * system  = ptr->filesystem;
   TSK_FS_FILE * tskfile = fsfile->file;
 
-  tsk_fs_file_open_meta(system, tskfile, (TSK_INUM_T)parsed_inum);
+  tsk4r_fs_file_open_meta(system, tskfile, (TSK_INUM_T)parsed_inum);
 //
   if (tskfile != NULL) {
     rb_iv_set(self, "@content_len", LONG2FIX(tskfile->meta->content_len));
@@ -327,3 +584,153 @@ VALUE open_fs_file(int argc, VALUE *args, VALUE self){
 
 }
 
+
+// content access
+
+struct tsk4r_file_read {
+  pthread_mutex_t * lock;
+  TSK_FS_FILE * file;
+  const TSK_FS_ATTR * attr;   // NULL: the default attribute
+  TSK_OFF_T offset;
+  char * dest;
+  size_t len;
+  ssize_t got;
+};
+
+static void * read_fs_file_without_gvl(void * ptr) {
+  struct tsk4r_file_read * rd = (struct tsk4r_file_read *)ptr;
+  pthread_mutex_lock(rd->lock);
+  if (rd->attr != NULL) {
+    rd->got = tsk4r_fs_attr_read(rd->attr, rd->offset, rd->dest, rd->len, TSK_FS_FILE_READ_FLAG_NONE);
+  } else {
+    rd->got = tsk4r_fs_file_read(rd->file, rd->offset, rd->dest, rd->len, TSK_FS_FILE_READ_FLAG_NONE);
+  }
+  pthread_mutex_unlock(rd->lock);
+  return NULL;
+}
+
+// the attribute a FileData reads: the default one unless opened with :type
+const TSK_FS_ATTR * tsk4r_fs_file_attr(const struct tsk4r_fs_file_wrapper * fs_file) {
+  if (fs_file->file == NULL) return NULL;
+  if (fs_file->attr_type == TSK_FS_ATTR_TYPE_DEFAULT) return tsk_fs_file_attr_get(fs_file->file);
+  return tsk_fs_file_attr_get_type(fs_file->file, fs_file->attr_type,
+                                   fs_file->attr_id < 0 ? 0 : (uint16_t)fs_file->attr_id, fs_file->attr_id >= 0);
+}
+
+// reads up to len bytes at offset into buffer, which is resized to the bytes read.
+// returns Qnil at end of file, like IO#read(len)
+static VALUE read_fs_file_into(struct tsk4r_fs_file_wrapper * fs_file, TSK_OFF_T offset, long len, VALUE buffer) {
+  struct tsk4r_file_read rd;
+  TSK_FS_FILE * file = fs_file->file;
+  TSK_OFF_T size;
+  if (file == NULL || file->meta == NULL) {
+    rb_raise(rb_eRuntimeError, "file has no metadata to read from.");
+  }
+  if (offset < 0 || len < 0) {
+    rb_raise(rb_eArgError, "offset and length must not be negative.");
+  }
+  rd.attr = NULL;
+  size = file->meta->size;
+  if (fs_file->attr_type != TSK_FS_ATTR_TYPE_DEFAULT) {
+    rd.attr = tsk4r_fs_file_attr(fs_file);
+    if (rd.attr == NULL) rb_raise(rb_eRuntimeError, "file has no attribute of type %d.", (int)fs_file->attr_type);
+    size = rd.attr->size;
+  }
+  rb_str_modify(buffer);
+  if (offset >= size) {
+    rb_str_set_len(buffer, 0);
+    return len == 0 ? buffer : Qnil;
+  }
+  if (len > size - offset) len = (long)(size - offset);
+  rb_str_resize(buffer, len);
+
+  rd.lock = &fs_file->read_lock;
+  rd.file = file; rd.offset = offset; rd.len = (size_t)len;
+  rb_str_locktmp(buffer);
+  rd.dest = RSTRING_PTR(buffer);
+  rb_thread_call_without_gvl(read_fs_file_without_gvl, &rd, NULL, NULL);
+  rb_str_unlocktmp(buffer);
+
+  if (rd.got < 0) {
+    rb_str_set_len(buffer, 0);
+    rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_file_read exited with an error. (%s)", tsk_error_get());
+  }
+  rb_str_set_len(buffer, rd.got);
+  return buffer;
+}
+
+static VALUE reusable_buffer(VALUE buffer, long len) {
+  if (NIL_P(buffer)) {
+    buffer = rb_str_buf_new(len);
+  } else {
+    StringValue(buffer);
+  }
+  return TSK4R_BINARY_STR(buffer);
+}
+
+// FileData#read_at(offset, len, buffer = nil)
+// the read itself runs without the GVL; pass buffer to avoid allocating a String per call
+VALUE read_fs_file_at(int argc, VALUE *args, VALUE self) {
+  VALUE offset; VALUE len; VALUE buffer;
+  struct tsk4r_fs_file_wrapper * fs_file;
+  rb_scan_args(argc, args, "21", &offset, &len, &buffer);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+
+  buffer = reusable_buffer(buffer, 0);
+  return read_fs_file_into(fs_file, (TSK_OFF_T)NUM2LL(offset), NUM2LONG(len), buffer);
+}
+
+// FileData#each_chunk(size = 65536) { |chunk, offset| ... }
+// the same String is yielded for every chunk; dup it to keep a copy
+VALUE each_fs_file_chunk(int argc, VALUE *args, VALUE self) {
+  VALUE size; VALUE buffer; long chunk; TSK_OFF_T offset = 0;
+  struct tsk4r_fs_file_wrapper * fs_file;
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &size);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+
+  chunk = NIL_P(size) ? TSK4R_FILE_CHUNK : NUM2LONG(size);
+  if (chunk < 1) rb_raise(rb_eArgError, "chunk size must be positive.");
+  buffer = reusable_buffer(Qnil, chunk);
+
+  while (! NIL_P(read_fs_file_into(fs_file, offset, chunk, buffer))) {
+    long got = RSTRING_LEN(buffer);
+    if (got == 0) break;
+    rb_yield_values(2, buffer, LL2NUM(offset));
+    offset += got;
+  }
+  return self;
+}
+
+// FileData#extents: packed runs of the attribute the file reads (see Attribute#runs)
+VALUE get_fs_file_extents(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  if (fs_file->file == NULL) return Qnil;
+  return pack_attr_runs(tsk4r_fs_file_attr(fs_file));
+}
+
+// FileData#attribute_type
+VALUE get_fs_file_attr_type(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  return INT2NUM((int)fs_file->attr_type);
+}
+
+// FileData#attribute_size: bytes read_at and each_chunk can return
+VALUE get_fs_file_attr_size(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  const TSK_FS_ATTR * attr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  if (fs_file->file == NULL || fs_file->file->meta == NULL) return INT2FIX(0);
+  if (fs_file->attr_type == TSK_FS_ATTR_TYPE_DEFAULT) return LL2NUM(fs_file->file->meta->size);
+  attr = tsk4r_fs_file_attr(fs_file);
+  return attr == NULL ? INT2FIX(0) : LL2NUM(attr->size);
+}
+
+// FileData#attribute_id; nil unless opened with :id
+VALUE get_fs_file_attr_id(VALUE self) {
+  struct tsk4r_fs_file_wrapper * fs_file;
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  return fs_file->attr_id < 0 ? Qnil : INT2NUM(fs_file->attr_id);
+}
@@ -25,28 +25,59 @@
 #ifndef RubyTSK_fs_file_h
 #define RubyTSK_fs_file_h
 
+#include <pthread.h>
 #include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+#include "owner.h"
+
+#define TSK4R_FILE_CHUNK 65536
+
 // structures
 
 // Sleuthkit::FileSystemDirectory struct
 struct tsk4r_fs_file_wrapper {
   TSK_FS_FILE * file;
+  VALUE parent;   // FileSystem::System
+  VALUE dir;      // Directory whose TSK_FS_FILE this borrows, or nil
+  struct tsk4r_owner * owner;   // holds the Directory's owner when borrowed
+  TSK_FS_ATTR_TYPE_ENUM attr_type;  // attribute read: TSK_FS_ATTR_TYPE_DEFAULT unless opened with :type
+  int attr_id;                      // its id, or -1 for the first of attr_type
+  pthread_mutex_t read_lock;        // held around every read of file: the file
+                                    // cache hands one FileData to all threads
 };
+
+// FileMeta and FileName point into the TSK_FS_FILE held by their owner
+// (FileData, Directory) and read fields on demand
+#define TSK4R_META_ATIME  0
+#define TSK4R_META_CRTIME 1
+#define TSK4R_META_CTIME  2
+#define TSK4R_META_MTIME  3
+#define TSK4R_META_TIMES  4
+
 struct tsk4r_fs_meta_wrapper {
   TSK_FS_META * metadata;
+  VALUE owner;    // FileData or Directory holding the TSK_FS_FILE
+  VALUE parent;   // what FileMeta.new was given (#parent)
+  VALUE times[TSK4R_META_TIMES];
 };
 struct tsk4r_fs_name_wrapper {
   TSK_FS_NAME * name;
+  VALUE owner;
+  VALUE name_str;
+  VALUE shrt_name_str;
 };
+extern const rb_data_type_t tsk4r_fs_file_type;
+extern const rb_data_type_t tsk4r_fs_meta_type;
+extern const rb_data_type_t tsk4r_fs_name_type;
 
 // function prototypes
 VALUE allocate_fs_file(VALUE self);
 VALUE allocate_fs_meta(VALUE self);
 VALUE allocate_fs_name(VALUE self);
 
-void deallocate_fs_file(struct tsk4r_fs_file_wrapper * ptr);
-void deallocate_fs_meta(struct tsk4r_fs_meta_wrapper * ptr);
-void deallocate_fs_name(struct tsk4r_fs_name_wrapper * ptr);
+void deallocate_fs_file(void * ptr);
+void deallocate_fs_meta(void * ptr);
+void deallocate_fs_name(void * ptr);
 
 VALUE initialize_fs_file(int argc, VALUE *args, VALUE self);
 VALUE initialize_fs_meta(int argc, VALUE *args, VALUE self);
@@ -58,6 +89,17 @@ VALUE get_meta_from_inum(VALUE self, VALUE filesystem, VALUE addr);
 VALUE get_meta_from_file(VALUE self, VALUE fs_file);
 VALUE get_meta_from_dir( VALUE self, VALUE fs_dir);
 VALUE get_number_of_attributes(VALUE self);
+VALUE get_fs_file_meta(VALUE self);
+VALUE get_fs_file_name(VALUE self);
+void init_fs_meta_accessors(VALUE klass);
+void init_fs_name_accessors(VALUE klass);
+VALUE read_fs_file_at(int argc, VALUE *args, VALUE self);
+VALUE each_fs_file_chunk(int argc, VALUE *args, VALUE self);
+VALUE get_fs_file_extents(VALUE self);
+VALUE get_fs_file_attr_type(VALUE self);
+VALUE get_fs_file_attr_id(VALUE self);
+VALUE get_fs_file_attr_size(VALUE self);
+const TSK_FS_ATTR * tsk4r_fs_file_attr(const struct tsk4r_fs_file_wrapper * fs_file);
 
 
 #endif
@@ -0,0 +1,260 @@
+//
+//  fs_journal.c
+//  RubyTSK
+//
+//  ext3/ext4 (JBD2) journal access for Sleuthkit::FileSystem::System
+//
+//  libtsk's jblk_walk/jentry_walk for ext2fs print their results to stdout
+//  (they back the jcat/jls tools) instead of calling the walk callback, so
+//  the journal inode is read here through tsk_fs_file_read and the JBD2
+//  block headers are decoded the same way jls does it: one journal block
+//  at a time, into a single reusable buffer.
+//
+
+#include <stdio.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_journal.h"
+#include "stats.h"
+
+#define TSK4R_JBD2_MAGIC          0xC03B3998U
+#define TSK4R_JBD2_DESCRIPTOR     1
+#define TSK4R_JBD2_COMMIT         2
+#define TSK4R_JBD2_SB_V1          3
+#define TSK4R_JBD2_SB_V2          4
+#define TSK4R_JBD2_REVOKE         5
+
+#define TSK4R_JBD2_FEATURE_64BIT   0x00000002
+#define TSK4R_JBD2_FEATURE_CSUM_V2 0x00000008
+#define TSK4R_JBD2_FEATURE_CSUM_V3 0x00000010
+
+#define TSK4R_JBD2_FLAG_SAME_UUID  0x2
+#define TSK4R_JBD2_FLAG_LAST_TAG   0x8
+
+// state shared by both walkers; freed by close_journal
+struct tsk4r_journal {
+  TSK_FS_FILE * file;
+  char * buf;             // one journal block, reused for every read
+  TSK_DADDR_T * tags;     // fs blocks announced by the last descriptor block
+  size_t tag_count;
+  size_t tag_next;
+  size_t block_size;
+  TSK_DADDR_T block_total;
+  uint32_t incompat;
+  long batch_size;
+  VALUE range;
+};
+
+static uint32_t journal_be32(const char * p) {
+  const unsigned char * u = (const unsigned char *)p;
+  return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16) | ((uint32_t)u[2] << 8) | (uint32_t)u[3];
+}
+
+static uint16_t journal_be16(const char * p) {
+  const unsigned char * u = (const unsigned char *)p;
+  return (uint16_t)(((uint16_t)u[0] << 8) | (uint16_t)u[1]);
+}
+
+// size of one descriptor tag, as computed by jbd2's journal_tag_bytes()
+static size_t journal_tag_size(uint32_t incompat) {
+  size_t size;
+  if (incompat & TSK4R_JBD2_FEATURE_CSUM_V3) return 16;
+  size = 12;
+  if (incompat & TSK4R_JBD2_FEATURE_CSUM_V2) size += 2;
+  if (incompat & TSK4R_JBD2_FEATURE_64BIT) return size;
+  return size - 4;
+}
+
+static int read_journal_block(struct tsk4r_journal * j, TSK_DADDR_T jblk, char * dest) {
+  ssize_t got;
+  got = tsk4r_fs_file_read(j->file, (TSK_OFF_T)(jblk * j->block_size), dest,
+                         j->block_size, TSK_FS_FILE_READ_FLAG_NONE);
+  return (got == (ssize_t)j->block_size);
+}
+
+static VALUE close_journal(VALUE arg);
+
+// opens the journal inode and validates its superblock
+static void open_journal(VALUE self, struct tsk4r_journal * j) {
+  struct tsk4r_fs_wrapper * fs_ptr;
+  TSK_FS_INFO * fs;
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  fs = fs_ptr->filesystem;
+
+  if (fs == NULL || fs->journ_inum == 0) {
+    rb_raise(rb_eRuntimeError, "file system has no journal.");
+  }
+  j->file = tsk4r_fs_file_open_meta(fs, NULL, fs->journ_inum);
+  if (j->file == NULL || j->file->meta == NULL) {
+    close_journal((VALUE)j);
+    rb_raise(rb_eRuntimeError, "unable to open journal inode %lu.", (unsigned long)fs->journ_inum);
+  }
+  j->block_size = fs->block_size;
+  j->block_total = (TSK_DADDR_T)(j->file->meta->size / (TSK_OFF_T)fs->block_size);
+  j->buf = ALLOC_N(char, j->block_size);
+  j->tags = ALLOC_N(TSK_DADDR_T, j->block_size / 8 + 1);
+
+  if (! read_journal_block(j, 0, j->buf) || journal_be32(j->buf) != TSK4R_JBD2_MAGIC) {
+    close_journal((VALUE)j);
+    rb_raise(rb_eRuntimeError, "journal superblock not found (not a JBD2 journal?)");
+  }
+  uint32_t sb_type = journal_be32(j->buf + 4);
+  if (sb_type == TSK4R_JBD2_SB_V2) {
+    j->incompat = journal_be32(j->buf + 40);
+  }
+  // s_maxlen bounds the log; the inode may be larger
+  TSK_DADDR_T maxlen = journal_be32(j->buf + 16);
+  if (maxlen > 0 && maxlen < j->block_total) j->block_total = maxlen;
+}
+
+static VALUE close_journal(VALUE arg) {
+  struct tsk4r_journal * j = (struct tsk4r_journal *)arg;
+  if (j->file != NULL) tsk_fs_file_close(j->file);
+  if (j->buf != NULL) xfree(j->buf);
+  if (j->tags != NULL) xfree(j->tags);
+  j->file = NULL; j->buf = NULL; j->tags = NULL;
+  return Qnil;
+}
+
+// records the fs block of every tag in a descriptor block
+static void parse_descriptor(struct tsk4r_journal * j) {
+  size_t tag_size = journal_tag_size(j->incompat);
+  size_t end = j->block_size;
+  size_t off = 12;
+  if (j->incompat & (TSK4R_JBD2_FEATURE_CSUM_V2 | TSK4R_JBD2_FEATURE_CSUM_V3)) end -= 4;
+
+  j->tag_count = 0; j->tag_next = 0;
+  while (off + tag_size <= end) {
+    const char * tag = j->buf + off;
+    uint32_t flags;
+    TSK_DADDR_T addr = journal_be32(tag);
+    if (j->incompat & TSK4R_JBD2_FEATURE_CSUM_V3) {
+      flags = journal_be32(tag + 4);
+    } else {
+      flags = journal_be16(tag + 6);
+    }
+    if (j->incompat & TSK4R_JBD2_FEATURE_64BIT) {
+      addr |= (TSK_DADDR_T)journal_be32(tag + 8) << 32;
+    }
+    j->tags[j->tag_count++] = addr;
+    off += tag_size;
+    if (! (flags & TSK4R_JBD2_FLAG_SAME_UUID)) off += 16;
+    if (flags & TSK4R_JBD2_FLAG_LAST_TAG) break;
+  }
+}
+
+static VALUE journal_entry(TSK_DADDR_T jblk, VALUE fs_block, const char * type, uint32_t seq) {
+  return rb_ary_new3(4, ULL2NUM(jblk), fs_block, ID2SYM(rb_intern(type)), UINT2NUM(seq));
+}
+
+static VALUE walk_journal_entries(VALUE arg) {
+  struct tsk4r_journal * j = (struct tsk4r_journal *)arg;
+  VALUE batch = rb_ary_new2(j->batch_size);
+  uint32_t seq = 0;
+  TSK_DADDR_T jblk;
+
+  for (jblk = 0; jblk < j->block_total; jblk++) {
+    if (! read_journal_block(j, jblk, j->buf)) break;
+
+    if (j->tag_next < j->tag_count) {
+      // blocks following a descriptor are copies of fs blocks
+      rb_ary_push(batch, journal_entry(jblk, ULL2NUM(j->tags[j->tag_next]), "data", seq));
+      j->tag_next++;
+    } else if (journal_be32(j->buf) == TSK4R_JBD2_MAGIC) {
+      uint32_t type = journal_be32(j->buf + 4);
+      seq = journal_be32(j->buf + 8);
+      switch (type) {
+        case TSK4R_JBD2_SB_V1:
+        case TSK4R_JBD2_SB_V2:
+          rb_ary_push(batch, journal_entry(jblk, Qnil, "superblock", seq));
+          break;
+        case TSK4R_JBD2_DESCRIPTOR:
+          rb_ary_push(batch, journal_entry(jblk, Qnil, "descriptor", seq));
+          parse_descriptor(j);
+          break;
+        case TSK4R_JBD2_COMMIT:
+          rb_ary_push(batch, journal_entry(jblk, Qnil, "commit", seq));
+          break;
+        case TSK4R_JBD2_REVOKE:
+          rb_ary_push(batch, journal_entry(jblk, Qnil, "revoke", seq));
+          break;
+        default:
+          break;
+      }
+    }
+    if (RARRAY_LEN(batch) >= j->batch_size) {
+      rb_yield(batch);
+      batch = rb_ary_new2(j->batch_size);
+    }
+  }
+  if (RARRAY_LEN(batch) > 0) rb_yield(batch);
+  return Qnil;
+}
+
+// FileSystem::System#each_journal_entry(batch_size = 512) { |entries| ... }
+// yields Arrays of [journal_block, fs_block, type, sequence] entries
+VALUE each_journal_entry(int argc, VALUE *args, VALUE self) {
+  VALUE batch_size; struct tsk4r_journal j;
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &batch_size);
+
+  MEMZERO(&j, struct tsk4r_journal, 1);
+  j.batch_size = NIL_P(batch_size) ? TSK4R_JOURNAL_BATCH : NUM2LONG(batch_size);
+  if (j.batch_size < 1) j.batch_size = 1;
+
+  open_journal(self, &j);
+  rb_ensure(walk_journal_entries, (VALUE)&j, close_journal, (VALUE)&j);
+  return self;
+}
+
+static VALUE walk_journal_blocks(VALUE arg) {
+  struct tsk4r_journal * j = (struct tsk4r_journal *)arg;
+  VALUE first; VALUE last; int excl = 0;
+  TSK_DADDR_T jblk; TSK_DADDR_T stop; long long bound;
+  VALUE buffer = rb_str_buf_new((long)j->block_size);
+
+  if (rb_obj_is_kind_of(j->range, rb_cRange)) {
+    rb_range_values(j->range, &first, &last, &excl);
+  } else if (NIL_P(j->range)) {
+    first = INT2FIX(0); last = Qnil;
+  } else {
+    first = last = j->range;
+  }
+  bound = NUM2LL(first);
+  if (bound < 0) rb_raise(rb_eArgError, "journal block %lld is negative.", bound);
+  jblk = (TSK_DADDR_T)bound;
+  if (NIL_P(last)) {
+    stop = j->block_total;
+  } else {
+    bound = NUM2LL(last);
+    if (bound < 0) rb_raise(rb_eArgError, "journal block %lld is negative.", bound);
+    stop = (TSK_DADDR_T)bound;
+    if (! excl) stop++;
+    if (stop > j->block_total) stop = j->block_total;
+  }
+
+  for (; jblk < stop; jblk++) {
+    // the caller may have resized or frozen the buffer inside the block
+    rb_str_modify(buffer);
+    rb_str_resize(buffer, (long)j->block_size);
+    if (! read_journal_block(j, jblk, RSTRING_PTR(buffer))) {
+      rb_raise(rb_eRuntimeError, "unable to read journal block %lu.", (unsigned long)jblk);
+    }
+    rb_yield_values(2, ULL2NUM(jblk), buffer);
+  }
+  return Qnil;
+}
+
+// FileSystem::System#journal_blocks(range = nil) { |journal_block, data| ... }
+// the same String is yielded for every block; dup it to keep a copy
+VALUE journal_blocks(int argc, VALUE *args, VALUE self) {
+  VALUE range; struct tsk4r_journal j;
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &range);
+
+  MEMZERO(&j, struct tsk4r_journal, 1);
+  j.range = range;
+  open_journal(self, &j);
+  rb_ensure(walk_journal_blocks, (VALUE)&j, close_journal, (VALUE)&j);
+  return self;
+}
@@ -0,0 +1,19 @@
+//
+//  fs_journal.h
+//  RubyTSK
+//
+//  ext3/ext4 (JBD2) journal access for Sleuthkit::FileSystem::System
+//
+
+#ifndef RubyTSK_fs_journal_h
+#define RubyTSK_fs_journal_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_JOURNAL_BATCH 512
+
+VALUE each_journal_entry(int argc, VALUE *args, VALUE self);
+VALUE journal_blocks(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -0,0 +1,345 @@
+//
+//  fs_pathmap.c
+//  RubyTSK
+//
+//  inum-to-path reverse map for Sleuthkit::FileSystem::System
+//
+//  One recursive name walk (run without the GVL) records a link
+//  {inum, parent inum, name} per directory entry. Name components are
+//  interned into one arena, so a link is 24 bytes and repeated names
+//  ("Thumbs.db", "index.html") are stored once. Links are then sorted by
+//  inum: a lookup is a binary search, and a path is rebuilt by following
+//  each directory's first allocated link up to the root. Every link of a
+//  hard-linked file yields its own path; entries whose parent chain
+//  doesn't reach the root are reported under /$OrphanFiles.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_pathmap.h"
+#include "batch.h"
+#include "stats.h"
+
+extern VALUE rb_cTSKFileSystemPathMap;
+
+#define TSK4R_PATH_ORPHAN "/$OrphanFiles"
+
+struct tsk4r_path_link {
+  TSK_INUM_T inum;
+  TSK_INUM_T parent;
+  uint32_t name;      // offset into the name arena
+  uint32_t unalloc;
+};
+
+struct tsk4r_path_map {
+  struct tsk4r_path_link * links;
+  size_t count;
+  size_t alloc;
+  char * arena;
+  size_t arena_used;
+  size_t arena_alloc;
+  TSK_INUM_T root;
+  unsigned long unique_names;
+
+  // build only: open-addressed intern table of arena offset + 1 (0 = empty)
+  uint32_t * intern;
+  size_t intern_slots;
+  TSK_FS_INFO * fs;       // the System's, only reopened
+  TSK_FS_DIR_WALK_FLAG_ENUM flags;
+  volatile int cancel;
+  int failed;
+  char error[256];
+};
+
+static void deallocate_path_map(void * ptr) {
+  struct tsk4r_path_map * map = (struct tsk4r_path_map *)ptr;
+  free(map->links);
+  free(map->arena);
+  free(map->intern);
+  xfree(map);
+}
+
+static size_t path_map_memsize(const void * ptr) {
+  const struct tsk4r_path_map * map = (const struct tsk4r_path_map *)ptr;
+  return sizeof(struct tsk4r_path_map)
+    + map->alloc * sizeof(struct tsk4r_path_link)
+    + map->arena_alloc
+    + map->intern_slots * sizeof(uint32_t);
+}
+
+const rb_data_type_t tsk4r_path_map_type = {
+  "Sleuthkit::FileSystem::PathMap",
+  TSK4R_DATA_FUNCTIONS(NULL, deallocate_path_map, path_map_memsize, NULL),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY };
+
+static uint32_t name_hash(const char * str) {
+  uint32_t h = 2166136261U;
+  while (*str) { h ^= (unsigned char)*str++; h *= 16777619U; }
+  return h;
+}
+
+static int intern_grow(struct tsk4r_path_map * map) {
+  size_t slots = map->intern_slots ? map->intern_slots * 2 : 4096;
+  uint32_t * table = calloc(slots, sizeof(uint32_t));
+  size_t i;
+  if (table == NULL) return -1;
+  for (i = 0; i < map->intern_slots; i++) {
+    uint32_t entry = map->intern[i];
+    size_t at;
+    if (entry == 0) continue;
+    at = name_hash(map->arena + entry - 1) & (slots - 1);
+    while (table[at] != 0) at = (at + 1) & (slots - 1);
+    table[at] = entry;
+  }
+  free(map->intern);
+  map->intern = table;
+  map->intern_slots = slots;
+  return 0;
+}
+
+// arena offset of str, adding it the first time it's seen; -1 when full
+static int64_t intern_name(struct tsk4r_path_map * map, const char * str) {
+  size_t len = strlen(str);
+  size_t at;
+  if ((map->unique_names + 1) * 2 > map->intern_slots && intern_grow(map) != 0) return -1;
+
+  at = name_hash(str) & (map->intern_slots - 1);
+  while (map->intern[at] != 0) {
+    if (strcmp(map->arena + map->intern[at] - 1, str) == 0) return map->intern[at] - 1;
+    at = (at + 1) & (map->intern_slots - 1);
+  }
+
+  if (map->arena_used + len + 1 >= UINT32_MAX) return -1;
+  if (map->arena_used + len + 1 > map->arena_alloc) {
+    size_t grow = map->arena_alloc ? map->arena_alloc * 2 : 65536;
+    char * arena;
+    while (grow < map->arena_used + len + 1) grow *= 2;
+    arena = realloc(map->arena, grow);
+    if (arena == NULL) return -1;
+    map->arena = arena;
+    map->arena_alloc = grow;
+  }
+  memcpy(map->arena + map->arena_used, str, len + 1);
+  map->intern[at] = (uint32_t)(map->arena_used + 1);
+  map->arena_used += len + 1;
+  map->unique_names++;
+  return map->intern[at] - 1;
+}
+
+static TSK_WALK_RET_ENUM path_map_callback(TSK_FS_FILE * file, const char * path, void * ptr) {
+  struct tsk4r_path_map * map = (struct tsk4r_path_map *)ptr;
+  struct tsk4r_path_link * link;
+  int64_t name;
+
+  if (map->cancel) return TSK_WALK_STOP;
+  if (file->name == NULL || file->name->name == NULL || TSK_FS_ISDOT(file->name->name)) return TSK_WALK_CONT;
+
+  if (map->count == map->alloc) {
+    size_t grow = map->alloc ? map->alloc * 2 : 4096;
+    struct tsk4r_path_link * links = realloc(map->links, grow * sizeof(struct tsk4r_path_link));
+    if (links == NULL) goto full;
+    map->links = links;
+    map->alloc = grow;
+  }
+  name = intern_name(map, file->name->name);
+  if (name < 0) goto full;
+
+  link = &map->links[map->count++];
+  link->inum = file->name->meta_addr;
+  link->parent = file->name->par_addr;
+  link->name = (uint32_t)name;
+  link->unalloc = (file->name->flags & TSK_FS_NAME_FLAG_UNALLOC) ? 1 : 0;
+  return TSK_WALK_CONT;
+
+full:
+  snprintf(map->error, sizeof(map->error), "out of memory");
+  map->failed = 1;
+  return TSK_WALK_ERROR;
+}
+
+// allocated links sort ahead of deleted ones, so a directory's first link
+// is its live name
+static int compare_links(const void * a, const void * b) {
+  const struct tsk4r_path_link * x = a; const struct tsk4r_path_link * y = b;
+  if (x->inum != y->inum) return x->inum < y->inum ? -1 : 1;
+  if (x->unalloc != y->unalloc) return x->unalloc < y->unalloc ? -1 : 1;
+  if (x->parent != y->parent) return x->parent < y->parent ? -1 : 1;
+  return (x->name > y->name) - (x->name < y->name);
+}
+
+// walks a handle of its own: Ruby threads can use the System's
+// TSK_FS_INFO meanwhile, and one isn't safe to share between threads
+static void * build_path_map(void * ptr) {
+  struct tsk4r_path_map * map = (struct tsk4r_path_map *)ptr;
+  TSK_FS_INFO * fs = tsk4r_fs_reopen(map->fs);
+  uint8_t failed;
+
+  if (fs == NULL) {
+    snprintf(map->error, sizeof(map->error), "tsk_fs_open_img: %s", tsk_error_get());
+    map->failed = 1;
+    return NULL;
+  }
+  failed = tsk4r_fs_dir_walk(fs, map->root, map->flags, path_map_callback, map);
+  tsk4r_fs_close(fs);
+  if (failed && ! map->cancel && ! map->failed) {
+    snprintf(map->error, sizeof(map->error), "%s", tsk_error_get());
+    map->failed = 1;
+  }
+  if (map->failed || map->cancel) return NULL;
+
+  qsort(map->links, map->count, sizeof(struct tsk4r_path_link), compare_links);
+  // the intern table is only needed while names are being added
+  free(map->intern);
+  map->intern = NULL;
+  map->intern_slots = 0;
+  if (map->count > 0 && map->count < map->alloc) {
+    struct tsk4r_path_link * links = realloc(map->links, map->count * sizeof(struct tsk4r_path_link));
+    if (links != NULL) { map->links = links; map->alloc = map->count; }
+  }
+  return NULL;
+}
+
+static void cancel_path_map(void * ptr) {
+  ((struct tsk4r_path_map *)ptr)->cancel = 1;
+}
+
+// index of the first link of inum, or count when there is none
+static size_t first_link(const struct tsk4r_path_map * map, TSK_INUM_T inum) {
+  size_t lo = 0, hi = map->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (map->links[mid].inum < inum) lo = mid + 1; else hi = mid;
+  }
+  return (lo < map->count && map->links[lo].inum == inum) ? lo : map->count;
+}
+
+// path of one link: its name under its parent directory's first link
+static VALUE link_path(const struct tsk4r_path_map * map, const struct tsk4r_path_link * link) {
+  uint32_t parts[TSK4R_PATH_MAX_DEPTH];
+  int depth = 0, orphan = 0, i;
+  size_t len = 0;
+  TSK_INUM_T dir = link->parent;
+  VALUE path; char * out;
+
+  parts[depth++] = link->name;
+  while (dir != map->root) {
+    size_t at = first_link(map, dir);
+    if (at == map->count || depth == TSK4R_PATH_MAX_DEPTH) { orphan = 1; break; }
+    parts[depth++] = map->links[at].name;
+    dir = map->links[at].parent;
+  }
+
+  if (orphan) len += strlen(TSK4R_PATH_ORPHAN);
+  for (i = 0; i < depth; i++) len += 1 + strlen(map->arena + parts[i]);
+  path = rb_str_new(NULL, (long)len);
+  out = RSTRING_PTR(path);
+  if (orphan) {
+    memcpy(out, TSK4R_PATH_ORPHAN, strlen(TSK4R_PATH_ORPHAN));
+    out += strlen(TSK4R_PATH_ORPHAN);
+  }
+  for (i = depth - 1; i >= 0; i--) {
+    size_t n = strlen(map->arena + parts[i]);
+    *out++ = '/';
+    memcpy(out, map->arena + parts[i], n);
+    out += n;
+  }
+  return path;
+}
+
+static VALUE inum_path(const struct tsk4r_path_map * map, TSK_INUM_T inum) {
+  size_t at;
+  if (inum == map->root) return rb_str_new2("/");
+  at = first_link(map, inum);
+  return (at == map->count) ? Qnil : link_path(map, &map->links[at]);
+}
+
+// FileSystem::System#path_map(opts = {})
+// opts: :unallocated => false (also map deleted names), :rebuild => false
+// builds the map on first use and keeps it in @path_map; asking for
+// different :unallocated than the kept map was built with builds it again
+VALUE get_fs_path_map(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE obj;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_path_map * map;
+  TSK_FS_DIR_WALK_FLAG_ENUM flags = TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE;
+
+  rb_scan_args(argc, args, "01", &opts);
+  if (RTEST(tsk4r_opt(opts, "unallocated", Qfalse))) flags |= TSK_FS_DIR_WALK_FLAG_UNALLOC;
+  obj = rb_iv_get(self, "@path_map");
+  if (! NIL_P(obj) && ! RTEST(tsk4r_opt(opts, "rebuild", Qfalse))) {
+    TypedData_Get_Struct(obj, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+    if (map->flags == flags) return obj;
+  }
+
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  obj = TypedData_Make_Struct(rb_cTSKFileSystemPathMap, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+  map->fs = fs_ptr->filesystem;
+  map->root = fs_ptr->filesystem->root_inum;
+  map->flags = flags;
+
+  tsk4r_call_interruptible(build_path_map, cancel_path_map, map);
+  map->fs = NULL;
+  if (map->failed) rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_dir_walk exited with an error. (%s)", map->error);
+
+  rb_iv_set(self, "@path_map", obj);
+  return obj;
+}
+
+// PathMap#path_for(inum, all = false)
+// the inum's path (its first allocated link), or with all every link's path;
+// nil (or []) when the walk never reached the inum
+VALUE path_map_path_for(int argc, VALUE *args, VALUE self) {
+  VALUE inum; VALUE all; VALUE paths;
+  struct tsk4r_path_map * map;
+  TSK_INUM_T addr;
+  size_t at;
+
+  rb_scan_args(argc, args, "11", &inum, &all);
+  TypedData_Get_Struct(self, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+  addr = (TSK_INUM_T)NUM2ULL(inum);
+  if (! RTEST(all)) return inum_path(map, addr);
+
+  paths = rb_ary_new();
+  if (addr == map->root) {
+    rb_ary_push(paths, rb_str_new2("/"));
+    return paths;
+  }
+  for (at = first_link(map, addr); at < map->count && map->links[at].inum == addr; at++) {
+    rb_ary_push(paths, link_path(map, &map->links[at]));
+  }
+  return paths;
+}
+
+// PathMap#paths_for(inums): an Array of path_for(inum) results
+VALUE path_map_paths_for(VALUE self, VALUE inums) {
+  struct tsk4r_path_map * map;
+  VALUE paths;
+  long i;
+
+  TypedData_Get_Struct(self, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+  inums = rb_Array(inums);
+  paths = rb_ary_new2(RARRAY_LEN(inums));
+  for (i = 0; i < RARRAY_LEN(inums); i++) {
+    rb_ary_push(paths, inum_path(map, (TSK_INUM_T)NUM2ULL(rb_ary_entry(inums, i))));
+  }
+  return paths;
+}
+
+// PathMap#size: number of links (names) in the map
+VALUE path_map_size(VALUE self) {
+  struct tsk4r_path_map * map;
+  TypedData_Get_Struct(self, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+  return SIZET2NUM(map->count);
+}
+
+// PathMap#unique_names: number of distinct name components in the arena
+VALUE path_map_unique_names(VALUE self) {
+  struct tsk4r_path_map * map;
+  TypedData_Get_Struct(self, struct tsk4r_path_map, &tsk4r_path_map_type, map);
+  return ULONG2NUM(map->unique_names);
+}
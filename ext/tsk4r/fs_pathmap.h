@@ -0,0 +1,25 @@
+//
+//  fs_pathmap.h
+//  RubyTSK
+//
+//  inum-to-path reverse map for Sleuthkit::FileSystem::System
+//
+
+#ifndef RubyTSK_fs_pathmap_h
+#define RubyTSK_fs_pathmap_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+// parent links followed before a chain is treated as an orphan (or a loop)
+#define TSK4R_PATH_MAX_DEPTH 1024
+
+extern const rb_data_type_t tsk4r_path_map_type;
+
+VALUE get_fs_path_map(int argc, VALUE *args, VALUE self);
+VALUE path_map_path_for(int argc, VALUE *args, VALUE self);
+VALUE path_map_paths_for(VALUE self, VALUE inums);
+VALUE path_map_size(VALUE self);
+VALUE path_map_unique_names(VALUE self);
+
+#endif
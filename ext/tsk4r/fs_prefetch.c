@@ -0,0 +1,390 @@
+//
+//  fs_prefetch.c
+//  RubyTSK
+//
+//  producer/consumer directory walk for Sleuthkit::FileSystem::System
+//
+//  A native thread runs tsk_fs_dir_walk, so the directory and MFT/inode
+//  reads happen there, and copies each entry into plain C batches in a
+//  bounded ring. The Ruby thread only converts finished batches and yields
+//  them; when the ring is empty it waits with the GVL released, so other
+//  Ruby threads keep running while the disk catches up. Producer-side
+//  memory comes from malloc, never the Ruby heap.
+//
+//  libtsk handles aren't safe for concurrent use, so the walker opens its
+//  own TSK_FS_INFO on the volume; the block is free to open and read files
+//  through the FileSystem::System it was called on.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_file.h"
+#include "fs_prefetch.h"
+#include "hashset.h"
+#include "batch.h"
+#include "stats.h"
+
+struct tsk4r_prefetch_entry {
+  TSK_INUM_T inum;
+  TSK_INUM_T parent;
+  TSK_OFF_T size;
+  uint32_t seq;
+  int name_type;
+  int meta_type;
+  int name_flags;
+  size_t path;     // offsets into the batch's string arena
+  size_t name;
+};
+
+struct tsk4r_prefetch_batch {
+  struct tsk4r_prefetch_entry * entries;
+  long count;
+  char * arena;
+  size_t arena_used;
+  size_t arena_alloc;
+};
+
+struct tsk4r_prefetch {
+  TSK_FS_INFO * fs;
+  TSK_INUM_T start;
+  TSK_FS_DIR_WALK_FLAG_ENUM flags;
+  long batch_size;
+  long depth;
+  struct tsk4r_prefetch_batch * ring;
+
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_t thread;
+  int started;
+
+  long head;        // next slot the producer fills
+  long tail;        // next slot the consumer takes
+  long filled;      // published, not yet taken
+  int in_use;       // the consumer holds the slot before tail
+  int done;
+  int cancel;
+  int interrupted;
+  int failed;
+  char error[256];
+
+  // skip_known: files whose digest is in the set never leave the producer
+  const struct tsk4r_hash_set * known;
+  char * hash_buf;
+
+  // metrics
+  unsigned long batches;
+  unsigned long entries;
+  unsigned long skipped_known;
+  long max_depth;
+  unsigned long depth_sum;
+  uint64_t consumer_stall_ns;
+  uint64_t producer_stall_ns;
+  uint64_t started_ns;
+};
+
+static uint64_t prefetch_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static size_t arena_push(struct tsk4r_prefetch_batch * b, const char * str) {
+  size_t len = (str == NULL) ? 0 : strlen(str);
+  size_t at = b->arena_used;
+  if (b->arena_used + len + 1 > b->arena_alloc) {
+    size_t grow = b->arena_alloc ? b->arena_alloc * 2 : 4096;
+    char * arena;
+    while (grow < b->arena_used + len + 1) grow *= 2;
+    arena = realloc(b->arena, grow);
+    if (arena == NULL) return (size_t)-1;
+    b->arena = arena;
+    b->arena_alloc = grow;
+  }
+  if (len > 0) memcpy(b->arena + at, str, len);
+  b->arena[at + len] = '\0';
+  b->arena_used += len + 1;
+  return at;
+}
+
+// producer: hand the filled slot over, then wait for a free one
+static int prefetch_publish(struct tsk4r_prefetch * q) {
+  uint64_t t0;
+  int cancel;
+  pthread_mutex_lock(&q->lock);
+  q->head = (q->head + 1) % q->depth;
+  q->filled++;
+  pthread_cond_signal(&q->not_empty);
+  t0 = prefetch_now_ns();
+  while (! q->cancel && q->filled + q->in_use >= q->depth) {
+    pthread_cond_wait(&q->not_full, &q->lock);
+  }
+  q->producer_stall_ns += prefetch_now_ns() - t0;
+  cancel = q->cancel;
+  pthread_mutex_unlock(&q->lock);
+  if (! cancel) {
+    q->ring[q->head].count = 0;
+    q->ring[q->head].arena_used = 0;
+  }
+  return cancel;
+}
+
+static TSK_WALK_RET_ENUM prefetch_callback(TSK_FS_FILE * file, const char * path, void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  struct tsk4r_prefetch_batch * b = &q->ring[q->head];
+  struct tsk4r_prefetch_entry * e;
+
+  if (q->cancel) return TSK_WALK_STOP;
+  if (file->name == NULL || file->name->name == NULL || TSK_FS_ISDOT(file->name->name)) return TSK_WALK_CONT;
+  if (q->known != NULL && file->meta != NULL && file->meta->type == TSK_FS_META_TYPE_REG && file->meta->size > 0) {
+    unsigned char digest[TSK4R_HS_MAX_DIGEST];
+    if (tsk4r_hash_set_digest_file(q->known, file, q->hash_buf, TSK4R_FILE_CHUNK, digest) == 0
+        && tsk4r_hash_set_contains(q->known, digest)) {
+      q->skipped_known++;
+      return TSK_WALK_CONT;
+    }
+  }
+
+  e = &b->entries[b->count];
+  e->inum = file->name->meta_addr;
+  e->parent = file->name->par_addr;
+  e->seq = file->name->meta_seq;
+  e->name_type = file->name->type;
+  e->name_flags = file->name->flags;
+  e->meta_type = file->meta ? file->meta->type : 0;
+  e->size = file->meta ? file->meta->size : 0;
+  e->path = arena_push(b, path);
+  e->name = arena_push(b, file->name->name);
+  if (e->path == (size_t)-1 || e->name == (size_t)-1) {
+    pthread_mutex_lock(&q->lock);
+    snprintf(q->error, sizeof(q->error), "out of memory");
+    q->failed = 1;
+    pthread_mutex_unlock(&q->lock);
+    return TSK_WALK_ERROR;
+  }
+  b->count++;
+
+  if (b->count >= q->batch_size && prefetch_publish(q)) return TSK_WALK_STOP;
+  return TSK_WALK_CONT;
+}
+
+static void * prefetch_producer(void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  uint8_t failed = tsk4r_fs_dir_walk(q->fs, q->start, q->flags, prefetch_callback, q);
+
+  pthread_mutex_lock(&q->lock);
+  if (failed && ! q->cancel && ! q->failed) {
+    // libtsk errors are per thread; copy it out before leaving
+    snprintf(q->error, sizeof(q->error), "%s", tsk_error_get());
+    q->failed = 1;
+  }
+  // the partly filled slot counts as a last batch
+  if (! q->cancel && q->ring[q->head].count > 0) {
+    q->head = (q->head + 1) % q->depth;
+    q->filled++;
+  }
+  q->done = 1;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+  return NULL;
+}
+
+// consumer side, without the GVL
+static void * prefetch_wait(void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  uint64_t t0 = prefetch_now_ns();
+  pthread_mutex_lock(&q->lock);
+  if (q->in_use) {
+    q->in_use = 0;
+    pthread_cond_signal(&q->not_full);
+  }
+  while (q->filled == 0 && ! q->done && ! q->interrupted) {
+    pthread_cond_wait(&q->not_empty, &q->lock);
+  }
+  pthread_mutex_unlock(&q->lock);
+  q->consumer_stall_ns += prefetch_now_ns() - t0;
+  return NULL;
+}
+
+static void prefetch_interrupt(void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  pthread_mutex_lock(&q->lock);
+  q->interrupted = 1;
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static VALUE prefetch_batch_to_ary(struct tsk4r_prefetch_batch * b) {
+  VALUE batch = rb_ary_new2(b->count);
+  long i;
+  for (i = 0; i < b->count; i++) {
+    struct tsk4r_prefetch_entry * e = &b->entries[i];
+    VALUE entry = rb_ary_new2(9);
+    rb_ary_push(entry, ULL2NUM(e->inum));
+    rb_ary_push(entry, UINT2NUM(e->seq));
+    rb_ary_push(entry, ULL2NUM(e->parent));
+    rb_ary_push(entry, rb_str_new2(b->arena + e->path));
+    rb_ary_push(entry, rb_str_new2(b->arena + e->name));
+    rb_ary_push(entry, INT2NUM(e->name_type));
+    rb_ary_push(entry, INT2NUM(e->meta_type));
+    rb_ary_push(entry, LL2NUM(e->size));
+    rb_ary_push(entry, INT2NUM(e->name_flags));
+    rb_ary_push(batch, entry);
+  }
+  return batch;
+}
+
+static VALUE prefetch_consume(VALUE arg) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)arg;
+  long slot; int done;
+
+  if (q->known != NULL) {
+    q->hash_buf = malloc(TSK4R_FILE_CHUNK);
+    if (q->hash_buf == NULL) rb_memerror();
+  }
+  if (pthread_create(&q->thread, NULL, prefetch_producer, q) != 0) {
+    rb_raise(rb_eRuntimeError, "unable to start the prefetch thread.");
+  }
+  q->started = 1;
+
+  for (;;) {
+    rb_thread_call_without_gvl(prefetch_wait, q, prefetch_interrupt, q);
+    pthread_mutex_lock(&q->lock);
+    if (q->interrupted) {
+      q->interrupted = 0;
+      pthread_mutex_unlock(&q->lock);
+      rb_thread_check_ints();
+      continue;
+    }
+    done = (q->filled == 0 && q->done);
+    if (! done) {
+      if (q->filled > q->max_depth) q->max_depth = q->filled;
+      q->depth_sum += q->filled;
+      slot = q->tail;
+      q->tail = (q->tail + 1) % q->depth;
+      q->filled--;
+      q->in_use = 1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    if (done) break;
+
+    q->batches++;
+    q->entries += q->ring[slot].count;
+    rb_yield(prefetch_batch_to_ary(&q->ring[slot]));
+  }
+  // done was set under the lock after the last write to failed
+  if (q->failed) rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_dir_walk exited with an error. (%s)", q->error);
+  return Qnil;
+}
+
+static void prefetch_cancel(void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  pthread_mutex_lock(&q->lock);
+  q->cancel = 1;
+  pthread_cond_broadcast(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static void * prefetch_join(void * ptr) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)ptr;
+  pthread_join(q->thread, NULL);
+  return NULL;
+}
+
+// stops the producer (the block may have raised or broken out) and frees the ring
+static VALUE prefetch_release(VALUE arg) {
+  struct tsk4r_prefetch * q = (struct tsk4r_prefetch *)arg;
+  long i;
+  if (q->started) {
+    prefetch_cancel(q);
+    // the walker stops at its next entry; an interrupt only repeats the cancel
+    rb_thread_call_without_gvl(prefetch_join, q, prefetch_cancel, q);
+  }
+  if (q->fs != NULL) tsk4r_fs_close(q->fs);
+  for (i = 0; i < q->depth; i++) {
+    free(q->ring[i].entries);
+    free(q->ring[i].arena);
+  }
+  free(q->ring);
+  free(q->hash_buf);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+  pthread_mutex_destroy(&q->lock);
+  return Qnil;
+}
+
+static VALUE prefetch_stats(struct tsk4r_prefetch * q) {
+  VALUE stats = rb_hash_new();
+  rb_hash_aset(stats, ID2SYM(rb_intern("batches")), ULONG2NUM(q->batches));
+  rb_hash_aset(stats, ID2SYM(rb_intern("entries")), ULONG2NUM(q->entries));
+  rb_hash_aset(stats, ID2SYM(rb_intern("skipped_known")), ULONG2NUM(q->skipped_known));
+  rb_hash_aset(stats, ID2SYM(rb_intern("queue_depth")), LONG2NUM(q->depth));
+  rb_hash_aset(stats, ID2SYM(rb_intern("max_queue_depth")), LONG2NUM(q->max_depth));
+  rb_hash_aset(stats, ID2SYM(rb_intern("avg_queue_depth")),
+               rb_float_new(q->batches ? (double)q->depth_sum / (double)q->batches : 0.0));
+  rb_hash_aset(stats, ID2SYM(rb_intern("consumer_stall_ns")), ULL2NUM(q->consumer_stall_ns));
+  rb_hash_aset(stats, ID2SYM(rb_intern("producer_stall_ns")), ULL2NUM(q->producer_stall_ns));
+  rb_hash_aset(stats, ID2SYM(rb_intern("elapsed_ns")), ULL2NUM(prefetch_now_ns() - q->started_ns));
+  return stats;
+}
+
+// FileSystem::System#prefetch_walk(opts = {}) { |entries| ... }
+// opts: :start => root inum, :unallocated => false, :batch_size => 1024,
+//       :queue_depth => 8 (batches read ahead of the block),
+//       :skip_known => a Sleuthkit::HashSet; regular files whose content
+//                      hash is in it are dropped by the walker thread
+// yields Arrays of [inum, seq, parent_inum, path, name, name_type, meta_type,
+// size, name_flags] and returns the walk's metrics (also in #prefetch_stats)
+VALUE prefetch_walk(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE start; VALUE stats;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_prefetch q;
+  long i;
+
+  RETURN_ENUMERATOR(self, argc, args);
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  MEMZERO(&q, struct tsk4r_prefetch, 1);
+  start = tsk4r_opt(opts, "start", Qnil);
+  q.start = NIL_P(start) ? fs_ptr->filesystem->root_inum : (TSK_INUM_T)NUM2ULL(start);
+  q.flags = TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE;
+  if (RTEST(tsk4r_opt(opts, "unallocated", Qfalse))) q.flags |= TSK_FS_DIR_WALK_FLAG_UNALLOC;
+  q.batch_size = NUM2LONG(tsk4r_opt(opts, "batch_size", LONG2NUM(TSK4R_BATCH_SIZE)));
+  q.depth = NUM2LONG(tsk4r_opt(opts, "queue_depth", LONG2NUM(TSK4R_PREFETCH_DEPTH)));
+  if (q.batch_size < 1) q.batch_size = 1;
+  if (q.depth < 2) q.depth = 2;
+  q.known = tsk4r_hash_set_get(tsk4r_opt(opts, "skip_known", Qnil));
+
+  q.ring = calloc((size_t)q.depth, sizeof(struct tsk4r_prefetch_batch));
+  if (q.ring == NULL) rb_memerror();
+  for (i = 0; i < q.depth; i++) {
+    q.ring[i].entries = malloc((size_t)q.batch_size * sizeof(struct tsk4r_prefetch_entry));
+    if (q.ring[i].entries == NULL) {
+      while (i-- > 0) free(q.ring[i].entries);
+      free(q.ring);
+      rb_memerror();
+    }
+  }
+  q.fs = tsk4r_fs_reopen(fs_ptr->filesystem);
+  if (q.fs == NULL) {
+    for (i = 0; i < q.depth; i++) free(q.ring[i].entries);
+    free(q.ring);
+    rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_open_img exited with an error. (%s)", tsk_error_get());
+  }
+  pthread_mutex_init(&q.lock, NULL);
+  pthread_cond_init(&q.not_empty, NULL);
+  pthread_cond_init(&q.not_full, NULL);
+  q.started_ns = prefetch_now_ns();
+
+  rb_ensure(prefetch_consume, (VALUE)&q, prefetch_release, (VALUE)&q);
+  stats = prefetch_stats(&q);
+  rb_iv_set(self, "@prefetch_stats", stats);
+  RB_GC_GUARD(opts);   // keeps a skip_known set mapped until the walker is done
+  return stats;
+}
@@ -0,0 +1,19 @@
+//
+//  fs_prefetch.h
+//  RubyTSK
+//
+//  producer/consumer directory walk for Sleuthkit::FileSystem::System
+//
+
+#ifndef RubyTSK_fs_prefetch_h
+#define RubyTSK_fs_prefetch_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+// batches the walker thread may run ahead of the Ruby block
+#define TSK4R_PREFETCH_DEPTH 8
+
+VALUE prefetch_walk(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -0,0 +1,762 @@
+//
+//  fs_search.c
+//  RubyTSK
+//
+//  FileSystem::System#search: multi-keyword search of file content,
+//  slack and unallocated space
+//
+//  Every keyword, in every requested encoding, goes into one Aho-Corasick
+//  automaton. It stays about 17 bytes a state: sorted child rows plus
+//  failure links, with full 256-entry rows only for the shallowest states,
+//  where scanning spends nearly all its time; each input byte costs one
+//  lookup there, and amortized at most two transitions anywhere. Worker
+//  threads take work items in turn: an allocated regular file (read through libtsk with its
+//  slack, one automaton state carried across reads) or a 1 MiB piece of an
+//  unallocated run (read with keyword-length overlap into the next piece).
+//  Each worker has fixed buffers; hits are the only memory that grows, and
+//  :max_hits bounds them. A TSK_FS_INFO isn't safe to share between
+//  threads, so each worker reads files through its own handle on the
+//  volume; the shared one only serves the metadata walk and the
+//  unallocated runs, before any worker starts.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_block.h"
+#include "fs_file.h"
+#include "fs_search.h"
+#include "batch.h"
+#include "stats.h"
+
+extern VALUE rb_cTSKFileSystem;
+
+enum tsk4r_search_encoding {
+  TSK4R_SEARCH_ASCII,
+  TSK4R_SEARCH_UTF16LE,
+  TSK4R_SEARCH_ENCODINGS
+};
+
+static const char * TSK4R_SEARCH_ENCODING_NAMES[TSK4R_SEARCH_ENCODINGS] = { "ascii", "utf16le" };
+
+struct tsk4r_ac_pattern {
+  long keyword;
+  int encoding;
+  size_t len;
+  int32_t same;         // next pattern ending in the same state, or -1
+  unsigned char * check;  // keyword bytes a hit must match (see ac_check), or NULL
+};
+
+struct tsk4r_ac {
+  // the trie, as ac_add builds it
+  int32_t * child;      // first child, or -1
+  int32_t * sibling;    // next child of the same parent, by byte, or -1
+  unsigned char * label;  // byte on the edge into the state
+  int32_t * out;        // a pattern ending in the state, or -1
+  size_t states;
+  size_t alloc;
+  // ac_compile renumbers the states breadth first; the children of a
+  // state are then first[s] ... first[s + 1] - 1, ordered by label
+  int32_t * first;
+  int32_t * fail;
+  int32_t * out_link;   // nearest proper suffix state with output, or -1
+  int32_t * dense;      // full rows, failures folded in, for the first dense_states
+  size_t dense_states;
+  struct tsk4r_ac_pattern * patterns;
+  size_t pattern_count;
+  size_t max_len;
+  int ignore_case;
+  unsigned char fold[256];
+};
+
+struct tsk4r_search_hit {
+  int32_t pattern;
+  int unallocated;
+  int slack;
+  TSK_INUM_T inum;
+  TSK_OFF_T file_offset;
+  TSK_OFF_T image_offset;   // -1 where the data has no fixed place in the image
+};
+
+struct tsk4r_search_piece {
+  TSK_OFF_T offset;
+  TSK_OFF_T length;
+  TSK_OFF_T end;
+};
+
+struct tsk4r_search_job {
+  TSK_FS_INFO * fs;
+  struct tsk4r_ac ac;
+  int threads;
+  int files;
+  int unallocated;
+  int encodings[TSK4R_SEARCH_ENCODINGS];
+  size_t max_hits;          // 0: no limit
+
+  TSK_INUM_T * inums;
+  size_t inum_count;
+  size_t inum_alloc;
+  struct tsk4r_search_piece * pieces;
+  size_t piece_count;
+  size_t piece_alloc;
+  size_t next;
+  pthread_mutex_t lock;
+
+  struct tsk4r_search_hit * hits;
+  size_t hit_count;
+  size_t hit_alloc;
+  int full;                 // max_hits reached
+
+  volatile int cancel;
+  const char * failed;
+  char error[256];
+};
+
+// automaton
+
+static int32_t ac_new_state(struct tsk4r_ac * ac) {
+  size_t s;
+  if (ac->states == ac->alloc) {
+    size_t grow = ac->alloc ? ac->alloc * 2 : 256;
+    int32_t * child = realloc(ac->child, grow * sizeof(int32_t));
+    int32_t * sibling;
+    unsigned char * label;
+    int32_t * out;
+    if (child == NULL) return -1;
+    ac->child = child;
+    sibling = realloc(ac->sibling, grow * sizeof(int32_t));
+    if (sibling == NULL) return -1;
+    ac->sibling = sibling;
+    label = realloc(ac->label, grow);
+    if (label == NULL) return -1;
+    ac->label = label;
+    out = realloc(ac->out, grow * sizeof(int32_t));
+    if (out == NULL) return -1;
+    ac->out = out;
+    ac->alloc = grow;
+  }
+  s = ac->states++;
+  ac->child[s] = -1;
+  ac->sibling[s] = -1;
+  ac->label[s] = 0;
+  ac->out[s] = -1;
+  return (int32_t)s;
+}
+
+static int ascii_letter(unsigned char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+}
+
+// with :ignore_case the automaton folds every byte it reads, but a UTF-16
+// keyword only folds its ASCII code units; one with a unit like U+0141,
+// whose low byte is 'A', gets its hits checked against its own bytes
+static int ac_needs_check(const struct tsk4r_ac * ac, const unsigned char * bytes, size_t len, int encoding) {
+  size_t i;
+  if (! ac->ignore_case || encoding != TSK4R_SEARCH_UTF16LE) return 0;
+  for (i = 0; i + 1 < len; i += 2) {
+    if (bytes[i + 1] != 0 && (ascii_letter(bytes[i]) || ascii_letter(bytes[i + 1]))) return 1;
+  }
+  return 0;
+}
+
+static int ac_add(struct tsk4r_ac * ac, const unsigned char * bytes, size_t len, long keyword, int encoding) {
+  int32_t s = 0;
+  size_t i;
+  struct tsk4r_ac_pattern * p = &ac->patterns[ac->pattern_count];
+
+  for (i = 0; i < len; i++) {
+    unsigned char c = ac->fold[bytes[i]];
+    int32_t prev = -1, t = ac->child[s];
+    while (t >= 0 && ac->label[t] < c) {
+      prev = t;
+      t = ac->sibling[t];
+    }
+    if (t < 0 || ac->label[t] != c) {
+      if (ac->states >= TSK4R_SEARCH_MAX_STATES) return -2;
+      t = ac_new_state(ac);
+      if (t < 0) return -1;
+      ac->label[t] = c;
+      if (prev < 0) {
+        ac->sibling[t] = ac->child[s];
+        ac->child[s] = t;
+      } else {
+        ac->sibling[t] = ac->sibling[prev];
+        ac->sibling[prev] = t;
+      }
+    }
+    s = t;
+  }
+  p->check = NULL;
+  if (ac_needs_check(ac, bytes, len, encoding)) {
+    p->check = malloc(len);
+    if (p->check == NULL) return -1;
+    memcpy(p->check, bytes, len);
+  }
+  ac->pattern_count++;
+  p->keyword = keyword;
+  p->encoding = encoding;
+  p->len = len;
+  p->same = ac->out[s];
+  ac->out[s] = (int32_t)(p - ac->patterns);
+  if (len > ac->max_len) ac->max_len = len;
+  return 0;
+}
+
+// the state after reading byte c (already folded) in state s; the root is
+// always dense, so the failure chain ends
+static inline int32_t ac_step(const struct tsk4r_ac * ac, int32_t s, unsigned char c) {
+  for (;;) {
+    int32_t lo, hi;
+    if ((size_t)s < ac->dense_states) return ac->dense[(size_t)s * 256 + c];
+    lo = ac->first[s];
+    hi = ac->first[s + 1];
+    while (lo < hi) {
+      int32_t mid = lo + (hi - lo) / 2;
+      if (ac->label[mid] == c) return mid;
+      if (ac->label[mid] < c) lo = mid + 1; else hi = mid;
+    }
+    s = ac->fail[s];
+  }
+}
+
+// renumbers the trie breadth first, then fills in failure links, output
+// links and the dense rows; a state's failure is always numbered lower,
+// so one pass in order has everything it needs
+static int ac_compile(struct tsk4r_ac * ac) {
+  size_t n = ac->states, head = 0, tail = 0, r;
+  int32_t * order = malloc(n * sizeof(int32_t));
+  unsigned char * label = malloc(n);
+  int32_t * out = malloc(n * sizeof(int32_t));
+  int c;
+
+  ac->first = malloc((n + 1) * sizeof(int32_t));
+  ac->fail = malloc(n * sizeof(int32_t));
+  ac->out_link = malloc(n * sizeof(int32_t));
+  ac->dense_states = n < TSK4R_SEARCH_DENSE_STATES ? n : TSK4R_SEARCH_DENSE_STATES;
+  ac->dense = malloc(ac->dense_states * 256 * sizeof(int32_t));
+  if (order == NULL || label == NULL || out == NULL || ac->first == NULL || ac->fail == NULL ||
+      ac->out_link == NULL || ac->dense == NULL) {
+    free(order);
+    free(label);
+    free(out);
+    return -1;
+  }
+
+  // a state's children are queued together, so they get consecutive numbers
+  order[tail++] = 0;
+  while (head < tail) {
+    int32_t s = order[head];
+    int32_t t;
+    ac->first[head++] = (int32_t)tail;
+    for (t = ac->child[s]; t >= 0; t = ac->sibling[t]) order[tail++] = t;
+  }
+  ac->first[n] = (int32_t)n;
+  for (r = 0; r < n; r++) {
+    label[r] = ac->label[order[r]];
+    out[r] = ac->out[order[r]];
+  }
+  free(order);
+  free(ac->label);
+  free(ac->out);
+  free(ac->child);
+  free(ac->sibling);
+  ac->label = label;
+  ac->out = out;
+  ac->child = NULL;
+  ac->sibling = NULL;
+
+  ac->fail[0] = 0;
+  ac->out_link[0] = -1;
+  for (r = 0; r < n; r++) {
+    int32_t u;
+    if (r < ac->dense_states) {
+      int32_t * row = ac->dense + r * 256;
+      for (c = 0; c < 256; c++) row[c] = r == 0 ? 0 : ac->dense[(size_t)ac->fail[r] * 256 + c];
+      for (u = ac->first[r]; u < ac->first[r + 1]; u++) row[ac->label[u]] = u;
+    }
+    for (u = ac->first[r]; u < ac->first[r + 1]; u++) {
+      int32_t f = r == 0 ? 0 : ac_step(ac, ac->fail[r], ac->label[u]);
+      ac->fail[u] = f;
+      ac->out_link[u] = ac->out[f] >= 0 ? f : ac->out_link[f];
+    }
+  }
+  return 0;
+}
+
+// a hit on a pattern with check bytes: ASCII code units match in either
+// case, everything else byte for byte
+static int ac_check(const struct tsk4r_ac * ac, const struct tsk4r_ac_pattern * p, const unsigned char * at) {
+  size_t i;
+  for (i = 0; i < p->len; i++) {
+    int ascii_unit = (i % 2) == 0 && i + 1 < p->len && p->check[i + 1] == 0 && p->check[i] < 0x80;
+    if (ascii_unit ? ac->fold[at[i]] != ac->fold[p->check[i]] : at[i] != p->check[i]) return 0;
+  }
+  return 1;
+}
+
+static void ac_free(struct tsk4r_ac * ac) {
+  size_t i;
+  free(ac->child);
+  free(ac->sibling);
+  free(ac->label);
+  free(ac->out);
+  free(ac->first);
+  free(ac->fail);
+  free(ac->out_link);
+  free(ac->dense);
+  for (i = 0; i < ac->pattern_count; i++) free(ac->patterns[i].check);
+  free(ac->patterns);
+}
+
+// hits
+
+static void search_fail(struct tsk4r_search_job * job, const char * function, const char * error) {
+  pthread_mutex_lock(&job->lock);
+  if (job->failed == NULL) {
+    job->failed = function;
+    snprintf(job->error, sizeof(job->error), "%s", error);
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+static int search_add_hits(struct tsk4r_search_job * job, const struct tsk4r_search_hit * hits, size_t count) {
+  size_t i;
+  int stop = 0;
+  pthread_mutex_lock(&job->lock);
+  for (i = 0; i < count && ! job->full; i++) {
+    if (job->hit_count == job->hit_alloc) {
+      size_t grow = job->hit_alloc ? job->hit_alloc * 2 : 1024;
+      struct tsk4r_search_hit * more = realloc(job->hits, grow * sizeof(struct tsk4r_search_hit));
+      if (more == NULL) {
+        // search_fail takes the lock itself
+        if (job->failed == NULL) {
+          job->failed = "search";
+          snprintf(job->error, sizeof(job->error), "out of memory");
+        }
+        stop = 1;
+        break;
+      }
+      job->hits = more;
+      job->hit_alloc = grow;
+    }
+    job->hits[job->hit_count++] = hits[i];
+    if (job->max_hits && job->hit_count >= job->max_hits) job->full = 1;
+  }
+  if (job->full) stop = 1;
+  pthread_mutex_unlock(&job->lock);
+  return stop ? -1 : 0;
+}
+
+struct tsk4r_search_worker {
+  struct tsk4r_search_job * job;
+  TSK_FS_INFO * fs;                 // this worker's own handle
+  unsigned char * buf;
+  struct tsk4r_search_hit * hits;   // this worker's batch
+  size_t hit_count;
+  size_t hit_alloc;
+};
+
+static int flush_hits(struct tsk4r_search_worker * w) {
+  int err = search_add_hits(w->job, w->hits, w->hit_count);
+  w->hit_count = 0;
+  return err;
+}
+
+static int push_hit(struct tsk4r_search_worker * w, const struct tsk4r_search_hit * hit) {
+  if (w->hit_count == w->hit_alloc) {
+    if (w->hit_alloc >= 4096) {
+      if (flush_hits(w) != 0) return -1;
+    } else {
+      size_t grow = w->hit_alloc ? w->hit_alloc * 2 : 256;
+      struct tsk4r_search_hit * more = realloc(w->hits, grow * sizeof(struct tsk4r_search_hit));
+      if (more == NULL) {
+        search_fail(w->job, "search", "out of memory");
+        return -1;
+      }
+      w->hits = more;
+      w->hit_alloc = grow;
+    }
+  }
+  w->hits[w->hit_count++] = *hit;
+  return 0;
+}
+
+// the image offset of a file offset, through the attribute's runs
+static TSK_OFF_T file_to_image(const TSK_FS_INFO * fs, const TSK_FS_ATTR * attr, TSK_OFF_T offset) {
+  const TSK_FS_ATTR_RUN * run;
+  TSK_DADDR_T block;
+  if (attr == NULL || ! (attr->flags & TSK_FS_ATTR_NONRES) || (attr->flags & (TSK_FS_ATTR_COMP | TSK_FS_ATTR_ENC))) return -1;
+  block = (TSK_DADDR_T)(offset / fs->block_size);
+  for (run = attr->nrd.run; run != NULL; run = run->next) {
+    if (block < run->offset || block >= run->offset + run->len) continue;
+    if (run->flags & (TSK_FS_ATTR_RUN_FLAG_SPARSE | TSK_FS_ATTR_RUN_FLAG_FILLER)) return -1;
+    return fs->offset + (TSK_OFF_T)((run->addr + block - run->offset) * fs->block_size) + offset % fs->block_size;
+  }
+  return -1;
+}
+
+// runs the automaton over buf; base is the stream position of buf[0].
+// owned limits reported hits to those starting before it (stream positions).
+// The bytes before buf must hold the stream's previous max_len - 1 bytes
+// (or all of them, nearer its start), for ac_check
+static int scan_bytes(struct tsk4r_search_worker * w, int32_t * state, const unsigned char * buf, size_t len,
+                      TSK_OFF_T base, TSK_OFF_T owned, struct tsk4r_search_hit * tmpl,
+                      const TSK_FS_ATTR * attr, TSK_OFF_T size) {
+  const struct tsk4r_ac * ac = &w->job->ac;
+  int32_t s = *state;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    int32_t o;
+    s = ac_step(ac, s, ac->fold[buf[i]]);
+    o = ac->out[s] >= 0 ? s : ac->out_link[s];
+    while (o >= 0) {
+      int32_t p;
+      for (p = ac->out[o]; p >= 0; p = ac->patterns[p].same) {
+        const struct tsk4r_ac_pattern * pattern = &ac->patterns[p];
+        TSK_OFF_T start = base + (TSK_OFF_T)i + 1 - (TSK_OFF_T)pattern->len;
+        if (start >= owned) continue;
+        if (pattern->check != NULL && ! ac_check(ac, pattern, buf + i + 1 - pattern->len)) continue;
+        tmpl->pattern = p;
+        if (tmpl->unallocated) {
+          tmpl->image_offset = start;
+        } else {
+          tmpl->file_offset = start;
+          tmpl->slack = start >= size;
+          tmpl->image_offset = file_to_image(w->fs, attr, start);
+        }
+        if (push_hit(w, tmpl) != 0) return -1;
+      }
+      o = ac->out_link[o];
+    }
+  }
+  *state = s;
+  return 0;
+}
+
+static int search_file(struct tsk4r_search_worker * w, TSK_INUM_T inum) {
+  struct tsk4r_search_job * job = w->job;
+  struct tsk4r_search_hit tmpl;
+  const TSK_FS_ATTR * attr;
+  TSK_FS_FILE * file = tsk4r_fs_file_open_meta(w->fs, NULL, inum);
+  TSK_OFF_T offset = 0, end, size;
+  size_t keep = 0;          // bytes of the previous read kept before the next
+  int32_t state = 0;
+  int err = 0;
+
+  if (file == NULL || file->meta == NULL) {
+    tsk_error_reset();
+    if (file != NULL) tsk_fs_file_close(file);
+    return 0;
+  }
+  attr = tsk_fs_file_attr_get(file);
+  size = file->meta->size;
+  end = (attr != NULL && (attr->flags & TSK_FS_ATTR_NONRES) && attr->nrd.allocsize > size) ? attr->nrd.allocsize : size;
+  memset(&tmpl, 0, sizeof(tmpl));
+  tmpl.inum = inum;
+  while (offset < end && ! job->cancel && ! job->full) {
+    size_t want = (size_t)(end - offset < TSK4R_FILE_CHUNK ? end - offset : TSK4R_FILE_CHUNK);
+    ssize_t got = tsk4r_fs_file_read(file, offset, (char *)w->buf + keep, want, TSK_FS_FILE_READ_FLAG_SLACK);
+    if (got <= 0) {
+      tsk_error_reset();
+      break;
+    }
+    if (scan_bytes(w, &state, w->buf + keep, (size_t)got, offset, end, &tmpl, attr, size) != 0) {
+      err = -1;
+      break;
+    }
+    offset += got;
+    if (job->ac.max_len > 1) {
+      size_t have = keep + (size_t)got;
+      keep = have < job->ac.max_len - 1 ? have : job->ac.max_len - 1;
+      memmove(w->buf, w->buf + have - keep, keep);
+    }
+  }
+  tsk_fs_file_close(file);
+  return err;
+}
+
+static int search_piece(struct tsk4r_search_worker * w, const struct tsk4r_search_piece * piece) {
+  struct tsk4r_search_job * job = w->job;
+  struct tsk4r_search_hit tmpl;
+  TSK_OFF_T want = piece->length + (TSK_OFF_T)job->ac.max_len - 1;
+  int32_t state = 0;
+  ssize_t got;
+
+  if (piece->offset + want > piece->end) want = piece->end - piece->offset;
+  got = tsk4r_img_read(job->fs->img_info, piece->offset, (char *)w->buf, (size_t)want);
+  if (got < 0) {
+    search_fail(job, "tsk_img_read", tsk_error_get());
+    tsk_error_reset();
+    return -1;
+  }
+  memset(&tmpl, 0, sizeof(tmpl));
+  tmpl.unallocated = 1;
+  tmpl.file_offset = -1;
+  return scan_bytes(w, &state, w->buf, (size_t)got, piece->offset, piece->offset + piece->length, &tmpl, NULL, 0);
+}
+
+static void * search_worker(void * ptr) {
+  struct tsk4r_search_worker w;
+  struct tsk4r_search_job * job = (struct tsk4r_search_job *)ptr;
+  // a piece with its overlap, or a file read after the kept tail
+  size_t buf_len = (TSK4R_SEARCH_CHUNK > TSK4R_FILE_CHUNK ? TSK4R_SEARCH_CHUNK : TSK4R_FILE_CHUNK) + job->ac.max_len;
+
+  memset(&w, 0, sizeof(w));
+  w.job = job;
+  w.buf = malloc(buf_len);
+  if (w.buf == NULL) {
+    search_fail(job, "search", "out of memory");
+    return NULL;
+  }
+  if ((w.fs = tsk4r_fs_reopen(job->fs)) == NULL) {
+    search_fail(job, "tsk_fs_open_img", tsk_error_get());
+    tsk_error_reset();
+    free(w.buf);
+    return NULL;
+  }
+  for (;;) {
+    size_t i;
+    int err;
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->inum_count + job->piece_count || job->cancel || job->failed || job->full) break;
+    err = i < job->inum_count ? search_file(&w, job->inums[i]) : search_piece(&w, &job->pieces[i - job->inum_count]);
+    if (err != 0 || flush_hits(&w) != 0) break;
+  }
+  tsk4r_fs_close(w.fs);
+  free(w.hits);
+  free(w.buf);
+  return NULL;
+}
+
+// work lists
+
+static TSK_WALK_RET_ENUM search_meta_callback(TSK_FS_FILE * file, void * ptr) {
+  struct tsk4r_search_job * job = (struct tsk4r_search_job *)ptr;
+  if (job->cancel) return TSK_WALK_STOP;
+  if (file->meta == NULL || file->meta->type != TSK_FS_META_TYPE_REG) return TSK_WALK_CONT;
+  if (job->inum_count == job->inum_alloc) {
+    size_t grow = job->inum_alloc ? job->inum_alloc * 2 : 4096;
+    TSK_INUM_T * more = realloc(job->inums, grow * sizeof(TSK_INUM_T));
+    if (more == NULL) {
+      search_fail(job, "search", "out of memory");
+      return TSK_WALK_ERROR;
+    }
+    job->inums = more;
+    job->inum_alloc = grow;
+  }
+  job->inums[job->inum_count++] = file->meta->addr;
+  return TSK_WALK_CONT;
+}
+
+static int add_pieces(void * ptr, TSK_OFF_T offset, TSK_OFF_T length) {
+  struct tsk4r_search_job * job = (struct tsk4r_search_job *)ptr;
+  TSK_OFF_T end = offset + length, at;
+  for (at = offset; at < end; at += TSK4R_SEARCH_CHUNK) {
+    struct tsk4r_search_piece * p;
+    if (job->piece_count == job->piece_alloc) {
+      size_t grow = job->piece_alloc ? job->piece_alloc * 2 : 256;
+      struct tsk4r_search_piece * more = realloc(job->pieces, grow * sizeof(struct tsk4r_search_piece));
+      if (more == NULL) return -1;
+      job->pieces = more;
+      job->piece_alloc = grow;
+    }
+    p = &job->pieces[job->piece_count++];
+    p->offset = at;
+    p->length = end - at < TSK4R_SEARCH_CHUNK ? end - at : TSK4R_SEARCH_CHUNK;
+    p->end = end;
+  }
+  return 0;
+}
+
+static int compare_search_hits(const void * a, const void * b) {
+  const struct tsk4r_search_hit * x = a; const struct tsk4r_search_hit * y = b;
+  if (x->unallocated != y->unallocated) return x->unallocated - y->unallocated;
+  if (! x->unallocated) {
+    if (x->inum != y->inum) return x->inum < y->inum ? -1 : 1;
+    if (x->file_offset != y->file_offset) return x->file_offset < y->file_offset ? -1 : 1;
+  } else if (x->image_offset != y->image_offset) {
+    return x->image_offset < y->image_offset ? -1 : 1;
+  }
+  return x->pattern - y->pattern;
+}
+
+static void * run_search(void * ptr) {
+  struct tsk4r_search_job * job = (struct tsk4r_search_job *)ptr;
+  pthread_t * workers;
+  int started = 0, t;
+
+  if (ac_compile(&job->ac) != 0) {
+    search_fail(job, "search", "out of memory");
+    return NULL;
+  }
+  if (job->files) {
+    uint8_t failed = tsk4r_fs_meta_walk(job->fs, job->fs->first_inum, job->fs->last_inum,
+                                      TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED, search_meta_callback, job);
+    if (job->cancel || job->failed) return NULL;
+    if (failed) {
+      search_fail(job, "tsk_fs_meta_walk", tsk_error_get());
+      return NULL;
+    }
+  }
+  if (job->unallocated) {
+    int failed = tsk4r_unalloc_runs(job->fs, &job->cancel, add_pieces, job);
+    if (job->cancel) return NULL;
+    if (failed) {
+      search_fail(job, "tsk_fs_block_walk", failed > 0 ? tsk_error_get() : "out of memory");
+      return NULL;
+    }
+  }
+
+  workers = malloc((size_t)job->threads * sizeof(pthread_t));
+  if (workers != NULL) {
+    for (t = 0; t < job->threads; t++) {
+      if (pthread_create(&workers[t], NULL, search_worker, job) != 0) break;
+      started++;
+    }
+  }
+  if (started == 0) search_worker(job);
+  for (t = 0; t < started; t++) pthread_join(workers[t], NULL);
+  free(workers);
+
+  if (! job->cancel && ! job->failed) qsort(job->hits, job->hit_count, sizeof(struct tsk4r_search_hit), compare_search_hits);
+  return NULL;
+}
+
+static void cancel_search(void * ptr) {
+  ((struct tsk4r_search_job *)ptr)->cancel = 1;
+}
+
+struct tsk4r_search_args {
+  struct tsk4r_search_job * job;
+  VALUE keywords;
+};
+
+static VALUE search_result(VALUE arg) {
+  struct tsk4r_search_args * a = (struct tsk4r_search_args *)arg;
+  struct tsk4r_search_job * job = a->job;
+  VALUE klass = rb_const_get(rb_cTSKFileSystem, rb_intern("SearchHit"));
+  VALUE encodings[TSK4R_SEARCH_ENCODINGS];
+  VALUE result;
+  size_t i;
+  int e;
+
+  tsk4r_call_interruptible(run_search, cancel_search, job);
+  if (job->failed) rb_raise(rb_eRuntimeError, "TSK function: %s exited with an error. (%s)", job->failed, job->error);
+
+  for (e = 0; e < TSK4R_SEARCH_ENCODINGS; e++) encodings[e] = ID2SYM(rb_intern(TSK4R_SEARCH_ENCODING_NAMES[e]));
+  result = rb_ary_new2((long)job->hit_count);
+  for (i = 0; i < job->hit_count; i++) {
+    const struct tsk4r_search_hit * h = &job->hits[i];
+    const struct tsk4r_ac_pattern * p = &job->ac.patterns[h->pattern];
+    rb_ary_push(result, rb_struct_new(klass, rb_ary_entry(a->keywords, p->keyword), encodings[p->encoding],
+                                      h->unallocated ? Qnil : ULL2NUM(h->inum),
+                                      h->unallocated ? Qnil : LL2NUM(h->file_offset),
+                                      h->image_offset < 0 ? Qnil : LL2NUM(h->image_offset),
+                                      h->slack ? Qtrue : Qfalse));
+  }
+  return result;
+}
+
+static VALUE release_search(VALUE arg) {
+  struct tsk4r_search_job * job = ((struct tsk4r_search_args *)arg)->job;
+  ac_free(&job->ac);
+  free(job->inums);
+  free(job->pieces);
+  free(job->hits);
+  pthread_mutex_destroy(&job->lock);
+  return Qnil;
+}
+
+// the keyword's bytes in one encoding (UTF-16LE through String#encode)
+static VALUE keyword_bytes(VALUE keyword, int encoding) {
+  if (encoding == TSK4R_SEARCH_UTF16LE) return rb_funcall(keyword, rb_intern("encode"), 1, rb_str_new2("UTF-16LE"));
+  return keyword;
+}
+
+static VALUE build_search(VALUE arg) {
+  struct tsk4r_search_args * a = (struct tsk4r_search_args *)arg;
+  struct tsk4r_search_job * job = a->job;
+  long i; int e;
+
+  job->ac.patterns = malloc((size_t)RARRAY_LEN(a->keywords) * TSK4R_SEARCH_ENCODINGS * sizeof(struct tsk4r_ac_pattern));
+  if (job->ac.patterns == NULL || ac_new_state(&job->ac) < 0) rb_memerror();
+  for (i = 0; i < RARRAY_LEN(a->keywords); i++) {
+    for (e = 0; e < TSK4R_SEARCH_ENCODINGS; e++) {
+      VALUE bytes; int err;
+      if (! job->encodings[e]) continue;
+      bytes = keyword_bytes(rb_ary_entry(a->keywords, i), e);
+      err = ac_add(&job->ac, (const unsigned char *)RSTRING_PTR(bytes), (size_t)RSTRING_LEN(bytes), i, e);
+      if (err == -1) rb_memerror();
+      if (err == -2) rb_raise(rb_eArgError, "too many keywords (automaton over %d states)", TSK4R_SEARCH_MAX_STATES);
+    }
+  }
+  return search_result(arg);
+}
+
+// FileSystem::System#search(keywords, opts = {})
+// opts: :encodings => [:ascii, :utf16le], :threads => 4,
+//       :ignore_case => false (ASCII letters; in UTF-16, only ASCII
+//       code units), :files => true (allocated
+//       regular files, slack included), :unallocated => true,
+//       :max_hits => nil (stop after that many)
+// returns FileSystem::System::SearchHit structs (keyword, encoding, inum,
+// file_offset, image_offset, slack), file hits by inum and offset first,
+// then unallocated hits (inum and file_offset nil) by image offset
+VALUE search_filesystem(int argc, VALUE *args, VALUE self) {
+  VALUE keywords; VALUE opts; VALUE encodings; VALUE max_hits; VALUE result;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_search_job job;
+  struct tsk4r_search_args a;
+  long i; int c, e;
+
+  rb_scan_args(argc, args, "11", &keywords, &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  keywords = rb_ary_dup(rb_Array(keywords));
+  for (i = 0; i < RARRAY_LEN(keywords); i++) {
+    VALUE keyword = rb_ary_entry(keywords, i);
+    StringValue(keyword);
+    if (RSTRING_LEN(keyword) == 0) rb_raise(rb_eArgError, "keywords can't be empty");
+    rb_ary_store(keywords, i, keyword);
+  }
+  if (RARRAY_LEN(keywords) == 0) rb_raise(rb_eArgError, "no keywords given");
+
+  MEMZERO(&job, struct tsk4r_search_job, 1);
+  job.fs = fs_ptr->filesystem;
+  job.unallocated = RTEST(tsk4r_opt(opts, "unallocated", Qtrue));
+  encodings = rb_Array(tsk4r_opt(opts, "encodings", Qnil));
+  if (RARRAY_LEN(encodings) == 0) encodings = rb_ary_new3(2, ID2SYM(rb_intern("ascii")), ID2SYM(rb_intern("utf16le")));
+  for (i = 0; i < RARRAY_LEN(encodings); i++) {
+    VALUE enc = rb_ary_entry(encodings, i);
+    int found = -1;
+    for (e = 0; e < TSK4R_SEARCH_ENCODINGS; e++) {
+      if (enc == ID2SYM(rb_intern(TSK4R_SEARCH_ENCODING_NAMES[e]))) found = e;
+    }
+    if (found < 0) rb_raise(rb_eArgError, "unknown encoding: %s", RSTRING_PTR(rb_inspect(enc)));
+    job.encodings[found] = 1;
+  }
+  job.files = RTEST(tsk4r_opt(opts, "files", Qtrue));
+  for (c = 0; c < 256; c++) job.ac.fold[c] = (unsigned char)c;
+  job.ac.ignore_case = RTEST(tsk4r_opt(opts, "ignore_case", Qfalse));
+  if (job.ac.ignore_case) {
+    for (c = 'A'; c <= 'Z'; c++) job.ac.fold[c] = (unsigned char)(c - 'A' + 'a');
+  }
+  max_hits = tsk4r_opt(opts, "max_hits", Qnil);
+  job.max_hits = NIL_P(max_hits) ? 0 : NUM2SIZET(max_hits);
+  job.threads = NUM2INT(tsk4r_opt(opts, "threads", INT2FIX(TSK4R_SEARCH_THREADS)));
+  if (job.threads < 1) job.threads = 1;
+  pthread_mutex_init(&job.lock, NULL);
+  a.job = &job;
+  a.keywords = keywords;
+
+  result = rb_ensure(build_search, (VALUE)&a, release_search, (VALUE)&a);
+  RB_GC_GUARD(keywords);
+  return result;
+}
@@ -0,0 +1,26 @@
+//
+//  fs_search.h
+//  RubyTSK
+//
+//  FileSystem::System#search: multi-keyword search of file content,
+//  slack and unallocated space
+//
+
+#ifndef RubyTSK_fs_search_h
+#define RubyTSK_fs_search_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_SEARCH_THREADS 4
+// bytes of unallocated space per work item
+#define TSK4R_SEARCH_CHUNK (1024 * 1024)
+// automaton size limit (one state per distinct keyword prefix byte, about
+// 17 bytes each)
+#define TSK4R_SEARCH_MAX_STATES (1 << 22)
+// states, breadth first, that get a full 1 KiB transition row
+#define TSK4R_SEARCH_DENSE_STATES 256
+
+VALUE search_filesystem(int argc, VALUE *args, VALUE self);
+
+#endif
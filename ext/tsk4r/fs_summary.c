@@ -0,0 +1,298 @@
+//
+//  fs_summary.c
+//  RubyTSK
+//
+//  FileSystem::System#summarize: histograms built inside one name walk
+//
+//  The walk runs without the GVL and folds each TSK_FS_NAME/TSK_FS_META
+//  pair into small open-addressed tables, one per requested grouping;
+//  Ruby only sees the finished tables. Counts are per name (a hard-linked
+//  file counts once per link); bytes are the sizes of regular files.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_summary.h"
+#include "batch.h"
+#include "stats.h"
+
+enum tsk4r_group_kind {
+  TSK4R_GROUP_EXTENSION,
+  TSK4R_GROUP_SIZE_BUCKET,
+  TSK4R_GROUP_UID,
+  TSK4R_GROUP_GID,
+  TSK4R_GROUP_ALLOCATION,
+  TSK4R_GROUP_TYPE,
+  TSK4R_GROUP_KINDS
+};
+
+static const char * TSK4R_GROUP_NAMES[TSK4R_GROUP_KINDS] = {
+  "extension", "size_bucket", "uid", "gid", "allocation", "type"
+};
+
+struct tsk4r_group_slot {
+  uint64_t key;
+  char ext[TSK4R_SUMMARY_EXT_MAX + 1];
+  int used;
+  unsigned long count;
+  uint64_t bytes;
+};
+
+struct tsk4r_group {
+  int kind;
+  struct tsk4r_group_slot * slots;
+  size_t capacity;
+  size_t used;
+};
+
+struct tsk4r_summary {
+  struct tsk4r_group groups[TSK4R_GROUP_KINDS];
+  int group_count;
+  unsigned long count;
+  uint64_t bytes;
+
+  TSK_FS_INFO * fs;       // the System's, only reopened
+  TSK_FS_DIR_WALK_FLAG_ENUM flags;
+  volatile int cancel;
+  int failed;
+  char error[256];
+};
+
+static uint64_t group_hash(uint64_t key, const char * ext) {
+  uint64_t h = 1469598103934665603ULL ^ key;
+  if (ext != NULL) {
+    while (*ext) { h ^= (unsigned char)*ext++; h *= 1099511628211ULL; }
+  }
+  h ^= h >> 33; h *= 0xff51afd7ed558ccdULL; h ^= h >> 33;
+  return h;
+}
+
+static struct tsk4r_group_slot * group_find(struct tsk4r_group_slot * slots, size_t capacity, uint64_t key, const char * ext) {
+  size_t at = (size_t)group_hash(key, ext) & (capacity - 1);
+  while (slots[at].used) {
+    if (slots[at].key == key && (ext == NULL || strcmp(slots[at].ext, ext) == 0)) break;
+    at = (at + 1) & (capacity - 1);
+  }
+  return &slots[at];
+}
+
+static int group_grow(struct tsk4r_group * g) {
+  size_t capacity = g->capacity ? g->capacity * 2 : 64;
+  struct tsk4r_group_slot * slots = calloc(capacity, sizeof(struct tsk4r_group_slot));
+  size_t i;
+  if (slots == NULL) return -1;
+  for (i = 0; i < g->capacity; i++) {
+    struct tsk4r_group_slot * from = &g->slots[i];
+    if (! from->used) continue;
+    *group_find(slots, capacity, from->key, g->kind == TSK4R_GROUP_EXTENSION ? from->ext : NULL) = *from;
+  }
+  free(g->slots);
+  g->slots = slots;
+  g->capacity = capacity;
+  return 0;
+}
+
+static int group_add(struct tsk4r_group * g, uint64_t key, const char * ext, uint64_t bytes) {
+  struct tsk4r_group_slot * slot;
+  if ((g->used + 1) * 2 > g->capacity && group_grow(g) != 0) return -1;
+  slot = group_find(g->slots, g->capacity, key, ext);
+  if (! slot->used) {
+    slot->used = 1;
+    slot->key = key;
+    if (ext != NULL) strcpy(slot->ext, ext);
+    g->used++;
+  }
+  slot->count++;
+  slot->bytes += bytes;
+  return 0;
+}
+
+// lowercased text after the last dot; "" for none, dotfiles or overlong ones
+static void name_extension(const char * name, char * ext) {
+  const char * dot = strrchr(name, '.');
+  size_t len, i;
+  ext[0] = '\0';
+  if (dot == NULL || dot == name || dot[1] == '\0') return;
+  len = strlen(dot + 1);
+  if (len > TSK4R_SUMMARY_EXT_MAX) return;
+  for (i = 0; i < len; i++) ext[i] = (char)tolower((unsigned char)dot[1 + i]);
+  ext[len] = '\0';
+}
+
+// smallest power of two holding size (0 stays 0)
+static uint64_t size_bucket(TSK_OFF_T size) {
+  uint64_t bucket = 1;
+  if (size <= 0) return 0;
+  while (bucket < (uint64_t)size && bucket < (1ULL << 63)) bucket <<= 1;
+  return bucket;
+}
+
+static TSK_WALK_RET_ENUM summary_callback(TSK_FS_FILE * file, const char * path, void * ptr) {
+  struct tsk4r_summary * s = (struct tsk4r_summary *)ptr;
+  const TSK_FS_META * m = file->meta;
+  char ext[TSK4R_SUMMARY_EXT_MAX + 1];
+  uint64_t bytes;
+  int i;
+
+  if (s->cancel) return TSK_WALK_STOP;
+  if (file->name == NULL || file->name->name == NULL || TSK_FS_ISDOT(file->name->name)) return TSK_WALK_CONT;
+
+  bytes = (m != NULL && m->type == TSK_FS_META_TYPE_REG && m->size > 0) ? (uint64_t)m->size : 0;
+  s->count++;
+  s->bytes += bytes;
+
+  for (i = 0; i < s->group_count; i++) {
+    struct tsk4r_group * g = &s->groups[i];
+    int err = 0;
+    switch (g->kind) {
+    case TSK4R_GROUP_EXTENSION:
+      name_extension(file->name->name, ext);
+      err = group_add(g, 0, ext, bytes);
+      break;
+    case TSK4R_GROUP_SIZE_BUCKET:
+      err = group_add(g, size_bucket(m != NULL ? m->size : 0), NULL, bytes);
+      break;
+    case TSK4R_GROUP_UID:
+      err = group_add(g, m != NULL ? (uint64_t)m->uid : UINT64_MAX, NULL, bytes);
+      break;
+    case TSK4R_GROUP_GID:
+      err = group_add(g, m != NULL ? (uint64_t)m->gid : UINT64_MAX, NULL, bytes);
+      break;
+    case TSK4R_GROUP_ALLOCATION:
+      err = group_add(g, (file->name->flags & TSK_FS_NAME_FLAG_UNALLOC) ? 0 : 1, NULL, bytes);
+      break;
+    case TSK4R_GROUP_TYPE:
+      err = group_add(g, m != NULL ? (uint64_t)m->type : 0, NULL, bytes);
+      break;
+    }
+    if (err) {
+      snprintf(s->error, sizeof(s->error), "out of memory");
+      s->failed = 1;
+      return TSK_WALK_ERROR;
+    }
+  }
+  return TSK_WALK_CONT;
+}
+
+// walks a handle of its own: Ruby threads can use the System's
+// TSK_FS_INFO meanwhile, and one isn't safe to share between threads
+static void * run_summary(void * ptr) {
+  struct tsk4r_summary * s = (struct tsk4r_summary *)ptr;
+  TSK_FS_INFO * fs = tsk4r_fs_reopen(s->fs);
+  uint8_t failed;
+
+  if (fs == NULL) {
+    snprintf(s->error, sizeof(s->error), "tsk_fs_open_img: %s", tsk_error_get());
+    s->failed = 1;
+    return NULL;
+  }
+  failed = tsk4r_fs_dir_walk(fs, fs->root_inum, s->flags, summary_callback, s);
+  tsk4r_fs_close(fs);
+  if (failed && ! s->cancel && ! s->failed) {
+    snprintf(s->error, sizeof(s->error), "%s", tsk_error_get());
+    s->failed = 1;
+  }
+  return NULL;
+}
+
+static void cancel_summary(void * ptr) {
+  ((struct tsk4r_summary *)ptr)->cancel = 1;
+}
+
+static VALUE group_key(const struct tsk4r_group * g, const struct tsk4r_group_slot * slot) {
+  switch (g->kind) {
+  case TSK4R_GROUP_EXTENSION:
+    return rb_str_new2(slot->ext);
+  case TSK4R_GROUP_ALLOCATION:
+    return ID2SYM(rb_intern(slot->key ? "allocated" : "unallocated"));
+  case TSK4R_GROUP_UID:
+  case TSK4R_GROUP_GID:
+    return slot->key == UINT64_MAX ? Qnil : ULL2NUM(slot->key);
+  default:
+    return ULL2NUM(slot->key);
+  }
+}
+
+static VALUE totals(unsigned long count, uint64_t bytes) {
+  VALUE t = rb_hash_new();
+  rb_hash_aset(t, ID2SYM(rb_intern("count")), ULONG2NUM(count));
+  rb_hash_aset(t, ID2SYM(rb_intern("bytes")), ULL2NUM(bytes));
+  return t;
+}
+
+static VALUE summary_result(VALUE arg) {
+  struct tsk4r_summary * s = (struct tsk4r_summary *)arg;
+  VALUE result;
+  int i; size_t j;
+
+  tsk4r_call_interruptible(run_summary, cancel_summary, s);
+  if (s->failed) rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_dir_walk exited with an error. (%s)", s->error);
+
+  result = totals(s->count, s->bytes);
+  for (i = 0; i < s->group_count; i++) {
+    const struct tsk4r_group * g = &s->groups[i];
+    VALUE histogram = rb_hash_new();
+    for (j = 0; j < g->capacity; j++) {
+      if (! g->slots[j].used) continue;
+      rb_hash_aset(histogram, group_key(g, &g->slots[j]), totals(g->slots[j].count, g->slots[j].bytes));
+    }
+    rb_hash_aset(result, ID2SYM(rb_intern(TSK4R_GROUP_NAMES[g->kind])), histogram);
+  }
+  return result;
+}
+
+static VALUE release_summary(VALUE arg) {
+  struct tsk4r_summary * s = (struct tsk4r_summary *)arg;
+  int i;
+  for (i = 0; i < s->group_count; i++) free(s->groups[i].slots);
+  return Qnil;
+}
+
+// FileSystem::System#summarize(opts = {})
+// opts: :group_by => [:extension, :size_bucket, :uid, :gid, :allocation, :type],
+//       :unallocated => true when grouping by :allocation, otherwise false
+// returns { :count, :bytes } totals plus, per grouping, a Hash of
+// key => { :count, :bytes }. Keys: lowercased extension ("" for none), the
+// power-of-two upper bound of the size, uid/gid (nil without metadata),
+// :allocated/:unallocated, or the TSK_FS_META_TYPE_ENUM value.
+VALUE summarize_filesystem(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE group_by; VALUE unallocated;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_summary s;
+  int by_allocation = 0;
+  long i; int k;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  MEMZERO(&s, struct tsk4r_summary, 1);
+  group_by = rb_Array(tsk4r_opt(opts, "group_by", Qnil));
+  for (i = 0; i < RARRAY_LEN(group_by); i++) {
+    VALUE g = rb_ary_entry(group_by, i);
+    int kind = -1;
+    if (SYMBOL_P(g)) {
+      for (k = 0; k < TSK4R_GROUP_KINDS; k++) {
+        if (strcmp(rb_id2name(SYM2ID(g)), TSK4R_GROUP_NAMES[k]) == 0) kind = k;
+      }
+    }
+    if (kind < 0) rb_raise(rb_eArgError, "unknown grouping: %s", RSTRING_PTR(rb_inspect(g)));
+    for (k = 0; k < s.group_count; k++) {
+      if (s.groups[k].kind == kind) break;
+    }
+    if (k < s.group_count) continue;
+    if (kind == TSK4R_GROUP_ALLOCATION) by_allocation = 1;
+    s.groups[s.group_count++].kind = kind;
+  }
+
+  s.fs = fs_ptr->filesystem;
+  s.flags = TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE;
+  unallocated = tsk4r_opt(opts, "unallocated", by_allocation ? Qtrue : Qfalse);
+  if (RTEST(unallocated)) s.flags |= TSK_FS_DIR_WALK_FLAG_UNALLOC;
+
+  return rb_ensure(summary_result, (VALUE)&s, release_summary, (VALUE)&s);
+}
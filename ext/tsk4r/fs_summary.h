@@ -0,0 +1,19 @@
+//
+//  fs_summary.h
+//  RubyTSK
+//
+//  FileSystem::System#summarize: histograms built inside one name walk
+//
+
+#ifndef RubyTSK_fs_summary_h
+#define RubyTSK_fs_summary_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+// longer "extensions" are more likely names with dots; they count as none
+#define TSK4R_SUMMARY_EXT_MAX 16
+
+VALUE summarize_filesystem(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -0,0 +1,270 @@
+//
+//  fs_timeindex.c
+//  RubyTSK
+//
+//  MAC timestamp index for Sleuthkit::FileSystem::System
+//
+//  One metadata walk (run without the GVL) copies every inode's atime,
+//  mtime, ctime and crtime into a column per field of {seconds, nanoseconds,
+//  inum} entries, each sorted by (seconds, nanoseconds). A range query is
+//  two binary searches plus a copy of the inums in between. Unset
+//  timestamps (0) are left out unless :zero_times is given, since most
+//  file systems store 0 for "never" rather than 1970-01-01.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ruby.h>
+#include "file_system.h"
+#include "fs_timeindex.h"
+#include "batch.h"
+#include "stats.h"
+
+extern VALUE rb_cTSKFileSystemTimeIndex;
+
+struct tsk4r_time_entry {
+  int64_t sec;
+  uint32_t nsec;
+  TSK_INUM_T inum;
+};
+
+struct tsk4r_time_column {
+  struct tsk4r_time_entry * entries;
+  size_t count;
+  size_t alloc;
+};
+
+struct tsk4r_time_index {
+  struct tsk4r_time_column columns[TSK4R_TIME_FIELDS];
+  unsigned long files;
+  TSK_FS_META_FLAG_ENUM flags;
+  int zero_times;
+
+  // build only
+  TSK_FS_INFO * fs;       // the System's, only reopened
+  volatile int cancel;
+  int failed;
+  char error[256];
+};
+
+static const char * TSK4R_TIME_FIELD_NAMES[TSK4R_TIME_FIELDS] = { "atime", "mtime", "ctime", "crtime" };
+
+static void deallocate_time_index(void * ptr) {
+  struct tsk4r_time_index * index = (struct tsk4r_time_index *)ptr;
+  int f;
+  for (f = 0; f < TSK4R_TIME_FIELDS; f++) free(index->columns[f].entries);
+  xfree(index);
+}
+
+static size_t time_index_memsize(const void * ptr) {
+  const struct tsk4r_time_index * index = (const struct tsk4r_time_index *)ptr;
+  size_t size = sizeof(struct tsk4r_time_index);
+  int f;
+  for (f = 0; f < TSK4R_TIME_FIELDS; f++) size += index->columns[f].alloc * sizeof(struct tsk4r_time_entry);
+  return size;
+}
+
+const rb_data_type_t tsk4r_time_index_type = {
+  "Sleuthkit::FileSystem::TimeIndex",
+  TSK4R_DATA_FUNCTIONS(NULL, deallocate_time_index, time_index_memsize, NULL),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY };
+
+static int push_time(struct tsk4r_time_column * col, time_t sec, uint32_t nano, TSK_INUM_T inum, int zero_times) {
+  if (sec == 0 && nano == 0 && ! zero_times) return 0;
+  if (col->count == col->alloc) {
+    size_t grow = col->alloc ? col->alloc * 2 : 4096;
+    struct tsk4r_time_entry * entries = realloc(col->entries, grow * sizeof(struct tsk4r_time_entry));
+    if (entries == NULL) return -1;
+    col->entries = entries;
+    col->alloc = grow;
+  }
+  col->entries[col->count].sec = (int64_t)sec;
+  col->entries[col->count].nsec = nano;
+  col->entries[col->count].inum = inum;
+  col->count++;
+  return 0;
+}
+
+static TSK_WALK_RET_ENUM time_index_callback(TSK_FS_FILE * file, void * ptr) {
+  struct tsk4r_time_index * index = (struct tsk4r_time_index *)ptr;
+  const TSK_FS_META * m = file->meta;
+
+  if (index->cancel) return TSK_WALK_STOP;
+  if (m == NULL) return TSK_WALK_CONT;
+  if (push_time(&index->columns[TSK4R_TIME_ATIME], m->atime, m->atime_nano, m->addr, index->zero_times) != 0
+      || push_time(&index->columns[TSK4R_TIME_MTIME], m->mtime, m->mtime_nano, m->addr, index->zero_times) != 0
+      || push_time(&index->columns[TSK4R_TIME_CTIME], m->ctime, m->ctime_nano, m->addr, index->zero_times) != 0
+      || push_time(&index->columns[TSK4R_TIME_CRTIME], m->crtime, m->crtime_nano, m->addr, index->zero_times) != 0) {
+    snprintf(index->error, sizeof(index->error), "out of memory");
+    index->failed = 1;
+    return TSK_WALK_ERROR;
+  }
+  index->files++;
+  return TSK_WALK_CONT;
+}
+
+static int compare_pair(int64_t sec, uint32_t nsec, const struct tsk4r_time_entry * e) {
+  if (sec != e->sec) return sec < e->sec ? -1 : 1;
+  return (nsec > e->nsec) - (nsec < e->nsec);
+}
+
+static int compare_times(const void * a, const void * b) {
+  const struct tsk4r_time_entry * x = a; const struct tsk4r_time_entry * y = b;
+  int c = compare_pair(x->sec, x->nsec, y);
+  if (c != 0) return c;
+  return (x->inum > y->inum) - (x->inum < y->inum);
+}
+
+// walks a handle of its own: Ruby threads can use the System's
+// TSK_FS_INFO meanwhile, and one isn't safe to share between threads
+static void * build_time_index(void * ptr) {
+  struct tsk4r_time_index * index = (struct tsk4r_time_index *)ptr;
+  TSK_FS_INFO * fs = tsk4r_fs_reopen(index->fs);
+  uint8_t failed;
+  int f;
+
+  if (fs == NULL) {
+    snprintf(index->error, sizeof(index->error), "tsk_fs_open_img: %s", tsk_error_get());
+    index->failed = 1;
+    return NULL;
+  }
+  failed = tsk4r_fs_meta_walk(fs, fs->first_inum, fs->last_inum, index->flags, time_index_callback, index);
+  tsk4r_fs_close(fs);
+  if (failed && ! index->cancel && ! index->failed) {
+    snprintf(index->error, sizeof(index->error), "%s", tsk_error_get());
+    index->failed = 1;
+  }
+  if (index->failed || index->cancel) return NULL;
+  for (f = 0; f < TSK4R_TIME_FIELDS; f++) {
+    struct tsk4r_time_column * col = &index->columns[f];
+    qsort(col->entries, col->count, sizeof(struct tsk4r_time_entry), compare_times);
+  }
+  return NULL;
+}
+
+static void cancel_time_index(void * ptr) {
+  ((struct tsk4r_time_index *)ptr)->cancel = 1;
+}
+
+// first entry at or after t (after, when past is set)
+static size_t time_bound(const struct tsk4r_time_column * col, struct timespec t, int past) {
+  size_t lo = 0, hi = col->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int c = compare_pair((int64_t)t.tv_sec, (uint32_t)t.tv_nsec, &col->entries[mid]);
+    if (c > 0 || (past && c == 0)) lo = mid + 1; else hi = mid;
+  }
+  return lo;
+}
+
+static int time_field(VALUE field) {
+  int f;
+  if (SYMBOL_P(field)) {
+    const char * name = rb_id2name(SYM2ID(field));
+    for (f = 0; f < TSK4R_TIME_FIELDS; f++) {
+      if (strcmp(name, TSK4R_TIME_FIELD_NAMES[f]) == 0) return f;
+    }
+  }
+  rb_raise(rb_eArgError, "field must be :atime, :mtime, :ctime or :crtime");
+  return -1;
+}
+
+// Time, or seconds since the epoch as any Numeric
+static struct timespec range_start(VALUE t) {
+  return rb_time_timespec(t);
+}
+
+// a whole-second end covers that entire second, so a timestamp read back
+// as seconds (FileMeta#mtime) still finds files with a sub-second part
+static struct timespec range_end(VALUE t) {
+  struct timespec ts = rb_time_timespec(t);
+  if (ts.tv_nsec == 0) ts.tv_nsec = 999999999;
+  return ts;
+}
+
+// FileSystem::System#time_index(opts = {})
+// opts: :unallocated => false (also index unallocated inodes),
+//       :zero_times => false (also index timestamps that are 0), :rebuild => false
+// builds the index on first use and keeps it in @time_index; asking for
+// other options than the kept index was built with builds it again
+VALUE get_fs_time_index(int argc, VALUE *args, VALUE self) {
+  VALUE opts; VALUE obj;
+  struct tsk4r_fs_wrapper * fs_ptr;
+  struct tsk4r_time_index * index;
+  TSK_FS_META_FLAG_ENUM flags = TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_USED;
+  int zero_times;
+
+  rb_scan_args(argc, args, "01", &opts);
+  if (RTEST(tsk4r_opt(opts, "unallocated", Qfalse))) flags |= TSK_FS_META_FLAG_UNALLOC;
+  zero_times = RTEST(tsk4r_opt(opts, "zero_times", Qfalse));
+  obj = rb_iv_get(self, "@time_index");
+  if (! NIL_P(obj) && ! RTEST(tsk4r_opt(opts, "rebuild", Qfalse))) {
+    TypedData_Get_Struct(obj, struct tsk4r_time_index, &tsk4r_time_index_type, index);
+    if (index->flags == flags && index->zero_times == zero_times) return obj;
+  }
+
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, fs_ptr);
+  if (fs_ptr->filesystem == NULL) rb_raise(rb_eRuntimeError, "filesystem pointer is NULL");
+
+  obj = TypedData_Make_Struct(rb_cTSKFileSystemTimeIndex, struct tsk4r_time_index, &tsk4r_time_index_type, index);
+  index->fs = fs_ptr->filesystem;
+  index->flags = flags;
+  index->zero_times = zero_times;
+
+  tsk4r_call_interruptible(build_time_index, cancel_time_index, index);
+  index->fs = NULL;
+  if (index->failed) rb_raise(rb_eRuntimeError, "TSK function: tsk_fs_meta_walk exited with an error. (%s)", index->error);
+
+  rb_iv_set(self, "@time_index", obj);
+  return obj;
+}
+
+// TimeIndex#files_between(field, t0, t1)
+// inums whose field (:atime, :mtime, :ctime, :crtime) lies in t0..t1
+// (inclusive; Time or epoch seconds, a whole-second t1 taking in all of
+// that second), ordered by that time, as a packed string of little-endian
+// uint64 ('Q<*')
+VALUE time_index_files_between(VALUE self, VALUE field, VALUE t0, VALUE t1) {
+  struct tsk4r_time_index * index;
+  const struct tsk4r_time_column * col;
+  size_t from, to, i;
+  unsigned char * out;
+  VALUE packed;
+
+  TypedData_Get_Struct(self, struct tsk4r_time_index, &tsk4r_time_index_type, index);
+  col = &index->columns[time_field(field)];
+  from = time_bound(col, range_start(t0), 0);
+  to = time_bound(col, range_end(t1), 1);
+  if (to < from) to = from;
+
+  packed = rb_str_new(NULL, (long)((to - from) * 8));
+  out = (unsigned char *)RSTRING_PTR(packed);
+  for (i = from; i < to; i++) {
+    uint64_t v = (uint64_t)col->entries[i].inum;
+    int b;
+    for (b = 0; b < 8; b++) *out++ = (unsigned char)(v >> (8 * b));
+  }
+  return TSK4R_BINARY_STR(packed);
+}
+
+// TimeIndex#count_between(field, t0, t1): the size of files_between, without copying
+VALUE time_index_count_between(VALUE self, VALUE field, VALUE t0, VALUE t1) {
+  struct tsk4r_time_index * index;
+  const struct tsk4r_time_column * col;
+  size_t from, to;
+
+  TypedData_Get_Struct(self, struct tsk4r_time_index, &tsk4r_time_index_type, index);
+  col = &index->columns[time_field(field)];
+  from = time_bound(col, range_start(t0), 0);
+  to = time_bound(col, range_end(t1), 1);
+  return SIZET2NUM(to > from ? to - from : 0);
+}
+
+// TimeIndex#size: number of inodes indexed
+VALUE time_index_size(VALUE self) {
+  struct tsk4r_time_index * index;
+  TypedData_Get_Struct(self, struct tsk4r_time_index, &tsk4r_time_index_type, index);
+  return ULONG2NUM(index->files);
+}
@@ -0,0 +1,27 @@
+//
+//  fs_timeindex.h
+//  RubyTSK
+//
+//  MAC timestamp index for Sleuthkit::FileSystem::System
+//
+
+#ifndef RubyTSK_fs_timeindex_h
+#define RubyTSK_fs_timeindex_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_TIME_ATIME  0
+#define TSK4R_TIME_MTIME  1
+#define TSK4R_TIME_CTIME  2
+#define TSK4R_TIME_CRTIME 3
+#define TSK4R_TIME_FIELDS 4
+
+extern const rb_data_type_t tsk4r_time_index_type;
+
+VALUE get_fs_time_index(int argc, VALUE *args, VALUE self);
+VALUE time_index_files_between(VALUE self, VALUE field, VALUE t0, VALUE t1);
+VALUE time_index_count_between(VALUE self, VALUE field, VALUE t0, VALUE t1);
+VALUE time_index_size(VALUE self);
+
+#endif
@@ -0,0 +1,568 @@
+//
+//  hashset.c
+//  RubyTSK
+//
+//  Sleuthkit::HashSet: sorted, mmap'd known-file hash sets
+//
+//  A set file is a header, a prefix index, an optional Bloom filter and
+//  the sorted, de-duplicated digests, so it can be mapped read-only and
+//  shared between processes without being parsed:
+//
+//    header   64 bytes (all integers little-endian)
+//             "TSK4RHS1", version, digest length, payload length, count,
+//             bloom bits (log2), bloom hashes, index/bloom/record/trailer
+//             offsets
+//    index    2^16 + 1 uint64: first record whose leading 16 bits are >= p
+//    bloom    2^n bits, or nothing
+//    records  count * (digest + payload) bytes, ascending
+//    trailer  whatever the set type keeps besides records, or nothing
+//
+//  A HashSet has no payload. Subclasses (BlockHashDB) store a fixed-size
+//  payload after each digest, so one digest may appear in several records.
+//
+//  A lookup checks the Bloom filter (a miss never touches the digests),
+//  then binary-searches the one prefix bucket.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include <ruby.h>
+#include "hashset.h"
+#include "batch.h"
+#include "stats.h"
+
+#define TSK4R_HS_MAGIC "TSK4RHS1"
+#define TSK4R_HS_VERSION 1
+#define TSK4R_HS_HEADER 64
+#define TSK4R_HS_PREFIXES 65536
+#define TSK4R_HS_BLOOM_HASHES 7
+// the largest filter the builder writes (2^40 bits)
+#define TSK4R_HS_BLOOM_MAX_LOG2 40
+
+struct tsk4r_hash_set {
+  unsigned char * base;
+  size_t length;
+  int mapped;
+  unsigned int digest_len;
+  unsigned int payload_len;
+  unsigned int record_len;
+  uint64_t count;
+  unsigned int bloom_log2;
+  unsigned int bloom_hashes;
+  const unsigned char * index;
+  const unsigned char * bloom;
+  const unsigned char * records;
+  const unsigned char * trailer;
+  size_t trailer_len;
+};
+
+static uint64_t get64le(const unsigned char * p) {
+  uint64_t v = 0;
+  int i;
+  for (i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+static void put64le(unsigned char * p, uint64_t v) {
+  int i;
+  for (i = 0; i < 8; i++) { p[i] = (unsigned char)v; v >>= 8; }
+}
+
+static void deallocate_hash_set(void * ptr) {
+  struct tsk4r_hash_set * set = (struct tsk4r_hash_set *)ptr;
+  if (set->base != NULL) {
+#ifdef HAVE_SYS_MMAN_H
+    if (set->mapped) munmap(set->base, set->length); else
+#endif
+    free(set->base);
+  }
+  xfree(set);
+}
+
+// mapped pages belong to the page cache, not this object
+static size_t hash_set_memsize(const void * ptr) {
+  const struct tsk4r_hash_set * set = (const struct tsk4r_hash_set *)ptr;
+  return sizeof(struct tsk4r_hash_set) + (set->mapped ? 0 : set->length);
+}
+
+const rb_data_type_t tsk4r_hash_set_type = {
+  "Sleuthkit::HashSet",
+  TSK4R_DATA_FUNCTIONS(NULL, deallocate_hash_set, hash_set_memsize, NULL),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY };
+
+static uint64_t bloom_word(const unsigned char * digest, unsigned int offset) {
+  uint64_t v = 0;
+  int i;
+  for (i = 7; i >= 0; i--) v = (v << 8) | digest[offset + i];
+  return v;
+}
+
+uint64_t tsk4r_hash_set_find(const struct tsk4r_hash_set * set, const unsigned char * digest, uint64_t * first) {
+  unsigned int prefix = ((unsigned int)digest[0] << 8) | digest[1];
+  uint64_t lo, hi, end;
+
+  if (set->bloom != NULL) {
+    uint64_t h1 = bloom_word(digest, 0), h2 = bloom_word(digest, set->digest_len - 8) | 1;
+    uint64_t mask = (1ULL << set->bloom_log2) - 1;
+    unsigned int k;
+    for (k = 0; k < set->bloom_hashes; k++) {
+      uint64_t bit = (h1 + k * h2) & mask;
+      if (! (set->bloom[bit >> 3] & (1 << (bit & 7)))) return 0;
+    }
+  }
+  lo = get64le(set->index + 8 * prefix);
+  hi = end = get64le(set->index + 8 * (prefix + 1));
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (memcmp(set->records + mid * set->record_len, digest, set->digest_len) < 0) lo = mid + 1; else hi = mid;
+  }
+  if (first != NULL) *first = lo;
+  for (hi = lo; hi < end && memcmp(set->records + hi * set->record_len, digest, set->digest_len) == 0; hi++);
+  return hi - lo;
+}
+
+int tsk4r_hash_set_contains(const struct tsk4r_hash_set * set, const unsigned char * digest) {
+  return tsk4r_hash_set_find(set, digest, NULL) > 0;
+}
+
+const unsigned char * tsk4r_hash_set_payload(const struct tsk4r_hash_set * set, uint64_t i) {
+  return set->records + i * set->record_len + set->digest_len;
+}
+
+const unsigned char * tsk4r_hash_set_trailer(const struct tsk4r_hash_set * set, size_t * len) {
+  *len = set->trailer_len;
+  return set->trailer;
+}
+
+int tsk4r_hash_set_digest_file(const struct tsk4r_hash_set * set, TSK_FS_FILE * file, char * buf, size_t buf_len, unsigned char * digest) {
+  TSK_OFF_T offset = 0, size;
+  TSK_MD5_CTX md5;
+  TSK_SHA_CTX sha;
+
+  if (file->meta == NULL) return -1;
+  size = file->meta->size;
+  if (set->digest_len == TSK4R_HS_MD5) TSK_MD5_Init(&md5); else TSK_SHA_Init(&sha);
+  while (offset < size) {
+    size_t want = (size_t)((size - offset) < (TSK_OFF_T)buf_len ? (size - offset) : (TSK_OFF_T)buf_len);
+    ssize_t got = tsk4r_fs_file_read(file, offset, buf, want, TSK_FS_FILE_READ_FLAG_NONE);
+    if (got <= 0) {
+      tsk_error_reset();
+      return -1;
+    }
+    if (set->digest_len == TSK4R_HS_MD5) TSK_MD5_Update(&md5, (unsigned char *)buf, (unsigned int)got);
+    else TSK_SHA_Update(&sha, (BYTE *)buf, (int)got);
+    offset += got;
+  }
+  if (set->digest_len == TSK4R_HS_MD5) TSK_MD5_Final(digest, &md5); else TSK_SHA_Final(digest, &sha);
+  return 0;
+}
+
+unsigned int tsk4r_hash_set_digest_len(const struct tsk4r_hash_set * set) {
+  return set->digest_len;
+}
+
+unsigned int tsk4r_hash_set_payload_len(const struct tsk4r_hash_set * set) {
+  return set->payload_len;
+}
+
+const struct tsk4r_hash_set * tsk4r_hash_set_get(VALUE obj) {
+  struct tsk4r_hash_set * set;
+  if (NIL_P(obj)) return NULL;
+  TypedData_Get_Struct(obj, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  return set;
+}
+
+// HashSet.build
+
+static int hex_value(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  c = tolower(c);
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+// first run of exactly 2 * digest_len hex digits in line
+static int parse_digest(const char * line, unsigned int digest_len, unsigned char * out) {
+  const char * p = line;
+  while (*p) {
+    const char * start; size_t run;
+    while (*p && hex_value((unsigned char)*p) < 0) p++;
+    start = p;
+    while (*p && hex_value((unsigned char)*p) >= 0) p++;
+    run = (size_t)(p - start);
+    if (run == 2 * digest_len) {
+      unsigned int i;
+      for (i = 0; i < digest_len; i++) {
+        out[i] = (unsigned char)((hex_value((unsigned char)start[2 * i]) << 4) | hex_value((unsigned char)start[2 * i + 1]));
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int tsk4r_hash_set_push(struct tsk4r_hash_set_builder * b, const unsigned char * digest, const unsigned char * payload) {
+  unsigned int record_len = b->digest_len + b->payload_len;
+  if (b->count == b->alloc) {
+    uint64_t grow = b->alloc ? b->alloc * 2 : 65536;
+    unsigned char * records = realloc(b->records, (size_t)(grow * record_len));
+    if (records == NULL) return -1;
+    b->records = records;
+    b->alloc = grow;
+  }
+  memcpy(b->records + b->count * record_len, digest, b->digest_len);
+  if (b->payload_len > 0) memcpy(b->records + b->count * record_len + b->digest_len, payload, b->payload_len);
+  b->count++;
+  return 0;
+}
+
+static void * read_hash_source(void * ptr) {
+  struct tsk4r_hash_set_builder * b = (struct tsk4r_hash_set_builder *)ptr;
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+  char line[4096];
+  FILE * in = fopen(b->source, "r");
+  if (in == NULL) {
+    b->err = errno;
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (parse_digest(line, b->digest_len, digest) && tsk4r_hash_set_push(b, digest, NULL) != 0) {
+      b->err = ENOMEM;
+      break;
+    }
+  }
+  fclose(in);
+  return NULL;
+}
+
+// qsort has no context argument, so one comparator per record length
+static int compare_16(const void * a, const void * b) { return memcmp(a, b, 16); }
+static int compare_20(const void * a, const void * b) { return memcmp(a, b, 20); }
+static int compare_24(const void * a, const void * b) { return memcmp(a, b, 24); }
+static int compare_28(const void * a, const void * b) { return memcmp(a, b, 28); }
+
+static int (*record_comparator(unsigned int record_len))(const void *, const void *) {
+  switch (record_len) {
+  case 16: return compare_16;
+  case 20: return compare_20;
+  case 24: return compare_24;
+  case 28: return compare_28;
+  }
+  return NULL;
+}
+
+static int write_all(FILE * out, const void * data, size_t len) {
+  return fwrite(data, 1, len, out) == len ? 0 : -1;
+}
+
+// sorts and de-duplicates the builder's records, then writes the set file
+void * tsk4r_hash_set_write(void * ptr) {
+  struct tsk4r_hash_set_builder * b = (struct tsk4r_hash_set_builder *)ptr;
+  unsigned int record_len = b->digest_len + b->payload_len;
+  int (*compare)(const void *, const void *) = record_comparator(record_len);
+  unsigned char header[TSK4R_HS_HEADER];
+  unsigned char * index = NULL; unsigned char * bloom = NULL;
+  uint64_t i, kept = 0, index_off, bloom_off, records_off, trailer_off, bloom_bytes = 0;
+  unsigned int prefix;
+  FILE * out;
+
+  if (compare == NULL) {
+    b->err = EINVAL;
+    return NULL;
+  }
+  qsort(b->records, (size_t)b->count, record_len, compare);
+  for (i = 0; i < b->count; i++) {
+    if (kept > 0 && memcmp(b->records + (kept - 1) * record_len, b->records + i * record_len, record_len) == 0) continue;
+    if (kept != i) memmove(b->records + kept * record_len, b->records + i * record_len, record_len);
+    kept++;
+  }
+  b->count = kept;
+
+  if (b->bloom_log2 == 1) {
+    // TSK4R_HS_BLOOM_BITS bits per record, rounded up to a power of two
+    uint64_t bits = b->count * TSK4R_HS_BLOOM_BITS;
+    b->bloom_log2 = 6;
+    while ((1ULL << b->bloom_log2) < bits && b->bloom_log2 < TSK4R_HS_BLOOM_MAX_LOG2) b->bloom_log2++;
+  }
+
+  index = calloc(TSK4R_HS_PREFIXES + 1, 8);
+  if (b->bloom_log2 > 0) {
+    bloom_bytes = (1ULL << b->bloom_log2) / 8;
+    bloom = calloc((size_t)bloom_bytes, 1);
+  }
+  if (index == NULL || (b->bloom_log2 > 0 && bloom == NULL)) {
+    b->err = ENOMEM;
+    goto done;
+  }
+  i = 0;
+  for (prefix = 0; prefix <= TSK4R_HS_PREFIXES; prefix++) {
+    while (i < b->count && (((unsigned int)b->records[i * record_len] << 8) | b->records[i * record_len + 1]) < prefix) i++;
+    put64le(index + 8 * prefix, i);
+  }
+  if (bloom != NULL) {
+    uint64_t mask = (1ULL << b->bloom_log2) - 1;
+    for (i = 0; i < b->count; i++) {
+      const unsigned char * d = b->records + i * record_len;
+      uint64_t h1 = bloom_word(d, 0), h2 = bloom_word(d, b->digest_len - 8) | 1;
+      unsigned int k;
+      for (k = 0; k < TSK4R_HS_BLOOM_HASHES; k++) {
+        uint64_t bit = (h1 + k * h2) & mask;
+        bloom[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+      }
+    }
+  }
+
+  index_off = TSK4R_HS_HEADER;
+  bloom_off = index_off + 8 * (TSK4R_HS_PREFIXES + 1);
+  records_off = bloom_off + bloom_bytes;
+  trailer_off = b->trailer_len > 0 ? records_off + b->count * record_len : 0;
+  memset(header, 0, sizeof(header));
+  memcpy(header, TSK4R_HS_MAGIC, 8);
+  header[8] = TSK4R_HS_VERSION;
+  header[12] = (unsigned char)b->digest_len;
+  header[13] = (unsigned char)b->payload_len;
+  put64le(header + 16, b->count);
+  header[24] = (unsigned char)b->bloom_log2;
+  header[28] = bloom != NULL ? TSK4R_HS_BLOOM_HASHES : 0;
+  put64le(header + 32, index_off);
+  put64le(header + 40, bloom_off);
+  put64le(header + 48, records_off);
+  put64le(header + 56, trailer_off);
+
+  out = fopen(b->path, "wb");
+  if (out == NULL) {
+    b->err = errno;
+    goto done;
+  }
+  if (write_all(out, header, sizeof(header)) != 0
+      || write_all(out, index, 8 * (TSK4R_HS_PREFIXES + 1)) != 0
+      || (bloom != NULL && write_all(out, bloom, (size_t)bloom_bytes) != 0)
+      || write_all(out, b->records, (size_t)(b->count * record_len)) != 0
+      || (b->trailer_len > 0 && write_all(out, b->trailer, b->trailer_len) != 0)) {
+    b->err = errno ? errno : EIO;
+  }
+  if (fclose(out) != 0 && b->err == 0) b->err = errno;
+
+done:
+  free(index);
+  free(bloom);
+  return NULL;
+}
+
+static unsigned int digest_length(VALUE digest) {
+  if (NIL_P(digest) || digest == ID2SYM(rb_intern("sha1"))) return TSK4R_HS_SHA1;
+  if (digest == ID2SYM(rb_intern("md5"))) return TSK4R_HS_MD5;
+  rb_raise(rb_eArgError, "digest must be :sha1 or :md5");
+  return 0;
+}
+
+struct tsk4r_hs_build_args {
+  struct tsk4r_hash_set_builder * build;
+  VALUE source;
+};
+
+static VALUE run_hash_set_build(VALUE arg) {
+  struct tsk4r_hs_build_args * a = (struct tsk4r_hs_build_args *)arg;
+  struct tsk4r_hash_set_builder * b = a->build;
+  unsigned char digest[TSK4R_HS_MAX_DIGEST];
+
+  if (RB_TYPE_P(a->source, T_STRING)) {
+    b->source = StringValueCStr(a->source);
+    rb_thread_call_without_gvl(read_hash_source, b, NULL, NULL);
+  } else {
+    VALUE items = rb_Array(a->source);
+    long i;
+    for (i = 0; i < RARRAY_LEN(items); i++) {
+      VALUE item = rb_ary_entry(items, i);
+      if (parse_digest(StringValueCStr(item), b->digest_len, digest) && tsk4r_hash_set_push(b, digest, NULL) != 0) rb_memerror();
+    }
+  }
+  if (b->err) {
+    errno = b->err;
+    rb_sys_fail(b->source);
+  }
+  rb_thread_call_without_gvl(tsk4r_hash_set_write, b, NULL, NULL);
+  if (b->err) {
+    errno = b->err;
+    rb_sys_fail(b->path);
+  }
+  return Qnil;
+}
+
+static VALUE release_hash_set_build(VALUE arg) {
+  struct tsk4r_hs_build_args * a = (struct tsk4r_hs_build_args *)arg;
+  free(a->build->records);
+  return Qnil;
+}
+
+// HashSet.build(source, path, opts = {})
+// source: path of a text file (one digest per line; the first hex token of
+// the right length is used, so NSRL CSV files load as they are) or an
+// Array of hex strings
+// opts: :digest => :sha1 or :md5, :bloom => true (false for none)
+// writes the set to path and returns HashSet.open(path)
+VALUE build_hash_set(int argc, VALUE *args, VALUE klass) {
+  VALUE source; VALUE path; VALUE opts;
+  struct tsk4r_hash_set_builder b;
+  struct tsk4r_hs_build_args a;
+
+  rb_scan_args(argc, args, "21", &source, &path, &opts);
+  MEMZERO(&b, struct tsk4r_hash_set_builder, 1);
+  b.digest_len = digest_length(tsk4r_opt(opts, "digest", Qnil));
+  b.bloom_log2 = RTEST(tsk4r_opt(opts, "bloom", Qtrue)) ? 1 : 0;
+  b.path = StringValueCStr(path);
+  a.build = &b;
+  a.source = source;
+
+  rb_ensure(run_hash_set_build, (VALUE)&a, release_hash_set_build, (VALUE)&a);
+  return rb_funcall(klass, rb_intern("open"), 1, path);
+}
+
+// every offset and count in the header, and every prefix index entry, must
+// stay inside the file: lookups trust them without further checks
+static int hash_set_layout_ok(const struct tsk4r_hash_set * set, uint64_t index_off, uint64_t bloom_off,
+                              uint64_t records_off, uint64_t trailer_off) {
+  uint64_t records_end, prev = 0;
+  unsigned int p;
+
+  if (set->digest_len != TSK4R_HS_SHA1 && set->digest_len != TSK4R_HS_MD5) return 0;
+  if (set->payload_len != 0 && set->payload_len != 8) return 0;
+  if (index_off < TSK4R_HS_HEADER || index_off > set->length
+      || set->length - index_off < 8 * (TSK4R_HS_PREFIXES + 1)
+      || bloom_off < index_off + 8 * (TSK4R_HS_PREFIXES + 1)
+      || records_off < bloom_off || records_off > set->length) return 0;
+  if (set->bloom_hashes == 0) {
+    if (records_off != bloom_off) return 0;
+  } else if (set->bloom_hashes > 32 || set->bloom_log2 < 3 || set->bloom_log2 > TSK4R_HS_BLOOM_MAX_LOG2
+             || (1ULL << set->bloom_log2) / 8 != records_off - bloom_off) {
+    return 0;
+  }
+  if (set->count > (set->length - records_off) / set->record_len) return 0;
+  records_end = records_off + set->count * set->record_len;
+  if (trailer_off != 0 && (trailer_off < records_end || trailer_off > set->length)) return 0;
+
+  for (p = 0; p <= TSK4R_HS_PREFIXES; p++) {
+    uint64_t at = get64le(set->base + index_off + 8 * p);
+    if (at < prev || at > set->count) return 0;
+    prev = at;
+  }
+  return get64le(set->base + index_off) == 0 && prev == set->count;
+}
+
+// HashSet.open(path): maps a set written by HashSet.build
+VALUE open_hash_set(VALUE klass, VALUE path) {
+  struct tsk4r_hash_set * set;
+  struct stat st;
+  const unsigned char * h;
+  uint64_t index_off, bloom_off, records_off, trailer_off;
+  VALUE obj;
+  int fd;
+
+  obj = TypedData_Make_Struct(klass, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  fd = open(StringValueCStr(path), O_RDONLY);
+  if (fd < 0) rb_sys_fail(StringValueCStr(path));
+  if (fstat(fd, &st) != 0 || st.st_size < TSK4R_HS_HEADER) {
+    close(fd);
+    rb_raise(rb_eArgError, "%s is not a hash set.", StringValueCStr(path));
+  }
+  set->length = (size_t)st.st_size;
+#ifdef HAVE_SYS_MMAN_H
+  set->base = mmap(NULL, set->length, PROT_READ, MAP_SHARED, fd, 0);
+  if (set->base == MAP_FAILED) {
+    set->base = NULL;
+  } else {
+    set->mapped = 1;
+  }
+#endif
+  if (set->base == NULL) {
+    size_t done = 0;
+    set->base = malloc(set->length);
+    if (set->base == NULL) { close(fd); rb_memerror(); }
+    while (done < set->length) {
+      ssize_t n = pread(fd, set->base + done, set->length - done, (off_t)done);
+      if (n <= 0) { close(fd); rb_sys_fail(StringValueCStr(path)); }
+      done += (size_t)n;
+    }
+  }
+  close(fd);
+
+  h = set->base;
+  if (memcmp(h, TSK4R_HS_MAGIC, 8) != 0 || h[8] != TSK4R_HS_VERSION) {
+    rb_raise(rb_eArgError, "%s is not a hash set.", StringValueCStr(path));
+  }
+  set->digest_len = h[12];
+  set->payload_len = h[13];
+  set->record_len = set->digest_len + set->payload_len;
+  set->count = get64le(h + 16);
+  set->bloom_log2 = h[24];
+  set->bloom_hashes = h[28];
+  index_off = get64le(h + 32);
+  bloom_off = get64le(h + 40);
+  records_off = get64le(h + 48);
+  trailer_off = get64le(h + 56);
+  if (! hash_set_layout_ok(set, index_off, bloom_off, records_off, trailer_off)) {
+    rb_raise(rb_eArgError, "%s is a damaged hash set.", StringValueCStr(path));
+  }
+  set->index = set->base + index_off;
+  set->bloom = set->bloom_hashes ? set->base + bloom_off : NULL;
+  set->records = set->base + records_off;
+  if (trailer_off != 0) {
+    set->trailer = set->base + trailer_off;
+    set->trailer_len = set->length - (size_t)trailer_off;
+  }
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_RANDOM)
+  if (set->mapped) madvise(set->base, set->length, MADV_RANDOM);
+#endif
+  rb_iv_set(obj, "@path", path);
+  return obj;
+}
+
+// a digest argument as hex or raw bytes; 0 if it can't be one of this set's
+int tsk4r_hash_set_parse(const struct tsk4r_hash_set * set, VALUE digest, unsigned char * raw) {
+  StringValue(digest);
+  if ((unsigned long)RSTRING_LEN(digest) == set->digest_len) {
+    memcpy(raw, RSTRING_PTR(digest), set->digest_len);
+    return 1;
+  }
+  return (unsigned long)RSTRING_LEN(digest) == 2 * set->digest_len
+    && parse_digest(StringValueCStr(digest), set->digest_len, raw);
+}
+
+// HashSet#include?(digest): digest as hex or raw bytes
+VALUE hash_set_include(VALUE self, VALUE digest) {
+  struct tsk4r_hash_set * set;
+  unsigned char raw[TSK4R_HS_MAX_DIGEST];
+  TypedData_Get_Struct(self, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  if (! tsk4r_hash_set_parse(set, digest, raw)) return Qfalse;
+  return tsk4r_hash_set_contains(set, raw) ? Qtrue : Qfalse;
+}
+
+// HashSet#size: number of records (distinct digests, for a HashSet)
+VALUE hash_set_size(VALUE self) {
+  struct tsk4r_hash_set * set;
+  TypedData_Get_Struct(self, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  return ULL2NUM(set->count);
+}
+
+// HashSet#digest: :sha1 or :md5
+VALUE hash_set_digest(VALUE self) {
+  struct tsk4r_hash_set * set;
+  TypedData_Get_Struct(self, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  return ID2SYM(rb_intern(set->digest_len == TSK4R_HS_MD5 ? "md5" : "sha1"));
+}
+
+// HashSet#bloom?: whether the set carries a Bloom prefilter
+VALUE hash_set_bloom(VALUE self) {
+  struct tsk4r_hash_set * set;
+  TypedData_Get_Struct(self, struct tsk4r_hash_set, &tsk4r_hash_set_type, set);
+  return set->bloom != NULL ? Qtrue : Qfalse;
+}
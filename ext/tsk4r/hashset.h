@@ -0,0 +1,60 @@
+//
+//  hashset.h
+//  RubyTSK
+//
+//  Sleuthkit::HashSet: sorted, mmap'd known-file hash sets
+//
+
+#ifndef RubyTSK_hashset_h
+#define RubyTSK_hashset_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_HS_SHA1 20
+#define TSK4R_HS_MD5 16
+#define TSK4R_HS_MAX_DIGEST 20
+// Bloom filter bits per digest (about 1% false positives with 7 hashes)
+#define TSK4R_HS_BLOOM_BITS 10
+
+struct tsk4r_hash_set;
+extern const rb_data_type_t tsk4r_hash_set_type;
+
+// collects digest (+ payload) records for tsk4r_hash_set_write
+struct tsk4r_hash_set_builder {
+  unsigned char * records;   // malloc'd; the caller frees it
+  uint64_t count;
+  uint64_t alloc;
+  unsigned int digest_len;
+  unsigned int payload_len;  // 0 or 8
+  unsigned int bloom_log2;   // 1 sizes the filter from the count, 0 leaves it out
+  const void * trailer;
+  size_t trailer_len;
+  const char * source;
+  const char * path;
+  int err;                   // errno of a failed read or write
+};
+
+int tsk4r_hash_set_push(struct tsk4r_hash_set_builder * b, const unsigned char * digest, const unsigned char * payload);
+void * tsk4r_hash_set_write(void * builder);
+
+// lookups for skip_known: options and BlockHashDB matching; safe to call
+// without the GVL while the HashSet object is reachable
+const struct tsk4r_hash_set * tsk4r_hash_set_get(VALUE obj);
+unsigned int tsk4r_hash_set_digest_len(const struct tsk4r_hash_set * set);
+unsigned int tsk4r_hash_set_payload_len(const struct tsk4r_hash_set * set);
+int tsk4r_hash_set_parse(const struct tsk4r_hash_set * set, VALUE digest, unsigned char * raw);
+int tsk4r_hash_set_contains(const struct tsk4r_hash_set * set, const unsigned char * digest);
+uint64_t tsk4r_hash_set_find(const struct tsk4r_hash_set * set, const unsigned char * digest, uint64_t * first);
+const unsigned char * tsk4r_hash_set_payload(const struct tsk4r_hash_set * set, uint64_t i);
+const unsigned char * tsk4r_hash_set_trailer(const struct tsk4r_hash_set * set, size_t * len);
+int tsk4r_hash_set_digest_file(const struct tsk4r_hash_set * set, TSK_FS_FILE * file, char * buf, size_t buf_len, unsigned char * digest);
+
+VALUE build_hash_set(int argc, VALUE *args, VALUE klass);
+VALUE open_hash_set(VALUE klass, VALUE path);
+VALUE hash_set_include(VALUE self, VALUE digest);
+VALUE hash_set_size(VALUE self);
+VALUE hash_set_digest(VALUE self);
+VALUE hash_set_bloom(VALUE self);
+
+#endif
@@ -24,26 +24,47 @@
 #include <stdio.h>
 #include <ruby.h>
 #include "image.h"
+#include "memsize.h"
+#include "stats.h"
 
 // prototypes (private)
 TSK_IMG_TYPE_ENUM * get_img_flag();
 
+static size_t image_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_image_type = {
+  "Sleuthkit::Image",
+  TSK4R_DATA_FUNCTIONS(0, deallocate_image, image_memsize, 0),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 // functions
 VALUE allocate_image(VALUE klass){
   struct tsk4r_img_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_img_wrapper, 0, deallocate_image, ptr);
+  return TypedData_Make_Struct(klass, struct tsk4r_img_wrapper, &tsk4r_image_type, ptr);
+}
+
+static void close_image_handle(void * handle){
+  tsk4r_img_close((TSK_IMG_INFO *)handle);
+}
+
+// the image closes once nothing opened on it is left (owner.h)
+void deallocate_image(void * ptr){
+  struct tsk4r_img_wrapper * wrapper = ptr;
+  tsk4r_owner_release(wrapper->owner);
+  xfree(wrapper);
 }
 
-void deallocate_image(struct tsk4r_img_wrapper * ptr){
-  TSK_IMG_INFO *image = ptr->image;
-  tsk_img_close(image);
-  xfree(ptr);
+// includes libtsk's sector cache
+static size_t image_memsize(const void * ptr){
+  const struct tsk4r_img_wrapper * wrapper = ptr;
+  return sizeof(*wrapper) + tsk4r_img_memsize(wrapper->image);
 }
 
 VALUE image_open(VALUE self, VALUE filename_location, VALUE disk_type_flag) {
   char * filename; int dtype;
   struct tsk4r_img_wrapper * ptr;
-  Data_Get_Struct(self, struct tsk4r_img_wrapper, ptr);
+  TypedData_Get_Struct(self, struct tsk4r_img_wrapper, &tsk4r_image_type, ptr);
   
   VALUE img_size;
   VALUE img_sector_size;
@@ -55,7 +76,7 @@ VALUE image_open(VALUE self, VALUE filename_location, VALUE disk_type_flag) {
     fprintf(stdout, "opening %s. (flag=%d)\n", StringValuePtr(filename_location), dtype);
     rb_str_modify(filename_location);
     filename=StringValuePtr(filename_location);
-    ptr->image = tsk_img_open_sing(filename, (TSK_IMG_TYPE_ENUM)type_flag_num, 0); // 0=default sector size
+    ptr->image = tsk4r_img_open_sing(filename, (TSK_IMG_TYPE_ENUM)type_flag_num, 0); // 0=default sector size
     if (ptr->image == NULL) rb_warn("unable to open image %s.\n", StringValuePtr(filename_location));
 
   }
@@ -70,7 +91,7 @@ VALUE image_open(VALUE self, VALUE filename_location, VALUE disk_type_flag) {
     }
     int count = (int)RARRAY_LEN(filename_location);
 
-    ptr->image = tsk_img_open(count, (const TSK_TCHAR **)images, (TSK_IMG_TYPE_ENUM)type_flag_num, 0); // 0=default sector size
+    ptr->image = tsk4r_img_open(count, (const TSK_TCHAR **)images, (TSK_IMG_TYPE_ENUM)type_flag_num, 0); // 0=default sector size
     VALUE arr_to_s = rb_funcall(filename_location, rb_intern("to_s"), 0, NULL);
     if (ptr->image == NULL) rb_warn("unable to open images %s.\n", StringValuePtr(arr_to_s));
 
@@ -86,6 +107,7 @@ VALUE image_open(VALUE self, VALUE filename_location, VALUE disk_type_flag) {
     
   } else {
     TSK_IMG_INFO *image = ptr->image;
+    ptr->owner = tsk4r_owner_new(image, close_image_handle, NULL);
 
     img_size = LONG2NUM(image->size);
     img_sector_size = INT2NUM((int)image->sector_size);
@@ -144,7 +166,7 @@ VALUE initialize_disk_image(int argc, VALUE *args, VALUE self){
     rb_raise(rb_eArgError, "Arg1 must be filename (string)");
   }
   
-  Data_Get_Struct(self, struct tsk4r_img_wrapper, ptr);
+  TypedData_Get_Struct(self, struct tsk4r_img_wrapper, &tsk4r_image_type, ptr);
   if ( ptr->image != NULL ) {
     return self;
   } else {
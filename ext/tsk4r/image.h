@@ -25,16 +25,20 @@
 #define RubyTSK_image_h
 
 #include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+#include "owner.h"
 
 
 // Sleuthkit::Image struct-in-ruby-object
 struct tsk4r_img_wrapper {
   TSK_IMG_INFO * image;
+  struct tsk4r_owner * owner;
 };
+extern const rb_data_type_t tsk4r_image_type;
 
 // Sleuthkit::Image function declarations
 VALUE allocate_image(VALUE klass);
-void  deallocate_image(struct tsk4r_img_wrapper * ptr);
+void  deallocate_image(void * ptr);
 VALUE initialize_disk_image(int argc, VALUE *args, VALUE self);
 VALUE image_open(VALUE self, VALUE filename_str, VALUE disk_type);
 VALUE image_type_to_desc(VALUE self, VALUE number);
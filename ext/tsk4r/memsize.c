@@ -0,0 +1,102 @@
+//
+//  memsize.c
+//  RubyTSK
+//
+//  native footprint of libtsk structures, for the TypedData dsize functions
+//
+//  libtsk allocates its file system and image handles as larger private
+//  structs (EXT2FS_INFO, IMG_RAW_INFO, ...) with the public one first, so
+//  the allocator is asked for the real block size where it can tell us.
+//  Everything reachable through public fields (name arrays, attribute
+//  lists, resident buffers, run lists) is added on top.
+//
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+#include <ruby.h>
+#include "memsize.h"
+
+size_t tsk4r_malloc_size(const void * ptr, size_t fallback) {
+  if (ptr == NULL) return 0;
+#if defined(HAVE_MALLOC_H) && defined(HAVE_MALLOC_USABLE_SIZE)
+  return malloc_usable_size((void *)ptr);
+#else
+  return fallback;
+#endif
+}
+
+// the sector cache lives inside TSK_IMG_INFO
+size_t tsk4r_img_memsize(const TSK_IMG_INFO * img) {
+  return tsk4r_malloc_size(img, sizeof(TSK_IMG_INFO));
+}
+
+size_t tsk4r_vs_memsize(const TSK_VS_INFO * vs) {
+  const TSK_VS_PART_INFO * part;
+  size_t size = tsk4r_malloc_size(vs, sizeof(TSK_VS_INFO));
+  if (vs == NULL) return 0;
+  for (part = vs->part_list; part != NULL; part = part->next) {
+    size += tsk4r_malloc_size(part, sizeof(TSK_VS_PART_INFO));
+    if (part->desc != NULL) size += tsk4r_malloc_size(part->desc, strlen(part->desc) + 1);
+  }
+  return size;
+}
+
+size_t tsk4r_fs_memsize(const TSK_FS_INFO * fs) {
+  size_t size = tsk4r_malloc_size(fs, sizeof(TSK_FS_INFO));
+  if (fs == NULL) return 0;
+  if (fs->orphan_dir != NULL) size += tsk4r_fs_dir_memsize(fs->orphan_dir);
+  return size;
+}
+
+static size_t fs_attr_memsize(const TSK_FS_ATTR * attr) {
+  const TSK_FS_ATTR_RUN * run;
+  size_t size = tsk4r_malloc_size(attr, sizeof(TSK_FS_ATTR));
+  size += attr->name_size;
+  if (attr->flags & TSK_FS_ATTR_RES) {
+    size += attr->rd.buf_size;
+  } else {
+    for (run = attr->nrd.run; run != NULL; run = run->next) {
+      size += tsk4r_malloc_size(run, sizeof(TSK_FS_ATTR_RUN));
+    }
+  }
+  return size;
+}
+
+static size_t fs_name_memsize(const TSK_FS_NAME * name) {
+  return name->name_size + name->shrt_name_size;
+}
+
+size_t tsk4r_fs_file_memsize(const TSK_FS_FILE * file) {
+  size_t size;
+  if (file == NULL) return 0;
+  size = tsk4r_malloc_size(file, sizeof(TSK_FS_FILE));
+  if (file->meta != NULL) {
+    size += tsk4r_malloc_size(file->meta, sizeof(TSK_FS_META)) + file->meta->content_len;
+    if (file->meta->attr != NULL) {
+      const TSK_FS_ATTR * attr;
+      size += sizeof(TSK_FS_ATTRLIST);
+      for (attr = file->meta->attr->head; attr != NULL; attr = attr->next) {
+        size += fs_attr_memsize(attr);
+      }
+    }
+  }
+  if (file->name != NULL) {
+    size += tsk4r_malloc_size(file->name, sizeof(TSK_FS_NAME)) + fs_name_memsize(file->name);
+  }
+  return size;
+}
+
+size_t tsk4r_fs_dir_memsize(const TSK_FS_DIR * dir) {
+  size_t size, i;
+  if (dir == NULL) return 0;
+  size = tsk4r_malloc_size(dir, sizeof(TSK_FS_DIR));
+  size += dir->names_alloc * sizeof(TSK_FS_NAME);
+  for (i = 0; i < dir->names_used; i++) {
+    size += fs_name_memsize(&dir->names[i]);
+  }
+  size += tsk4r_fs_file_memsize(dir->fs_file);
+  return size;
+}
@@ -0,0 +1,21 @@
+//
+//  memsize.h
+//  RubyTSK
+//
+//  native footprint of libtsk structures, for the TypedData dsize functions
+//
+
+#ifndef RubyTSK_memsize_h
+#define RubyTSK_memsize_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+size_t tsk4r_malloc_size(const void * ptr, size_t fallback);
+size_t tsk4r_img_memsize(const TSK_IMG_INFO * img);
+size_t tsk4r_vs_memsize(const TSK_VS_INFO * vs);
+size_t tsk4r_fs_memsize(const TSK_FS_INFO * fs);
+size_t tsk4r_fs_file_memsize(const TSK_FS_FILE * file);
+size_t tsk4r_fs_dir_memsize(const TSK_FS_DIR * dir);
+
+#endif
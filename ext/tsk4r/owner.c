@@ -0,0 +1,31 @@
+//
+//  owner.c
+//  RubyTSK
+//
+//  close order for libtsk handles held by Ruby objects (see owner.h)
+//
+//  Owners are only taken and released by allocation and free functions,
+//  which run with the GVL held, so the counts need no atomics.
+//
+
+#include <ruby.h>
+#include "owner.h"
+
+struct tsk4r_owner * tsk4r_owner_new(void * handle, void (*close)(void * handle), struct tsk4r_owner * parent) {
+  struct tsk4r_owner * owner = ALLOC(struct tsk4r_owner);
+  owner->refs = 1;
+  owner->handle = handle;
+  owner->close = close;
+  owner->parent = parent;
+  if (parent != NULL) parent->refs++;
+  return owner;
+}
+
+void tsk4r_owner_release(struct tsk4r_owner * owner) {
+  while (owner != NULL && --owner->refs == 0) {
+    struct tsk4r_owner * parent = owner->parent;
+    if (owner->handle != NULL && owner->close != NULL) owner->close(owner->handle);
+    xfree(owner);
+    owner = parent;
+  }
+}
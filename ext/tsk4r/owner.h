@@ -0,0 +1,32 @@
+//
+//  owner.h
+//  RubyTSK
+//
+//  close order for libtsk handles held by Ruby objects
+//
+//  Marking keeps an Image alive while a FileSystem opened on it is
+//  reachable, but when both become garbage in the same GC cycle, or at VM
+//  shutdown, their free functions run in any order. Each wrapper therefore
+//  holds a reference on a small native owner instead of closing its handle
+//  itself; an owner closes its handle when its wrapper and everything
+//  opened on it are gone, and only then releases its parent.
+//
+//    Image <- Volume::System <- FileSystem <- Directory <- FileData
+//                            (or Image)    <- FileData
+//
+
+#ifndef RubyTSK_owner_h
+#define RubyTSK_owner_h
+
+struct tsk4r_owner {
+  long refs;
+  void * handle;                 // NULL for a borrowed handle
+  void (*close)(void * handle);
+  struct tsk4r_owner * parent;
+};
+
+// one reference for the caller; takes one on parent (may be NULL)
+struct tsk4r_owner * tsk4r_owner_new(void * handle, void (*close)(void * handle), struct tsk4r_owner * parent);
+void tsk4r_owner_release(struct tsk4r_owner * owner);
+
+#endif
@@ -0,0 +1,491 @@
+//
+//  stats.c
+//  RubyTSK
+//
+//  I/O and libtsk performance counters
+//
+//  Every image and file system the binding opens is registered here by
+//  its libtsk handle. While counting is on, each registered image has its
+//  format read function (TSK_IMG_INFO.read, what libtsk calls on a sector
+//  cache miss) swapped for one that counts media reads, bytes and seek
+//  distance; turning counting off swaps the format's own back. A read
+//  through a wrapper that didn't reach the media on its thread counts as
+//  a cache hit, and media bytes over delivered bytes gives the read
+//  amplification.
+//
+//  An operation is charged to its handle, to the image under it (so
+//  Image#stats covers the file systems opened on it) and to the global
+//  counters. Counters are updated with relaxed atomics, since the native
+//  scanners run libtsk calls on several threads.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "image.h"
+#include "file_system.h"
+#include "fs_cache.h"
+#include "stats.h"
+#include "trace.h"
+
+#define STAT_ADD(field, v) __atomic_fetch_add(&(field), (uint64_t)(v), __ATOMIC_RELAXED)
+
+volatile int tsk4r_stats_enabled = 0;
+
+const char * tsk4r_op_names[TSK4R_OPS] = {
+  "image_open", "image_read", "fs_open", "dir_open", "file_open", "file_read",
+  "block_get", "block_read", "dir_walk", "meta_walk", "block_walk"
+};
+
+struct tsk4r_stats_entry {
+  const void * handle;
+  ssize_t (*read)(TSK_IMG_INFO *, TSK_OFF_T, char *, size_t);   // images: the format's own
+  unsigned int readers;     // stats_media_read calls in flight
+  struct tsk4r_stats_entry * next;
+  struct tsk4r_stats stats;
+};
+
+// handles hash to a bucket with its own lock, so a media read only
+// contends with the images that share its bucket
+struct tsk4r_stats_bucket {
+  pthread_mutex_t lock;
+  pthread_cond_t drained;   // an entry being removed lost its last reader
+  struct tsk4r_stats_entry * head;
+};
+
+static struct tsk4r_stats global_stats;
+static struct tsk4r_stats_bucket buckets[TSK4R_STATS_BUCKETS];
+static __thread uint64_t thread_media_reads = 0;
+
+uint64_t tsk4r_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// 0 when neither counting nor tracing is on; the wrappers skip both then
+uint64_t tsk4r_stats_start(void) {
+  return (tsk4r_stats_enabled || tsk4r_trace_enabled) ? tsk4r_now_ns() : 0;
+}
+
+uint64_t tsk4r_stats_media_mark(void) {
+  return thread_media_reads;
+}
+
+// registry
+
+static struct tsk4r_stats_bucket * stats_bucket(const void * handle) {
+  uint64_t h = (uint64_t)(uintptr_t)handle * 0x9e3779b97f4a7c15ULL;
+  return &buckets[(h >> 32) % TSK4R_STATS_BUCKETS];
+}
+
+// with the bucket locked
+static struct tsk4r_stats_entry * bucket_find(struct tsk4r_stats_bucket * b, const void * handle) {
+  struct tsk4r_stats_entry * e;
+  for (e = b->head; e != NULL; e = e->next) {
+    if (e->handle == handle) return e;
+  }
+  return NULL;
+}
+
+// the entry stays valid while its handle is open, which the caller
+// guarantees by holding the handle
+static struct tsk4r_stats_entry * stats_find(const void * handle) {
+  struct tsk4r_stats_bucket * b;
+  struct tsk4r_stats_entry * e;
+  if (handle == NULL) return NULL;
+  b = stats_bucket(handle);
+  pthread_mutex_lock(&b->lock);
+  e = bucket_find(b, handle);
+  pthread_mutex_unlock(&b->lock);
+  return e;
+}
+
+static void charge_media(struct tsk4r_stats * s, TSK_OFF_T offset, ssize_t got, uint64_t ns) {
+  TSK_OFF_T end = s->media_end;
+  STAT_ADD(s->media_reads, 1);
+  if (got > 0) STAT_ADD(s->media_bytes, got);
+  STAT_ADD(s->media_ns, ns);
+  STAT_ADD(s->seek_distance, offset >= end ? offset - end : end - offset);
+  s->media_end = offset + (got > 0 ? got : 0);
+}
+
+// an image's read function while counting is on. The entry is pinned for
+// the call, so tsk4r_stats_unregister can't free it under a read
+static ssize_t stats_media_read(TSK_IMG_INFO * img, TSK_OFF_T offset, char * buf, size_t len) {
+  struct tsk4r_stats_bucket * b = stats_bucket(img);
+  struct tsk4r_stats_entry * e;
+  int counting = tsk4r_stats_enabled;
+  uint64_t t0 = 0, ns;
+  ssize_t got;
+
+  pthread_mutex_lock(&b->lock);
+  e = bucket_find(b, img);
+  if (e != NULL) e->readers++;
+  pthread_mutex_unlock(&b->lock);
+  if (e == NULL) return -1;
+
+  if (counting) t0 = tsk4r_now_ns();
+  got = e->read(img, offset, buf, len);
+  if (counting) {
+    ns = tsk4r_now_ns() - t0;
+    thread_media_reads++;
+    charge_media(&e->stats, offset, got, ns);
+    charge_media(&global_stats, offset, got, ns);
+  }
+
+  pthread_mutex_lock(&b->lock);
+  if (--e->readers == 0) pthread_cond_broadcast(&b->drained);
+  pthread_mutex_unlock(&b->lock);
+  return got;
+}
+
+// with the bucket locked: counting images read through stats_media_read,
+// the others through their own function, so a read costs nothing extra
+// while counting is off
+static void image_read_hook(struct tsk4r_stats_entry * e, int counting) {
+  if (e->read == NULL) return;
+  __atomic_store_n(&((TSK_IMG_INFO *)e->handle)->read, counting ? stats_media_read : e->read, __ATOMIC_RELEASE);
+}
+
+static void stats_register(const void * handle, TSK_IMG_INFO * img) {
+  struct tsk4r_stats_bucket * b = stats_bucket(handle);
+  struct tsk4r_stats_entry * e = calloc(1, sizeof(struct tsk4r_stats_entry));
+  if (e == NULL) return;     // uncounted, but still usable
+  e->handle = handle;
+  if (img != NULL) e->read = img->read;
+  pthread_mutex_lock(&b->lock);
+  if (bucket_find(b, handle) != NULL) {
+    pthread_mutex_unlock(&b->lock);
+    free(e);
+    return;
+  }
+  e->next = b->head;
+  b->head = e;
+  image_read_hook(e, tsk4r_stats_enabled);
+  pthread_mutex_unlock(&b->lock);
+}
+
+void tsk4r_stats_register_img(TSK_IMG_INFO * img) {
+  if (img != NULL) stats_register(img, img);
+}
+
+void tsk4r_stats_register_fs(TSK_FS_INFO * fs) {
+  if (fs != NULL) stats_register(fs, NULL);
+}
+
+// before the handle is closed; gives an image its own read function back
+// and waits for media reads still inside stats_media_read
+void tsk4r_stats_unregister(const void * handle) {
+  struct tsk4r_stats_bucket * b;
+  struct tsk4r_stats_entry ** link;
+  struct tsk4r_stats_entry * e = NULL;
+  if (handle == NULL) return;
+  b = stats_bucket(handle);
+  pthread_mutex_lock(&b->lock);
+  for (link = &b->head; *link != NULL; link = &(*link)->next) {
+    if ((*link)->handle == handle) {
+      e = *link;
+      image_read_hook(e, 0);
+      *link = e->next;
+      break;
+    }
+  }
+  while (e != NULL && e->readers > 0) pthread_cond_wait(&b->drained, &b->lock);
+  pthread_mutex_unlock(&b->lock);
+  free(e);
+}
+
+static int read_op(int op) {
+  return op == TSK4R_OP_IMAGE_READ || op == TSK4R_OP_FILE_READ || op == TSK4R_OP_BLOCK_GET || op == TSK4R_OP_BLOCK_READ;
+}
+
+static void charge_op(struct tsk4r_stats * s, int op, uint64_t ns, ssize_t bytes, int hit) {
+  STAT_ADD(s->op[op].calls, 1);
+  if (bytes > 0) STAT_ADD(s->op[op].bytes, bytes);
+  STAT_ADD(s->op[op].ns, ns);
+  if (hit) STAT_ADD(s->cache_hits, 1);
+}
+
+// charges one finished call (started at t0) to handle, its image and the
+// global counters; media_before is tsk4r_stats_media_mark() from before it
+void tsk4r_stats_charge(const void * handle, const TSK_IMG_INFO * img, int op, uint64_t t0, ssize_t bytes, uint64_t media_before) {
+  uint64_t ns = tsk4r_now_ns() - t0;
+  int hit = read_op(op) && bytes > 0 && thread_media_reads == media_before;
+  struct tsk4r_stats_entry * e = stats_find(handle);
+  if (e != NULL) charge_op(&e->stats, op, ns, bytes, hit);
+  if ((const void *)img != handle && (e = stats_find(img)) != NULL) charge_op(&e->stats, op, ns, bytes, hit);
+  charge_op(&global_stats, op, ns, bytes, hit);
+}
+
+// wrapped libtsk calls
+
+// OP_BEGIN and OP_END bracket each call: USDT probes always, counters
+// and trace spans only when turned on. Arguments that don't apply are -1.
+#define OP_BEGIN(op, inum, offset, length) \
+  uint64_t t0 = tsk4r_stats_start(); uint64_t mark = t0 ? thread_media_reads : 0; \
+  TSK4R_PROBE_BEGIN(tsk4r_op_names[op], (inum), (offset), (length))
+#define OP_END(handle, img, op, bytes, inum, offset, length) do { \
+    TSK4R_PROBE_END(tsk4r_op_names[op], (inum), (offset), (length), (bytes)); \
+    if (t0) { \
+      if (tsk4r_stats_enabled) tsk4r_stats_charge((handle), (img), (op), t0, (bytes), mark); \
+      if (tsk4r_trace_enabled) tsk4r_trace_span((op), t0, (inum), (offset), (length), (bytes)); \
+    } \
+  } while (0)
+
+TSK_IMG_INFO * tsk4r_img_open(int count, const TSK_TCHAR * const images[], TSK_IMG_TYPE_ENUM type, unsigned int sector_size) {
+  OP_BEGIN(TSK4R_OP_IMAGE_OPEN, -1, -1, -1);
+  TSK_IMG_INFO * img = tsk_img_open(count, images, type, sector_size);
+  tsk4r_stats_register_img(img);
+  OP_END(img, img, TSK4R_OP_IMAGE_OPEN, 0, -1, -1, img ? img->size : -1);
+  return img;
+}
+
+TSK_IMG_INFO * tsk4r_img_open_sing(const TSK_TCHAR * image, TSK_IMG_TYPE_ENUM type, unsigned int sector_size) {
+  OP_BEGIN(TSK4R_OP_IMAGE_OPEN, -1, -1, -1);
+  TSK_IMG_INFO * img = tsk_img_open_sing(image, type, sector_size);
+  tsk4r_stats_register_img(img);
+  OP_END(img, img, TSK4R_OP_IMAGE_OPEN, 0, -1, -1, img ? img->size : -1);
+  return img;
+}
+
+void tsk4r_img_close(TSK_IMG_INFO * img) {
+  tsk4r_stats_unregister(img);
+  tsk_img_close(img);
+}
+
+TSK_FS_INFO * tsk4r_fs_open_img(TSK_IMG_INFO * img, TSK_OFF_T offset, TSK_FS_TYPE_ENUM type) {
+  OP_BEGIN(TSK4R_OP_FS_OPEN, -1, offset, -1);
+  TSK_FS_INFO * fs = tsk_fs_open_img(img, offset, type);
+  tsk4r_stats_register_fs(fs);
+  OP_END(fs ? (const void *)fs : (const void *)img, img, TSK4R_OP_FS_OPEN, 0, -1, offset, -1);
+  return fs;
+}
+
+TSK_FS_INFO * tsk4r_fs_open_vol(const TSK_VS_PART_INFO * part, TSK_FS_TYPE_ENUM type) {
+  TSK_IMG_INFO * img = part->vs->img_info;
+  TSK_OFF_T offset = part->vs->offset + (TSK_OFF_T)part->start * part->vs->block_size;
+  TSK_OFF_T length = (TSK_OFF_T)part->len * part->vs->block_size;
+  OP_BEGIN(TSK4R_OP_FS_OPEN, -1, offset, length);
+  TSK_FS_INFO * fs = tsk_fs_open_vol(part, type);
+  tsk4r_stats_register_fs(fs);
+  OP_END(fs ? (const void *)fs : (const void *)img, img, TSK4R_OP_FS_OPEN, 0, -1, offset, length);
+  return fs;
+}
+
+void tsk4r_fs_close(TSK_FS_INFO * fs) {
+  tsk4r_stats_unregister(fs);
+  tsk_fs_close(fs);
+}
+
+ssize_t tsk4r_img_read(TSK_IMG_INFO * img, TSK_OFF_T offset, char * buf, size_t len) {
+  OP_BEGIN(TSK4R_OP_IMAGE_READ, -1, offset, len);
+  ssize_t got = tsk_img_read(img, offset, buf, len);
+  OP_END(img, img, TSK4R_OP_IMAGE_READ, got, -1, offset, len);
+  return got;
+}
+
+TSK_FS_DIR * tsk4r_fs_dir_open(TSK_FS_INFO * fs, const char * path) {
+  OP_BEGIN(TSK4R_OP_DIR_OPEN, -1, -1, -1);
+  TSK_FS_DIR * dir = tsk_fs_dir_open(fs, path);
+  OP_END(fs, fs->img_info, TSK4R_OP_DIR_OPEN, 0, dir ? (int64_t)dir->addr : -1, -1, -1);
+  return dir;
+}
+
+TSK_FS_DIR * tsk4r_fs_dir_open_meta(TSK_FS_INFO * fs, TSK_INUM_T addr) {
+  OP_BEGIN(TSK4R_OP_DIR_OPEN, addr, -1, -1);
+  TSK_FS_DIR * dir = tsk_fs_dir_open_meta(fs, addr);
+  OP_END(fs, fs->img_info, TSK4R_OP_DIR_OPEN, 0, addr, -1, -1);
+  return dir;
+}
+
+TSK_FS_FILE * tsk4r_fs_file_open_meta(TSK_FS_INFO * fs, TSK_FS_FILE * file, TSK_INUM_T addr) {
+  OP_BEGIN(TSK4R_OP_FILE_OPEN, addr, -1, -1);
+  TSK_FS_FILE * opened = tsk_fs_file_open_meta(fs, file, addr);
+  OP_END(fs, fs->img_info, TSK4R_OP_FILE_OPEN, 0, addr, -1, -1);
+  return opened;
+}
+
+ssize_t tsk4r_fs_file_read(TSK_FS_FILE * file, TSK_OFF_T offset, char * buf, size_t len, TSK_FS_FILE_READ_FLAG_ENUM flags) {
+  int64_t inum = file->meta ? (int64_t)file->meta->addr : -1;
+  OP_BEGIN(TSK4R_OP_FILE_READ, inum, offset, len);
+  ssize_t got = tsk_fs_file_read(file, offset, buf, len, flags);
+  OP_END(file->fs_info, file->fs_info ? file->fs_info->img_info : NULL, TSK4R_OP_FILE_READ, got, inum, offset, len);
+  return got;
+}
+
+// charged as a file read, like tsk_fs_file_read of the default attribute
+ssize_t tsk4r_fs_attr_read(const TSK_FS_ATTR * attr, TSK_OFF_T offset, char * buf, size_t len, TSK_FS_FILE_READ_FLAG_ENUM flags) {
+  TSK_FS_FILE * file = attr->fs_file;
+  int64_t inum = (file && file->meta) ? (int64_t)file->meta->addr : -1;
+  TSK_FS_INFO * fs = file ? file->fs_info : NULL;
+  OP_BEGIN(TSK4R_OP_FILE_READ, inum, offset, len);
+  ssize_t got = tsk_fs_attr_read(attr, offset, buf, len, flags);
+  OP_END(fs, fs ? fs->img_info : NULL, TSK4R_OP_FILE_READ, got, inum, offset, len);
+  return got;
+}
+
+// block calls give the block's byte offset in the file system
+TSK_FS_BLOCK * tsk4r_fs_block_get(TSK_FS_INFO * fs, TSK_FS_BLOCK * block, TSK_DADDR_T addr) {
+  OP_BEGIN(TSK4R_OP_BLOCK_GET, -1, addr * fs->block_size, fs->block_size);
+  TSK_FS_BLOCK * got = tsk_fs_block_get(fs, block, addr);
+  OP_END(fs, fs->img_info, TSK4R_OP_BLOCK_GET, got ? (ssize_t)fs->block_size : 0, -1, addr * fs->block_size, fs->block_size);
+  return got;
+}
+
+ssize_t tsk4r_fs_read_block(TSK_FS_INFO * fs, TSK_DADDR_T addr, char * buf, size_t len) {
+  OP_BEGIN(TSK4R_OP_BLOCK_READ, -1, addr * fs->block_size, len);
+  ssize_t got = tsk_fs_read_block(fs, addr, buf, len);
+  OP_END(fs, fs->img_info, TSK4R_OP_BLOCK_READ, got, -1, addr * fs->block_size, len);
+  return got;
+}
+
+uint8_t tsk4r_fs_dir_walk(TSK_FS_INFO * fs, TSK_INUM_T inum, TSK_FS_DIR_WALK_FLAG_ENUM flags, TSK_FS_DIR_WALK_CB cb, void * ptr) {
+  OP_BEGIN(TSK4R_OP_DIR_WALK, inum, -1, -1);
+  uint8_t failed = tsk_fs_dir_walk(fs, inum, flags, cb, ptr);
+  OP_END(fs, fs->img_info, TSK4R_OP_DIR_WALK, 0, inum, -1, -1);
+  return failed;
+}
+
+// meta walks give the first inum and the number of inums
+uint8_t tsk4r_fs_meta_walk(TSK_FS_INFO * fs, TSK_INUM_T start, TSK_INUM_T end, TSK_FS_META_FLAG_ENUM flags, TSK_FS_META_WALK_CB cb, void * ptr) {
+  OP_BEGIN(TSK4R_OP_META_WALK, start, -1, end - start + 1);
+  uint8_t failed = tsk_fs_meta_walk(fs, start, end, flags, cb, ptr);
+  OP_END(fs, fs->img_info, TSK4R_OP_META_WALK, 0, start, -1, end - start + 1);
+  return failed;
+}
+
+uint8_t tsk4r_fs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end, TSK_FS_BLOCK_WALK_FLAG_ENUM flags, TSK_FS_BLOCK_WALK_CB cb, void * ptr) {
+  OP_BEGIN(TSK4R_OP_BLOCK_WALK, -1, start * fs->block_size, (end - start + 1) * fs->block_size);
+  uint8_t failed = tsk_fs_block_walk(fs, start, end, flags, cb, ptr);
+  OP_END(fs, fs->img_info, TSK4R_OP_BLOCK_WALK, 0, -1, start * fs->block_size, (end - start + 1) * fs->block_size);
+  return failed;
+}
+
+// Ruby side
+
+static VALUE stats_to_hash(const struct tsk4r_stats * s) {
+  VALUE stats = rb_hash_new();
+  VALUE ops = rb_hash_new();
+  VALUE media = rb_hash_new();
+  uint64_t delivered = 0;
+  int op;
+
+  for (op = 0; op < TSK4R_OPS; op++) {
+    VALUE counter = rb_hash_new();
+    rb_hash_aset(counter, ID2SYM(rb_intern("calls")), ULL2NUM(s->op[op].calls));
+    rb_hash_aset(counter, ID2SYM(rb_intern("bytes")), ULL2NUM(s->op[op].bytes));
+    rb_hash_aset(counter, ID2SYM(rb_intern("ns")), ULL2NUM(s->op[op].ns));
+    rb_hash_aset(ops, ID2SYM(rb_intern(tsk4r_op_names[op])), counter);
+    if (read_op(op)) delivered += s->op[op].bytes;
+  }
+  rb_hash_aset(media, ID2SYM(rb_intern("reads")), ULL2NUM(s->media_reads));
+  rb_hash_aset(media, ID2SYM(rb_intern("bytes")), ULL2NUM(s->media_bytes));
+  rb_hash_aset(media, ID2SYM(rb_intern("ns")), ULL2NUM(s->media_ns));
+  rb_hash_aset(media, ID2SYM(rb_intern("seek_distance")), ULL2NUM(s->seek_distance));
+
+  rb_hash_aset(stats, ID2SYM(rb_intern("ops")), ops);
+  rb_hash_aset(stats, ID2SYM(rb_intern("media")), media);
+  rb_hash_aset(stats, ID2SYM(rb_intern("delivered_bytes")), ULL2NUM(delivered));
+  rb_hash_aset(stats, ID2SYM(rb_intern("cache_hits")), ULL2NUM(s->cache_hits));
+  rb_hash_aset(stats, ID2SYM(rb_intern("read_amplification")),
+               rb_float_new(delivered ? (double)s->media_bytes / (double)delivered : 0.0));
+  return stats;
+}
+
+// the position of the last media read survives a reset, so the next seek
+// distance is still measured from where the disk really is
+static void stats_reset(struct tsk4r_stats * s) {
+  TSK_OFF_T end = s->media_end;
+  memset(s, 0, sizeof(*s));
+  s->media_end = end;
+}
+
+static VALUE handle_stats(const void * handle) {
+  struct tsk4r_stats zero;
+  struct tsk4r_stats_entry * e = stats_find(handle);
+  if (e != NULL) return stats_to_hash(&e->stats);
+  memset(&zero, 0, sizeof(zero));
+  return stats_to_hash(&zero);
+}
+
+static const void * image_handle(VALUE self) {
+  struct tsk4r_img_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_img_wrapper, &tsk4r_image_type, ptr);
+  return ptr->image;
+}
+
+static const void * fs_handle(VALUE self) {
+  struct tsk4r_fs_wrapper * ptr;
+  TypedData_Get_Struct(self, struct tsk4r_fs_wrapper, &tsk4r_fs_type, ptr);
+  return ptr->filesystem;
+}
+
+// Image#stats: everything done on the image, its file systems included
+VALUE get_image_stats(VALUE self) {
+  return handle_stats(image_handle(self));
+}
+
+VALUE reset_image_stats(VALUE self) {
+  struct tsk4r_stats_entry * e = stats_find(image_handle(self));
+  if (e != NULL) stats_reset(&e->stats);
+  return self;
+}
+
+// FileSystem::System#stats: this file system's calls, the media counters
+// of the image under it and the FileData cache
+VALUE get_fs_stats(VALUE self) {
+  const TSK_FS_INFO * fs = fs_handle(self);
+  VALUE stats = handle_stats(fs);
+  struct tsk4r_stats_entry * img = fs ? stats_find(fs->img_info) : NULL;
+  if (img != NULL) rb_hash_aset(stats, ID2SYM(rb_intern("media")), rb_hash_aref(stats_to_hash(&img->stats), ID2SYM(rb_intern("media"))));
+  rb_hash_aset(stats, ID2SYM(rb_intern("file_cache")), get_file_cache_stats(self));
+  return stats;
+}
+
+VALUE reset_fs_stats(VALUE self) {
+  struct tsk4r_stats_entry * e = stats_find(fs_handle(self));
+  if (e != NULL) stats_reset(&e->stats);
+  return self;
+}
+
+// Sleuthkit.stats
+VALUE get_global_stats(VALUE self) {
+  return stats_to_hash(&global_stats);
+}
+
+VALUE reset_global_stats(VALUE self) {
+  stats_reset(&global_stats);
+  return self;
+}
+
+VALUE get_stats_enabled(VALUE self) {
+  return tsk4r_stats_enabled ? Qtrue : Qfalse;
+}
+
+VALUE set_stats_enabled(VALUE self, VALUE enabled) {
+  int counting = RTEST(enabled);
+  int i;
+  tsk4r_stats_enabled = counting;
+  for (i = 0; i < TSK4R_STATS_BUCKETS; i++) {
+    struct tsk4r_stats_entry * e;
+    pthread_mutex_lock(&buckets[i].lock);
+    for (e = buckets[i].head; e != NULL; e = e->next) image_read_hook(e, counting);
+    pthread_mutex_unlock(&buckets[i].lock);
+  }
+  return enabled;
+}
+
+// TSK4R_STATS=1 in the environment turns counting on from the start
+void tsk4r_stats_init(void) {
+  const char * env = getenv("TSK4R_STATS");
+  int i;
+  for (i = 0; i < TSK4R_STATS_BUCKETS; i++) {
+    pthread_mutex_init(&buckets[i].lock, NULL);
+    pthread_cond_init(&buckets[i].drained, NULL);
+  }
+  if (env != NULL && *env != '\0' && strcmp(env, "0") != 0) tsk4r_stats_enabled = 1;
+}
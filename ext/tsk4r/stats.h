@@ -0,0 +1,98 @@
+//
+//  stats.h
+//  RubyTSK
+//
+//  I/O and libtsk performance counters: Image#stats,
+//  FileSystem::System#stats and Sleuthkit.stats
+//
+//  The binding calls libtsk through the tsk4r_* wrappers below. With
+//  counting off (the default) a wrapper costs one load of
+//  tsk4r_stats_enabled; with it on, the call is timed and charged to the
+//  handle's counters and to the global ones.
+//
+
+#ifndef RubyTSK_stats_h
+#define RubyTSK_stats_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+enum tsk4r_stat_op {
+  TSK4R_OP_IMAGE_OPEN,
+  TSK4R_OP_IMAGE_READ,
+  TSK4R_OP_FS_OPEN,
+  TSK4R_OP_DIR_OPEN,
+  TSK4R_OP_FILE_OPEN,
+  TSK4R_OP_FILE_READ,
+  TSK4R_OP_BLOCK_GET,
+  TSK4R_OP_BLOCK_READ,
+  TSK4R_OP_DIR_WALK,
+  TSK4R_OP_META_WALK,
+  TSK4R_OP_BLOCK_WALK,
+  TSK4R_OPS
+};
+
+// registry hash buckets, each with its own lock
+#define TSK4R_STATS_BUCKETS 64
+
+struct tsk4r_op_counter {
+  uint64_t calls;
+  uint64_t bytes;       // delivered to the binding
+  uint64_t ns;          // inside libtsk (walks include their callbacks)
+};
+
+struct tsk4r_stats {
+  struct tsk4r_op_counter op[TSK4R_OPS];
+  uint64_t cache_hits;      // reads served without touching the media
+  uint64_t media_reads;     // calls of the image format's read function
+  uint64_t media_bytes;
+  uint64_t media_ns;
+  uint64_t seek_distance;   // bytes between the end of one media read and the next
+  TSK_OFF_T media_end;
+};
+
+extern volatile int tsk4r_stats_enabled;
+extern const char * tsk4r_op_names[TSK4R_OPS];
+
+uint64_t tsk4r_now_ns(void);
+
+uint64_t tsk4r_stats_start(void);
+void tsk4r_stats_charge(const void * handle, const TSK_IMG_INFO * img, int op, uint64_t t0, ssize_t bytes, uint64_t media_before);
+uint64_t tsk4r_stats_media_mark(void);
+
+void tsk4r_stats_register_img(TSK_IMG_INFO * img);
+void tsk4r_stats_register_fs(TSK_FS_INFO * fs);
+void tsk4r_stats_unregister(const void * handle);
+
+// wrapped libtsk calls
+TSK_IMG_INFO * tsk4r_img_open(int count, const TSK_TCHAR * const images[], TSK_IMG_TYPE_ENUM type, unsigned int sector_size);
+TSK_IMG_INFO * tsk4r_img_open_sing(const TSK_TCHAR * image, TSK_IMG_TYPE_ENUM type, unsigned int sector_size);
+void tsk4r_img_close(TSK_IMG_INFO * img);
+TSK_FS_INFO * tsk4r_fs_open_img(TSK_IMG_INFO * img, TSK_OFF_T offset, TSK_FS_TYPE_ENUM type);
+TSK_FS_INFO * tsk4r_fs_open_vol(const TSK_VS_PART_INFO * part, TSK_FS_TYPE_ENUM type);
+void tsk4r_fs_close(TSK_FS_INFO * fs);
+
+ssize_t tsk4r_img_read(TSK_IMG_INFO * img, TSK_OFF_T offset, char * buf, size_t len);
+TSK_FS_DIR * tsk4r_fs_dir_open(TSK_FS_INFO * fs, const char * path);
+TSK_FS_DIR * tsk4r_fs_dir_open_meta(TSK_FS_INFO * fs, TSK_INUM_T addr);
+TSK_FS_FILE * tsk4r_fs_file_open_meta(TSK_FS_INFO * fs, TSK_FS_FILE * file, TSK_INUM_T addr);
+ssize_t tsk4r_fs_file_read(TSK_FS_FILE * file, TSK_OFF_T offset, char * buf, size_t len, TSK_FS_FILE_READ_FLAG_ENUM flags);
+ssize_t tsk4r_fs_attr_read(const TSK_FS_ATTR * attr, TSK_OFF_T offset, char * buf, size_t len, TSK_FS_FILE_READ_FLAG_ENUM flags);
+TSK_FS_BLOCK * tsk4r_fs_block_get(TSK_FS_INFO * fs, TSK_FS_BLOCK * block, TSK_DADDR_T addr);
+ssize_t tsk4r_fs_read_block(TSK_FS_INFO * fs, TSK_DADDR_T addr, char * buf, size_t len);
+uint8_t tsk4r_fs_dir_walk(TSK_FS_INFO * fs, TSK_INUM_T inum, TSK_FS_DIR_WALK_FLAG_ENUM flags, TSK_FS_DIR_WALK_CB cb, void * ptr);
+uint8_t tsk4r_fs_meta_walk(TSK_FS_INFO * fs, TSK_INUM_T start, TSK_INUM_T end, TSK_FS_META_FLAG_ENUM flags, TSK_FS_META_WALK_CB cb, void * ptr);
+uint8_t tsk4r_fs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end, TSK_FS_BLOCK_WALK_FLAG_ENUM flags, TSK_FS_BLOCK_WALK_CB cb, void * ptr);
+
+// Ruby methods
+VALUE get_image_stats(VALUE self);
+VALUE reset_image_stats(VALUE self);
+VALUE get_fs_stats(VALUE self);
+VALUE reset_fs_stats(VALUE self);
+VALUE get_global_stats(VALUE self);
+VALUE reset_global_stats(VALUE self);
+VALUE get_stats_enabled(VALUE self);
+VALUE set_stats_enabled(VALUE self, VALUE enabled);
+void  tsk4r_stats_init(void);
+
+#endif
@@ -0,0 +1,483 @@
+//
+//  str_extract.c
+//  RubyTSK
+//
+//  strings(1)-style extraction for Sleuthkit::Image and FileData
+//
+//  One pass over the bytes tracks three runs at once: printable ASCII, and
+//  UTF-16LE (a printable byte followed by a zero byte) at even and at odd
+//  offsets. Only the printable-ASCII subset of UTF-16 is recognised, as
+//  with `strings -el`. Stretches of zero bytes with no run open are
+//  skipped eight bytes at a time, which is where unallocated space and
+//  pagefiles spend most of their length.
+//
+//  The data is cut into pieces that worker threads scan with the GVL
+//  released. A piece is read from two bytes before its start, so a run
+//  already under way there is recognised and left to the previous piece,
+//  and runs that start inside the piece (a UTF-16 one may start on its
+//  last byte) are followed past its end. Each
+//  turn scans one piece per thread; the Ruby side converts the results in
+//  offset order and yields them in batches before the next turn starts.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ruby.h>
+#include "image.h"
+#include "fs_file.h"
+#include "str_extract.h"
+#include "batch.h"
+#include "stats.h"
+
+enum tsk4r_str_encoding {
+  TSK4R_STR_ASCII,
+  TSK4R_STR_UTF16LE,
+  TSK4R_STR_ENCODINGS
+};
+
+static const char * TSK4R_STR_ENCODING_NAMES[TSK4R_STR_ENCODINGS] = { "ascii", "utf16le" };
+
+// printable ASCII and tab, like strings(1)
+#define STR_PRINTABLE(c) ((unsigned int)(c) - 0x20 < 0x5f || (c) == '\t')
+
+struct tsk4r_str_hit {
+  TSK_OFF_T offset;
+  int encoding;
+  size_t text;          // offset into the piece's arena
+  size_t len;
+};
+
+// results of one piece
+struct tsk4r_str_out {
+  struct tsk4r_str_hit * hits;
+  size_t count;
+  size_t alloc;
+  char * arena;
+  size_t used;
+  size_t size;
+};
+
+struct tsk4r_str_run {
+  TSK_OFF_T start;      // -1 while no run is open
+  int owned;            // started inside the piece being scanned
+  char * text;
+  size_t len;
+  size_t alloc;
+};
+
+// run[0] is ASCII, run[1 + (offset & 1)] UTF-16LE starting at that parity
+struct tsk4r_str_scanner {
+  struct tsk4r_str_run run[3];
+  int ascii;
+  int utf16le;
+  size_t min_len;
+  TSK_OFF_T pos;        // offset of the next byte
+  int prev;             // the byte before it, or -1
+  TSK_OFF_T own_from;
+  TSK_OFF_T own_to;
+  struct tsk4r_str_out * out;
+};
+
+struct tsk4r_str_job {
+  TSK_IMG_INFO * img;   // either the image
+  TSK_FS_FILE * file;   // or a file's content
+  pthread_mutex_t * file_lock;   // its FileData's read lock
+  const TSK_FS_ATTR * attr;   // a non-default attribute of it, or NULL
+  TSK_OFF_T size;
+  int threads;
+  size_t min_len;
+  int encodings[TSK4R_STR_ENCODINGS];
+
+  TSK_OFF_T first;      // first piece of the current turn
+  size_t turn;          // pieces in it
+  size_t next;
+  struct tsk4r_str_out * outs;
+  pthread_mutex_t lock;
+
+  volatile int cancel;
+  const char * failed;
+  char error[256];
+};
+
+static void str_fail(struct tsk4r_str_job * job, const char * function, const char * message) {
+  pthread_mutex_lock(&job->lock);
+  if (job->failed == NULL) {
+    job->failed = function;
+    snprintf(job->error, sizeof(job->error), "%s", message ? message : "unknown error");
+  }
+  pthread_mutex_unlock(&job->lock);
+}
+
+// scanner
+
+static void run_open(struct tsk4r_str_scanner * sc, struct tsk4r_str_run * r, TSK_OFF_T start) {
+  r->start = start;
+  r->owned = start >= sc->own_from && start < sc->own_to;
+  r->len = 0;
+}
+
+static int run_push(struct tsk4r_str_run * r, int c) {
+  if (! r->owned) return 0;
+  if (r->len == r->alloc) {
+    size_t grow = r->alloc ? r->alloc * 2 : 256;
+    char * text = realloc(r->text, grow);
+    if (text == NULL) return -1;
+    r->text = text;
+    r->alloc = grow;
+  }
+  r->text[r->len++] = (char)c;
+  return 0;
+}
+
+static int run_close(struct tsk4r_str_scanner * sc, struct tsk4r_str_run * r, int encoding) {
+  struct tsk4r_str_out * out = sc->out;
+  struct tsk4r_str_hit * hit;
+  TSK_OFF_T start = r->start;
+  int keep = r->owned && r->len >= sc->min_len;
+  r->start = -1;
+  if (! keep) return 0;
+  if (out->count == out->alloc) {
+    size_t grow = out->alloc ? out->alloc * 2 : 1024;
+    struct tsk4r_str_hit * hits = realloc(out->hits, grow * sizeof(struct tsk4r_str_hit));
+    if (hits == NULL) return -1;
+    out->hits = hits;
+    out->alloc = grow;
+  }
+  if (out->used + r->len > out->size) {
+    size_t grow = out->size ? out->size * 2 : 65536;
+    char * arena;
+    while (grow < out->used + r->len) grow *= 2;
+    arena = realloc(out->arena, grow);
+    if (arena == NULL) return -1;
+    out->arena = arena;
+    out->size = grow;
+  }
+  hit = &out->hits[out->count++];
+  hit->offset = start;
+  hit->encoding = encoding;
+  hit->text = out->used;
+  hit->len = r->len;
+  memcpy(out->arena + out->used, r->text, r->len);
+  out->used += r->len;
+  return 0;
+}
+
+static int runs_closed(const struct tsk4r_str_scanner * sc) {
+  return sc->run[0].start < 0 && sc->run[1].start < 0 && sc->run[2].start < 0;
+}
+
+static int owned_run_open(const struct tsk4r_str_scanner * sc) {
+  int i;
+  for (i = 0; i < 3; i++) {
+    if (sc->run[i].start >= 0 && sc->run[i].owned) return 1;
+  }
+  return 0;
+}
+
+static int scan_bytes(struct tsk4r_str_scanner * sc, const unsigned char * buf, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    int c = buf[i];
+    TSK_OFF_T off = sc->pos + (TSK_OFF_T)i;
+    struct tsk4r_str_run * r;
+
+    // zeros can neither extend nor start a run once nothing is open and
+    // the byte before isn't printable
+    if (c == 0 && (sc->prev < 0 || ! STR_PRINTABLE(sc->prev)) && runs_closed(sc)) {
+      uint64_t word;
+      i++;
+      while (i + 8 <= len) {
+        memcpy(&word, buf + i, 8);
+        if (word != 0) break;
+        i += 8;
+      }
+      while (i < len && buf[i] == 0) i++;
+      sc->prev = 0;
+      continue;
+    }
+    if (sc->ascii) {
+      r = &sc->run[0];
+      if (STR_PRINTABLE(c)) {
+        if (r->start < 0) run_open(sc, r, off);
+        if (run_push(r, c) != 0) return -1;
+      } else if (r->start >= 0 && run_close(sc, r, TSK4R_STR_ASCII) != 0) {
+        return -1;
+      }
+    }
+    if (sc->utf16le && sc->prev >= 0) {
+      r = &sc->run[1 + ((off - 1) & 1)];
+      if (c == 0 && STR_PRINTABLE(sc->prev)) {
+        if (r->start < 0) run_open(sc, r, off - 1);
+        if (run_push(r, sc->prev) != 0) return -1;
+      } else if (r->start >= 0 && run_close(sc, r, TSK4R_STR_UTF16LE) != 0) {
+        return -1;
+      }
+    }
+    sc->prev = c;
+    i++;
+  }
+  sc->pos += (TSK_OFF_T)len;
+  return 0;
+}
+
+static int compare_str_hits(const void * a, const void * b) {
+  const struct tsk4r_str_hit * x = a; const struct tsk4r_str_hit * y = b;
+  if (x->offset != y->offset) return x->offset < y->offset ? -1 : 1;
+  return x->encoding - y->encoding;
+}
+
+// workers
+
+static ssize_t str_read(struct tsk4r_str_job * job, TSK_OFF_T offset, unsigned char * buf, size_t len) {
+  ssize_t got;
+  if (job->img != NULL) return tsk4r_img_read(job->img, offset, (char *)buf, len);
+  pthread_mutex_lock(job->file_lock);
+  if (job->attr != NULL) {
+    got = tsk4r_fs_attr_read(job->attr, offset, (char *)buf, len, TSK_FS_FILE_READ_FLAG_NONE);
+  } else {
+    got = tsk4r_fs_file_read(job->file, offset, (char *)buf, len, TSK_FS_FILE_READ_FLAG_NONE);
+  }
+  pthread_mutex_unlock(job->file_lock);
+  return got;
+}
+
+// reads [sc->pos, end) through buf and feeds it to the scanner
+static int scan_until(struct tsk4r_str_job * job, struct tsk4r_str_scanner * sc, TSK_OFF_T end,
+                      unsigned char * buf, size_t buf_len, int follow) {
+  while (sc->pos < end && ! job->cancel) {
+    size_t want = (size_t)(end - sc->pos < (TSK_OFF_T)buf_len ? end - sc->pos : (TSK_OFF_T)buf_len);
+    ssize_t got = str_read(job, sc->pos, buf, want);
+    if (got <= 0) {
+      str_fail(job, job->img ? "tsk_img_read" : "tsk_fs_file_read", got < 0 ? tsk_error_get() : "short read");
+      return -1;
+    }
+    if (scan_bytes(sc, buf, (size_t)got) != 0) {
+      str_fail(job, "strings", "out of memory");
+      return -1;
+    }
+    if (follow && ! owned_run_open(sc)) break;
+  }
+  return 0;
+}
+
+static int scan_piece(struct tsk4r_str_job * job, TSK_OFF_T start, struct tsk4r_str_out * out, unsigned char * buf) {
+  struct tsk4r_str_scanner sc;
+  TSK_OFF_T end = start + TSK4R_STRINGS_PIECE < job->size ? start + TSK4R_STRINGS_PIECE : job->size;
+  int i, failed;
+
+  MEMZERO(&sc, struct tsk4r_str_scanner, 1);
+  for (i = 0; i < 3; i++) sc.run[i].start = -1;
+  sc.ascii = job->encodings[TSK4R_STR_ASCII];
+  sc.utf16le = job->encodings[TSK4R_STR_UTF16LE];
+  sc.min_len = job->min_len;
+  sc.pos = start >= 2 ? start - 2 : 0;
+  sc.prev = -1;
+  sc.own_from = start;
+  sc.own_to = end;
+  sc.out = out;
+
+  failed = scan_until(job, &sc, end, buf, TSK4R_STRINGS_PIECE + 2, 0);
+  // a printable last byte only opens a UTF-16 run once the zero after it
+  // is seen, and the next piece won't own it
+  if (! failed && sc.utf16le && sc.prev >= 0 && STR_PRINTABLE(sc.prev) && end < job->size) {
+    failed = scan_until(job, &sc, end + 1, buf, 1, 0);
+  }
+  if (! failed && owned_run_open(&sc)) {
+    failed = scan_until(job, &sc, job->size, buf, TSK4R_STRINGS_WINDOW, 1);
+  }
+  if (! failed && sc.pos >= job->size) {
+    if (sc.run[0].start >= 0 && run_close(&sc, &sc.run[0], TSK4R_STR_ASCII) != 0) failed = -1;
+    for (i = 1; i < 3 && ! failed; i++) {
+      if (sc.run[i].start >= 0 && run_close(&sc, &sc.run[i], TSK4R_STR_UTF16LE) != 0) failed = -1;
+    }
+    if (failed) str_fail(job, "strings", "out of memory");
+  }
+  for (i = 0; i < 3; i++) free(sc.run[i].text);
+  if (failed) return -1;
+  if (out->count > 1) qsort(out->hits, out->count, sizeof(struct tsk4r_str_hit), compare_str_hits);
+  return 0;
+}
+
+static void * strings_worker(void * ptr) {
+  struct tsk4r_str_job * job = (struct tsk4r_str_job *)ptr;
+  unsigned char * buf = malloc(TSK4R_STRINGS_PIECE + 2);
+  size_t i;
+
+  if (buf == NULL) {
+    str_fail(job, "strings", "out of memory");
+    return NULL;
+  }
+  for (;;) {
+    pthread_mutex_lock(&job->lock);
+    i = job->next++;
+    pthread_mutex_unlock(&job->lock);
+    if (i >= job->turn || job->cancel || job->failed) break;
+    if (scan_piece(job, (job->first + (TSK_OFF_T)i) * TSK4R_STRINGS_PIECE, &job->outs[i], buf) != 0) break;
+  }
+  free(buf);
+  return NULL;
+}
+
+static void * run_strings_turn(void * ptr) {
+  struct tsk4r_str_job * job = (struct tsk4r_str_job *)ptr;
+  int count = job->turn < (size_t)job->threads ? (int)job->turn : job->threads;
+  pthread_t * workers = malloc((size_t)count * sizeof(pthread_t));
+  int started = 0, t;
+
+  if (workers != NULL) {
+    for (t = 0; t < count; t++) {
+      if (pthread_create(&workers[t], NULL, strings_worker, job) != 0) break;
+      started++;
+    }
+  }
+  if (started == 0) strings_worker(job);
+  for (t = 0; t < started; t++) pthread_join(workers[t], NULL);
+  free(workers);
+  return NULL;
+}
+
+static void cancel_strings(void * ptr) {
+  ((struct tsk4r_str_job *)ptr)->cancel = 1;
+}
+
+struct tsk4r_str_args {
+  struct tsk4r_str_job * job;
+  VALUE self;
+  long batch_size;
+};
+
+static VALUE strings_result(VALUE arg) {
+  struct tsk4r_str_args * a = (struct tsk4r_str_args *)arg;
+  struct tsk4r_str_job * job = a->job;
+  TSK_OFF_T pieces = (job->size + TSK4R_STRINGS_PIECE - 1) / TSK4R_STRINGS_PIECE;
+  int block = rb_block_given_p();
+  VALUE result = block ? Qnil : rb_ary_new();
+  VALUE batch = rb_ary_new();
+  VALUE encodings[TSK4R_STR_ENCODINGS];
+  size_t i, h;
+  int e;
+
+  for (e = 0; e < TSK4R_STR_ENCODINGS; e++) encodings[e] = ID2SYM(rb_intern(TSK4R_STR_ENCODING_NAMES[e]));
+  job->outs = calloc((size_t)job->threads, sizeof(struct tsk4r_str_out));
+  if (job->outs == NULL) rb_memerror();
+
+  for (job->first = 0; job->first < pieces; job->first += (TSK_OFF_T)job->turn) {
+    job->turn = pieces - job->first < job->threads ? (size_t)(pieces - job->first) : (size_t)job->threads;
+    job->next = 0;
+    for (i = 0; i < job->turn; i++) job->outs[i].count = job->outs[i].used = 0;
+
+    tsk4r_call_interruptible(run_strings_turn, cancel_strings, job);
+    if (job->failed) rb_raise(rb_eRuntimeError, "TSK function: %s exited with an error. (%s)", job->failed, job->error);
+
+    for (i = 0; i < job->turn; i++) {
+      const struct tsk4r_str_out * out = &job->outs[i];
+      for (h = 0; h < out->count; h++) {
+        const struct tsk4r_str_hit * hit = &out->hits[h];
+        VALUE entry = rb_ary_new3(3, LL2NUM(hit->offset), encodings[hit->encoding],
+                                  rb_usascii_str_new(out->arena + hit->text, (long)hit->len));
+        if (! block) {
+          rb_ary_push(result, entry);
+          continue;
+        }
+        rb_ary_push(batch, entry);
+        if (RARRAY_LEN(batch) >= a->batch_size) {
+          rb_yield(batch);
+          batch = rb_ary_new();
+        }
+      }
+    }
+  }
+  if (! block) return result;
+  if (RARRAY_LEN(batch) > 0) rb_yield(batch);
+  return a->self;
+}
+
+static VALUE release_strings(VALUE arg) {
+  struct tsk4r_str_job * job = ((struct tsk4r_str_args *)arg)->job;
+  int t;
+  if (job->outs != NULL) {
+    for (t = 0; t < job->threads; t++) {
+      free(job->outs[t].hits);
+      free(job->outs[t].arena);
+    }
+    free(job->outs);
+  }
+  pthread_mutex_destroy(&job->lock);
+  return Qnil;
+}
+
+static VALUE extract_strings(VALUE self, struct tsk4r_str_job * job, VALUE opts) {
+  struct tsk4r_str_args a;
+  VALUE encodings; VALUE min_len;
+  long i; int e;
+
+  min_len = tsk4r_opt(opts, "min_len", INT2FIX(TSK4R_STRINGS_MIN_LEN));
+  if (NUM2LONG(min_len) < 1) rb_raise(rb_eArgError, "min_len must be positive");
+  job->min_len = NUM2SIZET(min_len);
+  encodings = rb_Array(tsk4r_opt(opts, "encodings", Qnil));
+  if (RARRAY_LEN(encodings) == 0) encodings = rb_ary_new3(2, ID2SYM(rb_intern("ascii")), ID2SYM(rb_intern("utf16le")));
+  for (i = 0; i < RARRAY_LEN(encodings); i++) {
+    VALUE enc = rb_ary_entry(encodings, i);
+    int found = -1;
+    for (e = 0; e < TSK4R_STR_ENCODINGS; e++) {
+      if (enc == ID2SYM(rb_intern(TSK4R_STR_ENCODING_NAMES[e]))) found = e;
+    }
+    if (found < 0) rb_raise(rb_eArgError, "unknown encoding: %s", RSTRING_PTR(rb_inspect(enc)));
+    job->encodings[found] = 1;
+  }
+  a.batch_size = NUM2LONG(tsk4r_opt(opts, "batch_size", INT2FIX(TSK4R_STRINGS_BATCH)));
+  if (a.batch_size < 1) rb_raise(rb_eArgError, "batch_size must be positive");
+  if (job->threads < 1) job->threads = 1;
+  pthread_mutex_init(&job->lock, NULL);
+  a.job = job;
+  a.self = self;
+  return rb_ensure(strings_result, (VALUE)&a, release_strings, (VALUE)&a);
+}
+
+// Image#strings(opts = {}) { |batch| ... }
+// opts: :min_len => 4 (characters), :encodings => [:ascii, :utf16le],
+//       :threads => 4, :batch_size => 1024
+// yields Arrays of [image offset, encoding, string] in offset order, or
+// returns them all when no block is given
+VALUE image_strings(int argc, VALUE *args, VALUE self) {
+  VALUE opts;
+  struct tsk4r_img_wrapper * img_ptr;
+  struct tsk4r_str_job job;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_img_wrapper, &tsk4r_image_type, img_ptr);
+  if (img_ptr->image == NULL) rb_raise(rb_eRuntimeError, "image pointer is NULL");
+
+  MEMZERO(&job, struct tsk4r_str_job, 1);
+  job.img = img_ptr->image;
+  job.size = img_ptr->image->size;
+  job.threads = NUM2INT(tsk4r_opt(opts, "threads", INT2FIX(TSK4R_STRINGS_THREADS)));
+  return extract_strings(self, &job, opts);
+}
+
+// FileData#strings(opts = {}) { |batch| ... }
+// like Image#strings over the file's content, with file offsets; a
+// TSK_FS_FILE can't be read concurrently, so this scans on one thread
+VALUE fs_file_strings(int argc, VALUE *args, VALUE self) {
+  VALUE opts;
+  struct tsk4r_fs_file_wrapper * fs_file;
+  struct tsk4r_str_job job;
+
+  rb_scan_args(argc, args, "01", &opts);
+  TypedData_Get_Struct(self, struct tsk4r_fs_file_wrapper, &tsk4r_fs_file_type, fs_file);
+  if (fs_file->file == NULL) rb_raise(rb_eRuntimeError, "file pointer is NULL");
+
+  MEMZERO(&job, struct tsk4r_str_job, 1);
+  job.file = fs_file->file;
+  job.file_lock = &fs_file->read_lock;
+  job.size = fs_file->file->meta != NULL ? fs_file->file->meta->size : 0;
+  if (fs_file->attr_type != TSK_FS_ATTR_TYPE_DEFAULT) {
+    job.attr = tsk4r_fs_file_attr(fs_file);
+    if (job.attr == NULL) rb_raise(rb_eRuntimeError, "file has no attribute of type %d.", (int)fs_file->attr_type);
+    job.size = job.attr->size;
+  }
+  job.threads = 1;
+  return extract_strings(self, &job, opts);
+}
@@ -0,0 +1,25 @@
+//
+//  str_extract.h
+//  RubyTSK
+//
+//  Image#strings and FileData#strings: printable ASCII and UTF-16LE runs
+//
+
+#ifndef RubyTSK_str_extract_h
+#define RubyTSK_str_extract_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+#define TSK4R_STRINGS_THREADS 4
+#define TSK4R_STRINGS_MIN_LEN 4
+#define TSK4R_STRINGS_BATCH 1024
+// bytes each worker owns per turn; a run is reported by the piece it starts in
+#define TSK4R_STRINGS_PIECE (4 * 1024 * 1024)
+// read window for following a run past the end of its piece
+#define TSK4R_STRINGS_WINDOW 65536
+
+VALUE image_strings(int argc, VALUE *args, VALUE self);
+VALUE fs_file_strings(int argc, VALUE *args, VALUE self);
+
+#endif
@@ -0,0 +1,281 @@
+//
+//  trace.c
+//  RubyTSK
+//
+//  Sleuthkit.trace(path, opts = {}) { ... }
+//
+//  Each thread that makes a wrapped libtsk call while a trace is running
+//  gets its own ring buffer, linked onto a global list with a CAS the
+//  first time; after that, recording a span is a plain store into the
+//  thread's own buffer, bracketed by the thread's own busy flag, with no
+//  lock and nothing shared written. When the block returns (or raises)
+//  tracing stops, trace_stop waits out the flags still up, and the
+//  buffers are written out as Chrome trace events ("ph":"X", times in
+//  microseconds of CLOCK_MONOTONIC, the clock perf uses, so the spans
+//  line up with perf and bpftrace timestamps).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include <ruby.h>
+#include "stats.h"
+#include "trace.h"
+#include "batch.h"
+
+struct tsk4r_trace_event {
+  uint64_t begin;
+  uint64_t end;
+  int64_t inum;
+  int64_t offset;
+  int64_t length;
+  int64_t bytes;
+  int op;
+};
+
+struct tsk4r_trace_buffer {
+  struct tsk4r_trace_buffer * next;
+  long tid;
+  uint64_t head;        // events ever written; slot is head % capacity
+  uint64_t capacity;
+  struct tsk4r_trace_event events[];
+};
+
+// one per thread that has recorded a span. Records are never freed (a
+// thread that exits gives its record back for the next one), so
+// trace_stop can always read a record's busy flag; each sits on its own
+// cache line, so setting it doesn't touch memory other threads write
+struct tsk4r_trace_thread {
+  struct tsk4r_trace_thread * next;
+  int owned;            // held by a live thread
+  int busy;             // inside tsk4r_trace_span
+  unsigned int session; // the session buffer belongs to
+  struct tsk4r_trace_buffer * buffer;
+};
+
+#define TRACE_LINE 64
+
+volatile int tsk4r_trace_enabled = 0;
+
+static struct tsk4r_trace_buffer * buffers = NULL;
+static struct tsk4r_trace_thread * threads = NULL;
+static uint64_t trace_capacity = TSK4R_TRACE_EVENTS;
+static unsigned int trace_session = 0;
+static uint64_t trace_lost = 0;       // threads whose buffer couldn't be allocated
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static __thread struct tsk4r_trace_thread * thread_record = NULL;
+
+static long trace_tid(void) {
+#if defined(__linux__) && defined(SYS_gettid)
+  return (long)syscall(SYS_gettid);
+#else
+  return (long)(uintptr_t)pthread_self();
+#endif
+}
+
+static void trace_thread_exit(void * ptr) {
+  __atomic_store_n(&((struct tsk4r_trace_thread *)ptr)->owned, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_key_create(void) {
+  pthread_key_create(&trace_key, trace_thread_exit);
+}
+
+// the calling thread's record: a free one, or a new one on the list
+static struct tsk4r_trace_thread * trace_thread(void) {
+  struct tsk4r_trace_thread * t;
+  void * p;
+  if (thread_record != NULL) return thread_record;
+  pthread_once(&trace_key_once, trace_key_create);
+  for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next) {
+    int unowned = 0;
+    if (__atomic_compare_exchange_n(&t->owned, &unowned, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) break;
+  }
+  if (t == NULL) {
+    if (posix_memalign(&p, TRACE_LINE, TRACE_LINE > sizeof(*t) ? TRACE_LINE : sizeof(*t)) != 0) return NULL;
+    t = p;
+    memset(t, 0, sizeof(*t));
+    t->owned = 1;
+    // sequentially consistent, so trace_stop either sees the record or
+    // its thread sees tracing stopped
+    t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (! __atomic_compare_exchange_n(&threads, &t->next, t, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+  }
+  t->session = 0;
+  t->buffer = NULL;
+  pthread_setspecific(trace_key, t);
+  thread_record = t;
+  return t;
+}
+
+// the thread's buffer for the running session; called with t->busy set,
+// so trace_stop waits for the allocation as well
+static struct tsk4r_trace_buffer * trace_buffer(struct tsk4r_trace_thread * t) {
+  struct tsk4r_trace_buffer * b;
+  unsigned int session = __atomic_load_n(&trace_session, __ATOMIC_ACQUIRE);
+  if (t->session == session) return t->buffer;
+
+  t->session = session;
+  t->buffer = NULL;
+  b = malloc(sizeof(struct tsk4r_trace_buffer) + trace_capacity * sizeof(struct tsk4r_trace_event));
+  if (b == NULL) {
+    __atomic_fetch_add(&trace_lost, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  b->tid = trace_tid();
+  b->head = 0;
+  b->capacity = trace_capacity;
+  b->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+  while (! __atomic_compare_exchange_n(&buffers, &b->next, b, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  t->buffer = b;
+  return b;
+}
+
+// records one finished call started at t0; called from the wrappers in
+// stats.c, on whatever thread made the call. The busy flag is the
+// thread's own, so a span costs no shared read-modify-write
+void tsk4r_trace_span(int op, uint64_t t0, int64_t inum, int64_t offset, int64_t length, int64_t bytes) {
+  struct tsk4r_trace_thread * t = trace_thread();
+  struct tsk4r_trace_buffer * b;
+  struct tsk4r_trace_event * e;
+  uint64_t end = tsk4r_now_ns();
+
+  if (t == NULL) return;
+  __atomic_store_n(&t->busy, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&tsk4r_trace_enabled, __ATOMIC_SEQ_CST) && (b = trace_buffer(t)) != NULL) {
+    e = &b->events[b->head % b->capacity];
+    e->begin = t0; e->end = end;
+    e->inum = inum; e->offset = offset; e->length = length; e->bytes = bytes;
+    e->op = op;
+    __atomic_store_n(&b->head, b->head + 1, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&t->busy, 0, __ATOMIC_RELEASE);
+}
+
+// turns tracing off, then waits for every thread still inside
+// tsk4r_trace_span: each either saw tracing off or has its flag up here
+static void trace_stop(void) {
+  struct tsk4r_trace_thread * t;
+  __atomic_store_n(&tsk4r_trace_enabled, 0, __ATOMIC_SEQ_CST);
+  for (t = __atomic_load_n(&threads, __ATOMIC_SEQ_CST); t != NULL; t = t->next) {
+    while (__atomic_load_n(&t->busy, __ATOMIC_SEQ_CST)) sched_yield();
+  }
+}
+
+static void trace_free(void) {
+  struct tsk4r_trace_buffer * b = buffers;
+  while (b != NULL) {
+    struct tsk4r_trace_buffer * next = b->next;
+    free(b);
+    b = next;
+  }
+  buffers = NULL;
+}
+
+static void write_arg(FILE * out, const char * name, int64_t value, int * first) {
+  if (value < 0) return;
+  fprintf(out, "%s\"%s\":%lld", *first ? "" : ",", name, (long long)value);
+  *first = 0;
+}
+
+// returns 0, or errno
+static int trace_write(const char * path, uint64_t * written, uint64_t * dropped) {
+  struct tsk4r_trace_buffer * b;
+  FILE * out = fopen(path, "w");
+  long pid = (long)getpid();
+  int first_event = 1;
+  int failed;
+
+  if (out == NULL) return errno;
+  *written = 0; *dropped = 0;
+  fputs("{\"traceEvents\":[\n", out);
+  for (b = buffers; b != NULL; b = b->next) {
+    uint64_t head = __atomic_load_n(&b->head, __ATOMIC_ACQUIRE);
+    uint64_t i = head > b->capacity ? head - b->capacity : 0;
+    *dropped += i;
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"tsk4r-%ld\"}}",
+            first_event ? "" : ",\n", pid, b->tid, b->tid);
+    first_event = 0;
+    for (; i < head; i++) {
+      const struct tsk4r_trace_event * e = &b->events[i % b->capacity];
+      int first_arg = 1;
+      uint64_t dur = e->end - e->begin;
+      fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"tsk\",\"ph\":\"X\",\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":%ld,\"tid\":%ld,\"args\":{",
+              tsk4r_op_names[e->op],
+              (unsigned long long)(e->begin / 1000), (unsigned long long)(e->begin % 1000),
+              (unsigned long long)(dur / 1000), (unsigned long long)(dur % 1000), pid, b->tid);
+      write_arg(out, "inum", e->inum, &first_arg);
+      write_arg(out, "offset", e->offset, &first_arg);
+      write_arg(out, "length", e->length, &first_arg);
+      write_arg(out, "bytes", e->bytes, &first_arg);
+      fputs("}}", out);
+      (*written)++;
+    }
+  }
+  fprintf(out, "\n],\n\"displayTimeUnit\":\"ns\",\n\"otherData\":{\"clock\":\"CLOCK_MONOTONIC\",\"dropped\":%llu,\"threads_without_buffer\":%llu}}\n",
+          (unsigned long long)*dropped, (unsigned long long)trace_lost);
+  failed = ferror(out);
+  if (fclose(out) != 0 || failed) return errno ? errno : EIO;
+  return 0;
+}
+
+struct tsk4r_trace_args {
+  VALUE path;
+};
+
+static VALUE trace_yield(VALUE ptr) {
+  return rb_yield(Qnil);
+}
+
+static VALUE trace_finish(VALUE ptr) {
+  struct tsk4r_trace_args * a = (struct tsk4r_trace_args *)ptr;
+  uint64_t written; uint64_t dropped;
+  int err;
+  trace_stop();
+  err = trace_write(StringValueCStr(a->path), &written, &dropped);
+  trace_free();
+  if (err != 0) {
+    errno = err;
+    rb_sys_fail(StringValueCStr(a->path));
+  }
+  if (dropped > 0) rb_warn("Sleuthkit.trace: %llu early events were overwritten; raise :events_per_thread", (unsigned long long)dropped);
+  return Qnil;
+}
+
+// Sleuthkit.trace(path, opts = {}) { ... }
+//   opts: :events_per_thread => ring buffer size (default TSK4R_TRACE_EVENTS);
+//         a thread keeps its latest events beyond that
+// records every native libtsk call made while the block runs and writes
+// them to path as Chrome trace-event JSON; returns the block's value
+VALUE trace_native(int argc, VALUE *args, VALUE self) {
+  VALUE path; VALUE opts; long capacity;
+  struct tsk4r_trace_args a;
+
+  rb_scan_args(argc, args, "11", &path, &opts);
+  rb_need_block();
+  path = rb_str_dup(rb_String(path));
+  capacity = NUM2LONG(tsk4r_opt(opts, "events_per_thread", LONG2NUM(TSK4R_TRACE_EVENTS)));
+  if (capacity < 1) rb_raise(rb_eArgError, "events_per_thread must be positive");
+  if (tsk4r_trace_enabled) rb_raise(rb_eRuntimeError, "Sleuthkit.trace is already running");
+
+  trace_capacity = (uint64_t)capacity;
+  trace_lost = 0;
+  __atomic_add_fetch(&trace_session, 1, __ATOMIC_RELEASE);
+  tsk4r_trace_enabled = 1;
+
+  a.path = path;
+  return rb_ensure(trace_yield, (VALUE)&a, trace_finish, (VALUE)&a);
+}
+
+// Sleuthkit.tracing?
+VALUE get_tracing(VALUE self) {
+  return tsk4r_trace_enabled ? Qtrue : Qfalse;
+}
@@ -0,0 +1,47 @@
+//
+//  trace.h
+//  RubyTSK
+//
+//  Span tracing of native operations: Sleuthkit.trace(path) { ... }
+//  writes every wrapped libtsk call (see stats.h) made inside the block,
+//  on any thread, as a Chrome trace-event JSON file.
+//
+//  The same calls are USDT probe points when <sys/sdt.h> is available:
+//
+//    tsk4r:span_begin(op name, inum, offset, length)
+//    tsk4r:span_end(op name, inum, offset, length, bytes)
+//
+//  These fire whether or not a trace is running (an unattached probe is
+//  a nop), so perf and bpftrace can follow a production process.
+//  Arguments that don't apply to an operation are -1.
+//
+
+#ifndef RubyTSK_trace_h
+#define RubyTSK_trace_h
+
+#include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+
+// events kept per thread; the oldest are overwritten beyond this
+#define TSK4R_TRACE_EVENTS 65536
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TSK4R_PROBE_BEGIN(name, inum, offset, length) \
+  DTRACE_PROBE4(tsk4r, span_begin, (name), (int64_t)(inum), (int64_t)(offset), (int64_t)(length))
+#define TSK4R_PROBE_END(name, inum, offset, length, bytes) \
+  DTRACE_PROBE5(tsk4r, span_end, (name), (int64_t)(inum), (int64_t)(offset), (int64_t)(length), (int64_t)(bytes))
+#else
+#define TSK4R_PROBE_BEGIN(name, inum, offset, length) do { } while (0)
+#define TSK4R_PROBE_END(name, inum, offset, length, bytes) do { } while (0)
+#endif
+
+extern volatile int tsk4r_trace_enabled;
+
+void tsk4r_trace_span(int op, uint64_t t0, int64_t inum, int64_t offset, int64_t length, int64_t bytes);
+
+// Ruby methods
+VALUE trace_native(int argc, VALUE *args, VALUE self);
+VALUE get_tracing(VALUE self);
+
+#endif
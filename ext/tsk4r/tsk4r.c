@@ -50,6 +50,7 @@ void Init_tsk4r() {
   rb_mtsk4r = rb_define_module("Sleuthkit");
   rb_mtsk4r_v = rb_define_module_under(rb_mtsk4r, "Volume");
   rb_mtsk4r_fs = rb_define_module_under(rb_mtsk4r, "FileSystem");
+  rb_mtsk4r_batch = rb_define_module_under(rb_mtsk4r, "Batch");
 
   
   rb_const_set(rb_mtsk4r, rb_intern("TSK_VERSION"), rb_str_new2(tsk_version_get_str()));
@@ -65,6 +66,10 @@ void Init_tsk4r() {
   rb_cTSKFileSystemFileName   = rb_define_class_under(rb_mtsk4r_fs, "FileName", rb_cObject);
   rb_cTSKFileSystemAttr       = rb_define_class_under(rb_mtsk4r_fs, "Attribute", rb_cObject);
   rb_cTSKFileSystemBlock      = rb_define_class_under(rb_mtsk4r_fs, "Block", rb_cObject);
+  rb_cTSKFileSystemPathMap    = rb_define_class_under(rb_mtsk4r_fs, "PathMap", rb_cObject);
+  rb_cTSKFileSystemTimeIndex  = rb_define_class_under(rb_mtsk4r_fs, "TimeIndex", rb_cObject);
+  rb_cTSKHashSet              = rb_define_class_under(rb_mtsk4r, "HashSet", rb_cObject);
+  rb_cTSKBlockHashDB          = rb_define_class_under(rb_mtsk4r, "BlockHashDB", rb_cTSKHashSet);
 
   
   // allocation functions
@@ -78,6 +83,9 @@ void Init_tsk4r() {
   rb_define_alloc_func(rb_cTSKFileSystemFileName, allocate_fs_name);
   rb_define_alloc_func(rb_cTSKFileSystemAttr, allocate_fs_attr);
   rb_define_alloc_func(rb_cTSKFileSystemBlock, allocate_fs_block);
+  rb_undef_alloc_func(rb_cTSKFileSystemPathMap);   // built by System#path_map
+  rb_undef_alloc_func(rb_cTSKFileSystemTimeIndex); // built by System#time_index
+  rb_undef_alloc_func(rb_cTSKHashSet);             // HashSet.build / HashSet.open
 
 
   // sub classes
@@ -92,6 +100,10 @@ void Init_tsk4r() {
   rb_define_module_function(rb_cTSKImage, "image_type_to_name", image_type_to_name, 1);
   rb_define_module_function(rb_cTSKImage, "return_tsk_img_type_supported", return_tsk_img_type_supported, 0);
   rb_define_module_function(rb_cTSKImage, "return_type_list", return_tsk_img_type_list, -1);
+  rb_define_method(rb_cTSKImage, "match_blocks", match_image_blocks, -1);
+  rb_define_method(rb_cTSKImage, "strings", image_strings, -1);
+  rb_define_method(rb_cTSKImage, "stats", get_image_stats, 0);
+  rb_define_method(rb_cTSKImage, "reset_stats", reset_image_stats, 0);
 
   // attributes (read only)
   rb_define_attr(rb_cTSKImage, "auto_detect", 1, 0);
@@ -162,6 +174,24 @@ void Init_tsk4r() {
   rb_define_method(rb_cTSKFileSystem, "open_directory_by_inum", open_directory_by_inum, -1);
   rb_define_method(rb_cTSKFileSystem, "open_file_by_name", open_file_by_name, -1);
   rb_define_method(rb_cTSKFileSystem, "open_file_by_inum", open_file_by_inum, -1);
+  rb_define_method(rb_cTSKFileSystem, "file_cache_stats", get_file_cache_stats, 0);
+  rb_define_method(rb_cTSKFileSystem, "file_cache_capacity", get_file_cache_capacity, 0);
+  rb_define_method(rb_cTSKFileSystem, "file_cache_capacity=", set_file_cache_capacity, 1);
+  rb_define_method(rb_cTSKFileSystem, "clear_file_cache", clear_file_cache, 0);
+  rb_define_method(rb_cTSKFileSystem, "stats", get_fs_stats, 0);
+  rb_define_method(rb_cTSKFileSystem, "reset_stats", reset_fs_stats, 0);
+  rb_define_method(rb_cTSKFileSystem, "prefetch_walk", prefetch_walk, -1);
+  rb_define_method(rb_cTSKFileSystem, "path_map", get_fs_path_map, -1);
+  rb_define_method(rb_cTSKFileSystem, "time_index", get_fs_time_index, -1);
+  rb_define_method(rb_cTSKFileSystem, "summarize", summarize_filesystem, -1);
+  rb_define_method(rb_cTSKFileSystem, "duplicates", find_fs_duplicates, -1);
+  rb_define_method(rb_cTSKFileSystem, "match_blocks", match_fs_blocks, -1);
+  rb_define_method(rb_cTSKFileSystem, "carve", carve_filesystem, -1);
+  rb_define_method(rb_cTSKFileSystem, "search", search_filesystem, -1);
+  rb_define_method(rb_cTSKFileSystem, "each_journal_entry", each_journal_entry, -1);
+  rb_define_method(rb_cTSKFileSystem, "journal_blocks", journal_blocks, -1);
+  rb_define_method(rb_cTSKFileSystem, "each_attribute", each_fs_attribute, -1);
+  rb_define_method(rb_cTSKFileSystem, "read_blocks", read_fs_blocks, -1);
   rb_define_module_function(rb_mtsk4r_fs, "return_type_list", return_tsk_fs_type_list, -1);
 
   
@@ -175,6 +205,7 @@ void Init_tsk4r() {
   rb_define_attr(rb_cTSKFileSystem, "name", 1, 0);
   rb_define_attr(rb_cTSKFileSystem, "description", 1, 0);
   rb_define_attr(rb_cTSKFileSystem, "parent", 1, 0);
+  rb_define_attr(rb_cTSKFileSystem, "prefetch_stats", 1, 0);
 #ifdef TSK4R_DEPRECATED_TSK4_FEATURE
   rb_define_attr(rb_cTSKFileSystem, "isOrphanHunting", 1, 0);
 #endif
@@ -189,7 +220,9 @@ void Init_tsk4r() {
 //  rb_define_attr(rb_cTSKFileSystemDir, "inum", 1, 0);
   rb_define_attr(rb_cTSKFileSystemDir, "names_used", 1, 0);
   rb_define_attr(rb_cTSKFileSystemDir, "names_alloc", 1, 0);
-  rb_define_attr(rb_cTSKFileSystemDir, "names", 1, 0);
+  rb_define_method(rb_cTSKFileSystemDir, "names", get_fs_dir_names, 0);
+  rb_define_method(rb_cTSKFileSystemDir, "each_entry", each_fs_dir_entry, -1);
+  rb_define_method(rb_cTSKFileSystemDir, "entries_with_meta", get_fs_dir_entries_with_meta, -1);
   rb_define_attr(rb_cTSKFileSystemDir, "file", 1, 0);
 
   
@@ -200,14 +233,22 @@ void Init_tsk4r() {
   rb_define_method(rb_cTSKFileSystemFileData, "initialize", initialize_fs_file, -1);
   rb_define_method(rb_cTSKFileSystemFileData, "open_fs_file", open_fs_file, -1);
   rb_define_method(rb_cTSKFileSystemFileData, "get_number_of_attributes", get_number_of_attributes, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "read_at", read_fs_file_at, -1);
+  rb_define_method(rb_cTSKFileSystemFileData, "each_chunk", each_fs_file_chunk, -1);
+  rb_define_method(rb_cTSKFileSystemFileData, "extents", get_fs_file_extents, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "attribute_type", get_fs_file_attr_type, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "attribute_id", get_fs_file_attr_id, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "attribute_size", get_fs_file_attr_size, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "strings", fs_file_strings, -1);
+  rb_define_private_method(rb_cTSKFileSystemFileData, "export_raw", export_fs_file_raw, 2);
   
   // attributes
   rb_define_attr(rb_cTSKFileSystemFileData, "address", 1, 0);
   rb_define_attr(rb_cTSKFileSystemFileData, "content_len", 1, 0);
   
   rb_define_attr(rb_cTSKFileSystemFileData, "parent", 1, 0);
-  rb_define_attr(rb_cTSKFileSystemFileData, "meta", 1, 0);
-  rb_define_attr(rb_cTSKFileSystemFileData, "name", 1, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "meta", get_fs_file_meta, 0);
+  rb_define_method(rb_cTSKFileSystemFileData, "name", get_fs_file_name, 0);
   
   rb_define_attr(rb_cTSKFileSystemFileData, "uid", 1, 0);
 
@@ -221,23 +262,28 @@ void Init_tsk4r() {
   rb_define_private_method(rb_cTSKFileSystemFileMeta, "get_meta_from_dir",  get_meta_from_dir,  1);
 
   
-  // attributes
-  rb_define_attr(rb_cTSKFileSystemFileMeta, "parent", 1, 0);
-  rb_define_attr(rb_cTSKFileSystemFileMeta, "addr", 1, 0);
+  // attributes are read from TSK_FS_META on demand
+  init_fs_meta_accessors(rb_cTSKFileSystemFileMeta);
   
   /* Sleuthkit::FileSystemFileName */
   
   // object methods for FileSystemFileName objects
   rb_define_method(rb_cTSKFileSystemFileName, "initialize", initialize_fs_name, -1);
   
-  // attributes (see lib/sleuthkit/file_system.rb for more)
-  rb_define_attr(rb_cTSKFileSystemFileName, "parent", 1, 0);
+  // attributes are read from TSK_FS_NAME on demand
+  init_fs_name_accessors(rb_cTSKFileSystemFileName);
   
   /* Sleuthkit::FileSystem:Attr */
   rb_define_method(rb_cTSKFileSystemAttr, "initialize", initialize_fs_attr, -1);
   rb_define_method(rb_cTSKFileSystemAttr, "fetch", fetch_attr, -1);
   rb_define_method(rb_cTSKFileSystemAttr, "fetch_default_attribute", fetch_attr, -1);
   rb_define_method(rb_cTSKFileSystemAttr, "fetch_attribute_by_index", fetch_attr, -1);
+  rb_define_method(rb_cTSKFileSystemAttr, "runs", get_attr_runs, 0);
+
+  rb_define_const(rb_cTSKFileSystemAttr, "RUN_FILLER", INT2FIX(TSK_FS_ATTR_RUN_FLAG_FILLER));
+  rb_define_const(rb_cTSKFileSystemAttr, "RUN_SPARSE", INT2FIX(TSK_FS_ATTR_RUN_FLAG_SPARSE));
+  rb_define_const(rb_cTSKFileSystemAttr, "RUN_COMPRESSED", INT2FIX(TSK4R_RUN_COMPRESSED));
+  rb_define_const(rb_cTSKFileSystemAttr, "RUN_ENCRYPTED", INT2FIX(TSK4R_RUN_ENCRYPTED));
 
 
   rb_define_attr(rb_cTSKFileSystemAttr, "file", 1, 0);
@@ -260,6 +306,50 @@ void Init_tsk4r() {
   rb_define_attr(rb_cTSKFileSystemBlock, "flags", 1, 0);
   rb_define_attr(rb_cTSKFileSystemBlock, "tag", 1, 0);
 
+  
+  /* Sleuthkit::FileSystem::PathMap */
+  rb_define_method(rb_cTSKFileSystemPathMap, "path_for", path_map_path_for, -1);
+  rb_define_method(rb_cTSKFileSystemPathMap, "paths_for", path_map_paths_for, 1);
+  rb_define_method(rb_cTSKFileSystemPathMap, "size", path_map_size, 0);
+  rb_define_method(rb_cTSKFileSystemPathMap, "unique_names", path_map_unique_names, 0);
+
+  
+  /* Sleuthkit::FileSystem::TimeIndex */
+  rb_define_method(rb_cTSKFileSystemTimeIndex, "files_between", time_index_files_between, 3);
+  rb_define_method(rb_cTSKFileSystemTimeIndex, "count_between", time_index_count_between, 3);
+  rb_define_method(rb_cTSKFileSystemTimeIndex, "size", time_index_size, 0);
+
+  
+  /* Sleuthkit::HashSet */
+  rb_define_singleton_method(rb_cTSKHashSet, "build", build_hash_set, -1);
+  rb_define_singleton_method(rb_cTSKHashSet, "open", open_hash_set, 1);
+  rb_define_method(rb_cTSKHashSet, "include?", hash_set_include, 1);
+  rb_define_method(rb_cTSKHashSet, "size", hash_set_size, 0);
+  rb_define_method(rb_cTSKHashSet, "digest", hash_set_digest, 0);
+  rb_define_method(rb_cTSKHashSet, "bloom?", hash_set_bloom, 0);
+  rb_define_attr(rb_cTSKHashSet, "path", 1, 0);
+
+  /* Sleuthkit::BlockHashDB */
+  rb_define_singleton_method(rb_cTSKBlockHashDB, "build", build_block_hash_db, -1);
+  rb_define_singleton_method(rb_cTSKBlockHashDB, "open", open_block_hash_db, 1);
+  rb_define_method(rb_cTSKBlockHashDB, "lookup", block_hash_db_lookup, 1);
+  rb_define_attr(rb_cTSKBlockHashDB, "block_size", 1, 0);
+  rb_define_attr(rb_cTSKBlockHashDB, "sources", 1, 0);
+
+  /* Sleuthkit::Batch */
+  rb_define_module_function(rb_mtsk4r_batch, "run", run_batch, -1);
+
+  /* performance counters */
+  tsk4r_stats_init();
+  rb_define_module_function(rb_mtsk4r, "stats", get_global_stats, 0);
+  rb_define_module_function(rb_mtsk4r, "reset_stats", reset_global_stats, 0);
+  rb_define_module_function(rb_mtsk4r, "stats_enabled?", get_stats_enabled, 0);
+  rb_define_module_function(rb_mtsk4r, "stats_enabled=", set_stats_enabled, 1);
+
+  /* span tracing */
+  rb_define_module_function(rb_mtsk4r, "trace", trace_native, -1);
+  rb_define_module_function(rb_mtsk4r, "tracing?", get_tracing, 0);
+
 
 
 }
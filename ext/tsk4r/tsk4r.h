@@ -32,6 +32,24 @@
 #include "fs_file.h"
 #include "fs_attr.h"
 #include "fs_block.h"
+#include "fs_journal.h"
+#include "fs_export.h"
+#include "batch.h"
+#include "memsize.h"
+#include "fs_cache.h"
+#include "fs_prefetch.h"
+#include "fs_pathmap.h"
+#include "fs_timeindex.h"
+#include "fs_summary.h"
+#include "fs_dupes.h"
+#include "fs_carve.h"
+#include "fs_search.h"
+#include "hashset.h"
+#include "blockhash.h"
+#include "str_extract.h"
+#include "batch_run.h"
+#include "stats.h"
+#include "trace.h"
 
 
 const char * TSK4R_FS_ATTRS_NAMES[TSK4R_FS_ATTRS_COUNT] = {
@@ -51,6 +69,7 @@ void klassify(VALUE obj, char * name);
 VALUE rb_mtsk4r;
 VALUE rb_mtsk4r_v;
 VALUE rb_mtsk4r_fs;
+VALUE rb_mtsk4r_batch;
 
 VALUE rb_cTSKImage;
 VALUE rb_cTSKVolumeSystem;
@@ -62,6 +81,10 @@ VALUE rb_cTSKFileSystemFileMeta;
 VALUE rb_cTSKFileSystemFileName;
 VALUE rb_cTSKFileSystemAttr;
 VALUE rb_cTSKFileSystemBlock;
+VALUE rb_cTSKFileSystemPathMap;
+VALUE rb_cTSKFileSystemTimeIndex;
+VALUE rb_cTSKHashSet;
+VALUE rb_cTSKBlockHashDB;
 
 
 VALUE allocate_image(VALUE klass);
@@ -41,6 +41,38 @@
 #define TSK4R_FS_ATTRS_COUNT 21
 #endif
 
+// ruby 2.x releases the GVL through ruby/thread.h; 1.9 spells it rb_thread_blocking_region
+#include <ruby.h>
+#ifdef HAVE_RUBY_THREAD_H
+#include <ruby/thread.h>
+#endif
+#ifndef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+#define rb_thread_call_without_gvl(func, data1, ubf, data2) \
+  (void *)rb_thread_blocking_region((rb_blocking_function_t *)(func), (data1), (ubf), (data2))
+#endif
+
+// content read from an image is binary, not text in the default encoding
+#ifdef HAVE_RUBY_ENCODING_H
+#include <ruby/encoding.h>
+#define TSK4R_BINARY_STR(str) rb_enc_associate((str), rb_ascii8bit_encoding())
+#else
+#define TSK4R_BINARY_STR(str) (str)
+#endif
+
+// TypedData wrappers; movable marks and dcompact arrived in ruby 2.7
+#ifdef HAVE_RB_GC_MARK_MOVABLE
+#define tsk4r_gc_mark(v) rb_gc_mark_movable(v)
+#define tsk4r_gc_location(v) rb_gc_location(v)
+#define TSK4R_DATA_FUNCTIONS(mark, free, size, compact) { (mark), (free), (size), (compact), }
+#else
+#define tsk4r_gc_mark(v) rb_gc_mark(v)
+#define tsk4r_gc_location(v) (v)
+#define TSK4R_DATA_FUNCTIONS(mark, free, size, compact) { (mark), (free), (size), }
+#endif
+#ifndef RUBY_TYPED_FREE_IMMEDIATELY
+#define RUBY_TYPED_FREE_IMMEDIATELY 0
+#endif
+
 #define TSK4R_BLOCK_ATTRS \
 "block_pre_size", \
 "block_post_size",
@@ -24,29 +24,74 @@
 #include <stdio.h>
 #include <ruby.h>
 #include "volume.h"
+#include "image.h"
+#include "memsize.h"
 
 extern VALUE rb_cTSKImage;
 extern VALUE rb_cTSKVolumeSystem;
 extern VALUE rb_cTSKVolumePart;
 
-struct tsk4r_img {
-  TSK_IMG_INFO * image;
-  char * fn_given;
+TSK_VS_TYPE_ENUM * get_vs_flag();
+
+static void mark_volume_system(void * ptr);
+static void compact_volume_system(void * ptr);
+static void mark_volume_part(void * ptr);
+static void compact_volume_part(void * ptr);
+static size_t volume_system_memsize(const void * ptr);
+static size_t volume_part_memsize(const void * ptr);
+
+const rb_data_type_t tsk4r_vs_type = {
+  "Sleuthkit::Volume::System",
+  TSK4R_DATA_FUNCTIONS(mark_volume_system, deallocate_volume_system, volume_system_memsize, compact_volume_system),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
 };
 
-TSK_VS_TYPE_ENUM * get_vs_flag();
+const rb_data_type_t tsk4r_vpart_type = {
+  "Sleuthkit::Volume::Partition",
+  TSK4R_DATA_FUNCTIONS(mark_volume_part, deallocate_volume_part, volume_part_memsize, compact_volume_part),
+  0, 0, RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+static void mark_volume_system(void * ptr){
+  tsk4r_gc_mark(((struct tsk4r_vs_wrapper *)ptr)->parent);
+}
+
+static void compact_volume_system(void * ptr){
+  struct tsk4r_vs_wrapper * wrapper = ptr;
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
+}
+
+static void mark_volume_part(void * ptr){
+  tsk4r_gc_mark(((struct tsk4r_vpart_wrapper *)ptr)->parent);
+}
+
+static void compact_volume_part(void * ptr){
+  struct tsk4r_vpart_wrapper * wrapper = ptr;
+  wrapper->parent = tsk4r_gc_location(wrapper->parent);
+}
 
 // Sleuthkit::VolumeSystem functions
 
 VALUE allocate_volume_system(VALUE klass){
   struct tsk4r_vs_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_vs_wrapper, 0, deallocate_volume_system, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_vs_wrapper, &tsk4r_vs_type, ptr);
+  ptr->parent = Qnil;
+  return obj;
 }
 
-void deallocate_volume_system(struct tsk4r_vs_wrapper * ptr){
-  TSK_VS_INFO *volume = ptr->volume;
-  tsk_vs_close(volume);
-  xfree(ptr);
+static void close_volume_handle(void * handle){
+  tsk_vs_close((TSK_VS_INFO *)handle);
+}
+
+void deallocate_volume_system(void * ptr){
+  struct tsk4r_vs_wrapper * wrapper = ptr;
+  tsk4r_owner_release(wrapper->owner);
+  xfree(wrapper);
+}
+
+static size_t volume_system_memsize(const void * ptr){
+  const struct tsk4r_vs_wrapper * wrapper = ptr;
+  return sizeof(*wrapper) + tsk4r_vs_memsize(wrapper->volume);
 }
 
 VALUE initialize_volume_system(int argc, VALUE *args, VALUE self) {
@@ -73,14 +118,14 @@ VALUE initialize_volume_system(int argc, VALUE *args, VALUE self) {
 VALUE open_volume_system(VALUE self, VALUE img_obj, VALUE opts) {
 
   struct tsk4r_vs_wrapper * vs_ptr;
-  Data_Get_Struct(self, struct tsk4r_vs_wrapper, vs_ptr);
+  TypedData_Get_Struct(self, struct tsk4r_vs_wrapper, &tsk4r_vs_type, vs_ptr);
   TSK_VS_TYPE_ENUM * vs_type_requested;
   TSK_OFF_T imgaddr = FIX2LONG(rb_hash_aref(opts, rb_symname_p("offset"))); // sector number at which to open vs
   vs_type_requested = get_vs_flag(rb_hash_aref(opts, rb_symname_p("type_flag")));
   
   // open disk image
-  struct tsk4r_img * rb_image;
-  Data_Get_Struct(img_obj, struct tsk4r_img, rb_image);
+  struct tsk4r_img_wrapper * rb_image;
+  TypedData_Get_Struct(img_obj, struct tsk4r_img_wrapper, &tsk4r_image_type, rb_image);
   TSK_IMG_INFO * disk = rb_image->image;
   if (disk == NULL) {
     rb_raise(rb_eFatal, "image object had no data.");
@@ -89,8 +134,10 @@ VALUE open_volume_system(VALUE self, VALUE img_obj, VALUE opts) {
     TSK_VS_INFO * volume_system = tsk_vs_open(disk, (TSK_DADDR_T)( imgaddr * (TSK_DADDR_T)disk->sector_size ), (TSK_VS_TYPE_ENUM)vs_type_requested);
 
     vs_ptr->volume = volume_system;
+    vs_ptr->parent = img_obj;
     if (vs_ptr->volume != NULL) {
-    
+      vs_ptr->owner = tsk4r_owner_new(volume_system, close_volume_handle, rb_image->owner);
+
       rb_iv_set(self, "@partition_count", INT2NUM((int)volume_system->part_count));
       rb_iv_set(self, "@volume_system_type", INT2NUM((int)volume_system->vstype));
       rb_iv_set(self, "@description", rb_str_new2( (char *)tsk_vs_type_todesc(volume_system->vstype) ));
@@ -141,14 +188,20 @@ VALUE volume_expose_part_by_idx(VALUE self, VALUE index) {
 
 VALUE allocate_volume_part(VALUE klass){
   struct tsk4r_vpart_wrapper * ptr;
-  return Data_Make_Struct(klass, struct tsk4r_vpart_wrapper, 0, deallocate_volume_part, ptr);
+  VALUE obj = TypedData_Make_Struct(klass, struct tsk4r_vpart_wrapper, &tsk4r_vpart_type, ptr);
+  ptr->parent = Qnil;
+  return obj;
 }
 
-// this deallocate might need further work
-void deallocate_volume_part(struct tsk4r_vpart_wrapper * ptr){
+// the partition belongs to the parent's TSK_VS_INFO, which is kept alive by the mark
+void deallocate_volume_part(void * ptr){
   xfree(ptr);
 }
 
+static size_t volume_part_memsize(const void * ptr){
+  return sizeof(struct tsk4r_vpart_wrapper);
+}
+
 VALUE initialize_volume_part(int argc, VALUE *args, VALUE self){
   VALUE * vs_obj; VALUE index;
   
@@ -182,18 +235,19 @@ VALUE open_volume_part(int argc, VALUE *args, VALUE self){
   }
   
   // open volume system, storing ID locally
-  Data_Get_Struct(vs_obj, struct tsk4r_vs_wrapper, parent);
+  TypedData_Get_Struct(vs_obj, struct tsk4r_vs_wrapper, &tsk4r_vs_type, parent);
   VALUE parent_id = rb_funcall(vs_obj, rb_intern("object_id"), 0, NULL);
   rb_iv_set(self, "@parent", parent_id);
   
   // open self's struct and assign partition to it
-  Data_Get_Struct(self, struct tsk4r_vpart_wrapper, partition);
+  TypedData_Get_Struct(self, struct tsk4r_vpart_wrapper, &tsk4r_vpart_type, partition);
 
   TSK_VS_INFO * volume_system = parent->volume;
 
   TSK_PNUM_T idx = FIX2LONG(index);
   vp_ptr = tsk_vs_part_get(volume_system, idx);
   partition->volume_part = vp_ptr;
+  partition->parent = vs_obj;
 
   rb_iv_set(self, "@start", INT2NUM((int)vp_ptr->start));
   rb_iv_set(self, "@length", INT2NUM((int)vp_ptr->len));
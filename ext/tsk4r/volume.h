@@ -25,20 +25,27 @@
 #define RubyTSK_volume_h
 
 #include <tsk3/libtsk.h>
+#include "tsk4r_i.h"
+#include "owner.h"
 
 // Sleuthkit::Volume struct
 struct tsk4r_vs_wrapper {
   TSK_VS_INFO * volume;
+  VALUE parent;   // Image
+  struct tsk4r_owner * owner;
 };
 
 struct tsk4r_vpart_wrapper {
   const TSK_VS_PART_INFO * volume_part;
+  VALUE parent;   // Volume::System owning volume_part
 };
+extern const rb_data_type_t tsk4r_vs_type;
+extern const rb_data_type_t tsk4r_vpart_type;
 
 
 // Sleuthkit::VolumeSystem function declarations
 VALUE allocate_volume_system(VALUE klass);
-void  deallocate_volume_system();
+void  deallocate_volume_system(void * ptr);
 VALUE initialize_volume_system(int argc, VALUE *args, VALUE self);
 VALUE open_volume_system(VALUE self, VALUE image_obj, VALUE options);
 static VALUE close_volume_system(VALUE self);
@@ -50,7 +57,7 @@ VALUE return_tsk_vol_type_list(int argc, VALUE *args, VALUE self);
 
 // Sleuthkit::VolumePart function declarations
 VALUE allocate_volume_part(VALUE klass);
-void  deallocate_volume_part();
+void  deallocate_volume_part(void * ptr);
 VALUE initialize_volume_part(int argc, VALUE *args, VALUE self);
 VALUE open_volume_part(int argc, VALUE *args, VALUE self);
 //static VALUE close_volume_part(VALUE self);
@@ -3,6 +3,7 @@ require 'sleuthkit/image'
 require 'sleuthkit/file_system'
 require 'sleuthkit/version'
 require 'sleuthkit/volume'
+require 'sleuthkit/batch'
 require 'tsk4r/tsk4r' # gem install process uses this dir
 # require 'sleuthkit/image.rb'
 
@@ -0,0 +1,22 @@
+# -*- coding: utf-8 -*-
+module Sleuthkit
+  # Batch.run(images, opts) is native (batch_run.c); these are its results
+  module Batch
+    # volumes: [offset, length, description]; file_systems: [offset, type,
+    # file count, read errors]; elapsed in seconds
+    Result = Struct.new(:index, :image, :size, :volumes, :file_systems, :files, :error, :elapsed) do
+      def ok?
+        error.nil?
+      end
+    end
+    # file_system indexes Result#file_systems; digest is hex, export_path
+    # is set for :extract; meta_type is the TSK_FS_META_TYPE_ENUM value (0
+    # without metadata)
+    FileEntry = Struct.new(:file_system, :inum, :path, :size, :digest, :export_path, :meta_type) do
+      # only regular files are hashed and extracted
+      def regular?
+        meta_type == 1 # TSK_FS_META_TYPE_REG
+      end
+    end
+  end
+end
@@ -74,6 +74,21 @@ module Sleuthkit
         end
       end
       alias_method :stat, :print_tsk_fsstat
+
+      # packed inums ('Q<*') whose field (:atime, :mtime, :ctime, :crtime)
+      # falls in t0..t1; see TimeIndex#files_between
+      def files_between(field, t0, t1)
+        time_index.files_between(field, t0, t1)
+      end
+
+      # returned by System#search. inum and file_offset are nil for hits in
+      # unallocated space; image_offset is nil where the data has no fixed
+      # place in the image (resident, compressed or sparse)
+      SearchHit = Struct.new(:keyword, :encoding, :inum, :file_offset, :image_offset, :slack) do
+        def unallocated?
+          inum.nil?
+        end
+      end
       def istat(inum, report=STDOUT, opts={})
         # if opts were passed w/o report, assign report to STDOUT
         if report.is_a?(Hash) && opts.empty? then opts=report; report=STDOUT end
@@ -108,6 +123,17 @@ module Sleuthkit
       include ::Sleuthkit
       attr_reader :name, :inum
     
+      # yielded by Directory#each_entry; type and flags are the raw
+      # TSK_FS_NAME values
+      Entry = Struct.new(:index, :inum, :seq, :name, :type, :flags, :parent_inum) do
+        def allocated?
+          flags & 0x01 != 0
+        end
+        def directory?
+          type == 3
+        end
+      end
+    
       def addr
         @inum
       end
@@ -123,7 +149,6 @@ module Sleuthkit
     end
     
     class FileData
-      attr_reader :name
       include ::Sleuthkit
       def return_file_attributes
         attrs= []
@@ -134,33 +159,209 @@ module Sleuthkit
         end
         attrs.length == 1 ? attrs.first : attrs
       end
+      def extent_list
+        packed = extents
+        packed.nil? ? [] : Attribute.unpack_runs(packed)
+      end
+      # writes the file's content to a path or IO, returning the bytes written.
+      # raw images are copied kernel-side (see fs_export.c); everything else
+      # (EWF, compressed, resident data, pipes) streams through #each_chunk
+      def export_to(path_or_io)
+        io = path_or_io.respond_to?(:fileno) ? path_or_io : File.open(path_or_io.to_s, 'wb')
+        begin
+          io.flush
+          written = nil
+          paths = image_paths
+          written = export_raw(io.fileno, paths) unless paths.nil?
+          if written.nil?
+            written = 0
+            each_chunk { |chunk| written += io.write(chunk) }
+          end
+          written
+        ensure
+          io.close unless io.equal?(path_or_io)
+        end
+      end
+      # paths of the disk image segments this file lives on
+      def image_paths
+        source = parent
+        source = source.parent until source.nil? || source.kind_of?(::Sleuthkit::Image)
+        return nil if source.nil?
+        paths = [ source.path ].flatten.compact
+        paths.all? { |p| File.file?(p.to_s) } ? paths.map { |p| p.to_s } : nil
+      end
+      # IO-like reader over the file's content, for Digest, Zlib, CSV and friends
+      def to_io(read_ahead = FileStream::READ_AHEAD)
+        FileStream.new(self, read_ahead)
+      end
+    end
+
+    # duck-typed IO over FileData#read_at.  Small reads are served from one
+    # read-ahead buffer; reads larger than it go straight into the caller's String.
+    class FileStream
+      include Enumerable
+      READ_AHEAD = 256 * 1024
+      attr_reader :file, :pos, :size
+      alias_method :tell, :pos
+
+      def initialize(file, read_ahead = READ_AHEAD)
+        @file = file
+        @size = file.attribute_size
+        @read_ahead = read_ahead
+        @buffer = String.new
+        @buffer_offset = 0
+        @pos = 0
+        @closed = false
+      end
+
+      def read(length = nil, outbuf = nil)
+        outbuf ||= String.new
+        available = @size - @pos
+        if available <= 0
+          outbuf.replace('')
+          return (length.nil? || length == 0) ? outbuf : nil
+        end
+        length = available if length.nil? || length > available
+        if buffered == 0 && length >= @read_ahead
+          @file.read_at(@pos, length, outbuf)
+          @pos += outbuf.bytesize
+          return outbuf
+        end
+        outbuf.replace('')
+        outbuf.force_encoding(@buffer.encoding) if outbuf.respond_to?(:force_encoding)
+        while outbuf.bytesize < length
+          break if fill.zero?
+          take = [ buffered, length - outbuf.bytesize ].min
+          outbuf << @buffer.byteslice(@pos - @buffer_offset, take)
+          @pos += take
+        end
+        outbuf
+      end
+
+      def readpartial(length, outbuf = nil)
+        raise EOFError, "end of file reached" if eof?
+        read(length, outbuf)
+      end
+
+      def gets(sep = $/, limit = nil)
+        if sep.kind_of?(Integer) then limit = sep; sep = $/ end
+        return nil if eof?
+        # the buffer is binary, and a separator can straddle two fills, so
+        # each search starts sep.bytesize - 1 bytes back into the line
+        sep = sep.b unless sep.nil?
+        line = String.new
+        line.force_encoding(@buffer.encoding) if line.respond_to?(:force_encoding)
+        until eof? || (limit && line.bytesize >= limit)
+          break if fill.zero?
+          from = sep.nil? ? 0 : [ line.bytesize - sep.bytesize + 1, 0 ].max
+          take = buffered
+          take = [ take, limit - line.bytesize ].min if limit
+          line << @buffer.byteslice(@pos - @buffer_offset, take)
+          @pos += take
+          stop = sep.nil? ? nil : line.index(sep, from)
+          next if stop.nil?
+          # give back what follows the separator; it's all still buffered
+          @pos -= line.bytesize - (stop + sep.bytesize)
+          line = line.byteslice(0, stop + sep.bytesize)
+          break
+        end
+        line
+      end
+
+      def each_line(sep = $/)
+        while (line = gets(sep))
+          yield line
+        end
+        self
+      end
+      alias_method :each, :each_line
+
+      def seek(offset, whence = IO::SEEK_SET)
+        case whence
+        when IO::SEEK_CUR then @pos += offset
+        when IO::SEEK_END then @pos = @size + offset
+        else @pos = offset
+        end
+        @pos = 0 if @pos < 0
+        0
+      end
+      def pos=(offset)
+        seek(offset)
+      end
+      def rewind
+        seek(0)
+      end
+      def eof?
+        @pos >= @size
+      end
+      alias_method :eof, :eof?
+      def binmode
+        self
+      end
+      def close
+        @closed = true
+        @buffer = String.new
+        nil
+      end
+      def closed?
+        @closed
+      end
+
+      private
+      # bytes left in the read-ahead buffer at the current position
+      def buffered
+        if @pos < @buffer_offset || @pos >= @buffer_offset + @buffer.bytesize then 0
+        else @buffer_offset + @buffer.bytesize - @pos
+        end
+      end
+      def fill
+        return buffered if buffered > 0
+        raise IOError, "closed stream" if @closed
+        @buffer_offset = @pos
+        @file.read_at(@pos, @read_ahead, @buffer) || @buffer.replace('')
+        buffered
+      end
     end
     class FileMeta
       include ::Sleuthkit
-      FORMATTABLE_ATTRS = [ :atime, :crtime, :ctime, :mtime ]
-      attr_reader :addr, :atime, :atime_nano, :content_len, :content_ptr, :crtime, :crtime_nano, :ctime,
-      :ctime_nano, :gid, :link, :mode, :mtime, :mtime_nano, :nlink, :seq, :size, :tag
-      
-      # wrapper methods to format attributes representing times
-      FORMATTABLE_ATTRS.each do |att|
-        define_method att do |*opts|
-          opts.empty? ? opts = :cooked : opts = opts.first.to_sym
-          if (opts.to_sym == :raw)
-            instance_variable_get("@"+ att.to_s)
-          else
-            Time.at(instance_variable_get("@"+ att.to_s))
-          end
-        end
+      # readers are defined in C and read TSK_FS_META when called;
+      # #atime, #crtime, #ctime and #mtime take an optional :raw
+      ATTRIBUTES = [ :addr, :atime, :atime_nano, :content_len, :content_ptr, :crtime, :crtime_nano, :ctime,
+      :ctime_nano, :flags, :gid, :link, :mode, :mtime, :mtime_nano, :nlink, :seq, :size, :tag, :type, :uid ]
+
+      def [](sym)
+        ATTRIBUTES.include?(sym.to_sym) ? send(sym) : super
+      end
+      def inspect_object
+        h = Hash.new
+        ATTRIBUTES.each { |att| h[att] = send(att) }
+        h
       end
-      
     end
     class FileName
       include ::Sleuthkit
-      attr_reader :meta_addr, :meta_seq, :name, :name_size, :parent_addr, :shrt_name, :shrt_name_size, :tag
-      
+      # readers are defined in C and read TSK_FS_NAME when called
+      ATTRIBUTES = [ :flags, :meta_addr, :meta_seq, :name, :name_size, :parent_addr, :shrt_name,
+      :shrt_name_size, :tag, :type ]
+
+      def [](sym)
+        ATTRIBUTES.include?(sym.to_sym) ? send(sym) : super
+      end
+      def inspect_object
+        h = Hash.new
+        ATTRIBUTES.each { |att| h[att] = send(att) }
+        h
+      end
     end
     class Attribute
       include ::Sleuthkit
+      # packed runs (see #runs) as [file_offset, image_offset, length, flags] arrays
+      def self.unpack_runs(packed)
+        packed.unpack('Q<*').each_slice(4).to_a
+      end
+      def run_list
+        Attribute.unpack_runs(runs)
+      end
     end
   end
 end
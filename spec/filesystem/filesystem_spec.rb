@@ -1,6 +1,9 @@
+require 'spec_helper'
+
 describe "spec/filesystem" do
   require 'sleuthkit'
-  
+  require 'tmpdir'
+
   before :all do
     @sample_dir="samples"
     
@@ -17,7 +20,28 @@ describe "spec/filesystem" do
     
     @volume = Sleuthkit::Volume::System.new(@mac_partitioned_image)
     @string = "some string"
+
+    # a small ext4 file system with known content
+    same = Random.new(1).bytes(64 * 1024)
+    # same size, head and tail as the pair; only the middle differs
+    near = same.dup
+    near.setbyte(32 * 1024, near.getbyte(32 * 1024) ^ 0xff)
+    # carve.* and gone.txt are deleted, so their blocks are unallocated but still hold them
+    @png = png_bytes(1, 64, 64)
+    @zip = stored_zip("inner.png", png_bytes(2))
+    # keywords for #search: live ones in both encodings, and a deleted one
+    @needle = "xx QX7-NEEDLE xx " + "zz Qx7-Needle \u0141AMA zz".encode("UTF-16LE").force_encoding("BINARY")
+    files = { "dup_a.bin" => same, "dup_b.bin" => same, "near_dup.bin" => near,
+              "carve.png" => @png, "carve.zip" => @zip,
+              "needle.txt" => @needle, "gone.txt" => "some text, then QX7-GONE and more" }
+    @ext4_image_path = ext4_image("filesystem.ext4", "8M", files, :deleted => %w[ carve.png carve.zip gone.txt ])
+    if @ext4_image_path
+      @ext4_filesystem = Sleuthkit::FileSystem::System.new(Sleuthkit::Image.new(@ext4_image_path))
+    else
+      puts "mke2fs or debugfs not found; skipping the examples on a known ext4 image"
+    end
   end
+
   # check opening routines
   # simple open
   describe "#new([single raw image])" do
@@ -282,6 +306,288 @@ describe "spec/filesystem" do
       
     end
   end
+  describe "ObjectSpace.memsize_of(filesystem)" do
+    it "should report the native TSK_FS_INFO footprint" do
+      require 'objspace'
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      ObjectSpace.memsize_of(@filesystem).should be > 1024
+    end
+  end
+  describe "FileSystem::System file cache" do
+    it "should return the same FileData for repeat opens of an inum" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      first = @filesystem.open_file_by_inum(28)
+      @filesystem.open_file_by_inum(28).should equal(first)
+      @filesystem.file_cache_stats[:hits].should eq(1)
+      @filesystem.file_cache_stats[:misses].should eq(1)
+    end
+    it "should share the cached file with FileMeta.new(fs, inum)" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      file = @filesystem.open_file_by_inum(28)
+      meta = Sleuthkit::FileSystem::FileMeta.new(@filesystem, 28)
+      meta.parent.should equal(@filesystem)
+      meta.addr.should eq(28)
+      @filesystem.file_cache_stats[:hits].should eq(1)
+    end
+    it "should key entries by attribute type and id" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      file = @filesystem.open_file_by_inum(28)
+      type = Sleuthkit::FileSystem::Attribute.new(file).type
+      data = @filesystem.open_file_by_inum(28, :type => type)
+      data.should_not equal(file)
+      data.attribute_type.should eq(type)
+      @filesystem.open_file_by_inum(28, :type => type).should equal(data)
+      data.read_at(0, 42).should eq(file.read_at(0, 42))
+    end
+    it "should keep the most recently used files held" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.file_cache_capacity = 2
+      @filesystem.open_file_by_inum(26)
+      @filesystem.open_file_by_inum(28)
+      @filesystem.open_file_by_inum(26)
+      @filesystem.open_file_by_inum(2)
+      @filesystem.file_cache_stats[:evictions].should eq(1)
+      # 28 was evicted, not 26, so 26 survives a GC
+      GC.start
+      hits = @filesystem.file_cache_stats[:hits]
+      @filesystem.open_file_by_inum(26)
+      @filesystem.file_cache_stats[:hits].should eq(hits + 1)
+    end
+    it "should evict strong references beyond its capacity" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.file_cache_capacity = 1
+      @filesystem.open_file_by_inum(26)
+      @filesystem.open_file_by_inum(28)
+      @filesystem.file_cache_stats[:evictions].should eq(1)
+      @filesystem.file_cache_stats[:held].should eq(1)
+    end
+  end
+  describe "FileSystem::System#stats" do
+    before { @stats_were = Sleuthkit.stats_enabled? }
+    after { Sleuthkit.stats_enabled = @stats_were }
+    it "should count file reads and the media reads behind them" do
+      Sleuthkit.stats_enabled = true
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.reset_stats
+      @filesystem.open_file_by_inum(28).to_io.read
+      stats = @filesystem.stats
+      stats[:ops][:file_read][:calls].should be >= 1
+      stats[:ops][:file_read][:bytes].should eq(42)
+      stats[:delivered_bytes].should be >= 42
+      stats[:media][:reads].should be >= 1
+      stats[:read_amplification].should be > 0
+      stats[:file_cache].should have_key(:hits)
+    end
+    it "should count nothing while counting is off" do
+      Sleuthkit.stats_enabled = false
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.open_file_by_inum(28).to_io.read
+      @filesystem.stats[:ops][:file_read][:calls].should eq(0)
+    end
+  end
+  describe "FileSystem::System#prefetch_walk" do
+    it "should yield batches of entries read ahead by the walker thread" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      names = []
+      stats = @filesystem.prefetch_walk(:batch_size => 2, :queue_depth => 2) do |entries|
+        entries.length.should be <= 2
+        entries.each { |e| names << e[4] }
+      end
+      names.should include("sample.txt")
+      stats[:entries].should eq(names.length)
+      stats.should have_key(:consumer_stall_ns)
+      @filesystem.prefetch_stats.should eq(stats)
+    end
+    it "should stop the walker when the block breaks" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.prefetch_walk(:batch_size => 1) { |entries| break :stopped }.should eq(:stopped)
+    end
+    it "should let the block read files through the same filesystem" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      read = 0
+      @filesystem.prefetch_walk(:batch_size => 1) do |entries|
+        entries.each do |e|
+          next unless e[6] == 1 && e[7] > 0
+          @filesystem.open_file_by_inum(e[0]).to_io.read.bytesize.should eq(e[7])
+          read += 1
+        end
+      end
+      read.should be > 0
+    end
+  end
+  describe "FileSystem::System#path_map" do
+    it "should map inums back to full paths" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      map = @filesystem.path_map
+      map.should be_an_instance_of Sleuthkit::FileSystem::PathMap
+      @filesystem.path_map.should equal(map)
+      map.path_for(@filesystem.root_inum).should eq("/")
+      map.path_for(26).should eq("/Test_Root_Folder")
+      map.path_for(26, true).should eq(["/Test_Root_Folder"])
+      map.paths_for([26, 0xffffffff]).should eq(["/Test_Root_Folder", nil])
+    end
+    it "should build the map again when :unallocated changes" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      map = @filesystem.path_map
+      all = @filesystem.path_map(:unallocated => true)
+      all.should_not equal(map)
+      @filesystem.path_map(:unallocated => true).should equal(all)
+      @filesystem.path_map.should_not equal(all)
+    end
+    it "should agree with the walk's paths" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      map = @filesystem.path_map
+      @filesystem.prefetch_walk do |entries|
+        entries.each do |e|
+          map.path_for(e[0], true).should include("/#{e[3]}#{e[4]}")
+        end
+      end
+    end
+  end
+  describe "FileSystem::System#files_between" do
+    it "should return packed inums whose timestamp falls in the range" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      mtime = Sleuthkit::FileSystem::FileMeta.new(@filesystem, 28).mtime
+      packed = @filesystem.files_between(:mtime, mtime, mtime)
+      packed.encoding.should eq(Encoding::BINARY)
+      packed.unpack('Q<*').should include(28)
+      @filesystem.time_index.count_between(:mtime, mtime - 1, mtime + 1).should be >= 1
+      @filesystem.files_between(:mtime, 0, 1).should eq("")
+      lambda { @filesystem.files_between(:size, 0, 1) }.should raise_error(ArgumentError)
+    end
+    it "should take in the whole second of a whole-second end" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      mtime = Sleuthkit::FileSystem::FileMeta.new(@filesystem, 28).mtime
+      index = @filesystem.time_index
+      index.count_between(:mtime, mtime, mtime).should eq(index.count_between(:mtime, mtime, mtime + Rational(999999999, 1000000000)))
+      index.count_between(:mtime, mtime, mtime + Rational(1, 2)).should be <= index.count_between(:mtime, mtime, mtime)
+    end
+    it "should keep zero timestamps only when asked" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      index = @filesystem.time_index
+      index.count_between(:crtime, 0, 0).should eq(0)
+      zeros = @filesystem.time_index(:zero_times => true)
+      zeros.should_not equal(index)
+      [:atime, :mtime, :ctime, :crtime].each do |field|
+        zeros.count_between(field, 0, 0).should eq(zeros.size - index.count_between(field, 1, 2**40))
+      end
+    end
+  end
+  describe "FileSystem::System#summarize" do
+    it "should return totals and per-group histograms" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      summary = @filesystem.summarize(:group_by => [:extension, :size_bucket, :allocation])
+      summary[:count].should be > 0
+      summary[:extension]["txt"][:count].should be >= 1
+      summary[:extension].values.map { |t| t[:count] }.inject(:+).should eq(summary[:count])
+      summary[:size_bucket].values.map { |t| t[:bytes] }.inject(:+).should eq(summary[:bytes])
+      summary[:allocation].should have_key(:allocated)
+    end
+    it "should reject unknown groupings" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      lambda { @filesystem.summarize(:group_by => [:color]) }.should raise_error(ArgumentError)
+    end
+  end
+  describe "FileSystem::System#duplicates" do
+    it "should return groups of at least two inums of the same size" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      groups = @filesystem.duplicates(:threads => 2)
+      groups.should be_an_instance_of Array
+      groups.each do |inums|
+        inums.length.should be >= 2
+        inums.map { |i| Sleuthkit::FileSystem::FileMeta.new(@filesystem, i).size }.uniq.length.should eq(1)
+      end
+    end
+    it "should skip files below min_size" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @filesystem.duplicates(:min_size => 2**40).should eq([])
+    end
+    it "should find a known duplicate pair and leave out a file that differs mid-way" do
+      pending "needs mke2fs" unless @ext4_filesystem
+      a, b, near = %w[ dup_a.bin dup_b.bin near_dup.bin ].map { |n| @ext4_filesystem.open_file_by_name("/#{n}").address }
+      groups = @ext4_filesystem.duplicates(:threads => 3)
+      groups.should eq([[a, b].sort])
+      groups.flatten.should_not include(near)
+    end
+  end
+  describe "FileSystem::System#carve" do
+    it "should write the carved files and a manifest" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      Dir.mktmpdir do |dir|
+        carved = @filesystem.carve(:output => "#{dir}/carved", :threads => 2, :aligned => false)
+        carved.should be_an_instance_of Array
+        File.exist?("#{dir}/carved/manifest.csv").should eq(true)
+        File.readlines("#{dir}/carved/manifest.csv").length.should eq(carved.length + 1)
+        carved.each do |offset, length, type, path|
+          [:jpeg, :png, :pdf, :zip, :sqlite, :evtx].should include(type)
+          File.size(path).should eq(length)
+        end
+      end
+    end
+    it "should require an output directory and known types" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      lambda { @filesystem.carve(:types => [:jpeg]) }.should raise_error(ArgumentError)
+      lambda { @filesystem.carve(:output => Dir.tmpdir, :types => [:gif]) }.should raise_error(ArgumentError)
+      Dir.mktmpdir do |dir|
+        lambda { @filesystem.carve(:output => "#{dir}/carved", :types => [:gif]) }.should raise_error(ArgumentError)
+        File.exist?("#{dir}/carved").should eq(false)
+      end
+    end
+    it "should carve deleted files at their exact offsets, without what is nested in them" do
+      pending "needs mke2fs and debugfs" unless @ext4_filesystem
+      raw = File.binread(@ext4_image_path)
+      png_at = raw.index(@png)
+      zip_at = raw.index(@zip)
+      Dir.mktmpdir do |dir|
+        [true, false].each do |aligned|
+          carved = @ext4_filesystem.carve(:output => "#{dir}/#{aligned}", :types => [:png, :zip], :aligned => aligned, :threads => 2)
+          carved.map { |offset, length, type, path| [offset, length, type] }.should eq([[png_at, @png.bytesize, :png], [zip_at, @zip.bytesize, :zip]].sort)
+          File.binread(carved.assoc(png_at)[3]).should eq(@png)
+          File.binread(carved.assoc(zip_at)[3]).should eq(@zip)
+          Dir.entries("#{dir}/#{aligned}").length.should eq(2 + 3)
+        end
+      end
+    end
+  end
+  describe "FileSystem::System#search" do
+    it "should find file content and attribute it to the file" do
+      pending "needs mke2fs and debugfs" unless @ext4_filesystem
+      image = File.binread(@ext4_image_path)
+      image.scan("QX7-NEEDLE").length.should eq(1)
+      inum = @ext4_filesystem.open_file_by_name("/needle.txt").address
+      hits = @ext4_filesystem.search(["QX7-NEEDLE"], :encodings => [:ascii], :unallocated => false, :threads => 2)
+      hits.length.should eq(1)
+      hit = hits.first
+      hit.should be_an_instance_of Sleuthkit::FileSystem::System::SearchHit
+      hit.keyword.should eq("QX7-NEEDLE")
+      hit.encoding.should eq(:ascii)
+      hit.inum.should eq(inum)
+      hit.file_offset.should eq(@needle.index("QX7-NEEDLE"))
+      hit.image_offset.should eq(image.index("QX7-NEEDLE"))
+      hit.slack.should eq(false)
+      hit.unallocated?.should eq(false)
+    end
+    it "should find a deleted file's content in unallocated space" do
+      pending "needs mke2fs and debugfs" unless @ext4_filesystem
+      image = File.binread(@ext4_image_path)
+      hits = @ext4_filesystem.search(["QX7-GONE"], :files => false)
+      hits.map { |h| [h.keyword, h.encoding, h.inum, h.file_offset, h.image_offset] }.should eq([["QX7-GONE", :ascii, nil, nil, image.index("QX7-GONE")]])
+      hits.first.unallocated?.should eq(true)
+      @ext4_filesystem.search(["QX7-GONE"], :unallocated => false).should eq([])
+    end
+    it "should fold only ASCII code units in UTF-16 with :ignore_case" do
+      pending "needs mke2fs and debugfs" unless @ext4_filesystem
+      inum = @ext4_filesystem.open_file_by_name("/needle.txt").address
+      wide = lambda { |s| @needle.index(s.encode("UTF-16LE").force_encoding("BINARY")) }
+      # U+0141 and U+0161 differ only in the high byte of a letter's unit
+      hits = @ext4_filesystem.search(["qx7-needle", "\u0141ama", "\u0161ama"], :encodings => [:utf16le], :ignore_case => true, :unallocated => false)
+      hits.map { |h| [h.keyword, h.inum, h.file_offset] }.should eq([["qx7-needle", inum, wide.call("Qx7-Needle")], ["\u0141ama", inum, wide.call("\u0141AMA")]])
+      @ext4_filesystem.search(["qx7-needle"], :encodings => [:ascii], :ignore_case => true, :unallocated => false).map(&:file_offset).should eq([@needle.index("QX7-NEEDLE")])
+    end
+    it "should reject empty keywords" do
+      pending "needs mke2fs and debugfs" unless @ext4_filesystem
+      lambda { @ext4_filesystem.search([""]) }.should raise_error(ArgumentError)
+      lambda { @ext4_filesystem.search([]) }.should raise_error(ArgumentError)
+    end
+  end
 end
-
-
@@ -86,4 +86,36 @@ describe "spec/filesystem" do
     end
   end
   
+  describe "Sleuthkit::FileSystem::Attribute#runs" do
+    it "should return the run list packed as (file offset, image offset, length, flags)" do
+      @fs = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @fs.find_file_by_inum(28)
+      @attr = Sleuthkit::FileSystem::Attribute.new(@file)
+      @attr.runs.bytesize.should eq(32)
+      file_offset, image_offset, length, flags = @attr.run_list.first
+      file_offset.should eq(0)
+      # one block on disk, clipped to the 42 bytes of the file
+      length.should eq(42)
+      flags.should eq(0)
+      image_offset.should eq(3582 * @fs.block_size)
+      @file.extents.should eq(@attr.runs)
+    end
+  end
+  
+  describe "FileSystem::System#each_attribute(opts)" do
+    it "should yield batches of [inum, type, id, name, size, resident] for named attributes" do
+      entries = []
+      @ntfs.each_attribute(:type => :all, :named_only => true) { |batch| entries.concat(batch) }
+      i30 = entries.find { |e| e[0] == 73 && e[3] == "$I30" }
+      i30.should_not be_nil
+      i30[1].should eq(144)
+      entries.all? { |e| e[3].kind_of?(String) }.should eq(true)
+    end
+    it "should only yield named data streams by default" do
+      @ntfs.each_attribute do |batch|
+        batch.each { |e| e[1].should eq(128); e[3].should_not be_nil }
+      end
+    end
+  end
+  
 end
\ No newline at end of file
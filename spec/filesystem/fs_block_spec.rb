@@ -33,4 +33,29 @@ describe "spec/filesystem" do
     end
   end
   
+  describe "FileSystem::System#read_blocks(start, count, buffer, :flags_out => flags)" do
+    it "should read contiguous blocks into one binary buffer with per-block flags" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@volume)
+      buffer = String.new; flags = String.new
+      result = @filesystem.read_blocks(3582, 2, buffer, :flags_out => flags)
+      result.should equal(buffer)
+      buffer.bytesize.should eq(2 * @filesystem.block_size)
+      buffer.should match("this is a test txt file.\nIt has two lines.")
+      flags.unpack('L<*').length.should eq(2)
+      (flags.unpack('L<*').first & 1).should eq(1) # TSK_FS_BLOCK_FLAG_ALLOC
+    end
+    it "should raise ArgumentError on a negative start or count" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@volume)
+      lambda { @filesystem.read_blocks(-1, 2) }.should raise_error(ArgumentError)
+      lambda { @filesystem.read_blocks(3582, -1) }.should raise_error(ArgumentError)
+    end
+  end
+  describe "File Block buffer" do
+    it "should hold the whole block, not stop at the first NUL" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@volume)
+      @block = Sleuthkit::FileSystem::Block.new(@filesystem, 3582)
+      @block.buffer.bytesize.should eq(@filesystem.block_size)
+    end
+  end
+  
 end
\ No newline at end of file
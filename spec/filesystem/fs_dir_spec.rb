@@ -67,6 +67,44 @@ describe "spec/filesystem" do
       @dir.names[1].should match("sample.txt")
     end
   end
-  
-  
-end
\ No newline at end of file
+  describe "Directory#each_entry" do
+    before :all do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @dir = @filesystem.find_directory(26)
+    end
+    it "should yield Entry structs in on-disk order by default" do
+      entries = @dir.each_entry.to_a
+      entries.first.should be_an_instance_of Sleuthkit::FileSystem::Directory::Entry
+      entries.map(&:name).should eq(@dir.names.reject { |n| n == "." || n == ".." })
+    end
+    it "should filter by glob and by type" do
+      @dir.each_entry(:filter => { :name => "*.txt" }).map(&:name).should include("sample.txt")
+      @dir.each_entry(:filter => { :type => :reg }).all? { |e| e.type == 5 }.should eq(true)
+    end
+    it "should reject a numeric type outside the name types" do
+      @dir.each_entry(:filter => { :type => 5 }).all? { |e| e.type == 5 }.should eq(true)
+      lambda { @dir.each_entry(:filter => { :type => 64 }).to_a }.should raise_error(ArgumentError)
+      lambda { @dir.each_entry(:filter => { :type => -1 }).to_a }.should raise_error(ArgumentError)
+    end
+    it "should page through sorted entries without overlap" do
+      all = @dir.each_entry(:sort => :name).map(&:name)
+      all.should eq(all.sort)
+      page1 = @dir.each_entry(:sort => :name, :limit => 1).map(&:name)
+      page2 = @dir.each_entry(:sort => :name, :offset => 1, :limit => 1).map(&:name)
+      (page1 + page2).should eq(all.first(2))
+    end
+  end
+  describe "Directory#entries_with_meta" do
+    it "should return names and metadata as equal-length columns" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @dir = @filesystem.find_directory(26)
+      cols = @dir.entries_with_meta
+      cols[:name].should eq(@dir.names)
+      cols.values.map(&:length).uniq.should eq([@dir.names.length])
+      i = cols[:name].index("sample.txt")
+      meta = Sleuthkit::FileSystem::FileMeta.new(@filesystem, cols[:inum][i])
+      cols[:size][i].should eq(meta.size)
+      cols[:mtime][i].should eq(meta.mtime(:raw))
+    end
+  end
+end
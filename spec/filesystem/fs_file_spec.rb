@@ -105,4 +105,84 @@ describe "spec/filesystem" do
     end
   end
   
+  describe "FileSystem::FileData#read_at(offset, len, buffer)" do
+    it "should read file content into the buffer it was given" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @filesystem.find_file_by_inum(28)
+      buffer = String.new
+      @file.read_at(0, 14, buffer).should equal(buffer)
+      buffer.should eq("this is a test")
+      @file.read_at(25, 100, buffer).should eq("It has two lines.")
+      @file.read_at(42, 10, buffer).should be_nil
+    end
+  end
+  describe "FileSystem::FileData#each_chunk(size)" do
+    it "should yield the file content in chunks of at most size bytes" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @filesystem.find_file_by_inum(28)
+      chunks = []
+      @file.each_chunk(16) { |chunk, offset| chunks << [ offset, chunk.dup ] }
+      chunks.map { |c| c.first }.should eq([ 0, 16, 32 ])
+      chunks.map { |c| c.last }.join.should eq("this is a test txt file.\nIt has two lines.")
+    end
+  end
+  describe "FileSystem::FileData#strings" do
+    it "should return the printable runs with their file offsets" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @filesystem.open_file_by_inum(28)
+      @file.strings(:min_len => 6).should eq([ [ 0, :ascii, "this is a test txt file." ], [ 25, :ascii, "It has two lines." ] ])
+    end
+    it "should yield batches when given a block" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      batches = []
+      @filesystem.open_file_by_inum(28).strings(:batch_size => 1, :encodings => [:ascii]) { |batch| batches << batch }
+      batches.map { |b| b.size }.should eq([ 1, 1 ])
+    end
+  end
+  describe "FileSystem::FileData#to_io" do
+    it "should return an IO-like stream over the file content" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @io = @filesystem.find_file_by_inum(28).to_io
+      @io.gets.should eq("this is a test txt file.\n")
+      @io.read.should eq("It has two lines.")
+      @io.eof?.should eq(true)
+    end
+    it "should find a separator that straddles two read-ahead fills" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @io = @filesystem.find_file_by_inum(28).to_io(4)
+      @io.gets("file.\n").should eq("this is a test txt file.\n")
+      @io.gets("\u00e9").should eq("It has two lines.")
+    end
+  end
+  
+  describe "FileSystem::FileData#export_to(path)" do
+    it "should write the file content to the given path" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @filesystem.find_file_by_inum(28)
+      out = "tempfile-#{$$}.txt"
+      begin
+        @file.export_to(out).should eq(42)
+        File.binread(out).should eq("this is a test txt file.\nIt has two lines.")
+      ensure
+        File.delete(out) if File.exist?(out)
+      end
+    end
+    it "should keep what follows the export in a caller's IO" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @file = @filesystem.find_file_by_inum(28)
+      out = "tempfile-#{$$}.txt"
+      begin
+        File.binwrite(out, "x" * 100)
+        File.open(out, "r+b") do |io|
+          io.seek(10)
+          @file.export_to(io).should eq(42)
+          io.pos.should eq(52)
+        end
+        File.binread(out).should eq("x" * 10 + "this is a test txt file.\nIt has two lines." + "x" * 48)
+      ensure
+        File.delete(out) if File.exist?(out)
+      end
+    end
+  end
+  
 end
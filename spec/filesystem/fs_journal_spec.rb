@@ -0,0 +1,60 @@
+# -*- coding: utf-8 -*-
+require 'spec_helper'
+
+describe "spec/filesystem" do
+  require 'sleuthkit'
+
+  before :all do
+    @sample_dir="samples"
+
+    @mac_fs_only_image_path = "#{@sample_dir}/tsk4r_img_02.dmg"
+    puts "File #{@mac_fs_only_image_path} not found!!" unless File.exist?(@mac_fs_only_image_path)
+
+    @mac_fs_only_image = Sleuthkit::Image.new(@mac_fs_only_image_path)
+    @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+
+    # a small ext4 file system with a 1 KiB-block journal
+    @ext4_image_path = ext4_image("journal.ext4", "8M")
+    if @ext4_image_path
+      @ext4_filesystem = Sleuthkit::FileSystem::System.new(Sleuthkit::Image.new(@ext4_image_path))
+    else
+      puts "mke2fs not found; skipping the ext4 journal examples"
+    end
+  end
+
+  # use `jls image` to troubleshoot on ext3/ext4 images
+  describe "FileSystem::System#each_journal_entry" do
+    it "should return an Enumerator when no block is given" do
+      @filesystem.each_journal_entry.should be_a_kind_of Enumerator
+    end
+    it "should raise RuntimeError on a file system without a JBD2 journal" do
+      lambda { @filesystem.each_journal_entry { |entries| entries } }.should raise_error(RuntimeError)
+    end
+    it "should yield the journal superblock first on ext4" do
+      pending "needs mke2fs" unless @ext4_filesystem
+      entries = []
+      @ext4_filesystem.each_journal_entry { |batch| entries.concat(batch) }
+      entries.first[0].should eq 0
+      entries.first[2].should eq :superblock
+    end
+  end
+  describe "FileSystem::System#journal_blocks(range)" do
+    it "should raise RuntimeError on a file system without a JBD2 journal" do
+      lambda { @filesystem.journal_blocks(0..1) { |jblk, data| data } }.should raise_error(RuntimeError)
+    end
+    it "should yield each journal block with its data" do
+      pending "needs mke2fs" unless @ext4_filesystem
+      blocks = []
+      @ext4_filesystem.journal_blocks(0..1) { |jblk, data| blocks << [ jblk, data.dup ] }
+      blocks.map { |b| b[0] }.should eq [ 0, 1 ]
+      blocks[0][1].size.should eq 1024
+      blocks[0][1][0, 4].unpack("N").first.should eq 0xC03B3998
+    end
+    it "should raise ArgumentError on a negative bound" do
+      pending "needs mke2fs" unless @ext4_filesystem
+      lambda { @ext4_filesystem.journal_blocks(-1..1) { |jblk, data| data } }.should raise_error(ArgumentError)
+      lambda { @ext4_filesystem.journal_blocks(0..-1) { |jblk, data| data } }.should raise_error(ArgumentError)
+    end
+  end
+
+end
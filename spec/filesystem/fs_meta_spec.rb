@@ -56,6 +56,23 @@ describe "spec/filesystem" do
       @tsk_meta.should be_an_instance_of Sleuthkit::FileSystem::FileMeta 
     end
   end
+  describe "Meta accessors" do
+    it "should return the same Time object on repeated calls" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @tsk_meta = Sleuthkit::FileSystem::FileMeta.new(@filesystem, 28)
+      @tsk_meta.mtime.should be_a_kind_of Time
+      @tsk_meta.mtime.should equal(@tsk_meta.mtime)
+      @tsk_meta.mtime(:raw).should eq(@tsk_meta.mtime.to_i)
+      @tsk_meta.mtime.nsec.should eq(@tsk_meta.mtime_nano)
+    end
+    it "should read fields without setting instance variables" do
+      @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+      @tsk_meta = Sleuthkit::FileSystem::FileMeta.new(@filesystem, 28)
+      @tsk_meta.size.should eq(42)
+      @tsk_meta[:size].should eq(42)
+      @tsk_meta.instance_variables.should be_empty
+    end
+  end
   # describe "File Open (name)" do
   #   it "should return a file object sought by name" do
   #     @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
@@ -0,0 +1,120 @@
+# -*- coding: utf-8 -*-
+describe "spec/filesystem" do
+  require 'sleuthkit'
+  require 'digest/sha1'
+  require 'digest/md5'
+  require 'tmpdir'
+
+  before :all do
+    @sample_dir="samples"
+
+    @mac_fs_only_image_path = "#{@sample_dir}/tsk4r_img_02.dmg"
+    puts "File #{@mac_fs_only_image_path} not found!!" unless File.exist?(@mac_fs_only_image_path)
+
+    @mac_fs_only_image = Sleuthkit::Image.new(@mac_fs_only_image_path)
+    @filesystem = Sleuthkit::FileSystem::System.new(@mac_fs_only_image)
+    @tmpdir = Dir.mktmpdir
+  end
+  after :all do
+    FileUtils.remove_entry(@tmpdir)
+  end
+
+  describe "Sleuthkit::HashSet.build(source, path)" do
+    it "should write a sorted set that opens and answers lookups" do
+      known = [ "a" * 40, "0123456789abcdef0123456789abcdef01234567", "A" * 40 ]
+      set = Sleuthkit::HashSet.build(known, "#{@tmpdir}/known.hs")
+      set.should be_an_instance_of Sleuthkit::HashSet
+      set.size.should eq(2)
+      set.digest.should eq(:sha1)
+      set.bloom?.should eq(true)
+      set.include?("A" * 40).should eq(true)
+      set.include?(["0123456789abcdef0123456789abcdef01234567"].pack('H*')).should eq(true)
+      set.include?("b" * 40).should eq(false)
+      Sleuthkit::HashSet.open("#{@tmpdir}/known.hs").size.should eq(2)
+    end
+    it "should read NSRL-style CSV files and MD5 sets" do
+      File.open("#{@tmpdir}/nsrl.txt", "w") do |f|
+        f.puts '"SHA-1","MD5","CRC32","FileName"'
+        f.puts '"000000206738748EDD92C4E3D2E823896700F849","392126E756571EBF112CB1C1CDEDF926","EBD105A0","I05002T2.PFB"'
+      end
+      Sleuthkit::HashSet.build("#{@tmpdir}/nsrl.txt", "#{@tmpdir}/sha1.hs").include?("000000206738748edd92c4e3d2e823896700f849").should eq(true)
+      md5 = Sleuthkit::HashSet.build("#{@tmpdir}/nsrl.txt", "#{@tmpdir}/md5.hs", :digest => :md5, :bloom => false)
+      md5.digest.should eq(:md5)
+      md5.bloom?.should eq(false)
+      md5.include?("392126E756571EBF112CB1C1CDEDF926").should eq(true)
+    end
+    it "should refuse files that aren't hash sets" do
+      File.open("#{@tmpdir}/junk.hs", "w") { |f| f.write("x" * 100) }
+      lambda { Sleuthkit::HashSet.open("#{@tmpdir}/junk.hs") }.should raise_error(ArgumentError)
+    end
+    it "should refuse truncated and damaged sets" do
+      Sleuthkit::HashSet.build([ "a" * 40, "b" * 40, "c" * 40 ], "#{@tmpdir}/good.hs")
+      good = File.binread("#{@tmpdir}/good.hs")
+      damaged = {
+        "truncated" => good[0, good.size - 1],
+        "count" => good.dup.tap { |d| d[16, 8] = [ 2**61 ].pack('Q<') },
+        "bloom_log2" => good.dup.tap { |d| d.setbyte(24, 255) },
+        "index order" => good.dup.tap { |d| d[64 + 8 * 0xaaaa, 8] = [ 3 ].pack('Q<') },
+        "index bound" => good.dup.tap { |d| d[64 + 8 * 65536, 8] = [ 4 ].pack('Q<') }
+      }
+      damaged.each do |name, bytes|
+        path = "#{@tmpdir}/damaged.hs"
+        File.open(path, "wb") { |f| f.write(bytes) }
+        lambda { Sleuthkit::HashSet.open(path) }.should raise_error(ArgumentError, /damaged|not a hash set/)
+      end
+      Sleuthkit::HashSet.open("#{@tmpdir}/good.hs").size.should eq(3)
+    end
+  end
+  describe "Sleuthkit::BlockHashDB" do
+    before :all do
+      # a reference file made of the first non-zero 512-byte block in the
+      # image and the three that follow it
+      data = File.binread(@mac_fs_only_image_path, 1024 * 1024)
+      @ref_offset = (0...data.size / 512).map { |b| b * 512 }.find { |o| data[o, 512].count("\0") < 512 }
+      @ref_path = "#{@tmpdir}/reference.bin"
+      File.binwrite(@ref_path, data[@ref_offset, 2048] + "tail")
+      @db = Sleuthkit::BlockHashDB.build([@ref_path], "#{@tmpdir}/blocks.bhdb", :block_size => 512)
+    end
+    it "should keep block size, sources and per-block records" do
+      @db.should be_a_kind_of Sleuthkit::HashSet
+      @db.block_size.should eq(512)
+      @db.sources.should eq([@ref_path])
+      @db.digest.should eq(:md5)
+      @db.size.should be <= 4
+      block = File.binread(@ref_path, 512)
+      @db.lookup(Digest::MD5.hexdigest(block)).should include([@ref_path, 0])
+      Sleuthkit::BlockHashDB.open("#{@tmpdir}/blocks.bhdb").sources.should eq([@ref_path])
+    end
+    it "should refuse plain hash sets" do
+      Sleuthkit::HashSet.build([ "a" * 40 ], "#{@tmpdir}/plain.hs")
+      lambda { Sleuthkit::BlockHashDB.open("#{@tmpdir}/plain.hs") }.should raise_error(ArgumentError)
+    end
+    it "should refuse a source count the trailer can't hold" do
+      bytes = File.binread("#{@tmpdir}/blocks.bhdb")
+      bytes[bytes.size - @ref_path.bytesize - 5, 4] = [ 2**32 - 1 ].pack('V')
+      File.binwrite("#{@tmpdir}/damaged.bhdb", bytes)
+      lambda { Sleuthkit::BlockHashDB.open("#{@tmpdir}/damaged.bhdb") }.should raise_error(ArgumentError, /damaged/)
+    end
+    it "should find the reference blocks in the image" do
+      runs = @mac_fs_only_image.match_blocks(@db, :step => 512, :threads => 2)
+      runs.any? { |offset, source, block, count| offset == @ref_offset && source == @ref_path && block == 0 }.should eq(true)
+      runs.map { |r| r[0] }.should eq(runs.map { |r| r[0] }.sort)
+    end
+    it "should scan a file system's blocks" do
+      runs = @filesystem.match_blocks(@db, :unallocated => false)
+      runs.any? { |offset, source, block, count| offset == @ref_offset && block == 0 }.should eq(true)
+      @filesystem.match_blocks(@db).should be_an_instance_of Array
+    end
+  end
+  describe "FileSystem::System#prefetch_walk(:skip_known => set)" do
+    it "should drop known files before they reach Ruby" do
+      buffer = String.new
+      @filesystem.find_file_by_inum(28).read_at(0, 42, buffer)
+      set = Sleuthkit::HashSet.build([Digest::SHA1.hexdigest(buffer)], "#{@tmpdir}/sample.hs")
+      inums = []
+      stats = @filesystem.prefetch_walk(:skip_known => set) { |entries| entries.each { |e| inums << e[0] } }
+      inums.should_not include(28)
+      stats[:skipped_known].should be >= 1
+    end
+  end
+end
@@ -90,6 +90,69 @@ describe "spec/image" do
     end
   end
   
+  describe "Image#strings" do
+    it "should find ASCII and UTF-16LE strings in offset order" do
+      @image = Sleuthkit::Image.new(@sample_filename)
+      found = @image.strings(:threads => 2)
+      found.should_not be_empty
+      found.map { |s| s[0] }.should eq(found.map { |s| s[0] }.sort)
+      found.each { |offset, encoding, string| [:ascii, :utf16le].should include(encoding); string.size.should be >= 4 }
+    end
+    it "should agree with a single-threaded scan" do
+      @image = Sleuthkit::Image.new(@sample_filename)
+      batches = []
+      @image.strings(:threads => 1, :min_len => 8) { |batch| batches << batch }
+      batches.flatten(1).should eq(@image.strings(:threads => 4, :min_len => 8))
+    end
+    it "should find a UTF-16LE run that starts on the last byte of a piece" do
+      require 'tmpdir'
+      piece = 4 * 1024 * 1024   # TSK4R_STRINGS_PIECE
+      Dir.mktmpdir do |dir|
+        data = "\0".b * (piece + 4096)
+        text = "straddle".encode("UTF-16LE").force_encoding("BINARY")
+        data[piece - 1, text.bytesize] = text
+        File.open("#{dir}/straddle.raw", "wb") { |f| f.write(data) }
+        image = Sleuthkit::Image.new("#{dir}/straddle.raw")
+        image.strings(:encodings => [:utf16le], :threads => 2).should eq([[piece - 1, :utf16le, "straddle"]])
+        image.strings(:encodings => [:utf16le], :threads => 1).should eq([[piece - 1, :utf16le, "straddle"]])
+      end
+    end
+  end
+  
+  describe "Image#stats" do
+    before { @stats_were = Sleuthkit.stats_enabled? }
+    after { Sleuthkit.stats_enabled = @stats_were }
+    it "should count reads until reset" do
+      Sleuthkit.stats_enabled = true
+      @image = Sleuthkit::Image.new(@sample_filename)
+      @image.strings(:threads => 1)
+      @image.stats[:ops][:image_read][:calls].should be > 0
+      @image.stats[:media][:bytes].should be > 0
+      Sleuthkit.stats[:ops][:image_read][:calls].should be >= @image.stats[:ops][:image_read][:calls]
+      @image.reset_stats
+      @image.stats[:ops][:image_read][:calls].should eq(0)
+    end
+    it "should count media reads of an image opened while counting was off" do
+      Sleuthkit.stats_enabled = false
+      @image = Sleuthkit::Image.new(@sample_filename)
+      Sleuthkit.stats_enabled = true
+      @image.strings(:threads => 1)
+      @image.stats[:media][:reads].should be > 0
+      Sleuthkit.stats_enabled = false
+      @image.reset_stats
+      @image.strings(:threads => 1)
+      @image.stats[:media][:reads].should eq(0)
+    end
+  end
+  
+  describe "ObjectSpace.memsize_of(image)" do
+    it "should include libtsk's image handle and sector cache" do
+      require 'objspace'
+      @image = Sleuthkit::Image.new(@sample_filename)
+      ObjectSpace.memsize_of(@image).should be > 65536
+    end
+  end
+  
   after :all do
     $stderr = @orig_stderr
   end
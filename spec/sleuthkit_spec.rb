@@ -1,4 +1,8 @@
 require 'sleuthkit'
+require 'digest/md5'
+require 'json'
+require 'tmpdir'
+require 'fileutils'
 require 'spec_helper'
 SAMPLE_DIR="samples"
 
@@ -14,3 +18,116 @@ describe Sleuthkit::TSK_VERSION do
 		Sleuthkit::TSK_VERSION.should match("3.2.3")
 	end
 end
+
+describe Sleuthkit::Batch do
+	before :all do
+		@images = [ "#{SAMPLE_DIR}/tsk4r_img_02.dmg", "#{SAMPLE_DIR}/tsk4r_img_01.dmg", "#{SAMPLE_DIR}/no_such_image.dmg",
+		            Dir.glob("#{SAMPLE_DIR}/tsk4r_img_01*split.?").sort ]
+		# a small ext4 image with known files
+		@content = { "a.txt" => "first file\n", "docs/b.bin" => Random.new(2).bytes(5000) }
+		@ext4 = ext4_image("batch.ext4", "4M", @content)
+		@tmpdir = Dir.mktmpdir
+	end
+	after :all do
+		FileUtils.rm_rf(@tmpdir)
+	end
+	it 'should return a Result per image, in image order' do
+		results = Sleuthkit::Batch.run(@images, :jobs => [:open, :walk], :workers => 2)
+		results.map { |r| r.index }.should eq([ 0, 1, 2, 3 ])
+		results[0].ok?.should eq(true)
+		results[0].files.map { |f| f.inum }.should include(28)
+		results[1].volumes.should_not be_empty
+		results[2].ok?.should eq(false)
+		results[2].error.should match("tsk_img_open")
+		results[3].file_systems.size.should eq(results[1].file_systems.size)
+	end
+	it 'should hash files and stream results to a block under a small budget' do
+		seen = []
+		stats = Sleuthkit::Batch.run(@images.first(2), :jobs => [:hash], :memory_budget => 1) { |r| seen << r }
+		seen.map { |r| r.index }.sort.should eq([ 0, 1 ])
+		file = seen.find { |r| r.index == 0 }.files.find { |f| f.inum == 28 }
+		file.digest.should eq(Digest::MD5.hexdigest("this is a test txt file.\nIt has two lines."))
+		stats[:images].should eq(2)
+		stats[:errors].should eq(0)
+	end
+	it 'should extract regular files under :output' do
+		pending "needs mke2fs" unless @ext4
+		out = "#{@tmpdir}/out"
+		result = Sleuthkit::Batch.run([ @ext4 ], :jobs => [:extract], :output => out).first
+		result.ok?.should eq(true)
+		exported = @content.map do |name, data|
+			entry = result.files.find { |f| f.path.end_with?(name) }
+			entry.regular?.should eq(true)
+			entry.digest.should be_nil
+			entry.export_path.should eq("#{out}/0-0-#{entry.inum}")
+			File.binread(entry.export_path).should eq(data)
+			File.basename(entry.export_path)
+		end
+		dir = result.files.find { |f| f.path.end_with?("docs") }
+		dir.meta_type.should eq(2)	# TSK_FS_META_TYPE_DIR
+		dir.export_path.should be_nil
+		(Dir.entries(out) - %w[ . .. ]).sort.should eq(exported.sort)
+		lambda { Sleuthkit::Batch.run([ @ext4 ], :jobs => [:extract], :output => "#{@tmpdir}/#{'x' * 4096}") }.should raise_error(ArgumentError)
+	end
+	it 'should start one image at a time once the memory budget is spent' do
+		pending "needs mke2fs" unless @ext4
+		image_cost = 4 * 1024 * 1024	# TSK4R_BATCH_IMAGE_COST
+		seen = []
+		stats = Sleuthkit::Batch.run([ @ext4 ] * 4, :jobs => [:hash], :workers => 4, :memory_budget => 1) { |r| seen << r }
+		seen.map { |r| r.index }.sort.should eq([ 0, 1, 2, 3 ])
+		seen.each { |r| r.ok?.should eq(true) }
+		stats[:peak_memory].should be >= image_cost
+		stats[:peak_memory].should be < 2 * image_cost
+	end
+	it 'should reject unknown jobs' do
+		lambda { Sleuthkit::Batch.run(@images, :jobs => [:bogus]) }.should raise_error(ArgumentError)
+	end
+	it 'should not create :output when an option is invalid' do
+		out = "#{@tmpdir}/never"
+		lambda { Sleuthkit::Batch.run(@images, :jobs => [:extract], :output => out, :memory_budget => 0) }.should raise_error(ArgumentError)
+		lambda { Sleuthkit::Batch.run(@images, :jobs => [:extract], :output => out, :max_open_files => 0) }.should raise_error(ArgumentError)
+		File.exist?(out).should eq(false)
+	end
+end
+
+describe "Sleuthkit.trace" do
+	before :all do
+		@image = "#{SAMPLE_DIR}/tsk4r_img_02.dmg"
+		@tmpdir = Dir.mktmpdir
+		@trace = "#{@tmpdir}/trace_spec.json"
+	end
+	it 'should write native calls from every thread as Chrome trace events' do
+		value = Sleuthkit.trace(@trace) do
+			Sleuthkit.tracing?.should eq(true)
+			# two Ruby threads alive at once (so neither reuses the other's
+			# native thread) and two batch workers
+			ready = Queue.new
+			go = Queue.new
+			threads = 2.times.map { Thread.new { ready << true; go.pop; Sleuthkit::Image.new(@image) } }
+			2.times { ready.pop }
+			2.times { go << true }
+			threads.each { |t| t.join }
+			Sleuthkit::Batch.run([ @image ] * 4, :jobs => [:hash], :workers => 2)
+			:done
+		end
+		value.should eq(:done)
+		Sleuthkit.tracing?.should eq(false)
+		events = JSON.parse(File.read(@trace))["traceEvents"]
+		spans = events.select { |e| e["ph"] == "X" }
+		spans.map { |e| e["name"] }.should include("image_open", "dir_walk", "file_read")
+		tids = spans.map { |e| e["tid"] }.uniq
+		tids.size.should be >= 3
+		events.select { |e| e["ph"] == "M" }.map { |e| e["tid"] }.should include(*tids)
+		spans.select { |e| e["name"] == "image_open" }.map { |e| e["tid"] }.uniq.size.should be >= 3
+		read = spans.find { |e| e["name"] == "file_read" && e["args"]["inum"] == 28 }
+		read["args"]["offset"].should eq(0)
+		read["dur"].should be >= 0
+	end
+	it 'should still write the trace when the block raises' do
+		lambda { Sleuthkit.trace(@trace) { Sleuthkit::Image.new(@image); raise IOError } }.should raise_error(IOError)
+		JSON.parse(File.read(@trace))["traceEvents"].map { |e| e["name"] }.should include("image_open")
+	end
+	after :all do
+		FileUtils.rm_rf(@tmpdir)
+	end
+end
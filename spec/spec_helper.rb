@@ -24,12 +24,12 @@ if $LOADED_FEATURES.grep(/spec\/spec_helper\.rb/).any?
 require 'rspec'
 #require 'sleuthkit'
 require 'pp'
-
-
+require File.expand_path('../support/fixtures', __FILE__)
 
 RSpec.configure do |config|
 	config.color_enabled = true
 	config.formatter = 'documentation'
+	config.include SleuthkitFixtures
 end
 
 puts RSpec.configure.inspect
@@ -0,0 +1,63 @@
+require 'tmpdir'
+require 'fileutils'
+require 'zlib'
+
+# fixtures built on the fly: spec_helper.rb includes these in every
+# example group, and bench/images.rb finds its tools with #tool. This file
+# doesn't load RSpec, so the benchmark doesn't need it
+module SleuthkitFixtures
+  # the formatting tools often live in sbin, outside a user's PATH
+  TOOL_PATH = ENV["PATH"].to_s.split(File::PATH_SEPARATOR) | %w[ /sbin /usr/sbin ]
+
+  module_function
+
+  # full path of an executable on TOOL_PATH, or nil
+  def tool(name)
+    TOOL_PATH.map { |d| File.join(d, name) }.find { |f| File.executable?(f) }
+  end
+
+  # one temporary directory per run, removed at exit
+  def fixture_dir
+    @@fixture_dir ||= Dir.mktmpdir("tsk4r").tap { |dir| at_exit { FileUtils.rm_rf(dir) } }
+  end
+
+  # a small ext4 image with 1 KiB blocks, built by mke2fs -d from files
+  # ({ relative path => content }) in fixture_dir; the paths in :deleted
+  # are then removed with debugfs, so their blocks are unallocated but
+  # still hold them. Returns the image path, or nil when a tool is missing
+  def ext4_image(name, size, files = {}, opts = {})
+    deleted = Array(opts[:deleted])
+    mke2fs = tool("mke2fs")
+    debugfs = tool("debugfs") unless deleted.empty?
+    return nil unless mke2fs && (deleted.empty? || debugfs)
+    path = File.join(fixture_dir, name)
+    src = "#{path}.src"
+    files.each do |file, data|
+      FileUtils.mkdir_p(File.dirname("#{src}/#{file}"))
+      File.open("#{src}/#{file}", "wb") { |f| f.write(data) }
+    end
+    args = [ mke2fs, "-q", "-F", "-t", "ext4", "-b", "1024" ]
+    args += [ "-d", src ] unless files.empty?
+    built = system(*args, path, size, :out => File::NULL) &&
+      deleted.all? { |file| system(debugfs, "-w", "-R", "rm /#{file}", path, :out => File::NULL, :err => File::NULL) }
+    FileUtils.rm_rf(src)
+    built ? path : nil
+  end
+
+  # a small RGB PNG of random pixels
+  def png_bytes(seed, width = 16, height = 16)
+    rng = Random.new(seed)
+    raw = (0...height).map { "\0" + rng.bytes(width * 3) }.join
+    chunk = lambda { |type, data| [data.bytesize].pack('N') + type + data + [Zlib.crc32(type + data)].pack('N') }
+    "\x89PNG\r\n\x1A\n".b + chunk.call("IHDR", [width, height, 8, 2, 0, 0, 0].pack('NNC5')) +
+      chunk.call("IDAT", Zlib::Deflate.deflate(raw)) + chunk.call("IEND", "")
+  end
+
+  # a ZIP archive holding data uncompressed under name
+  def stored_zip(name, data)
+    crc = Zlib.crc32(data)
+    local = ["PK\3\4", 20, 0, 0, 0, 0, crc, data.bytesize, data.bytesize, name.bytesize, 0].pack('a4v5V3v2') + name + data
+    central = ["PK\1\2", 20, 20, 0, 0, 0, 0, crc, data.bytesize, data.bytesize, name.bytesize, 0, 0, 0, 0, 0, 0].pack('a4v6V3v5V2') + name
+    local + central + ["PK\5\6", 0, 0, 1, 1, central.bytesize, local.bytesize, 0].pack('a4v4V2v')
+  end
+end